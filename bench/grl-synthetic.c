@@ -0,0 +1,763 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * Grilo source generating a deterministic tree, used to benchmark
+ * grilo-mediaserver2 without network nor real plugins. It is not installed;
+ * point GRL_PLUGIN_PATH to the directory with the built module (bench/.libs
+ * with autotools, bench/ in the meson build directory) and run:
+ *
+ *   grilo-ms2 -c synthetic.conf grl-synthetic
+ *
+ * Each group in the configuration file creates a source:
+ *
+ *   [grl-synthetic]
+ *   source-id = grl-synthetic        (id of the source)
+ *   fan-out = 4                      (containers in each container)
+ *   depth = 3                        (levels of containers below root)
+ *   items = 16                       (items in each container)
+ *   metadata-size = 64               (bytes of the description of each media)
+ *   latency = 0                      (milliseconds before answering)
+ *   jitter = 0                       (max. random milliseconds added)
+ *   error-rate = 0                   (percentage of failing operations)
+ *   seed = 0                         (seed of latencies and failures)
+ *
+ * Media ids are the path from root, as in "c1/c3/i7": "cN" is the N-th
+ * container and "iN" the N-th item of its parent. Titles are "Container <id>"
+ * and "Item <id>", and search matches the items whose title contains the
+ * text.
+ */
+
+#include <grilo.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SYNTHETIC_PLUGIN_ID "grl-synthetic"
+
+#define SYNTHETIC_DEFAULT_FAN_OUT       4
+#define SYNTHETIC_DEFAULT_DEPTH         3
+#define SYNTHETIC_DEFAULT_ITEMS         16
+#define SYNTHETIC_DEFAULT_METADATA_SIZE 64
+
+#define GRL_SYNTHETIC_SOURCE_TYPE (grl_synthetic_source_get_type ())
+
+#define GRL_SYNTHETIC_SOURCE(obj)                                       \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), GRL_SYNTHETIC_SOURCE_TYPE, GrlSyntheticSource))
+
+#define GRL_SYNTHETIC_SOURCE_GET_PRIVATE(o)                             \
+  G_TYPE_INSTANCE_GET_PRIVATE((o), GRL_SYNTHETIC_SOURCE_TYPE, GrlSyntheticSourcePrivate)
+
+typedef struct _GrlSyntheticSource        GrlSyntheticSource;
+typedef struct _GrlSyntheticSourceClass   GrlSyntheticSourceClass;
+typedef struct _GrlSyntheticSourcePrivate GrlSyntheticSourcePrivate;
+
+struct _GrlSyntheticSource {
+  GrlSource parent;
+
+  /*< private >*/
+  GrlSyntheticSourcePrivate *priv;
+};
+
+struct _GrlSyntheticSourceClass {
+  GrlSourceClass parent_class;
+};
+
+/*
+ * Private SyntheticSource structure
+ *   fan_out: containers in each container
+ *   depth: levels of containers below root
+ *   items: items in each container
+ *   metadata_size: bytes of the description of each media
+ *   latency: milliseconds before answering
+ *   jitter: max. random milliseconds added to latency
+ *   error_rate: percentage of failing operations
+ *   rand: random generator for jitter and failures
+ *   operations: <operation id, SyntheticOperation> pending operations
+ */
+struct _GrlSyntheticSourcePrivate {
+  guint fan_out;
+  guint depth;
+  guint items;
+  guint metadata_size;
+  guint latency;
+  guint jitter;
+  guint error_rate;
+  GRand *rand;
+  GHashTable *operations;
+};
+
+typedef enum {
+  SYNTHETIC_BROWSE,
+  SYNTHETIC_SEARCH,
+  SYNTHETIC_RESOLVE
+} SyntheticOperationType;
+
+/*
+ * Operation waiting to be answered
+ *   source: source doing the operation; a reference is kept while it is
+ *           pending
+ *   type: kind of operation
+ *   spec: GrlSourceBrowseSpec, GrlSourceSearchSpec or GrlSourceResolveSpec
+ *   operation_id: Grilo operation id
+ *   cancelled: TRUE if operation was cancelled
+ */
+typedef struct {
+  GrlSyntheticSource *source;
+  SyntheticOperationType type;
+  gpointer spec;
+  guint operation_id;
+  gboolean cancelled;
+} SyntheticOperation;
+
+GType grl_synthetic_source_get_type (void);
+
+gboolean grl_synthetic_plugin_init (GrlRegistry *registry,
+                                    GrlPlugin *plugin,
+                                    GList *configs);
+
+G_DEFINE_TYPE (GrlSyntheticSource, grl_synthetic_source, GRL_TYPE_SOURCE);
+
+/******************** PRIVATE API ********************/
+
+/* Returns param from config as an unsigned number, or default_value if not
+   set */
+static guint
+get_config_uint (GrlConfig *config,
+                 const gchar *param,
+                 guint default_value)
+{
+  gchar *value;
+  guint result = default_value;
+
+  if (config && grl_config_has_param (config, param)) {
+    value = grl_config_get_string (config, param);
+    if (value) {
+      result = (guint) strtoul (value, NULL, 10);
+      g_free (value);
+    }
+  }
+
+  return result;
+}
+
+/* Returns how many children has a container at level (root is level 0) */
+static guint
+get_childcount (GrlSyntheticSource *source,
+                guint level)
+{
+  if (level < source->priv->depth) {
+    return source->priv->fan_out + source->priv->items;
+  } else {
+    return source->priv->items;
+  }
+}
+
+/* Decomposes an id, returning FALSE if it does not belong to the tree */
+static gboolean
+parse_id (GrlSyntheticSource *source,
+          const gchar *id,
+          guint *level,
+          gboolean *is_container,
+          guint *index)
+{
+  gchar **components;
+  gchar *end;
+  gboolean valid = TRUE;
+  guint i;
+  guint n;
+
+  *level = 0;
+  *is_container = TRUE;
+  *index = 0;
+
+  if (!id) {
+    return TRUE;
+  }
+
+  components = g_strsplit (id, "/", -1);
+  for (i = 0; valid && components[i]; i++) {
+    n = (guint) strtoul (components[i] + 1, &end, 10);
+    if (*end != '\0' || end == components[i] + 1 || !*is_container) {
+      valid = FALSE;
+    } else if (components[i][0] == 'c') {
+      valid = *level < source->priv->depth && n < source->priv->fan_out;
+      (*level)++;
+    } else if (components[i][0] == 'i') {
+      valid = n < source->priv->items;
+      *is_container = FALSE;
+    } else {
+      valid = FALSE;
+    }
+    *index = n;
+  }
+  g_strfreev (components);
+
+  return valid && i > 0;
+}
+
+/* Returns the id of the child of parent */
+static gchar *
+get_child_id (const gchar *parent,
+              gboolean is_container,
+              guint index)
+{
+  if (parent) {
+    return g_strdup_printf ("%s/%c%u", parent, is_container? 'c': 'i', index);
+  } else {
+    return g_strdup_printf ("%c%u", is_container? 'c': 'i', index);
+  }
+}
+
+/* Sets the synthetic properties of media */
+static void
+fill_media (GrlSyntheticSource *source,
+            GrlMedia *media,
+            const gchar *id,
+            guint level,
+            gboolean is_container,
+            guint index)
+{
+  gchar *description;
+  gchar *title;
+  gchar *url;
+  guint hash;
+  guint i;
+
+  grl_media_set_id (media, id);
+
+  if (!id) {
+    grl_media_set_title (media, "Synthetic");
+  } else {
+    title = g_strconcat (is_container? "Container ": "Item ", id, NULL);
+    grl_media_set_title (media, title);
+    g_free (title);
+  }
+
+  /* Description gives the requested size to metadata */
+  hash = id? g_str_hash (id): 0;
+  description = g_malloc (source->priv->metadata_size + 1);
+  for (i = 0; i < source->priv->metadata_size; i++) {
+    description[i] = 'a' + (hash + i) % 26;
+  }
+  description[i] = '\0';
+  grl_media_set_description (media, description);
+  g_free (description);
+
+  if (is_container) {
+    grl_media_set_childcount (media, get_childcount (source, level));
+    return;
+  }
+
+  url = g_strconcat ("synthetic://", id, NULL);
+  grl_media_set_url (media, url);
+  g_free (url);
+
+  grl_media_set_mime (media, "audio/mpeg");
+  grl_media_set_duration (media, 30 + (hash + index) % 600);
+  grl_media_set_size (media, 1024 * (1 + (hash + index) % 8192));
+  grl_media_set_track_number (media, index + 1);
+  grl_media_set_artist (media, "Synthetic Artist");
+  grl_media_set_album (media, "Synthetic Album");
+}
+
+/* Returns a new media for the child of parent */
+static GrlMedia *
+build_media (GrlSyntheticSource *source,
+             const gchar *parent,
+             guint parent_level,
+             gboolean is_container,
+             guint index)
+{
+  GrlMedia *media;
+  gchar *id;
+
+  media = is_container? grl_media_container_new (): grl_media_audio_new ();
+  id = get_child_id (parent, is_container, index);
+  fill_media (source,
+              media,
+              id,
+              parent_level + (is_container? 1: 0),
+              is_container,
+              index);
+  g_free (id);
+
+  return media;
+}
+
+/* Adds to results, in reverse order, the items below container id matching
+   text, stopping once max of them are found */
+static void
+search_tree (GrlSyntheticSource *source,
+             const gchar *id,
+             guint level,
+             const gchar *text,
+             guint max,
+             GList **results,
+             guint *found)
+{
+  GrlMedia *media;
+  gchar *child_id;
+  guint i;
+
+  for (i = 0; *found < max && level < source->priv->depth &&
+         i < source->priv->fan_out; i++) {
+    child_id = get_child_id (id, TRUE, i);
+    search_tree (source, child_id, level + 1, text, max, results, found);
+    g_free (child_id);
+  }
+
+  for (i = 0; *found < max && i < source->priv->items; i++) {
+    media = build_media (source, id, level, FALSE, i);
+    if (!text || strstr (grl_media_get_title (media), text)) {
+      *results = g_list_prepend (*results, media);
+      (*found)++;
+    } else {
+      g_object_unref (media);
+    }
+  }
+}
+
+/* Sends the medias of a browse or search operation */
+static void
+send_results (SyntheticOperation *operation,
+              GList *results,
+              GrlSourceResultCb callback,
+              gpointer user_data)
+{
+  GError *error;
+  GrlMedia *media;
+  guint remaining;
+
+  remaining = g_list_length (results);
+  if (remaining == 0) {
+    callback (GRL_SOURCE (operation->source), operation->operation_id,
+              NULL, 0, user_data, NULL);
+    return;
+  }
+
+  while (results) {
+    if (operation->cancelled) {
+      error = g_error_new_literal (GRL_CORE_ERROR,
+                                   GRL_CORE_ERROR_OPERATION_CANCELLED,
+                                   "Operation was cancelled");
+      callback (GRL_SOURCE (operation->source), operation->operation_id,
+                NULL, 0, user_data, error);
+      g_error_free (error);
+      g_list_free_full (results, g_object_unref);
+      return;
+    }
+    media = results->data;
+    results = g_list_delete_link (results, results);
+    remaining--;
+    callback (GRL_SOURCE (operation->source), operation->operation_id,
+              media, remaining, user_data, NULL);
+  }
+}
+
+/* Answers a browse operation */
+static void
+do_browse (SyntheticOperation *operation)
+{
+  GList *results = NULL;
+  GrlSourceBrowseSpec *bs = operation->spec;
+  GrlSyntheticSource *source = operation->source;
+  gboolean is_container;
+  const gchar *id;
+  guint count;
+  guint i;
+  guint index;
+  guint level;
+  guint n_containers;
+  guint skip;
+  gint requested;
+
+  id = grl_media_get_id (bs->container);
+  if (!parse_id (source, id, &level, &is_container, &index) || !is_container) {
+    send_results (operation, NULL, bs->callback, bs->user_data);
+    return;
+  }
+
+  n_containers = level < source->priv->depth? source->priv->fan_out: 0;
+  count = get_childcount (source, level);
+  skip = grl_operation_options_get_skip (bs->options);
+  requested = grl_operation_options_get_count (bs->options);
+  if (requested >= 0 && (guint) requested < count) {
+    count = requested + skip < count? requested + skip: count;
+  }
+
+  for (i = skip; i < count; i++) {
+    if (i < n_containers) {
+      results = g_list_prepend (results,
+                                build_media (source, id, level, TRUE, i));
+    } else {
+      results = g_list_prepend (results,
+                                build_media (source, id, level, FALSE,
+                                             i - n_containers));
+    }
+  }
+
+  send_results (operation, g_list_reverse (results),
+                bs->callback, bs->user_data);
+}
+
+/* Answers a search operation */
+static void
+do_search (SyntheticOperation *operation)
+{
+  GList *results = NULL;
+  GList *skipped;
+  GrlSourceSearchSpec *ss = operation->spec;
+  guint found = 0;
+  guint max;
+  guint skip;
+  gint count;
+
+  skip = grl_operation_options_get_skip (ss->options);
+  count = grl_operation_options_get_count (ss->options);
+  max = count < 0 || (guint) count > G_MAXUINT - skip? G_MAXUINT: skip + count;
+
+  search_tree (operation->source,
+               NULL,
+               0,
+               ss->text && *ss->text? ss->text: NULL,
+               max,
+               &results,
+               &found);
+
+  results = g_list_reverse (results);
+  while (skip > 0 && results) {
+    skipped = results;
+    results = g_list_remove_link (results, skipped);
+    g_object_unref (skipped->data);
+    g_list_free (skipped);
+    skip--;
+  }
+
+  send_results (operation, results, ss->callback, ss->user_data);
+}
+
+/* Answers a resolve operation */
+static void
+do_resolve (SyntheticOperation *operation)
+{
+  GError *error;
+  GrlSourceResolveSpec *rs = operation->spec;
+  gboolean is_container;
+  const gchar *id;
+  guint index;
+  guint level;
+
+  id = grl_media_get_id (rs->media);
+  if (!parse_id (operation->source, id, &level, &is_container, &index)) {
+    error = g_error_new (GRL_CORE_ERROR,
+                         GRL_CORE_ERROR_RESOLVE_FAILED,
+                         "Unknown media %s", id);
+    rs->callback (rs->source, rs->operation_id, rs->media, rs->user_data, error);
+    g_error_free (error);
+    return;
+  }
+
+  fill_media (operation->source, rs->media, id, level, is_container, index);
+  rs->callback (rs->source, rs->operation_id, rs->media, rs->user_data, NULL);
+}
+
+/* Fails operation, as requested by error rate */
+static void
+fail_operation (SyntheticOperation *operation)
+{
+  GError *error;
+  GrlSourceBrowseSpec *bs;
+  GrlSourceResolveSpec *rs;
+  GrlSourceSearchSpec *ss;
+
+  switch (operation->type) {
+  case SYNTHETIC_BROWSE:
+    bs = operation->spec;
+    error = g_error_new_literal (GRL_CORE_ERROR,
+                                 GRL_CORE_ERROR_BROWSE_FAILED,
+                                 "Synthetic browse failure");
+    bs->callback (bs->source, bs->operation_id, NULL, 0, bs->user_data, error);
+    break;
+  case SYNTHETIC_SEARCH:
+    ss = operation->spec;
+    error = g_error_new_literal (GRL_CORE_ERROR,
+                                 GRL_CORE_ERROR_SEARCH_FAILED,
+                                 "Synthetic search failure");
+    ss->callback (ss->source, ss->operation_id, NULL, 0, ss->user_data, error);
+    break;
+  default:
+    rs = operation->spec;
+    error = g_error_new_literal (GRL_CORE_ERROR,
+                                 GRL_CORE_ERROR_RESOLVE_FAILED,
+                                 "Synthetic resolve failure");
+    rs->callback (rs->source, rs->operation_id, rs->media, rs->user_data, error);
+    break;
+  }
+
+  g_error_free (error);
+}
+
+/* Frees operation, dropping its reference on the source */
+static void
+free_operation (SyntheticOperation *operation)
+{
+  g_object_unref (operation->source);
+  g_slice_free (SyntheticOperation, operation);
+}
+
+/* Runs operation once its latency expired */
+static gboolean
+run_operation (gpointer user_data)
+{
+  SyntheticOperation *operation = (SyntheticOperation *) user_data;
+  GrlSyntheticSourcePrivate *priv = operation->source->priv;
+
+  if (priv->error_rate > 0 &&
+      (guint) g_rand_int_range (priv->rand, 0, 100) < priv->error_rate) {
+    fail_operation (operation);
+  } else if (operation->type == SYNTHETIC_BROWSE) {
+    do_browse (operation);
+  } else if (operation->type == SYNTHETIC_SEARCH) {
+    do_search (operation);
+  } else {
+    do_resolve (operation);
+  }
+
+  g_hash_table_remove (priv->operations,
+                       GUINT_TO_POINTER (operation->operation_id));
+  free_operation (operation);
+
+  return FALSE;
+}
+
+/* Schedules an operation, after the configured latency */
+static void
+queue_operation (GrlSyntheticSource *source,
+                 SyntheticOperationType type,
+                 guint operation_id,
+                 gpointer spec)
+{
+  SyntheticOperation *operation;
+  guint delay;
+
+  operation = g_slice_new0 (SyntheticOperation);
+  operation->source = g_object_ref (source);
+  operation->type = type;
+  operation->spec = spec;
+  operation->operation_id = operation_id;
+
+  g_hash_table_insert (source->priv->operations,
+                       GUINT_TO_POINTER (operation_id),
+                       operation);
+
+  delay = source->priv->latency;
+  if (source->priv->jitter > 0) {
+    delay += g_rand_int_range (source->priv->rand, 0, source->priv->jitter + 1);
+  }
+
+  if (delay > 0) {
+    g_timeout_add (delay, run_operation, operation);
+  } else {
+    g_idle_add (run_operation, operation);
+  }
+}
+
+/* Creates a new source, configured from config */
+static GrlSyntheticSource *
+grl_synthetic_source_new (GrlConfig *config)
+{
+  GrlSyntheticSource *source;
+  gchar *source_id = NULL;
+
+  if (config && grl_config_has_param (config, "source-id")) {
+    source_id = grl_config_get_string (config, "source-id");
+  }
+
+  source = g_object_new (GRL_SYNTHETIC_SOURCE_TYPE,
+                         "source-id", source_id? source_id: SYNTHETIC_PLUGIN_ID,
+                         "source-name", "Synthetic",
+                         "source-desc", "Deterministic tree for benchmarks",
+                         NULL);
+  g_free (source_id);
+
+  source->priv->fan_out =
+    get_config_uint (config, "fan-out", SYNTHETIC_DEFAULT_FAN_OUT);
+  source->priv->depth =
+    get_config_uint (config, "depth", SYNTHETIC_DEFAULT_DEPTH);
+  source->priv->items =
+    get_config_uint (config, "items", SYNTHETIC_DEFAULT_ITEMS);
+  source->priv->metadata_size =
+    get_config_uint (config, "metadata-size", SYNTHETIC_DEFAULT_METADATA_SIZE);
+  source->priv->latency = get_config_uint (config, "latency", 0);
+  source->priv->jitter = get_config_uint (config, "jitter", 0);
+  source->priv->error_rate = MIN (get_config_uint (config, "error-rate", 0), 100);
+  source->priv->rand = g_rand_new_with_seed (get_config_uint (config, "seed", 0));
+
+  return source;
+}
+
+/* Source methods */
+
+static const GList *
+grl_synthetic_source_supported_keys (GrlSource *source)
+{
+  static GList *keys = NULL;
+
+  if (!keys) {
+    keys = grl_metadata_key_list_new (GRL_METADATA_KEY_ID,
+                                      GRL_METADATA_KEY_TITLE,
+                                      GRL_METADATA_KEY_DESCRIPTION,
+                                      GRL_METADATA_KEY_CHILDCOUNT,
+                                      GRL_METADATA_KEY_URL,
+                                      GRL_METADATA_KEY_MIME,
+                                      GRL_METADATA_KEY_DURATION,
+                                      GRL_METADATA_KEY_SIZE,
+                                      GRL_METADATA_KEY_TRACK_NUMBER,
+                                      GRL_METADATA_KEY_ARTIST,
+                                      GRL_METADATA_KEY_ALBUM,
+                                      GRL_METADATA_KEY_INVALID);
+  }
+
+  return keys;
+}
+
+static void
+grl_synthetic_source_browse (GrlSource *source,
+                             GrlSourceBrowseSpec *bs)
+{
+  queue_operation (GRL_SYNTHETIC_SOURCE (source),
+                   SYNTHETIC_BROWSE,
+                   bs->operation_id,
+                   bs);
+}
+
+static void
+grl_synthetic_source_search (GrlSource *source,
+                             GrlSourceSearchSpec *ss)
+{
+  queue_operation (GRL_SYNTHETIC_SOURCE (source),
+                   SYNTHETIC_SEARCH,
+                   ss->operation_id,
+                   ss);
+}
+
+static void
+grl_synthetic_source_resolve (GrlSource *source,
+                              GrlSourceResolveSpec *rs)
+{
+  queue_operation (GRL_SYNTHETIC_SOURCE (source),
+                   SYNTHETIC_RESOLVE,
+                   rs->operation_id,
+                   rs);
+}
+
+static void
+grl_synthetic_source_cancel (GrlSource *source,
+                             guint operation_id)
+{
+  SyntheticOperation *operation;
+
+  operation = g_hash_table_lookup (GRL_SYNTHETIC_SOURCE (source)->priv->operations,
+                                   GUINT_TO_POINTER (operation_id));
+  if (operation) {
+    operation->cancelled = TRUE;
+  }
+}
+
+/* Class initialization */
+
+static void
+grl_synthetic_source_finalize (GObject *object)
+{
+  GrlSyntheticSource *source = GRL_SYNTHETIC_SOURCE (object);
+
+  g_hash_table_unref (source->priv->operations);
+  g_rand_free (source->priv->rand);
+
+  G_OBJECT_CLASS (grl_synthetic_source_parent_class)->finalize (object);
+}
+
+static void
+grl_synthetic_source_class_init (GrlSyntheticSourceClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GrlSourceClass *source_class = GRL_SOURCE_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (GrlSyntheticSourcePrivate));
+
+  gobject_class->finalize = grl_synthetic_source_finalize;
+
+  source_class->supported_keys = grl_synthetic_source_supported_keys;
+  source_class->browse = grl_synthetic_source_browse;
+  source_class->search = grl_synthetic_source_search;
+  source_class->resolve = grl_synthetic_source_resolve;
+  source_class->cancel = grl_synthetic_source_cancel;
+}
+
+static void
+grl_synthetic_source_init (GrlSyntheticSource *source)
+{
+  source->priv = GRL_SYNTHETIC_SOURCE_GET_PRIVATE (source);
+  source->priv->operations =
+    g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+/* Plugin initialization */
+
+gboolean
+grl_synthetic_plugin_init (GrlRegistry *registry,
+                           GrlPlugin *plugin,
+                           GList *configs)
+{
+  GList *config;
+
+  if (!configs) {
+    grl_registry_register_source (registry,
+                                  plugin,
+                                  GRL_SOURCE (grl_synthetic_source_new (NULL)),
+                                  NULL);
+    return TRUE;
+  }
+
+  /* One source per configuration */
+  for (config = configs; config; config = g_list_next (config)) {
+    grl_registry_register_source (registry,
+                                  plugin,
+                                  GRL_SOURCE (grl_synthetic_source_new (config->data)),
+                                  NULL);
+  }
+
+  return TRUE;
+}
+
+GRL_PLUGIN_DEFINE (GRL_MAJOR,
+                   GRL_MINOR,
+                   SYNTHETIC_PLUGIN_ID,
+                   "Synthetic",
+                   "Deterministic source for benchmarks",
+                   "Igalia S.L.",
+                   "0.3",
+                   "LGPL",
+                   "http://www.igalia.com",
+                   grl_synthetic_plugin_init,
+                   NULL,
+                   NULL);
@@ -0,0 +1,861 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * Load generator: starts a private bus and grilo-ms2 on it, and drives a
+ * workload with several concurrent clients through the asynchronous
+ * MS2Client API. Results are printed as a JSON object.
+ *
+ * Workloads:
+ *   walk: lists every container of the tree, page by page
+ *   get: gets properties of random objects
+ *   page: pages through all objects with SearchObjects offsets
+ *   cursor: pages through all objects with SearchObjects cursors
+ *   search: runs a mix of searches
+ *   proxy-cached: gets properties of root through a dbus proxy kept by client
+ *   proxy-fresh: same, but creating a new dbus proxy for each request, as
+ *                MS2Client did before caching them
+ */
+
+#include <dbus/dbus-glib.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <media-server2-client.h>
+
+/* Max. time to wait for the provider to show up, in seconds */
+#define MS2_BENCH_STARTUP_TIMEOUT 10
+
+/* Max. number of object paths collected for the get workload */
+#define MS2_BENCH_MAX_PATHS 10000
+
+/* Configuration of the private bus; only services written by the daemon for
+   this run can be activated */
+#define MS2_BENCH_BUS_CONFIG                                            \
+  "<!DOCTYPE busconfig PUBLIC "                                         \
+  "\"-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN\" "            \
+  "\"http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd\">\n"  \
+  "<busconfig>\n"                                                       \
+  "  <type>session</type>\n"                                            \
+  "  <listen>unix:tmpdir=%s</listen>\n"                                 \
+  "  <servicedir>%s</servicedir>\n"                                     \
+  "  <policy context=\"default\">\n"                                    \
+  "    <allow send_destination=\"*\" eavesdrop=\"true\"/>\n"           \
+  "    <allow eavesdrop=\"true\"/>\n"                                   \
+  "    <allow own=\"*\"/>\n"                                            \
+  "  </policy>\n"                                                       \
+  "</busconfig>\n"
+
+/* Well-known name of providers is this prefix plus their name */
+#define MS2_BENCH_SERVICE_PREFIX "org.gnome.UPnP.MediaServer2."
+
+#ifndef MS2_BENCH_DAEMON
+#define MS2_BENCH_DAEMON "grilo-ms2"
+#endif
+
+#ifndef MS2_BENCH_PLUGIN_PATH
+#define MS2_BENCH_PLUGIN_PATH "."
+#endif
+
+#ifndef MS2_BENCH_CONFIG
+#define MS2_BENCH_CONFIG "synthetic.conf"
+#endif
+
+typedef enum {
+  WORKLOAD_WALK,
+  WORKLOAD_GET,
+  WORKLOAD_PAGE,
+  WORKLOAD_CURSOR,
+  WORKLOAD_SEARCH,
+  WORKLOAD_PROXY_CACHED,
+  WORKLOAD_PROXY_FRESH
+} Workload;
+
+/*
+ * Client driving requests
+ *   client: MS2Client used
+ *   sent: requests sent
+ *   start: monotonic time when current request was sent
+ *   path: container being listed, for the walk workload
+ *   offset: offset of current request
+ *   cursor: cursor of current request
+ *   gproxy: dbus proxy of current request, for the proxy workloads
+ */
+typedef struct {
+  MS2Client *client;
+  guint sent;
+  gint64 start;
+  gchar *path;
+  guint offset;
+  gchar *cursor;
+  DBusGProxy *gproxy;
+} BenchClient;
+
+/*
+ * Container waiting to be listed in the walk workload
+ *   path: object path of container
+ *   offset: first child to list
+ */
+typedef struct {
+  gchar *path;
+  guint offset;
+} PendingList;
+
+static gchar *daemon_path = MS2_BENCH_DAEMON;
+static gchar *plugin_path = MS2_BENCH_PLUGIN_PATH;
+static gchar *config_file = MS2_BENCH_CONFIG;
+static gchar *source_id = "grl-synthetic";
+static gchar *workload_name = "walk";
+static gint n_clients = 4;
+static gint n_requests = 1000;
+static gint page_size = 50;
+static gint seed = 0;
+
+static GOptionEntry entries[] = {
+  { "daemon", 'd', 0,
+    G_OPTION_ARG_FILENAME, &daemon_path,
+    "grilo-ms2 executable to run",
+    "PATH" },
+  { "plugin-path", 'p', 0,
+    G_OPTION_ARG_FILENAME, &plugin_path,
+    "Where to look for Grilo plugins",
+    "PATH" },
+  { "config-file", 'c', 0,
+    G_OPTION_ARG_FILENAME, &config_file,
+    "Configuration file given to grilo-ms2",
+    "FILE" },
+  { "source", 's', 0,
+    G_OPTION_ARG_STRING, &source_id,
+    "Grilo plugin to load",
+    "ID" },
+  { "workload", 'w', 0,
+    G_OPTION_ARG_STRING, &workload_name,
+    "Workload to run: walk, get, page, cursor, search, proxy-cached or "
+    "proxy-fresh",
+    "NAME" },
+  { "clients", 'n', 0,
+    G_OPTION_ARG_INT, &n_clients,
+    "Number of concurrent clients",
+    "N" },
+  { "requests", 'r', 0,
+    G_OPTION_ARG_INT, &n_requests,
+    "Requests per client (walk runs until tree is walked)",
+    "N" },
+  { "page-size", 'P', 0,
+    G_OPTION_ARG_INT, &page_size,
+    "Max. number of objects per listing",
+    "N" },
+  { "seed", 'S', 0,
+    G_OPTION_ARG_INT, &seed,
+    "Seed to choose random objects and queries",
+    "N" },
+  { NULL }
+};
+
+static gchar *properties[] = { MS2_PROP_PATH,
+                               MS2_PROP_TYPE,
+                               MS2_PROP_DISPLAY_NAME,
+                               MS2_PROP_CHILD_COUNT,
+                               MS2_PROP_URLS,
+                               MS2_PROP_MIME_TYPE,
+                               MS2_PROP_ARTIST,
+                               MS2_PROP_ALBUM,
+                               MS2_PROP_DURATION,
+                               NULL };
+
+static const gchar *queries[] = { "",
+                                  "Item c0",
+                                  "Item c1/c1",
+                                  "/i1",
+                                  "no match",
+                                  NULL };
+
+static Workload workload;
+static GMainLoop *main_loop = NULL;
+static GArray *latencies = NULL;
+static guint errors = 0;
+static guint running = 0;
+static guint in_flight = 0;
+static GQueue *pending_lists = NULL;
+static GPtrArray *paths = NULL;
+static GRand *generator = NULL;
+static gchar *root_path = NULL;
+static gchar *bench_dir = NULL;
+static gchar *service_name = NULL;
+static DBusGConnection *connection = NULL;
+
+static void send_request (BenchClient *bc);
+
+/* Removes path, and everything below it if it is a directory */
+static void
+remove_path (const gchar *path)
+{
+  GDir *dir;
+  const gchar *name;
+  gchar *child;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir) {
+    while ((name = g_dir_read_name (dir)) != NULL) {
+      child = g_build_filename (path, name, NULL);
+      remove_path (child);
+      g_free (child);
+    }
+    g_dir_close (dir);
+  }
+
+  g_remove (path);
+}
+
+/* Creates the directory holding the files of this run, which is used as data
+   and cache directory of the daemon, returning the path of the bus
+   configuration */
+static gchar *
+setup_bench_dir (void)
+{
+  GError *error = NULL;
+  gchar *bus_config;
+  gchar *config_path;
+  gchar *services_dir;
+
+  bench_dir = g_dir_make_tmp ("ms2-bench-XXXXXX", &error);
+  if (!bench_dir) {
+    g_printerr ("Unable to create temporary directory, %s\n", error->message);
+    g_error_free (error);
+    return NULL;
+  }
+
+  services_dir = g_build_filename (bench_dir, "dbus-1", "services", NULL);
+  g_mkdir_with_parents (services_dir, 0755);
+
+  bus_config = g_markup_printf_escaped (MS2_BENCH_BUS_CONFIG,
+                                        g_get_tmp_dir (),
+                                        services_dir);
+  config_path = g_build_filename (bench_dir, "bus.conf", NULL);
+  if (!g_file_set_contents (config_path, bus_config, -1, &error)) {
+    g_printerr ("Unable to write %s, %s\n", config_path, error->message);
+    g_error_free (error);
+    g_free (config_path);
+    config_path = NULL;
+  }
+  g_free (bus_config);
+  g_free (services_dir);
+
+  /* Keep the files the daemon writes away from the user's ones */
+  g_setenv ("XDG_DATA_HOME", bench_dir, TRUE);
+  g_setenv ("XDG_CACHE_HOME", bench_dir, TRUE);
+
+  return config_path;
+}
+
+/* Starts a private bus, returning its pid */
+static GPid
+start_bus (void)
+{
+  GError *error = NULL;
+  GIOChannel *channel;
+  GPid pid;
+  gchar *address = NULL;
+  gchar *config_option;
+  gchar *config_path;
+  gchar *argv[] = { "dbus-daemon", NULL, "--nofork", "--print-address", NULL };
+  gint out;
+
+  config_path = setup_bench_dir ();
+  if (!config_path) {
+    return 0;
+  }
+
+  config_option = g_strconcat ("--config-file=", config_path, NULL);
+  argv[1] = config_option;
+  g_free (config_path);
+
+  if (!g_spawn_async_with_pipes (NULL, argv, NULL,
+                                 G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                                 NULL, NULL, &pid, NULL, &out, NULL,
+                                 &error)) {
+    g_printerr ("Unable to start dbus-daemon, %s\n", error->message);
+    g_error_free (error);
+    g_free (config_option);
+    return 0;
+  }
+  g_free (config_option);
+
+  channel = g_io_channel_unix_new (out);
+  g_io_channel_read_line (channel, &address, NULL, NULL, NULL);
+  g_io_channel_unref (channel);
+
+  if (!address) {
+    g_printerr ("Unable to get address of dbus-daemon\n");
+    kill (pid, SIGTERM);
+    g_spawn_close_pid (pid);
+    return 0;
+  }
+
+  g_setenv ("DBUS_SESSION_BUS_ADDRESS", g_strstrip (address), TRUE);
+  g_free (address);
+
+  return pid;
+}
+
+/* Starts grilo-ms2 on the private bus, returning its pid */
+static GPid
+start_daemon (void)
+{
+  GError *error = NULL;
+  GPid pid;
+  gchar *argv[] = { daemon_path, "-c", config_file, source_id, NULL };
+
+  g_setenv ("GRL_PLUGIN_PATH", plugin_path, TRUE);
+
+  if (!g_spawn_async (NULL, argv, NULL,
+                      G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                      NULL, NULL, &pid, &error)) {
+    g_printerr ("Unable to start %s, %s\n", daemon_path, error->message);
+    g_error_free (error);
+    return 0;
+  }
+
+  return pid;
+}
+
+/* Waits for the provider of the source being benchmarked to show up,
+   returning its name */
+static gchar *
+wait_for_provider (void)
+{
+  gchar **providers;
+  gchar *expected;
+  gchar *provider = NULL;
+  gint64 deadline;
+  gint i;
+
+  /* grilo-ms2 replaces characters not allowed in dbus names */
+  expected = g_strdelimit (g_strdup (source_id), "-:", '_');
+
+  deadline = g_get_monotonic_time () + MS2_BENCH_STARTUP_TIMEOUT * G_USEC_PER_SEC;
+  while (!provider && g_get_monotonic_time () < deadline) {
+    providers = ms2_client_get_providers ();
+    for (i = 0; providers && providers[i]; i++) {
+      if (g_strcmp0 (providers[i], expected) == 0) {
+        provider = g_strdup (providers[i]);
+        break;
+      }
+    }
+    if (!provider) {
+      g_usleep (G_USEC_PER_SEC / 10);
+      /* Providers are tracked through NameOwnerChanged, which needs to be
+         dispatched */
+      while (g_main_context_iteration (NULL, FALSE));
+    }
+    g_strfreev (providers);
+  }
+  g_free (expected);
+
+  return provider;
+}
+
+static void
+free_pending_list (PendingList *pending)
+{
+  g_free (pending->path);
+  g_slice_free (PendingList, pending);
+}
+
+static void
+queue_list (const gchar *path,
+            guint offset)
+{
+  PendingList *pending;
+
+  pending = g_slice_new (PendingList);
+  pending->path = g_strdup (path);
+  pending->offset = offset;
+  g_queue_push_tail (pending_lists, pending);
+}
+
+/* Collects object paths below root, breadth first, for the get workload */
+static void
+collect_paths (MS2Client *client)
+{
+  GList *children;
+  GList *child;
+  guint next = 0;
+
+  g_ptr_array_add (paths, g_strdup (root_path));
+  while (next < paths->len && paths->len < MS2_BENCH_MAX_PATHS) {
+    children = ms2_client_list_children (client,
+                                         g_ptr_array_index (paths, next),
+                                         0, 0,
+                                         properties,
+                                         NULL);
+    for (child = children;
+         child && paths->len < MS2_BENCH_MAX_PATHS;
+         child = g_list_next (child)) {
+      g_ptr_array_add (paths, g_strdup (ms2_client_get_path (child->data)));
+    }
+    g_list_free_full (children, (GDestroyNotify) g_hash_table_unref);
+
+    /* Items are visited too, but have no children */
+    next++;
+  }
+}
+
+/* Accounts a finished request and sends the next one */
+static void
+request_done (BenchClient *bc,
+              GError *error)
+{
+  gint64 latency;
+
+  latency = g_get_monotonic_time () - bc->start;
+  g_array_append_val (latencies, latency);
+  in_flight--;
+
+  if (error) {
+    errors++;
+    g_error_free (error);
+  }
+
+  send_request (bc);
+}
+
+static void
+list_children_cb (GObject *source_object,
+                  GAsyncResult *res,
+                  gpointer user_data)
+{
+  BenchClient *bc = (BenchClient *) user_data;
+  GError *error = NULL;
+  GList *children;
+  GList *child;
+  guint n = 0;
+
+  children = ms2_client_list_children_finish (bc->client, res, &error);
+  for (child = children; child; child = g_list_next (child)) {
+    if (ms2_client_get_item_type (child->data) == MS2_ITEM_TYPE_CONTAINER) {
+      queue_list (ms2_client_get_path (child->data), 0);
+    }
+    n++;
+  }
+  g_list_free_full (children, (GDestroyNotify) g_hash_table_unref);
+
+  /* Full page: there could be more children */
+  if (!error && n == (guint) page_size) {
+    queue_list (bc->path, bc->offset + n);
+  }
+
+  request_done (bc, error);
+}
+
+static void
+get_properties_cb (GObject *source_object,
+                   GAsyncResult *res,
+                   gpointer user_data)
+{
+  BenchClient *bc = (BenchClient *) user_data;
+  GError *error = NULL;
+  GHashTable *result;
+
+  result = ms2_client_get_properties_finish (bc->client, res, &error);
+  if (result) {
+    g_hash_table_unref (result);
+  }
+
+  request_done (bc, error);
+}
+
+static void
+search_objects_cb (GObject *source_object,
+                   GAsyncResult *res,
+                   gpointer user_data)
+{
+  BenchClient *bc = (BenchClient *) user_data;
+  GError *error = NULL;
+  GList *objects;
+  guint n;
+
+  objects = ms2_client_search_objects_finish (bc->client, res, &error);
+  n = g_list_length (objects);
+  g_list_free_full (objects, (GDestroyNotify) g_hash_table_unref);
+
+  /* Start again once all objects were paged */
+  bc->offset = n < (guint) page_size? 0: bc->offset + n;
+
+  request_done (bc, error);
+}
+
+static void
+search_objects_cursor_cb (GObject *source_object,
+                          GAsyncResult *res,
+                          gpointer user_data)
+{
+  BenchClient *bc = (BenchClient *) user_data;
+  GError *error = NULL;
+  GList *objects;
+
+  g_free (bc->cursor);
+  bc->cursor = NULL;
+  objects = ms2_client_search_objects_cursor_finish (bc->client,
+                                                     res,
+                                                     &bc->cursor,
+                                                     &error);
+  g_list_free_full (objects, (GDestroyNotify) g_hash_table_unref);
+
+  request_done (bc, error);
+}
+
+static void
+get_all_cb (DBusGProxy *proxy,
+            DBusGProxyCall *call,
+            void *user_data)
+{
+  BenchClient *bc = (BenchClient *) user_data;
+  GError *error = NULL;
+  GHashTable *result = NULL;
+
+  if (dbus_g_proxy_end_call (proxy, call, &error,
+                             dbus_g_type_get_map ("GHashTable",
+                                                  G_TYPE_STRING,
+                                                  G_TYPE_VALUE), &result,
+                             G_TYPE_INVALID)) {
+    g_hash_table_unref (result);
+  }
+
+  if (workload == WORKLOAD_PROXY_FRESH) {
+    g_object_unref (bc->gproxy);
+    bc->gproxy = NULL;
+  }
+
+  request_done (bc, error);
+}
+
+/* Gets properties of root through bc->gproxy, creating it if needed */
+static void
+send_get_all (BenchClient *bc)
+{
+  if (!bc->gproxy) {
+    bc->gproxy = dbus_g_proxy_new_for_name (connection,
+                                            service_name,
+                                            root_path,
+                                            "org.freedesktop.DBus.Properties");
+  }
+
+  dbus_g_proxy_begin_call (bc->gproxy,
+                           "GetAll", get_all_cb,
+                           bc, NULL,
+                           G_TYPE_STRING, "org.gnome.UPnP.MediaObject2",
+                           G_TYPE_INVALID);
+}
+
+static gboolean
+retry_request (gpointer user_data)
+{
+  send_request ((BenchClient *) user_data);
+
+  return FALSE;
+}
+
+/* Sends next request of client, or finishes it if there is nothing left */
+static void
+send_request (BenchClient *bc)
+{
+  PendingList *pending = NULL;
+  const gchar *query;
+  gboolean finished;
+
+  if (workload == WORKLOAD_WALK) {
+    pending = g_queue_pop_head (pending_lists);
+    if (!pending && in_flight > 0) {
+      /* Requests in flight may still find containers; try again later */
+      g_timeout_add (1, retry_request, bc);
+      return;
+    }
+    finished = !pending;
+  } else {
+    finished = bc->sent >= (guint) n_requests;
+  }
+
+  if (finished) {
+    running--;
+    if (running == 0) {
+      g_main_loop_quit (main_loop);
+    }
+    return;
+  }
+
+  bc->sent++;
+  bc->start = g_get_monotonic_time ();
+  in_flight++;
+
+  switch (workload) {
+  case WORKLOAD_WALK:
+    g_free (bc->path);
+    bc->path = pending->path;
+    bc->offset = pending->offset;
+    g_slice_free (PendingList, pending);
+    ms2_client_list_children_async (bc->client,
+                                    bc->path,
+                                    bc->offset,
+                                    page_size,
+                                    properties,
+                                    list_children_cb,
+                                    bc);
+    break;
+  case WORKLOAD_GET:
+    ms2_client_get_properties_async (bc->client,
+                                     g_ptr_array_index (paths,
+                                                        g_rand_int_range (generator, 0, paths->len)),
+                                     properties,
+                                     get_properties_cb,
+                                     bc);
+    break;
+  case WORKLOAD_PAGE:
+    ms2_client_search_objects_async (bc->client,
+                                     root_path,
+                                     "",
+                                     bc->offset,
+                                     page_size,
+                                     properties,
+                                     search_objects_cb,
+                                     bc);
+    break;
+  case WORKLOAD_CURSOR:
+    ms2_client_search_objects_cursor_async (bc->client,
+                                            root_path,
+                                            "",
+                                            bc->cursor? bc->cursor: "",
+                                            page_size,
+                                            properties,
+                                            search_objects_cursor_cb,
+                                            bc);
+    break;
+  case WORKLOAD_SEARCH:
+    query = queries[g_rand_int_range (generator, 0, G_N_ELEMENTS (queries) - 1)];
+    bc->offset = 0;
+    ms2_client_search_objects_async (bc->client,
+                                     root_path,
+                                     query,
+                                     0,
+                                     page_size,
+                                     properties,
+                                     search_objects_cb,
+                                     bc);
+    break;
+  case WORKLOAD_PROXY_CACHED:
+  case WORKLOAD_PROXY_FRESH:
+    send_get_all (bc);
+    break;
+  }
+}
+
+static gint
+compare_latencies (gconstpointer a,
+                   gconstpointer b)
+{
+  gint64 la = *((const gint64 *) a);
+  gint64 lb = *((const gint64 *) b);
+
+  return la < lb? -1: (la > lb? 1: 0);
+}
+
+/* Returns the given percentile of sorted latencies */
+static gint64
+get_percentile (guint percentile)
+{
+  guint index;
+
+  if (latencies->len == 0) {
+    return 0;
+  }
+
+  index = (latencies->len * percentile + 99) / 100;
+  index = CLAMP (index, 1, latencies->len) - 1;
+
+  return g_array_index (latencies, gint64, index);
+}
+
+static void
+print_results (gint64 elapsed)
+{
+  g_array_sort (latencies, compare_latencies);
+
+  g_print ("{\n");
+  g_print ("  \"workload\": \"%s\",\n", workload_name);
+  g_print ("  \"source\": \"%s\",\n", source_id);
+  g_print ("  \"clients\": %d,\n", n_clients);
+  g_print ("  \"page_size\": %d,\n", page_size);
+  g_print ("  \"requests\": %u,\n", latencies->len);
+  g_print ("  \"errors\": %u,\n", errors);
+  g_print ("  \"elapsed_us\": %" G_GINT64_FORMAT ",\n", elapsed);
+  g_print ("  \"throughput_rps\": %.2f,\n",
+           elapsed > 0? latencies->len * (gdouble) G_USEC_PER_SEC / elapsed: 0.0);
+  g_print ("  \"latency_p50_us\": %" G_GINT64_FORMAT ",\n", get_percentile (50));
+  g_print ("  \"latency_p95_us\": %" G_GINT64_FORMAT ",\n", get_percentile (95));
+  g_print ("  \"latency_p99_us\": %" G_GINT64_FORMAT ",\n", get_percentile (99));
+  g_print ("  \"latency_max_us\": %" G_GINT64_FORMAT "\n",
+           latencies->len > 0? g_array_index (latencies, gint64, latencies->len - 1): 0);
+  g_print ("}\n");
+}
+
+static void
+stop_process (GPid pid)
+{
+  if (pid) {
+    kill (pid, SIGTERM);
+    g_spawn_close_pid (pid);
+  }
+}
+
+gint
+main (gint argc, gchar **argv)
+{
+  BenchClient *clients;
+  GError *error = NULL;
+  GOptionContext *context;
+  GPid bus_pid;
+  GPid daemon_pid = 0;
+  MS2Client *client;
+  gchar *provider;
+  gint64 start;
+  gint i;
+  gint result = 1;
+
+  context = g_option_context_new ("- benchmark grilo-ms2");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_parse (context, &argc, &argv, &error);
+  g_option_context_free (context);
+
+  if (error) {
+    g_printerr ("Invalid arguments, %s\n", error->message);
+    g_error_free (error);
+    return 1;
+  }
+
+  if (g_strcmp0 (workload_name, "walk") == 0) {
+    workload = WORKLOAD_WALK;
+  } else if (g_strcmp0 (workload_name, "get") == 0) {
+    workload = WORKLOAD_GET;
+  } else if (g_strcmp0 (workload_name, "page") == 0) {
+    workload = WORKLOAD_PAGE;
+  } else if (g_strcmp0 (workload_name, "cursor") == 0) {
+    workload = WORKLOAD_CURSOR;
+  } else if (g_strcmp0 (workload_name, "search") == 0) {
+    workload = WORKLOAD_SEARCH;
+  } else if (g_strcmp0 (workload_name, "proxy-cached") == 0) {
+    workload = WORKLOAD_PROXY_CACHED;
+  } else if (g_strcmp0 (workload_name, "proxy-fresh") == 0) {
+    workload = WORKLOAD_PROXY_FRESH;
+  } else {
+    g_printerr ("Unknown workload %s\n", workload_name);
+    return 1;
+  }
+
+  n_clients = MAX (n_clients, 1);
+  page_size = MAX (page_size, 1);
+
+  g_type_init ();
+
+  /* Everything runs on a private bus */
+  bus_pid = start_bus ();
+  if (!bus_pid) {
+    goto out;
+  }
+
+  daemon_pid = start_daemon ();
+  provider = daemon_pid? wait_for_provider (): NULL;
+  if (!provider) {
+    g_printerr ("Provider did not show up\n");
+    goto out;
+  }
+
+  client = ms2_client_new (provider);
+  root_path = g_strdup (ms2_client_get_root_path (client));
+
+  latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+  pending_lists = g_queue_new ();
+  paths = g_ptr_array_new_with_free_func (g_free);
+  generator = g_rand_new_with_seed (seed);
+
+  if (workload == WORKLOAD_WALK) {
+    queue_list (root_path, 0);
+  } else if (workload == WORKLOAD_GET) {
+    collect_paths (client);
+  } else if (workload == WORKLOAD_PROXY_CACHED ||
+             workload == WORKLOAD_PROXY_FRESH) {
+    connection = dbus_g_bus_get (DBUS_BUS_SESSION, NULL);
+    service_name = g_strconcat (MS2_BENCH_SERVICE_PREFIX, provider, NULL);
+  }
+
+  /* All clients share the connection, so concurrency comes from having
+     several requests in flight */
+  clients = g_new0 (BenchClient, n_clients);
+  main_loop = g_main_loop_new (NULL, FALSE);
+  running = n_clients;
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n_clients; i++) {
+    clients[i].client = ms2_client_new (provider);
+    send_request (&clients[i]);
+  }
+
+  if (running > 0) {
+    g_main_loop_run (main_loop);
+  }
+  print_results (g_get_monotonic_time () - start);
+  result = errors > 0? 2: 0;
+
+  for (i = 0; i < n_clients; i++) {
+    g_object_unref (clients[i].client);
+    g_free (clients[i].path);
+    g_free (clients[i].cursor);
+    if (clients[i].gproxy) {
+      g_object_unref (clients[i].gproxy);
+    }
+  }
+  g_free (clients);
+  g_object_unref (client);
+  g_main_loop_unref (main_loop);
+  g_array_unref (latencies);
+  g_queue_free_full (pending_lists, (GDestroyNotify) free_pending_list);
+  g_ptr_array_unref (paths);
+  g_rand_free (generator);
+  g_free (root_path);
+  g_free (service_name);
+  g_free (provider);
+  if (connection) {
+    dbus_g_connection_unref (connection);
+  }
+
+ out:
+  stop_process (daemon_pid);
+  stop_process (bus_pid);
+  if (bench_dir) {
+    remove_path (bench_dir);
+    g_free (bench_dir);
+  }
+
+  return result;
+}
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * Marshalling microbenchmark: encodes a synthetic listing as the server
+ * replies it, and decodes it back as the client gets it, without any bus.
+ * Prints one line per direction with the time and allocations per object.
+ *
+ * dbus-glib demarshaller can not be used without a connection, so decoding
+ * parses the wire message with libdbus into the same tables of GValues
+ * dbus-glib builds, with the same types (object paths are boxed, string arrays
+ * are strv), and then runs the client conversion and accessors.
+ */
+
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "media-server2-private.h"
+
+/* Objects marshalled per run, when iterations are not given */
+#define MS2_BENCH_OBJECTS 200000
+
+static gint n_children = 1000;
+static gint n_iterations = 0;
+static gchar *property_set = "full";
+
+static GOptionEntry entries[] = {
+  { "children", 'n', 0,
+    G_OPTION_ARG_INT, &n_children,
+    "Number of objects in the listing",
+    "N" },
+  { "iterations", 'i', 0,
+    G_OPTION_ARG_INT, &n_iterations,
+    "Times the listing is encoded and decoded",
+    "N" },
+  { "properties", 'p', 0,
+    G_OPTION_ARG_STRING, &property_set,
+    "Properties of each object: basic or full",
+    "SET" },
+  { NULL }
+};
+
+/* Allocations are counted by wrapping the allocator of the C library, which
+   GLib uses too */
+static guint64 n_allocations = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+void *
+malloc (size_t size)
+{
+  n_allocations++;
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+  n_allocations++;
+  return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  n_allocations++;
+  return __libc_realloc (ptr, size);
+}
+#endif
+
+static void
+free_gvalue (GValue *value)
+{
+  g_value_unset (value);
+  g_free (value);
+}
+
+/* Returns the synthetic listing */
+static GList *
+build_objects (MS2Server *server,
+               gboolean full)
+{
+  GHashTable *properties;
+  GList *objects = NULL;
+  gchar *id;
+  gchar *name;
+  gchar *urls[2] = { NULL, NULL };
+  gint i;
+
+  for (i = n_children - 1; i >= 0; i--) {
+    id = g_strdup_printf ("item-%d", i);
+    name = g_strdup_printf ("Synthetic item number %d", i);
+    properties = ms2_server_new_properties_hashtable ();
+    ms2_server_set_path (server, properties, id, FALSE);
+    ms2_server_set_parent (server, properties, MS2_ROOT);
+    ms2_server_set_display_name (server, properties, name);
+    ms2_server_set_item_type (server, properties, MS2_ITEM_TYPE_MUSIC);
+
+    if (full) {
+      urls[0] = g_strconcat ("file:///music/", id, ".mp3", NULL);
+      ms2_server_set_urls (server, properties, urls);
+      ms2_server_set_mime_type (server, properties, "audio/mpeg");
+      ms2_server_set_artist (server, properties, "Synthetic Artist");
+      ms2_server_set_album (server, properties, "Synthetic Album");
+      ms2_server_set_genre (server, properties, "Synthetic");
+      ms2_server_set_date (server, properties, "2010-01-01");
+      ms2_server_set_size (server, properties, 1024 * (i + 1));
+      ms2_server_set_duration (server, properties, 30 + i % 600);
+      ms2_server_set_bitrate (server, properties, 128000);
+      g_free (urls[0]);
+    }
+
+    objects = g_list_prepend (objects, properties);
+    g_free (id);
+    g_free (name);
+  }
+
+  return objects;
+}
+
+/* Returns the value of a variant as dbus-glib would give it */
+static GValue *
+decode_variant (DBusMessageIter *variant)
+{
+  DBusMessageIter array;
+  GPtrArray *strv;
+  GValue *value;
+  dbus_bool_t b;
+  dbus_int32_t i;
+  dbus_int64_t x;
+  dbus_uint32_t u;
+  const gchar *s;
+
+  value = g_new0 (GValue, 1);
+
+  switch (dbus_message_iter_get_arg_type (variant)) {
+  case DBUS_TYPE_STRING:
+    dbus_message_iter_get_basic (variant, &s);
+    g_value_init (value, G_TYPE_STRING);
+    g_value_set_string (value, s);
+    break;
+  case DBUS_TYPE_OBJECT_PATH:
+    dbus_message_iter_get_basic (variant, &s);
+    g_value_init (value, DBUS_TYPE_G_OBJECT_PATH);
+    g_value_set_boxed (value, s);
+    break;
+  case DBUS_TYPE_INT32:
+    dbus_message_iter_get_basic (variant, &i);
+    g_value_init (value, G_TYPE_INT);
+    g_value_set_int (value, i);
+    break;
+  case DBUS_TYPE_UINT32:
+    dbus_message_iter_get_basic (variant, &u);
+    g_value_init (value, G_TYPE_UINT);
+    g_value_set_uint (value, u);
+    break;
+  case DBUS_TYPE_INT64:
+    dbus_message_iter_get_basic (variant, &x);
+    g_value_init (value, G_TYPE_INT64);
+    g_value_set_int64 (value, x);
+    break;
+  case DBUS_TYPE_BOOLEAN:
+    dbus_message_iter_get_basic (variant, &b);
+    g_value_init (value, G_TYPE_BOOLEAN);
+    g_value_set_boolean (value, b);
+    break;
+  case DBUS_TYPE_ARRAY:
+    strv = g_ptr_array_new ();
+    dbus_message_iter_recurse (variant, &array);
+    while (dbus_message_iter_get_arg_type (&array) != DBUS_TYPE_INVALID) {
+      dbus_message_iter_get_basic (&array, &s);
+      g_ptr_array_add (strv, g_strdup (s));
+      dbus_message_iter_next (&array);
+    }
+    g_ptr_array_add (strv, NULL);
+    g_value_init (value, G_TYPE_STRV);
+    g_value_take_boxed (value, g_ptr_array_free (strv, FALSE));
+    break;
+  default:
+    g_free (value);
+    return NULL;
+  }
+
+  return value;
+}
+
+/* Decodes a listing reply into the GPtrArray of GHashTable dbus-glib gives */
+static GPtrArray *
+decode_objects (DBusMessage *m)
+{
+  DBusMessageIter array;
+  DBusMessageIter dict;
+  DBusMessageIter entry;
+  DBusMessageIter iter;
+  DBusMessageIter variant;
+  GHashTable *properties;
+  GPtrArray *result;
+  GValue *value;
+  const gchar *key;
+
+  result = g_ptr_array_new ();
+
+  dbus_message_iter_init (m, &iter);
+  dbus_message_iter_recurse (&iter, &array);
+  while (dbus_message_iter_get_arg_type (&array) == DBUS_TYPE_ARRAY) {
+    properties = g_hash_table_new_full (g_str_hash,
+                                        g_str_equal,
+                                        g_free,
+                                        (GDestroyNotify) free_gvalue);
+    dbus_message_iter_recurse (&array, &dict);
+    while (dbus_message_iter_get_arg_type (&dict) == DBUS_TYPE_DICT_ENTRY) {
+      dbus_message_iter_recurse (&dict, &entry);
+      dbus_message_iter_get_basic (&entry, &key);
+      dbus_message_iter_next (&entry);
+      dbus_message_iter_recurse (&entry, &variant);
+      value = decode_variant (&variant);
+      if (value) {
+        g_hash_table_insert (properties, g_strdup (key), value);
+      }
+      dbus_message_iter_next (&dict);
+    }
+    g_ptr_array_add (result, properties);
+    dbus_message_iter_next (&array);
+  }
+
+  return result;
+}
+
+static void
+print_result (const gchar *direction,
+              gint64 elapsed,
+              guint64 allocations,
+              gint length)
+{
+  gdouble objects = (gdouble) n_children * n_iterations;
+
+  g_print ("direction=%s children=%d properties=%s iterations=%d "
+           "ns_per_item=%.1f allocs_per_item=%.2f wire_bytes_per_item=%.1f\n",
+           direction,
+           n_children,
+           property_set,
+           n_iterations,
+           elapsed * 1000.0 / objects,
+           allocations / objects,
+           length / (gdouble) n_children);
+}
+
+gint
+main (gint argc, gchar **argv)
+{
+  DBusMessage *m;
+  GError *error = NULL;
+  GList *list;
+  GList *object;
+  GList *objects;
+  GOptionContext *context;
+  GPtrArray *result;
+  MS2Server *server;
+  gchar *blob;
+  gint64 start;
+  guint64 allocations;
+  gint i;
+  gint length;
+
+  /* Slices must come from malloc to be counted */
+  g_setenv ("G_SLICE", "always-malloc", TRUE);
+
+  context = g_option_context_new ("- benchmark marshalling of listings");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_parse (context, &argc, &argv, &error);
+  g_option_context_free (context);
+
+  if (error) {
+    g_printerr ("Invalid arguments, %s\n", error->message);
+    g_error_free (error);
+    return 1;
+  }
+
+  n_children = MAX (n_children, 1);
+  if (n_iterations <= 0) {
+    n_iterations = MAX (MS2_BENCH_OBJECTS / n_children, 1);
+  }
+
+  g_type_init ();
+
+  server = ms2_server_new_offline ("bench");
+  objects = build_objects (server, g_strcmp0 (property_set, "basic") != 0);
+
+  /* Server: properties to wire format */
+  allocations = n_allocations;
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n_iterations; i++) {
+    m = dbus_message_new_signal ("/", "org.gnome.Grilo.Bench", "Objects");
+    ms2_server_append_objects (m, objects);
+    dbus_message_marshal (m, &blob, &length);
+    dbus_free (blob);
+    dbus_message_unref (m);
+  }
+  print_result ("marshal",
+                g_get_monotonic_time () - start,
+                n_allocations - allocations,
+                length);
+
+  /* Client: wire format to properties */
+  m = dbus_message_new_signal ("/", "org.gnome.Grilo.Bench", "Objects");
+  ms2_server_append_objects (m, objects);
+  dbus_message_marshal (m, &blob, &length);
+  dbus_message_unref (m);
+
+  /* Make sure client sees the same values it would get from dbus-glib */
+  m = dbus_message_demarshal (blob, length, NULL);
+  result = decode_objects (m);
+  list = ms2_client_results_to_glist (result);
+  if (!list || !ms2_client_get_path (list->data) ||
+      !ms2_client_get_parent (list->data) ||
+      !ms2_client_get_display_name (list->data)) {
+    g_printerr ("Decoded objects do not match what client gets\n");
+    return 1;
+  }
+  g_list_free_full (list, (GDestroyNotify) g_hash_table_unref);
+  g_ptr_array_free (result, TRUE);
+  dbus_message_unref (m);
+
+  allocations = n_allocations;
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n_iterations; i++) {
+    m = dbus_message_demarshal (blob, length, NULL);
+    result = decode_objects (m);
+    list = ms2_client_results_to_glist (result);
+    for (object = list; object; object = g_list_next (object)) {
+      ms2_client_get_path (object->data);
+      ms2_client_get_display_name (object->data);
+      ms2_client_get_item_type (object->data);
+    }
+    g_list_free_full (list, (GDestroyNotify) g_hash_table_unref);
+    g_ptr_array_free (result, TRUE);
+    dbus_message_unref (m);
+  }
+  print_result ("unmarshal",
+                g_get_monotonic_time () - start,
+                n_allocations - allocations,
+                length);
+
+  dbus_free (blob);
+  g_list_free_full (objects, (GDestroyNotify) g_hash_table_unref);
+  g_object_unref (server);
+
+  return 0;
+}
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+#
+# gen-property-table.py
+#
+# Generates the table describing MediaServer2 properties from the
+# introspection data in media-server2-introspection.h, along with a perfect
+# hash to look them up by name.
+#
+# Usage: gen-property-table.py media-server2-introspection.h output.c
+#
+# Copyright (C) 2010 Igalia S.L.
+
+import re
+import sys
+
+INTERFACES = [('MEDIAOBJECT2_IFACE', 'mediaobject2'),
+              ('MEDIAITEM2_IFACE', 'mediaitem2'),
+              ('MEDIACONTAINER2_IFACE', 'mediacontainer2')]
+
+# Default value used when backend does not provide a property, by signature
+DEFAULTS = {'i': 'MS2_UNKNOWN_INT',
+            'x': 'MS2_UNKNOWN_INT',
+            'u': 'MS2_UNKNOWN_UINT',
+            'b': 'FALSE'}
+
+FNV_OFFSET = 2166136261
+FNV_PRIME = 16777619
+
+
+def parse_interfaces(header):
+    """Returns a list of (macro, interface name, [(property, signature)])"""
+    with open(header) as f:
+        text = f.read()
+
+    interfaces = []
+    for macro, short_name in INTERFACES:
+        match = re.search(r'#define\s+%s\b(.*?)(?=\n#define|\n#endif)' % macro,
+                          text, re.S)
+        if not match:
+            sys.exit('%s not found in %s' % (macro, header))
+        body = match.group(1)
+        name = re.search(r'<interface name=\\"([^\\]+)\\"', body).group(1)
+        properties = re.findall(r'<property name=\\"(\w+)\\"\s+type=\\"([^\\]+)\\"',
+                                body)
+        interfaces.append((short_name, name, properties))
+
+    return interfaces
+
+
+def fnv1a(name, seed):
+    h = FNV_OFFSET ^ seed
+    for c in name.encode('ascii'):
+        h ^= c
+        h = (h * FNV_PRIME) & 0xffffffff
+    return h
+
+
+def find_perfect_hash(names):
+    """Returns (seed, size) so every name falls in a different slot"""
+    size = 1
+    while size < 2 * len(names):
+        size *= 2
+
+    while True:
+        for seed in range(1 << 16):
+            slots = set(fnv1a(name, seed) & (size - 1) for name in names)
+            if len(slots) == len(names):
+                return seed, size
+        size *= 2
+
+
+def generate(header, output):
+    interfaces = parse_interfaces(header)
+    properties = [(name, iface, signature)
+                  for short_name, iface, props in interfaces
+                  for name, signature in props]
+    names = [name for name, iface, signature in properties]
+    seed, size = find_perfect_hash(names)
+
+    slots = [0] * size
+    for i, name in enumerate(names):
+        slots[fnv1a(name, seed) & (size - 1)] = i + 1
+
+    out = []
+    out.append('/* Generated by gen-property-table.py from '
+               'media-server2-introspection.h. Do not edit. */')
+    out.append('')
+    out.append('#include <string.h>')
+    out.append('')
+    out.append('#include "media-server2-private.h"')
+    out.append('')
+    out.append('#define MS2_PROPERTY_HASH_SEED %uU' % seed)
+    out.append('#define MS2_PROPERTY_HASH_SIZE %d' % size)
+    out.append('')
+    out.append('const MS2PropertyDesc ms2_property_table[] = {')
+    for name, iface, signature in properties:
+        out.append('  { "%s", "%s", "%s", %s },'
+                   % (name, iface, signature, DEFAULTS.get(signature, '0')))
+    out.append('  { NULL }')
+    out.append('};')
+    out.append('')
+    out.append('const guint ms2_n_properties = %d;' % len(properties))
+    out.append('')
+
+    for short_name, iface, props in interfaces:
+        out.append('const gchar *ms2_%s_properties[] = {' % short_name)
+        for name, signature in props:
+            out.append('  "%s",' % name)
+        out.append('  NULL')
+        out.append('};')
+        out.append('')
+
+    out.append('const gchar *ms2_all_properties[] = {')
+    for name in names:
+        out.append('  "%s",' % name)
+    out.append('  NULL')
+    out.append('};')
+    out.append('')
+
+    out.append('/* Index + 1 in ms2_property_table of the property hashed to each '
+               'slot */')
+    out.append('static const guint8 property_slots[MS2_PROPERTY_HASH_SIZE] = {')
+    for i in range(0, size, 16):
+        out.append('  ' + ', '.join('%d' % slot for slot in slots[i:i + 16]) + ',')
+    out.append('};')
+    out.append('')
+
+    out.append('''/* Returns the description of property, or NULL if it is not a MediaServer2
+   property */
+const MS2PropertyDesc *
+ms2_property_lookup (const gchar *property)
+{
+  const guchar *c;
+  guint32 hash = 2166136261U ^ MS2_PROPERTY_HASH_SEED;
+  guint8 slot;
+
+  if (!property) {
+    return NULL;
+  }
+
+  for (c = (const guchar *) property; *c; c++) {
+    hash ^= *c;
+    hash *= 16777619U;
+  }
+
+  slot = property_slots[hash & (MS2_PROPERTY_HASH_SIZE - 1)];
+  if (slot == 0 ||
+      strcmp (ms2_property_table[slot - 1].name, property) != 0) {
+    return NULL;
+  }
+
+  return &ms2_property_table[slot - 1];
+}''')
+
+    with open(output, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        sys.exit('Usage: %s media-server2-introspection.h output.c' % sys.argv[0])
+    generate(sys.argv[1], sys.argv[2])
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <string.h>
+
+#include "media-server2-private.h"
+
+#define MS2_ARENA_CHUNK_SIZE (16 * 1024)
+
+/* Max. number of chunks kept for next requests once the arena is reset */
+#define MS2_ARENA_MAX_SPARE_CHUNKS 4
+
+#define MS2_ARENA_ALIGN(size) (((size) + 7) & ~((gsize) 7))
+
+/*
+ * Chunk of memory where allocations are taken from
+ *   size: bytes available in data
+ *   used: bytes already given
+ *   data: memory to give
+ */
+typedef struct {
+  gsize size;
+  gsize used;
+  guint8 data[];
+} MS2ArenaChunk;
+
+/*
+ * GValue given by ms2_arena_new_value(), tagged with where it was taken from
+ *   in_arena: TRUE if it belongs to the arena, FALSE if it is in the heap
+ *   value: the value itself
+ */
+typedef struct {
+  gboolean in_arena;
+  GValue value;
+} MS2ArenaValue;
+
+/*
+ * Request-scoped arena. Requests can be nested, as backends may iterate the
+ * main loop while waiting for results; all of them share the arena, which is
+ * reset when outermost request finishes.
+ *   chunks: chunks in use; first one is where allocations are taken from
+ *   spare_chunks: chunks kept from previous requests, ready to be used
+ *   tables: reply tables whose values are taken from the arena; each one holds
+ *           a reference, dropped when arena is reset
+ *   depth: number of requests being handled
+ *   request_bytes: bytes used by the ongoing request
+ *   arena_stats: allocation statistics since the beginning
+ */
+static GSList *chunks = NULL;
+static GSList *spare_chunks = NULL;
+static GHashTable *tables = NULL;
+static guint depth = 0;
+static gsize request_bytes = 0;
+static MS2AllocationStats arena_stats = { 0 };
+
+/******************** PRIVATE API ********************/
+
+/* Adds a new chunk able to hold at least size bytes, reusing a spare one if
+   possible */
+static MS2ArenaChunk *
+add_chunk (gsize size)
+{
+  MS2ArenaChunk *chunk;
+
+  size = MAX (size, MS2_ARENA_CHUNK_SIZE);
+  if (size == MS2_ARENA_CHUNK_SIZE && spare_chunks) {
+    chunk = spare_chunks->data;
+    spare_chunks = g_slist_delete_link (spare_chunks, spare_chunks);
+  } else {
+    chunk = g_malloc (sizeof (MS2ArenaChunk) + size);
+    chunk->size = size;
+  }
+  chunk->used = 0;
+  chunks = g_slist_prepend (chunks, chunk);
+  arena_stats.chunks++;
+
+  return chunk;
+}
+
+/* Empties a reply table while its values are still valid, and drops the
+   reference the arena holds */
+static void
+release_table (GHashTable *table)
+{
+  g_hash_table_remove_all (table);
+  g_hash_table_unref (table);
+}
+
+/* Releases everything given, keeping some chunks for next requests */
+static void
+reset (void)
+{
+  MS2ArenaChunk *chunk;
+
+  /* Tables go first, as their values live in the chunks */
+  if (tables) {
+    g_hash_table_remove_all (tables);
+  }
+
+  while (chunks) {
+    chunk = chunks->data;
+    chunks = g_slist_delete_link (chunks, chunks);
+    if (chunk->size == MS2_ARENA_CHUNK_SIZE &&
+        g_slist_length (spare_chunks) < MS2_ARENA_MAX_SPARE_CHUNKS) {
+      spare_chunks = g_slist_prepend (spare_chunks, chunk);
+    } else {
+      g_free (chunk);
+    }
+  }
+
+  arena_stats.peak_bytes = MAX (arena_stats.peak_bytes, request_bytes);
+  request_bytes = 0;
+}
+
+/****************** INTERNAL PUBLIC API (NOT TO BE EXPORTED) ******************/
+
+/* Starts handling a request; memory given from now on is valid until request,
+   and the ones it is nested in, finishes */
+void
+ms2_arena_enter (void)
+{
+  if (depth == 0) {
+    arena_stats.requests++;
+  }
+  depth++;
+}
+
+/* Finishes handling a request */
+void
+ms2_arena_leave (void)
+{
+  g_return_if_fail (depth > 0);
+
+  depth--;
+  if (depth == 0) {
+    reset ();
+  }
+}
+
+/* Returns size bytes set to zero, or NULL if no request is being handled */
+gpointer
+ms2_arena_alloc0 (gsize size)
+{
+  MS2ArenaChunk *chunk;
+  gpointer mem;
+
+  if (depth == 0) {
+    return NULL;
+  }
+
+  size = MS2_ARENA_ALIGN (size);
+  chunk = chunks? chunks->data: NULL;
+  if (!chunk || chunk->size - chunk->used < size) {
+    chunk = add_chunk (size);
+  }
+
+  mem = chunk->data + chunk->used;
+  chunk->used += size;
+  memset (mem, 0, size);
+
+  arena_stats.allocations++;
+  arena_stats.bytes += size;
+  request_bytes += size;
+
+  return mem;
+}
+
+/* Returns a copy of str, or NULL if no request is being handled */
+gchar *
+ms2_arena_strdup (const gchar *str)
+{
+  gchar *copy;
+  gsize length;
+
+  if (depth == 0 || !str) {
+    return NULL;
+  }
+
+  length = strlen (str) + 1;
+  copy = ms2_arena_alloc0 (length);
+  memcpy (copy, str, length);
+
+  return copy;
+}
+
+/* Returns a new GValue, taken from the arena if a request is being handled;
+   it must be freed with ms2_arena_free_value() */
+GValue *
+ms2_arena_new_value (void)
+{
+  MS2ArenaValue *value;
+
+  value = ms2_arena_alloc0 (sizeof (MS2ArenaValue));
+  if (value) {
+    value->in_arena = TRUE;
+  } else {
+    value = g_new0 (MS2ArenaValue, 1);
+  }
+
+  return &value->value;
+}
+
+/* Sets a copy of str in value, taken from the arena if possible */
+void
+ms2_arena_value_set_string (GValue *value,
+                            const gchar *str)
+{
+  gchar *copy;
+
+  copy = ms2_arena_strdup (str);
+  if (copy) {
+    g_value_set_static_string (value, copy);
+  } else {
+    g_value_set_string (value, str);
+  }
+}
+
+/* Returns a new properties table whose values must be taken from the arena,
+   or NULL if no request is being handled. The table is emptied when the
+   arena is reset, even if there are other references to it */
+GHashTable *
+ms2_arena_new_table (void)
+{
+  GHashTable *table;
+
+  if (depth == 0) {
+    return NULL;
+  }
+
+  if (!tables) {
+    tables = g_hash_table_new_full (g_direct_hash,
+                                    g_direct_equal,
+                                    (GDestroyNotify) release_table,
+                                    NULL);
+  }
+
+  table = g_hash_table_new_full (g_str_hash,
+                                 g_str_equal,
+                                 NULL,
+                                 (GDestroyNotify) ms2_arena_free_value);
+  g_hash_table_insert (tables, g_hash_table_ref (table), NULL);
+
+  return table;
+}
+
+/* Returns TRUE if table was given by ms2_arena_new_table() and the arena has
+   not been reset since then */
+gboolean
+ms2_arena_has_table (GHashTable *table)
+{
+  return tables && g_hash_table_lookup_extended (tables, table, NULL, NULL);
+}
+
+/* Frees value given by ms2_arena_new_value(), wherever it was taken from */
+void
+ms2_arena_free_value (GValue *value)
+{
+  MS2ArenaValue *arena_value;
+
+  arena_value = (MS2ArenaValue *) ((guint8 *) value -
+                                   G_STRUCT_OFFSET (MS2ArenaValue, value));
+  g_value_unset (value);
+  if (!arena_value->in_arena) {
+    g_free (arena_value);
+  }
+}
+
+/********************* PUBLIC API *********************/
+
+/**
+ * ms2_server_get_allocation_stats:
+ * @stats: (out): where to store the statistics
+ *
+ * Returns statistics about the memory used to build replies since the
+ * beginning. Values built by #MS2Server while a request is handled, and the
+ * ones stored in tables given by ms2_server_new_reply_properties_hashtable(),
+ * are taken from an arena, which is released in one shot when request is
+ * replied.
+ **/
+void
+ms2_server_get_allocation_stats (MS2AllocationStats *stats)
+{
+  g_return_if_fail (stats);
+
+  *stats = arena_stats;
+  stats->peak_bytes = MAX (arena_stats.peak_bytes, request_bytes);
+}
@@ -25,11 +25,27 @@
 
 #include "media-server2-private.h"
 #include "media-server2-client.h"
+#include "media-server2-observer.h"
 
 #define IMEDIAOBJECT2_INDEX    0
 #define IMEDIAITEM2_INDEX      1
 #define IMEDIACONTAINER2_INDEX 2
 
+/* Maximum number of dbus proxies kept alive per client */
+#define MS2_CLIENT_MAX_PROXIES 32
+
+/* Maximum number of objects which properties are cached per client */
+#define MS2_CLIENT_MAX_CACHED_OBJECTS 4096
+
+/* Page sizes used by MS2ChildIterator, and how long it tries each page to
+   take, in microseconds */
+#define MS2_CHILD_ITERATOR_MIN_PAGE       32
+#define MS2_CHILD_ITERATOR_MAX_PAGE       2048
+#define MS2_CHILD_ITERATOR_TARGET_LATENCY (100 * 1000)
+
+/* Number of objects requested at once while walking */
+#define MS2_CLIENT_WALK_PAGE 1024
+
 #define MS2_CLIENT_GET_PRIVATE(o)                                       \
   G_TYPE_INSTANCE_GET_PRIVATE((o), MS2_TYPE_CLIENT, MS2ClientPrivate)
 
@@ -41,6 +57,21 @@
  *   error: operation error
  *   properties: result of invoking get_properties
  *   children: result of invoking list_children/containers/items
+ *   next_cursor: cursor to get next page of children (used only with
+ *                list_children_cursor() and search_objects_cursor())
+ *   cache_generation: generation of properties cache when operation started
+ *   object_path: object which properties are requested (used only with
+ *                get_properties())
+ *   keys: properties requested (used only with get_properties() and
+ *         get_properties_batch())
+ *   object_paths: objects which properties are requested (used only with
+ *                 get_properties_batch())
+ *   set: result of invoking list_children/containers/items or search_objects
+ *   calls: calls sent through gproxy without reply yet
+ *   pending: call sent through libdbus without reply yet
+ *   timeout: milliseconds to wait for each reply, or -1 for the default
+ *   cancellable: cancellable that cancels the calls without reply
+ *   cancelled_id: handler connected to cancellable
  */
 typedef struct {
   DBusGProxy *gproxy;
@@ -48,6 +79,17 @@ typedef struct {
   GError *error;
   GHashTable *properties;
   GList *children;
+  gchar *next_cursor;
+  guint cache_generation;
+  gchar *object_path;
+  gchar **keys;
+  gchar **object_paths;
+  MS2ResultSet *set;
+  GSList *calls;
+  DBusPendingCall *pending;
+  gint timeout;
+  GCancellable *cancellable;
+  gulong cancelled_id;
 } AsyncData;
 
 /*
@@ -62,6 +104,206 @@ typedef struct {
   GSimpleAsyncResult *result;
 } GetData;
 
+/*
+ * Structure to store a cached dbus proxy
+ *   key: object path and interface the proxy is bound to
+ *   gproxy: dbus proxy
+ */
+typedef struct {
+  gchar *key;
+  DBusGProxy *gproxy;
+} ProxyEntry;
+
+/*
+ * Structure to store a page of children requested by MS2ChildIterator
+ *   iter: iterator the page belongs to
+ *   offset: index of first child in page
+ *   count: number of children requested
+ *   start: when page was requested
+ *   plain: page was requested through the standard interface
+ *   gproxy: dbus proxy used to request the page
+ *   call: request in flight, or NULL if reply was received
+ *   children: children not consumed yet
+ *   error: error getting the page
+ */
+typedef struct {
+  MS2ChildIterator *iter;
+  guint offset;
+  guint count;
+  gint64 start;
+  gboolean plain;
+  DBusGProxy *gproxy;
+  DBusGProxyCall *call;
+  GList *children;
+  GError *error;
+} ChildPage;
+
+/*
+ * MS2ChildIterator structure
+ *   client: client used to request children
+ *   object_path: container which children are listed
+ *   properties: properties requested for each child
+ *   read_ahead: number of pages requested beyond the one being consumed
+ *   pages: pages requested, in listing order
+ *   next_offset: index of first child of next page to request
+ *   page_size: number of children of next page to request
+ *   max_page_size: largest page to request
+ *   timeout: milliseconds to wait for each page, or -1 for the default
+ *   cancellable: cancellable that cancels the pages in flight
+ *   cancelled_id: handler connected to cancellable
+ *   plain: provider does not implement paged interface; pages already in
+ *          flight keep the interface they were requested through
+ *   exhausted: end of listing has been reached
+ *   failed: an error has been reported to consumer
+ *   pending: request of consumer waiting for a child
+ */
+struct _MS2ChildIterator {
+  MS2Client *client;
+  gchar *object_path;
+  gchar **properties;
+  guint read_ahead;
+  GQueue *pages;
+  guint next_offset;
+  guint page_size;
+  guint max_page_size;
+  gint timeout;
+  GCancellable *cancellable;
+  gulong cancelled_id;
+  gboolean plain;
+  gboolean exhausted;
+  gboolean failed;
+  GSimpleAsyncResult *pending;
+};
+
+/*
+ * Structure to store data for ms2_client_walk_async()
+ *   client: client used to walk
+ *   properties: properties requested for each object
+ *   max_depth: deepest level to descend to, or 0 for no limit
+ *   max_requests: maximum number of requests in flight
+ *   func: function to invoke with each object found
+ *   user_data: data passed to func
+ *   result: result of the walk operation
+ *   visited: object paths of containers already found
+ *   requests: requests waiting to be sent
+ *   sent: requests sent without reply yet
+ *   in_flight: number of requests sent without reply yet
+ *   plain: provider does not implement paged interface; requests already sent
+ *          keep the interface they were sent through
+ *   stopped: no more requests must be sent
+ *   error: first error found
+ *   timeout: milliseconds to wait for each reply, or -1 for the default
+ *   cancellable: cancellable that stops the walk
+ *   cancelled_id: handler connected to cancellable
+ *   cancelled_idle_id: source that finishes the walk once cancelled
+ */
+typedef struct {
+  MS2Client *client;
+  gchar **properties;
+  guint max_depth;
+  guint max_requests;
+  MS2WalkFunc func;
+  gpointer user_data;
+  GSimpleAsyncResult *result;
+  GHashTable *visited;
+  GQueue *requests;
+  GList *sent;
+  guint in_flight;
+  gboolean plain;
+  gboolean stopped;
+  GError *error;
+  gint timeout;
+  GCancellable *cancellable;
+  gulong cancelled_id;
+  guint cancelled_idle_id;
+} WalkData;
+
+/*
+ * Structure to store a request sent while walking
+ *   walk: walk the request belongs to
+ *   object_path: container to list
+ *   operation: "ListContainers" or "ListItems"
+ *   depth: depth of the objects listed
+ *   offset: index of first object to list
+ *   plain: request was sent through the standard interface
+ *   gproxy: dbus proxy used to send the request
+ *   call: request in flight
+ */
+typedef struct {
+  WalkData *walk;
+  gchar *object_path;
+  const gchar *operation;
+  guint depth;
+  guint offset;
+  gboolean plain;
+  DBusGProxy *gproxy;
+  DBusGProxyCall *call;
+} WalkRequest;
+
+/*
+ * Structure to store data for ms2_client_search_all_async()
+ *   ref_count: one for the search, plus one for each provider not replied yet
+ *   query: query to perform
+ *   max_count: maximum number of objects to request to each provider
+ *   properties: properties to request for each object
+ *   timeout: milliseconds to wait for each provider, or 0 for no limit
+ *   func: function to invoke with the results of each provider
+ *   user_data: data passed to func
+ *   result: result of the search operation
+ *   hits: SearchHit of objects found so far
+ *   providers: SearchProvider of providers whose reply has not been received
+ *   pending: number of providers that have not replied nor timed out yet
+ *   arrivals: number of providers that have replied
+ *   completed: result has already been completed
+ *   cancellable: cancellable that finishes the search
+ *   cancelled_id: handler connected to cancellable
+ */
+typedef struct {
+  gint ref_count;
+  gchar *query;
+  guint max_count;
+  gchar **properties;
+  guint timeout;
+  MS2SearchFunc func;
+  gpointer user_data;
+  GSimpleAsyncResult *result;
+  GPtrArray *hits;
+  GList *providers;
+  guint pending;
+  guint arrivals;
+  gboolean completed;
+  GCancellable *cancellable;
+  gulong cancelled_id;
+} SearchAllData;
+
+/*
+ * Structure to store a provider being searched
+ *   search: search the provider belongs to
+ *   client: client used to search the provider
+ *   cancellable: cancels the request once it is not needed any more
+ *   timeout_id: source that gives up waiting for the provider
+ *   done: provider has replied or timed out
+ */
+typedef struct {
+  SearchAllData *search;
+  MS2Client *client;
+  GCancellable *cancellable;
+  guint timeout_id;
+  gboolean done;
+} SearchProvider;
+
+/*
+ * Structure to store an object found in a federated search
+ *   rank: position of object in the reply of its provider
+ *   arrival: number of providers that replied before its provider
+ *   properties: properties of the object
+ */
+typedef struct {
+  guint rank;
+  guint arrival;
+  GHashTable *properties;
+} SearchHit;
+
 enum {
   UPDATED,
   DESTROY,
@@ -74,12 +316,23 @@ enum {
  *   name: name of provider
  *   fullname: full dbus service name of provider
  *   root_path: object path to reach root category
+ *   proxies: cached dbus proxies, indexed by object path and interface
+ *   proxies_lru: cached dbus proxies, most recently used first
+ *   cache: properties received, indexed by object path; NULL if cache is
+ *          disabled
+ *   cache_generation: incremented each time cached properties are invalidated
+ *   no_properties_batch: provider does not implement GetPropertiesBatch
  */
 struct _MS2ClientPrivate {
   DBusGConnection *bus;
   gchar *name;
   gchar *fullname;
   gchar *root_path;
+  GHashTable *proxies;
+  GQueue *proxies_lru;
+  GHashTable *cache;
+  guint cache_generation;
+  gboolean no_properties_batch;
 };
 
 static guint32 signals[LAST_SIGNAL] = { 0 };
@@ -106,7 +359,20 @@ free_gvalue (GValue *v)
 static void
 free_async_data (AsyncData *adata)
 {
-  g_object_unref (adata->gproxy);
+  if (adata->gproxy) {
+    g_object_unref (adata->gproxy);
+  }
+  g_free (adata->next_cursor);
+  g_free (adata->object_path);
+  g_strfreev (adata->keys);
+  g_strfreev (adata->object_paths);
+  if (adata->set) {
+    ms2_result_set_unref (adata->set);
+  }
+  if (adata->cancellable) {
+    g_cancellable_disconnect (adata->cancellable, adata->cancelled_id);
+    g_object_unref (adata->cancellable);
+  }
   g_slice_free (AsyncData, adata);
 }
 
@@ -123,6 +389,410 @@ free_get_data (GetData *gdata)
   g_slice_free (GetData, gdata);
 }
 
+/* Callback invoked when an asynchronous operation is cancelled. Calls without
+   reply are cancelled, so their replies are neither waited for nor decoded,
+   and the operation is completed with an error */
+static void
+cancelled_async (GCancellable *cancellable,
+                 GSimpleAsyncResult *res)
+{
+  AsyncData *adata;
+  GSList *call;
+
+  adata = g_simple_async_result_get_op_res_gpointer (res);
+
+  /* Operation has already been completed */
+  if (!adata->calls && !adata->pending) {
+    return;
+  }
+
+  /* Cancelling the calls drops the references they hold */
+  g_object_ref (res);
+
+  for (call = adata->calls; call; call = g_slist_next (call)) {
+    dbus_g_proxy_cancel_call (adata->gproxy, call->data);
+  }
+  g_slist_free (adata->calls);
+  adata->calls = NULL;
+
+  if (adata->pending) {
+    dbus_pending_call_cancel (adata->pending);
+    dbus_pending_call_unref (adata->pending);
+    adata->pending = NULL;
+  }
+
+  /* Get/GetAll replies share the last reference */
+  if (adata->expected_replies > 0) {
+    adata->expected_replies = 0;
+    g_object_unref (res);
+  }
+
+  if (adata->error) {
+    g_error_free (adata->error);
+    adata->error = NULL;
+  }
+  g_cancellable_set_error_if_cancelled (cancellable, &(adata->error));
+
+  g_simple_async_result_complete_in_idle (res);
+  g_object_unref (res);
+}
+
+/* Reports a request whose reply did not arrive in time with
+   G_IO_ERROR_TIMED_OUT, as cancelled ones are reported with GIO errors too */
+static void
+check_timed_out (GError **error)
+{
+  GError *timed_out;
+
+  if (g_error_matches (*error, DBUS_GERROR, DBUS_GERROR_NO_REPLY)) {
+    timed_out = g_error_new_literal (G_IO_ERROR,
+                                     G_IO_ERROR_TIMED_OUT,
+                                     (*error)->message);
+    g_error_free (*error);
+    *error = timed_out;
+  }
+}
+
+/* Makes cancellable cancel the calls without reply of res; must be invoked
+   once the calls have been sent */
+static void
+watch_cancellable (GSimpleAsyncResult *res,
+                   GCancellable *cancellable)
+{
+  AsyncData *adata;
+
+  if (!cancellable) {
+    return;
+  }
+
+  adata = g_simple_async_result_get_op_res_gpointer (res);
+  adata->cancellable = g_object_ref (cancellable);
+  adata->cancelled_id = g_cancellable_connect (cancellable,
+                                               G_CALLBACK (cancelled_async),
+                                               res,
+                                               NULL);
+}
+
+/* Free ProxyEntry */
+static void
+free_proxy_entry (ProxyEntry *entry)
+{
+  g_object_unref (entry->gproxy);
+  g_free (entry->key);
+  g_slice_free (ProxyEntry, entry);
+}
+
+/* Drops all cached proxies */
+static void
+clear_proxies (MS2Client *client)
+{
+  ProxyEntry *entry;
+
+  g_hash_table_remove_all (client->priv->proxies);
+  while ((entry = g_queue_pop_head (client->priv->proxies_lru))) {
+    free_proxy_entry (entry);
+  }
+}
+
+/* Returns a new reference to a proxy for object_path and iface in provider.
+   Proxies are kept in a bounded LRU cache, so browsing the same objects does
+   not build and tear down a proxy, with its match rules, on each request */
+static DBusGProxy *
+get_proxy (MS2Client *client,
+           const gchar *object_path,
+           const gchar *iface)
+{
+  GList *link;
+  ProxyEntry *entry;
+  gchar *key;
+
+  key = g_strconcat (object_path, "\n", iface, NULL);
+  link = g_hash_table_lookup (client->priv->proxies, key);
+
+  if (link) {
+    g_free (key);
+    entry = link->data;
+    g_queue_unlink (client->priv->proxies_lru, link);
+    g_queue_push_head_link (client->priv->proxies_lru, link);
+    return g_object_ref (entry->gproxy);
+  }
+
+  if (g_queue_get_length (client->priv->proxies_lru) >=
+      MS2_CLIENT_MAX_PROXIES) {
+    entry = g_queue_pop_tail (client->priv->proxies_lru);
+    g_hash_table_remove (client->priv->proxies, entry->key);
+    free_proxy_entry (entry);
+  }
+
+  entry = g_slice_new (ProxyEntry);
+  entry->key = key;
+  entry->gproxy = dbus_g_proxy_new_for_name (client->priv->bus,
+                                             client->priv->fullname,
+                                             object_path,
+                                             iface);
+  g_queue_push_head (client->priv->proxies_lru, entry);
+  g_hash_table_insert (client->priv->proxies,
+                       entry->key,
+                       client->priv->proxies_lru->head);
+
+  return g_object_ref (entry->gproxy);
+}
+
+/* Returns a copy of value */
+static GValue *
+copy_gvalue (const GValue *value)
+{
+  GValue *copy;
+
+  copy = g_new0 (GValue, 1);
+  g_value_init (copy, G_VALUE_TYPE (value));
+  g_value_copy (value, copy);
+
+  return copy;
+}
+
+/* Stores a copy of properties of object_path in cache. Properties in requested
+   that are not in the table are remembered as not available, so asking for
+   them again does not need to reach the provider. Empty tables are not stored,
+   as they usually mean the object does not exist (yet) */
+static void
+cache_store (MS2Client *client,
+             const gchar *object_path,
+             GHashTable *properties,
+             gchar **requested)
+{
+  GHashTable *cached;
+  GHashTableIter iter;
+  gchar **prop;
+  gpointer key;
+  gpointer value;
+
+  if (!client->priv->cache ||
+      !object_path ||
+      !properties ||
+      g_hash_table_size (properties) == 0) {
+    return;
+  }
+
+  cached = g_hash_table_lookup (client->priv->cache, object_path);
+  if (!cached) {
+    /* Do not let the cache grow without limit; just start it over */
+    if (g_hash_table_size (client->priv->cache) >=
+        MS2_CLIENT_MAX_CACHED_OBJECTS) {
+      g_hash_table_remove_all (client->priv->cache);
+    }
+    cached = g_hash_table_new_full (g_str_hash,
+                                    g_str_equal,
+                                    (GDestroyNotify) g_free,
+                                    (GDestroyNotify) free_gvalue);
+    g_hash_table_insert (client->priv->cache, g_strdup (object_path), cached);
+  }
+
+  g_hash_table_iter_init (&iter, properties);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    g_hash_table_insert (cached, g_strdup (key), copy_gvalue (value));
+  }
+
+  if (requested) {
+    for (prop = requested; *prop; prop++) {
+      if (!g_hash_table_lookup_extended (properties, *prop, NULL, NULL)) {
+        g_hash_table_insert (cached, g_strdup (*prop), NULL);
+      }
+    }
+  }
+}
+
+/* Stores in cache the properties of a list of objects; objects are identified
+   by their Path property */
+static void
+cache_store_objects (MS2Client *client,
+                     GList *objects)
+{
+  GList *object;
+
+  if (!client->priv->cache) {
+    return;
+  }
+
+  for (object = objects; object; object = g_list_next (object)) {
+    cache_store (client,
+                 ms2_client_get_path (object->data),
+                 object->data,
+                 NULL);
+  }
+}
+
+/* Stores in cache the properties of objects in set */
+static void
+cache_store_set (MS2Client *client,
+                 MS2ResultSet *set)
+{
+  GHashTable *properties;
+  guint i;
+
+  if (!client->priv->cache) {
+    return;
+  }
+
+  for (i = 0; i < ms2_result_set_get_length (set); i++) {
+    properties = ms2_result_set_get_properties (set, i);
+    cache_store (client, ms2_client_get_path (properties), properties, NULL);
+    g_hash_table_unref (properties);
+  }
+}
+
+/* Stores in cache the properties of a list of objects, in the same order than
+   object_paths */
+static void
+cache_store_batch (MS2Client *client,
+                   gchar **object_paths,
+                   GList *objects,
+                   gchar **requested)
+{
+  GList *object;
+  gchar **path;
+
+  for (object = objects, path = object_paths;
+       object && *path;
+       object = g_list_next (object), path++) {
+    cache_store (client, *path, object->data, requested);
+  }
+}
+
+/* Returns a new table with the requested properties of object_path, if all of
+   them are in cache, or NULL otherwise */
+static GHashTable *
+cache_lookup (MS2Client *client,
+              const gchar *object_path,
+              gchar **properties)
+{
+  GHashTable *cached;
+  GHashTable *result;
+  gchar **prop;
+  gpointer value;
+
+  if (!client->priv->cache) {
+    return NULL;
+  }
+
+  cached = g_hash_table_lookup (client->priv->cache, object_path);
+  if (!cached) {
+    return NULL;
+  }
+
+  result = g_hash_table_new_full (g_str_hash,
+                                  g_str_equal,
+                                  (GDestroyNotify) g_free,
+                                  (GDestroyNotify) free_gvalue);
+  for (prop = properties; *prop; prop++) {
+    if (!g_hash_table_lookup_extended (cached, *prop, NULL, &value)) {
+      g_hash_table_unref (result);
+      return NULL;
+    }
+    if (value) {
+      g_hash_table_insert (result, g_strdup (*prop), copy_gvalue (value));
+    }
+  }
+
+  return result;
+}
+
+/* Returns a list with the requested properties of each object, if all of them
+   are in cache, or NULL otherwise */
+static GList *
+cache_lookup_batch (MS2Client *client,
+                    gchar **object_paths,
+                    gchar **properties)
+{
+  GHashTable *result;
+  GList *objects = NULL;
+  gchar **path;
+
+  if (!client->priv->cache) {
+    return NULL;
+  }
+
+  for (path = object_paths; *path; path++) {
+    result = cache_lookup (client, *path, properties);
+    if (!result) {
+      g_list_free_full (objects, (GDestroyNotify) g_hash_table_unref);
+      return NULL;
+    }
+    objects = g_list_prepend (objects, result);
+  }
+
+  return g_list_reverse (objects);
+}
+
+/* Drops cached properties of object_path and its children, or all of them if
+   object_path is NULL or the root category; changes in root mean any object
+   could have changed */
+static void
+cache_invalidate (MS2Client *client,
+                  const gchar *object_path)
+{
+  GHashTableIter iter;
+  const gchar *parent;
+  gpointer cached;
+
+  if (!client->priv->cache) {
+    return;
+  }
+
+  if (object_path && g_strcmp0 (object_path, client->priv->root_path) != 0) {
+    g_hash_table_remove (client->priv->cache, object_path);
+    /* Provider signals changes in an item through the container it belongs
+       to; objects which parent is not known could be one of them too */
+    g_hash_table_iter_init (&iter, client->priv->cache);
+    while (g_hash_table_iter_next (&iter, NULL, &cached)) {
+      parent = ms2_client_get_parent (cached);
+      if (!parent || g_strcmp0 (parent, object_path) == 0) {
+        g_hash_table_iter_remove (&iter);
+      }
+    }
+  } else {
+    g_hash_table_remove_all (client->priv->cache);
+  }
+
+  /* Replies of requests in flight may contain old values */
+  client->priv->cache_generation++;
+}
+
+/* Checks if results of an asynchronous operation can be stored in cache */
+static gboolean
+cache_is_current (MS2Client *client,
+                  AsyncData *adata)
+{
+  return client->priv->cache &&
+    adata->cache_generation == client->priv->cache_generation;
+}
+
+/* Stores in cache the reply received for an asynchronous operation, unless it
+   failed or cache has been invalidated while waiting for it */
+static void
+cache_store_reply (GSimpleAsyncResult *res)
+{
+  AsyncData *adata;
+  MS2Client *client;
+
+  adata = g_simple_async_result_get_op_res_gpointer (res);
+  client = MS2_CLIENT (g_async_result_get_source_object (G_ASYNC_RESULT (res)));
+
+  if (!adata->error && cache_is_current (client, adata)) {
+    if (adata->object_paths) {
+      cache_store_batch (client, adata->object_paths, adata->children, adata->keys);
+    } else if (adata->object_path) {
+      cache_store (client, adata->object_path, adata->properties, adata->keys);
+    } else if (adata->set) {
+      cache_store_set (client, adata->set);
+    } else {
+      cache_store_objects (client, adata->children);
+    }
+  }
+
+  g_object_unref (client);
+}
+
 /* Given a NULL-terminated array of properties, returns an array of two
    elements; each array is a NULL-terminated array with properties for one
    interface. */
@@ -178,6 +848,21 @@ gptrarray_to_glist (GPtrArray *result)
   return g_list_reverse (list);
 }
 
+/* Returns object paths as the GPtrArray expected by dbus-glib */
+static GPtrArray *
+strv_to_object_paths (gchar **object_paths)
+{
+  GPtrArray *paths;
+  gchar **path;
+
+  paths = g_ptr_array_new ();
+  for (path = object_paths; *path; path++) {
+    g_ptr_array_add (paths, *path);
+  }
+
+  return paths;
+}
+
 /* Callback invoked when ListenChildren/ListenContainers/ListenItems reply is
    received */
 static void
@@ -190,6 +875,8 @@ list_elements_reply (DBusGProxy *proxy,
   GSimpleAsyncResult *res = G_SIMPLE_ASYNC_RESULT (user_data);
 
   adata = g_simple_async_result_get_op_res_gpointer (res);
+  adata->calls = g_slist_remove (adata->calls, call);
+
   if (dbus_g_proxy_end_call (proxy, call, &(adata->error),
                              dbus_g_type_get_collection ("GPtrArray",
                                                          dbus_g_type_get_map ("GHashTable",
@@ -199,31 +886,38 @@ list_elements_reply (DBusGProxy *proxy,
     adata->children = gptrarray_to_glist (result);
     g_ptr_array_free (result, TRUE);
   }
+  check_timed_out (&(adata->error));
 
+  cache_store_reply (res);
   g_simple_async_result_complete (res);
 }
 
-/* Callback invoked when SearchObjects reply is received */
+/* Callback invoked when ListChildrenFrom/SearchObjectsFrom reply is received */
 static void
-search_objects_reply (DBusGProxy *proxy,
-                      DBusGProxyCall *call,
-                      void *user_data)
+children_from_reply (DBusGProxy *proxy,
+                     DBusGProxyCall *call,
+                     void *user_data)
 {
   AsyncData *adata;
   GPtrArray *result = NULL;
   GSimpleAsyncResult *res = G_SIMPLE_ASYNC_RESULT (user_data);
 
   adata = g_simple_async_result_get_op_res_gpointer (res);
+  adata->calls = g_slist_remove (adata->calls, call);
+
   if (dbus_g_proxy_end_call (proxy, call, &(adata->error),
                              dbus_g_type_get_collection ("GPtrArray",
                                                          dbus_g_type_get_map ("GHashTable",
                                                                               G_TYPE_STRING,
                                                                               G_TYPE_VALUE)), &result,
+                             G_TYPE_STRING, &(adata->next_cursor),
                              G_TYPE_INVALID)) {
     adata->children = gptrarray_to_glist (result);
     g_ptr_array_free (result, TRUE);
   }
+  check_timed_out (&(adata->error));
 
+  cache_store_reply (res);
   g_simple_async_result_complete (res);
 }
 
@@ -238,6 +932,7 @@ get_reply (DBusGProxy *proxy,
   GetData *gdata = (GetData *) user_data;
 
   adata = g_simple_async_result_get_op_res_gpointer (gdata->result);
+  adata->calls = g_slist_remove (adata->calls, call);
 
   if (dbus_g_proxy_end_call (proxy, call, &(adata->error),
                              G_TYPE_VALUE, v,
@@ -246,8 +941,10 @@ get_reply (DBusGProxy *proxy,
                          g_strdup (gdata->key),
                          v);
   }
+  check_timed_out (&(adata->error));
   adata->expected_replies--;
   if (adata->expected_replies == 0) {
+    cache_store_reply (gdata->result);
     g_simple_async_result_complete (gdata->result);
     g_object_unref (gdata->result);
   }
@@ -267,6 +964,7 @@ get_all_reply (DBusGProxy *proxy,
   gpointer prop_result_value;
 
   adata = g_simple_async_result_get_op_res_gpointer (gdata->result);
+  adata->calls = g_slist_remove (adata->calls, call);
 
   if (dbus_g_proxy_end_call (proxy, call, &(adata->error),
                              dbus_g_type_get_map ("GHashTable",
@@ -287,104 +985,190 @@ get_all_reply (DBusGProxy *proxy,
     }
     g_hash_table_unref (prop_result);
   }
+  check_timed_out (&(adata->error));
 
   adata->expected_replies--;
   if (adata->expected_replies == 0) {
+    cache_store_reply (gdata->result);
     g_simple_async_result_complete (gdata->result);
     g_object_unref (gdata->result);
   }
 }
 
-/* Invoke synchronous ListFoo method */
-static GList *
-ms2_client_list_elements (MS2Client *client,
-                          const gchar *list_operation,
-                          const gchar *object_path,
-                          guint offset,
-                          guint max_count,
-                          gchar **properties,
-                          GError **error)
+/* Returns a new call to a MediaContainer2 listing method on object_path; query
+   is only used with SearchObjects */
+static DBusMessage *
+new_list_message (MS2Client *client,
+                  const gchar *list_operation,
+                  const gchar *object_path,
+                  const gchar *query,
+                  guint offset,
+                  guint max_count,
+                  gchar **properties)
 {
-  DBusGProxy *gproxy;
-  GList *children = NULL;
-  GPtrArray *result = NULL;
+  DBusMessage *m;
+  gint n_properties;
+
+  m = dbus_message_new_method_call (client->priv->fullname,
+                                    object_path,
+                                    "org.gnome.UPnP.MediaContainer2",
+                                    list_operation);
+  if (query) {
+    dbus_message_append_args (m,
+                              DBUS_TYPE_STRING, &query,
+                              DBUS_TYPE_INVALID);
+  }
 
-  g_return_val_if_fail (MS2_IS_CLIENT (client), NULL);
-  g_return_val_if_fail (properties, NULL);
+  n_properties = g_strv_length (properties);
+  dbus_message_append_args (m,
+                            DBUS_TYPE_UINT32, &offset,
+                            DBUS_TYPE_UINT32, &max_count,
+                            DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &properties,
+                            n_properties,
+                            DBUS_TYPE_INVALID);
 
-  gproxy = dbus_g_proxy_new_for_name (client->priv->bus,
-                                      client->priv->fullname,
-                                      object_path,
-                                      "org.gnome.UPnP.MediaContainer2");
+  return m;
+}
 
-  if (dbus_g_proxy_call (gproxy,
-                         list_operation, error,
-                         G_TYPE_UINT, offset,
-                         G_TYPE_UINT, max_count,
-                         G_TYPE_STRV, properties,
-                         G_TYPE_INVALID,
-                         dbus_g_type_get_collection ("GPtrArray",
-                                                     dbus_g_type_get_map ("GHashTable",
-                                                                          G_TYPE_STRING,
-                                                                          G_TYPE_VALUE)), &result,
-                         G_TYPE_INVALID)) {
-    children = gptrarray_to_glist (result);
-    g_ptr_array_free (result, TRUE);
+/* Invoke synchronous ListFoo or SearchObjects method. Reply is decoded
+   straight into a result set, without building intermediate tables */
+static MS2ResultSet *
+ms2_client_list_set (MS2Client *client,
+                     const gchar *list_operation,
+                     const gchar *object_path,
+                     const gchar *query,
+                     guint offset,
+                     guint max_count,
+                     gchar **properties,
+                     GError **error)
+{
+  DBusError derror;
+  DBusMessage *m;
+  DBusMessage *r;
+  MS2ResultSet *set;
+
+  m = new_list_message (client,
+                        list_operation,
+                        object_path,
+                        query,
+                        offset,
+                        max_count,
+                        properties);
+
+  dbus_error_init (&derror);
+  r = dbus_connection_send_with_reply_and_block (dbus_g_connection_get_connection (client->priv->bus),
+                                                 m, -1, &derror);
+  dbus_message_unref (m);
+
+  if (!r) {
+    dbus_set_g_error (error, &derror);
+    dbus_error_free (&derror);
+    return NULL;
   }
 
-  g_object_unref (gproxy);
+  set = ms2_result_set_new_from_message (r);
+  dbus_message_unref (r);
 
-  return children;
+  cache_store_set (client, set);
+
+  return set;
 }
 
-/* Invoke asynchronous ListFoo method */
+/* Callback invoked when ListFoo or SearchObjects reply is received */
 static void
-ms2_client_list_elements_async (MS2Client *client,
-                                const gchar *list_operation,
-                                const gchar *object_path,
-                                guint offset,
-                                guint max_count,
-                                gchar **properties,
-                                GAsyncReadyCallback callback,
-                                gpointer user_data)
+list_set_reply (DBusPendingCall *call,
+                void *user_data)
 {
   AsyncData *adata;
-  GSimpleAsyncResult *res;
+  DBusError derror;
+  DBusMessage *r;
+  GSimpleAsyncResult *res = G_SIMPLE_ASYNC_RESULT (user_data);
 
-  g_return_if_fail (MS2_IS_CLIENT (client));
+  adata = g_simple_async_result_get_op_res_gpointer (res);
+  dbus_pending_call_unref (adata->pending);
+  adata->pending = NULL;
+
+  r = dbus_pending_call_steal_reply (call);
+  dbus_error_init (&derror);
+  if (dbus_set_error_from_message (&derror, r)) {
+    dbus_set_g_error (&(adata->error), &derror);
+    dbus_error_free (&derror);
+    check_timed_out (&(adata->error));
+  } else {
+    adata->set = ms2_result_set_new_from_message (r);
+  }
+  dbus_message_unref (r);
+
+  cache_store_reply (res);
+  g_simple_async_result_complete (res);
+}
+
+/* Invoke asynchronous ListFoo or SearchObjects method; source_tag is the
+   function that starts the operation */
+static void
+ms2_client_list_set_async (MS2Client *client,
+                           const gchar *list_operation,
+                           const gchar *object_path,
+                           const gchar *query,
+                           guint offset,
+                           guint max_count,
+                           gchar **properties,
+                           gint timeout,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data,
+                           gpointer source_tag)
+{
+  AsyncData *adata;
+  DBusMessage *m;
+  DBusPendingCall *call = NULL;
+  GSimpleAsyncResult *res;
 
   res = g_simple_async_result_new (G_OBJECT (client),
                                    callback,
                                    user_data,
-                                   ms2_client_list_elements_async);
+                                   source_tag);
   adata = g_slice_new0 (AsyncData);
+  adata->cache_generation = client->priv->cache_generation;
   g_simple_async_result_set_op_res_gpointer (res,
                                              adata,
                                              (GDestroyNotify) free_async_data);
-  adata->gproxy = dbus_g_proxy_new_for_name (client->priv->bus,
-                                             client->priv->fullname,
-                                             object_path,
-                                             "org.gnome.UPnP.MediaContainer2");
 
-  dbus_g_proxy_begin_call (adata->gproxy,
-                           list_operation, list_elements_reply,
-                           res, g_object_unref,
-                           G_TYPE_UINT, offset,
-                           G_TYPE_UINT, max_count,
-                           G_TYPE_STRV, properties,
-                           G_TYPE_INVALID);
+  m = new_list_message (client,
+                        list_operation,
+                        object_path,
+                        query,
+                        offset,
+                        max_count,
+                        properties);
+
+  if (dbus_connection_send_with_reply (dbus_g_connection_get_connection (client->priv->bus),
+                                       m, &call, timeout) && call) {
+    adata->pending = call;
+    dbus_pending_call_set_notify (call,
+                                  list_set_reply,
+                                  res,
+                                  g_object_unref);
+    watch_cancellable (res, cancellable);
+  } else {
+    adata->error = g_error_new (DBUS_GERROR,
+                                DBUS_GERROR_DISCONNECTED,
+                                "Connection to provider is closed");
+    g_simple_async_result_complete_in_idle (res);
+    g_object_unref (res);
+  }
+
+  dbus_message_unref (m);
 }
 
-/* Finishes asynchronous ListFoo method */
-static GList *
-ms2_client_list_elements_finish (MS2Client *client,
-                                 GAsyncResult *res,
-                                 GError **error)
+/* Finishes asynchronous ListFoo or SearchObjects method */
+static MS2ResultSet *
+ms2_client_list_set_finish (MS2Client *client,
+                            GAsyncResult *res,
+                            GError **error)
 {
   AsyncData *adata;
-
-  g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
-                        ms2_client_list_elements_async, NULL);
+  MS2ResultSet *set;
 
   adata = g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res));
 
@@ -392,283 +1176,439 @@ ms2_client_list_elements_finish (MS2Client *client,
     *error = adata->error;
   }
 
-  return adata->children;
+  set = adata->set;
+  adata->set = NULL;
+
+  return set;
 }
 
-/* Dispose function */
-static void
-ms2_client_dispose (GObject *object)
+/* Invoke synchronous ListFoo method, or SearchObjects if query is not NULL.
+   Reply is decoded by dbus-glib, so any value the provider sends is kept */
+static GList *
+ms2_client_list_elements (MS2Client *client,
+                          const gchar *list_operation,
+                          const gchar *object_path,
+                          const gchar *query,
+                          guint offset,
+                          guint max_count,
+                          gchar **properties,
+                          GError **error)
 {
-  MS2Client *client = MS2_CLIENT (object);
+  DBusGProxy *gproxy;
+  GList *children = NULL;
+  GPtrArray *result = NULL;
+  gboolean success;
 
-  ms2_observer_remove_client (client, client->priv->name);
+  g_return_val_if_fail (MS2_IS_CLIENT (client), NULL);
+  g_return_val_if_fail (properties, NULL);
 
-  G_OBJECT_CLASS (ms2_client_parent_class)->dispose (object);
-}
+  gproxy = get_proxy (client, object_path, "org.gnome.UPnP.MediaContainer2");
+
+  if (query) {
+    success = dbus_g_proxy_call (gproxy,
+                                 list_operation, error,
+                                 G_TYPE_STRING, query,
+                                 G_TYPE_UINT, offset,
+                                 G_TYPE_UINT, max_count,
+                                 G_TYPE_STRV, properties,
+                                 G_TYPE_INVALID,
+                                 dbus_g_type_get_collection ("GPtrArray",
+                                                             dbus_g_type_get_map ("GHashTable",
+                                                                                  G_TYPE_STRING,
+                                                                                  G_TYPE_VALUE)), &result,
+                                 G_TYPE_INVALID);
+  } else {
+    success = dbus_g_proxy_call (gproxy,
+                                 list_operation, error,
+                                 G_TYPE_UINT, offset,
+                                 G_TYPE_UINT, max_count,
+                                 G_TYPE_STRV, properties,
+                                 G_TYPE_INVALID,
+                                 dbus_g_type_get_collection ("GPtrArray",
+                                                             dbus_g_type_get_map ("GHashTable",
+                                                                                  G_TYPE_STRING,
+                                                                                  G_TYPE_VALUE)), &result,
+                                 G_TYPE_INVALID);
+  }
 
-/* Finalize function */
-static void
-ms2_client_finalize (GObject *object)
-{
-  MS2Client *client = MS2_CLIENT (object);
+  if (success) {
+    children = gptrarray_to_glist (result);
+    g_ptr_array_free (result, TRUE);
+    cache_store_objects (client, children);
+  }
 
-  g_free (client->priv->name);
-  g_free (client->priv->fullname);
-  g_free (client->priv->root_path);
+  g_object_unref (gproxy);
 
-  G_OBJECT_CLASS (ms2_client_parent_class)->finalize (object);
+  return children;
 }
 
-/* Class init function */
+/* Invoke asynchronous ListFoo method, or SearchObjects if query is not NULL;
+   source_tag is the function that starts the operation */
 static void
-ms2_client_class_init (MS2ClientClass *klass)
+ms2_client_list_elements_async (MS2Client *client,
+                                const gchar *list_operation,
+                                const gchar *object_path,
+                                const gchar *query,
+                                guint offset,
+                                guint max_count,
+                                gchar **properties,
+                                gint timeout,
+                                GCancellable *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer user_data,
+                                gpointer source_tag)
 {
-  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
-
-  g_type_class_add_private (klass, sizeof (MS2ClientPrivate));
+  AsyncData *adata;
+  DBusGProxyCall *call;
+  GSimpleAsyncResult *res;
 
-  gobject_class->dispose = ms2_client_dispose;
-  gobject_class->finalize = ms2_client_finalize;
+  g_return_if_fail (MS2_IS_CLIENT (client));
+  g_return_if_fail (properties);
 
-  /**
-   * MS2Client::updated:
-   * @client: a #MS2Client
-   * @id: identifier of item that has changed
-   *
-   * Notifies when an item in provider has changed.
-   **/
-  signals[UPDATED] = g_signal_new ("updated",
-                                   G_TYPE_FROM_CLASS (klass),
-                                   G_SIGNAL_RUN_FIRST | G_SIGNAL_NO_RECURSE,
-                                   G_STRUCT_OFFSET (MS2ClientClass, updated),
-                                   NULL,
-                                   NULL,
-                                   g_cclosure_marshal_VOID__STRING,
-                                   G_TYPE_NONE,
-                                   1,
-                                   G_TYPE_STRING);
+  res = g_simple_async_result_new (G_OBJECT (client),
+                                   callback,
+                                   user_data,
+                                   source_tag);
+  adata = g_slice_new0 (AsyncData);
+  adata->cache_generation = client->priv->cache_generation;
+  g_simple_async_result_set_op_res_gpointer (res,
+                                             adata,
+                                             (GDestroyNotify) free_async_data);
+  adata->gproxy = get_proxy (client,
+                             object_path,
+                             "org.gnome.UPnP.MediaContainer2");
+
+  if (query) {
+    call = dbus_g_proxy_begin_call_with_timeout (adata->gproxy,
+                                                 list_operation, list_elements_reply,
+                                                 res, g_object_unref,
+                                                 timeout,
+                                                 G_TYPE_STRING, query,
+                                                 G_TYPE_UINT, offset,
+                                                 G_TYPE_UINT, max_count,
+                                                 G_TYPE_STRV, properties,
+                                                 G_TYPE_INVALID);
+  } else {
+    call = dbus_g_proxy_begin_call_with_timeout (adata->gproxy,
+                                                 list_operation, list_elements_reply,
+                                                 res, g_object_unref,
+                                                 timeout,
+                                                 G_TYPE_UINT, offset,
+                                                 G_TYPE_UINT, max_count,
+                                                 G_TYPE_STRV, properties,
+                                                 G_TYPE_INVALID);
+  }
 
-  /**
-   * MS2Client::destroy:
-   * @client: a #MS2Client
-   *
-   * Notifies when a client is going to be destroyed. Usually this happens when
-   * provider goes away.
-   *
-   * User should not use the object, as provider is not present.
-   *
-   * After this, client will be automatically destroyed.
-   **/
-  signals[DESTROY] = g_signal_new ("destroy",
-                                   G_TYPE_FROM_CLASS (klass),
-                                   G_SIGNAL_RUN_LAST | G_SIGNAL_RUN_CLEANUP,
-                                   G_STRUCT_OFFSET (MS2ClientClass, destroy),
-                                   NULL,
-                                   NULL,
-                                   g_cclosure_marshal_VOID__VOID,
-                                   G_TYPE_NONE,
-                                   0);
+  adata->calls = g_slist_prepend (adata->calls, call);
+  watch_cancellable (res, cancellable);
 }
 
-/* Object init function */
-static void
-ms2_client_init (MS2Client *client)
+/* Finishes asynchronous ListFoo or SearchObjects method */
+static GList *
+ms2_client_list_elements_finish (MS2Client *client,
+                                 GAsyncResult *res,
+                                 GError **error)
 {
-  client->priv = MS2_CLIENT_GET_PRIVATE (client);
-}
+  AsyncData *adata;
 
-/****************** INTERNAL PUBLIC API (NOT TO BE EXPORTED) ******************/
+  adata = g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res));
 
-/* Notify destruction of client; client should not use this client any more*/
-void
-ms2_client_notify_destroy (MS2Client *client)
-{
-  g_return_if_fail (MS2_IS_CLIENT (client));
+  if (error) {
+    *error = adata->error;
+  }
 
-  g_signal_emit (client, signals[DESTROY], 0);
+  return adata->children;
 }
 
-/* Notify update of object_path */
-void
-ms2_client_notify_updated (MS2Client *client,
-                           const gchar *object_path)
+/* Returns cursor if it points to more elements, or NULL otherwise */
+static gchar *
+check_next_cursor (gchar *cursor)
 {
-  g_signal_emit (client, signals[UPDATED], 0, object_path);
-}
+  if (cursor && !*cursor) {
+    g_free (cursor);
+    return NULL;
+  }
 
-/******************** PUBLIC API ********************/
+  return cursor;
+}
 
-/**
- * ms2_client_get_providers:
- *
- * Returns a list of content providers following MediaServer2 specification.
- *
- * Returns: a new @NULL-terminated array of strings
- **/
-gchar **
-ms2_client_get_providers ()
+/* Invoke synchronous ListChildrenFrom method, or SearchObjectsFrom if query is
+   not NULL */
+static GList *
+ms2_client_children_from (MS2Client *client,
+                          const gchar *object_path,
+                          const gchar *query,
+                          const gchar *cursor,
+                          guint max_count,
+                          gchar **properties,
+                          gchar **next_cursor,
+                          GError **error)
 {
-  DBusGConnection *connection;
   DBusGProxy *gproxy;
-  GError *error = NULL;
-  GPtrArray *providers;
-  gchar **dbus_names;
-  gchar **list_providers;
-  gchar **p;
-  gint i;
-  gint prefix_size = strlen (MS2_DBUS_SERVICE_PREFIX);
-
-  connection = dbus_g_bus_get (DBUS_BUS_SESSION, &error);
-  if (!connection) {
-    g_printerr ("Could not connect to session bus, %s\n", error->message);
-    g_clear_error (&error);
-    return FALSE;
-  }
-
-  gproxy = dbus_g_proxy_new_for_name (connection,
-                                      DBUS_SERVICE_DBUS,
-                                      DBUS_PATH_DBUS,
-                                      DBUS_INTERFACE_DBUS);
+  GList *children = NULL;
+  GPtrArray *result = NULL;
+  gboolean success;
+  gchar *new_cursor = NULL;
 
-  /* Get a list of all DBUS services running */
-  org_freedesktop_DBus_list_names (gproxy, &dbus_names, &error);
-  g_object_unref (gproxy);
+  g_return_val_if_fail (MS2_IS_CLIENT (client), NULL);
+  g_return_val_if_fail (properties, NULL);
 
-  if (error) {
-    g_printerr ("Could not get list of dbus names, %s\n", error->message);
-    g_clear_error (&error);
-    return FALSE;
+  if (next_cursor) {
+    *next_cursor = NULL;
   }
 
-  if (!dbus_names) {
-    return FALSE;
+  gproxy = get_proxy (client, object_path, MS2_PAGED_CONTAINER_IFACE);
+
+  if (query) {
+    success = dbus_g_proxy_call (gproxy,
+                                 "SearchObjectsFrom", error,
+                                 G_TYPE_STRING, query,
+                                 G_TYPE_STRING, cursor? cursor: "",
+                                 G_TYPE_UINT, max_count,
+                                 G_TYPE_STRV, properties,
+                                 G_TYPE_INVALID,
+                                 dbus_g_type_get_collection ("GPtrArray",
+                                                             dbus_g_type_get_map ("GHashTable",
+                                                                                  G_TYPE_STRING,
+                                                                                  G_TYPE_VALUE)), &result,
+                                 G_TYPE_STRING, &new_cursor,
+                                 G_TYPE_INVALID);
+  } else {
+    success = dbus_g_proxy_call (gproxy,
+                                 "ListChildrenFrom", error,
+                                 G_TYPE_STRING, cursor? cursor: "",
+                                 G_TYPE_UINT, max_count,
+                                 G_TYPE_STRV, properties,
+                                 G_TYPE_INVALID,
+                                 dbus_g_type_get_collection ("GPtrArray",
+                                                             dbus_g_type_get_map ("GHashTable",
+                                                                                  G_TYPE_STRING,
+                                                                                  G_TYPE_VALUE)), &result,
+                                 G_TYPE_STRING, &new_cursor,
+                                 G_TYPE_INVALID);
   }
 
-  /* Filter the list to obtain those services that fulfils MediaServer2 spec */
-  providers = g_ptr_array_new ();
-  for (p = dbus_names; *p; p++) {
-    if (g_str_has_prefix (*p, MS2_DBUS_SERVICE_PREFIX)) {
-      g_ptr_array_add (providers, *p);
+  if (success) {
+    children = gptrarray_to_glist (result);
+    g_ptr_array_free (result, TRUE);
+    cache_store_objects (client, children);
+    new_cursor = check_next_cursor (new_cursor);
+    if (next_cursor) {
+      *next_cursor = new_cursor;
+    } else {
+      g_free (new_cursor);
     }
   }
 
-  /* Put them in a NULL-terminated array */
-  list_providers = g_new (gchar *, providers->len + 1);
-  for (i = 0; i < providers->len; i++) {
-    list_providers[i] =
-      g_strdup (g_ptr_array_index (providers, i) + prefix_size);
-  }
-
-  list_providers[i] = NULL;
-
-  g_strfreev (dbus_names);
-  g_ptr_array_free (providers, TRUE);
+  g_object_unref (gproxy);
 
-  return list_providers;
+  return children;
 }
 
-/**
- * ms2_client_new:
- * @provider: provider name.
- *
- * Create a new #MS2Client that will be used to obtain content from the provider
- * specified.
- *
- * Providers can be obtained with ms2_client_get_providers().
- *
- * Returns: a new #MS2Client
- **/
-MS2Client *ms2_client_new (const gchar *provider)
+/* Invoke asynchronous ListChildrenFrom method, or SearchObjectsFrom if query is
+   not NULL */
+static void
+ms2_client_children_from_async (MS2Client *client,
+                                const gchar *object_path,
+                                const gchar *query,
+                                const gchar *cursor,
+                                guint max_count,
+                                gchar **properties,
+                                gint timeout,
+                                GCancellable *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer user_data)
 {
-  DBusGConnection *connection;
-  GError *error = NULL;
-  MS2Client *client;
-
-  connection = dbus_g_bus_get (DBUS_BUS_SESSION, &error);
-  if (!connection) {
-    g_printerr ("Could not connect to session bus, %s\n", error->message);
-    g_clear_error (&error);
-    return NULL;
-  }
+  AsyncData *adata;
+  DBusGProxyCall *call;
+  GSimpleAsyncResult *res;
 
-  client = g_object_new (MS2_TYPE_CLIENT, NULL);
-  client->priv->bus = connection;
-  client->priv->name = g_strdup (provider);
-  client->priv->fullname = g_strconcat (MS2_DBUS_SERVICE_PREFIX, provider, NULL);
-  client->priv->root_path = g_strconcat (MS2_DBUS_PATH_PREFIX, provider, NULL);
+  g_return_if_fail (MS2_IS_CLIENT (client));
 
-  ms2_observer_add_client (client, provider);
+  res = g_simple_async_result_new (G_OBJECT (client),
+                                   callback,
+                                   user_data,
+                                   ms2_client_children_from_async);
+  adata = g_slice_new0 (AsyncData);
+  adata->cache_generation = client->priv->cache_generation;
+  g_simple_async_result_set_op_res_gpointer (res,
+                                             adata,
+                                             (GDestroyNotify) free_async_data);
+  adata->gproxy = get_proxy (client, object_path, MS2_PAGED_CONTAINER_IFACE);
+
+  if (query) {
+    call = dbus_g_proxy_begin_call_with_timeout (adata->gproxy,
+                                                 "SearchObjectsFrom", children_from_reply,
+                                                 res, g_object_unref,
+                                                 timeout,
+                                                 G_TYPE_STRING, query,
+                                                 G_TYPE_STRING, cursor? cursor: "",
+                                                 G_TYPE_UINT, max_count,
+                                                 G_TYPE_STRV, properties,
+                                                 G_TYPE_INVALID);
+  } else {
+    call = dbus_g_proxy_begin_call_with_timeout (adata->gproxy,
+                                                 "ListChildrenFrom", children_from_reply,
+                                                 res, g_object_unref,
+                                                 timeout,
+                                                 G_TYPE_STRING, cursor? cursor: "",
+                                                 G_TYPE_UINT, max_count,
+                                                 G_TYPE_STRV, properties,
+                                                 G_TYPE_INVALID);
+  }
 
-  return client;
+  adata->calls = g_slist_prepend (adata->calls, call);
+  watch_cancellable (res, cancellable);
 }
 
-/**
- * ms2_client_get_provider_name:
- * @client: a #MS2Client
- *
- * Returns name of provider which client is attending
- *
- * Returns: name of provider
- **/
-const gchar *
-ms2_client_get_provider_name (MS2Client *client)
+/* Finishes asynchronous ListChildrenFrom/SearchObjectsFrom method */
+static GList *
+ms2_client_children_from_finish (MS2Client *client,
+                                 GAsyncResult *res,
+                                 gchar **next_cursor,
+                                 GError **error)
 {
-  g_return_val_if_fail (MS2_IS_CLIENT (client), NULL);
+  AsyncData *adata;
 
-  return client->priv->name;
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
+                        ms2_client_children_from_async, NULL);
+
+  adata = g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res));
+
+  if (next_cursor) {
+    *next_cursor = check_next_cursor (adata->next_cursor);
+    adata->next_cursor = NULL;
+  }
+
+  if (error) {
+    *error = adata->error;
+  }
+
+  return adata->children;
 }
 
-/**
- * ms2_client_get_properties_async:
- * @client: a #MS2Client
- * @object_path: media identifier to obtain properties from
- * @callback: a #GAsyncReadyCallback to call when request is satisfied
- * @user_data: the data to pass to callback function
- *
- * Starts an asynchronous request of properties.
- *
- * For more details, see ms2_client_get_properties(), which is the synchronous
- * version of this call.
- *
- * When the result has been obtained, @callback will be called with
- * @user_data. To finish the operation, call ms2_client_get_properties_finish()
- * with the #GAsyncResult returned by the @callback.
- **/
-void
-ms2_client_get_properties_async (MS2Client *client,
+/* Invoke synchronous Get/GetAll methods, one for each interface properties
+   belong to */
+static GHashTable *
+ms2_client_get_properties_split (MS2Client *client,
                                  const gchar *object_path,
                                  gchar **properties,
-                                 GAsyncReadyCallback callback,
-                                 gpointer user_data)
+                                 GError **error)
+{
+  DBusGProxy *gproxy;
+  GHashTable *collected_properties;
+  GHashTable *prop_result;
+  GValue *v;
+  gboolean error_happened = FALSE;
+  gchar ***prop_by_iface;
+  gchar **prop;
+  gint i;
+  gint num_props;
+  gpointer prop_result_key;
+  gpointer prop_result_value;
+
+  gproxy = get_proxy (client, object_path, "org.freedesktop.DBus.Properties");
+
+  collected_properties = g_hash_table_new_full (g_str_hash,
+                                                g_str_equal,
+                                                (GDestroyNotify) g_free,
+                                                (GDestroyNotify) free_gvalue);
+
+  prop_by_iface = split_properties_by_interface (properties);
+  for (i = 0; i < 3; i++) {
+    num_props = g_strv_length (prop_by_iface[i]);
+    /* If only one property is required, then invoke "Get" method */
+    if (num_props == 1) {
+      v = g_new0 (GValue, 1);
+      if (dbus_g_proxy_call (gproxy,
+                             "Get", error,
+                             G_TYPE_STRING, IFACES[i],
+                             G_TYPE_STRING, prop_by_iface[i][0],
+                             G_TYPE_INVALID,
+                             G_TYPE_VALUE, v,
+                             G_TYPE_INVALID)) {
+        g_hash_table_insert (collected_properties,
+                             g_strdup (prop_by_iface[i][0]),
+                             v);
+      } else {
+        error_happened = TRUE;
+        break;
+      }
+    } else if (num_props > 1) {
+      /* If several properties are required, use "GetAll" method */
+      if (dbus_g_proxy_call (gproxy,
+                             "GetAll", error,
+                             G_TYPE_STRING, IFACES[i],
+                             G_TYPE_INVALID,
+                             dbus_g_type_get_map ("GHashTable",
+                                                  G_TYPE_STRING,
+                                                  G_TYPE_VALUE), &prop_result,
+                            G_TYPE_INVALID)) {
+        /* Get only requested keys */
+        for (prop = prop_by_iface[i]; *prop; prop++) {
+          if (g_hash_table_lookup_extended (prop_result,
+                                            *prop,
+                                            &prop_result_key,
+                                            &prop_result_value)) {
+            g_hash_table_insert (collected_properties,
+                                 prop_result_key,
+                                 prop_result_value);
+            g_hash_table_steal (prop_result, *prop);
+          }
+        }
+        g_hash_table_unref (prop_result);
+      } else {
+        error_happened = TRUE;
+        break;
+      }
+    }
+  }
+
+  g_object_unref (gproxy);
+
+  g_free (prop_by_iface[0]);
+  g_free (prop_by_iface[1]);
+  g_free (prop_by_iface[2]);
+  g_free (prop_by_iface);
+
+  if (error_happened) {
+    if (collected_properties) {
+      g_hash_table_unref (collected_properties);
+    }
+    return NULL;
+  } else {
+    return collected_properties;
+  }
+}
+
+/* Invoke asynchronous Get/GetAll methods, one for each interface requested
+   properties belong to; takes its own reference on res */
+static void
+ms2_client_get_properties_split_async (MS2Client *client,
+                                       GSimpleAsyncResult *res)
 {
   AsyncData *adata;
+  DBusGProxyCall *call;
   GetData *gdata;
-  GSimpleAsyncResult *res;
   gchar ***prop_by_iface;
   gint i;
   gint num_props;
 
-  g_return_if_fail (MS2_IS_CLIENT (client));
+  adata = g_simple_async_result_get_op_res_gpointer (res);
 
-  res = g_simple_async_result_new (G_OBJECT (client),
-                                   callback,
-                                   user_data,
-                                   ms2_client_get_properties_async);
-  adata = g_slice_new0 (AsyncData);
-  g_simple_async_result_set_op_res_gpointer (res,
-                                             adata,
-                                             (GDestroyNotify) free_async_data);
-  adata->gproxy = dbus_g_proxy_new_for_name (client->priv->bus,
-                                             client->priv->fullname,
-                                             object_path,
-                                             "org.freedesktop.DBus.Properties");
+  if (adata->gproxy) {
+    g_object_unref (adata->gproxy);
+  }
+  adata->gproxy = get_proxy (client,
+                             adata->object_path,
+                             "org.freedesktop.DBus.Properties");
 
   adata->properties = g_hash_table_new_full (g_str_hash,
                                              g_str_equal,
                                              (GDestroyNotify) g_free,
                                              (GDestroyNotify) free_gvalue);
 
-  prop_by_iface = split_properties_by_interface (properties);
+  prop_by_iface = split_properties_by_interface (adata->keys);
   for (i = 0; i < 3; i++) {
     num_props = g_strv_length (prop_by_iface[i]);
     /* If only one property is required, then invoke "Get" method */
@@ -677,591 +1617,3309 @@ ms2_client_get_properties_async (MS2Client *client,
       gdata = g_slice_new0 (GetData);
       gdata->key = g_strdup (prop_by_iface[i][0]);
       gdata->result = res;
-      dbus_g_proxy_begin_call (adata->gproxy,
-                               "Get", get_reply,
-                               gdata, (GDestroyNotify) free_get_data,
-                               G_TYPE_STRING, IFACES[i],
-                               G_TYPE_STRING, prop_by_iface[i][0],
-                               G_TYPE_INVALID);
+      call = dbus_g_proxy_begin_call_with_timeout (adata->gproxy,
+                                                   "Get", get_reply,
+                                                   gdata, (GDestroyNotify) free_get_data,
+                                                   adata->timeout,
+                                                   G_TYPE_STRING, IFACES[i],
+                                                   G_TYPE_STRING, prop_by_iface[i][0],
+                                                   G_TYPE_INVALID);
+      adata->calls = g_slist_prepend (adata->calls, call);
     } else if (num_props > 1) {
       /* If several properties are required, use "GetAll" method */
       adata->expected_replies++;
       gdata = g_slice_new0 (GetData);
       gdata->keys = g_strdupv (prop_by_iface[i]);
       gdata->result = res;
-      dbus_g_proxy_begin_call (adata->gproxy,
-                               "GetAll", get_all_reply,
-                               gdata, (GDestroyNotify) free_get_data,
-                               G_TYPE_STRING, IFACES[i],
-                               G_TYPE_INVALID);
+      call = dbus_g_proxy_begin_call_with_timeout (adata->gproxy,
+                                                   "GetAll", get_all_reply,
+                                                   gdata, (GDestroyNotify) free_get_data,
+                                                   adata->timeout,
+                                                   G_TYPE_STRING, IFACES[i],
+                                                   G_TYPE_INVALID);
+      adata->calls = g_slist_prepend (adata->calls, call);
     }
   }
 
+  /* Last reply drops the reference */
+  if (adata->expected_replies > 0) {
+    g_object_ref (res);
+  } else {
+    g_simple_async_result_complete_in_idle (res);
+  }
+
   g_free (prop_by_iface[0]);
   g_free (prop_by_iface[1]);
   g_free (prop_by_iface[2]);
   g_free (prop_by_iface);
 }
 
+/* Checks if error means provider does not implement the invoked method */
+static gboolean
+is_unsupported_error (GError *error)
+{
+  return g_error_matches (error, DBUS_GERROR, DBUS_GERROR_UNKNOWN_METHOD) ||
+    (g_error_matches (error, DBUS_GERROR, DBUS_GERROR_REMOTE_EXCEPTION) &&
+     (dbus_g_error_has_name (error, DBUS_ERROR_UNKNOWN_INTERFACE) ||
+      dbus_g_error_has_name (error, DBUS_ERROR_UNKNOWN_OBJECT)));
+}
+
+/* Adds to properties of object_path the value Get gives to each of keys
+   provider did not return */
+static void
+add_default_properties (GHashTable *properties,
+                        const gchar *object_path,
+                        gchar **keys)
+{
+  const MS2PropertyDesc *desc;
+  GValue *v;
+  gchar **key;
+
+  for (key = keys; *key; key++) {
+    if (g_hash_table_lookup (properties, *key)) {
+      continue;
+    }
+
+    v = g_new0 (GValue, 1);
+    if (g_strcmp0 (*key, MS2_PROP_PATH) == 0) {
+      g_value_init (v, DBUS_TYPE_G_OBJECT_PATH);
+      g_value_set_boxed (v, object_path);
+      g_hash_table_insert (properties, g_strdup (*key), v);
+      continue;
+    }
+
+    desc = ms2_property_lookup (*key);
+    switch (desc? desc->signature[0]: DBUS_TYPE_STRING) {
+    case DBUS_TYPE_INT32:
+      g_value_init (v, G_TYPE_INT);
+      g_value_set_int (v, desc->default_value);
+      break;
+    case DBUS_TYPE_INT64:
+      g_value_init (v, G_TYPE_INT64);
+      g_value_set_int64 (v, desc->default_value);
+      break;
+    case DBUS_TYPE_UINT32:
+      g_value_init (v, G_TYPE_UINT);
+      g_value_set_uint (v, desc->default_value);
+      break;
+    case DBUS_TYPE_BOOLEAN:
+      g_value_init (v, G_TYPE_BOOLEAN);
+      g_value_set_boolean (v, desc->default_value);
+      break;
+    case DBUS_TYPE_ARRAY:
+      g_value_init (v, G_TYPE_STRV);
+      g_value_take_boxed (v, g_new0 (gchar *, 1));
+      break;
+    default:
+      g_value_init (v, G_TYPE_STRING);
+      g_value_set_string (v, MS2_UNKNOWN_STR);
+    }
+    g_hash_table_insert (properties, g_strdup (*key), v);
+  }
+}
+
+/* Returns properties of the only object in a GetPropertiesBatch reply, or NULL
+   if provider could not give any of them. Providers leaving out some of keys
+   get them filled with defaults, so they do not need to be asked again */
+static GHashTable *
+take_single_result (GPtrArray *result,
+                    const gchar *object_path,
+                    gchar **keys)
+{
+  GHashTable *properties = NULL;
+  gint i;
+
+  for (i = 0; i < result->len; i++) {
+    if (i == 0 && g_hash_table_size (g_ptr_array_index (result, i)) > 0) {
+      properties = g_ptr_array_index (result, i);
+      add_default_properties (properties, object_path, keys);
+    } else {
+      g_hash_table_unref (g_ptr_array_index (result, i));
+    }
+  }
+  g_ptr_array_free (result, TRUE);
+
+  return properties;
+}
+
+/* Callback invoked when GetPropertiesBatch reply for a single object is
+   received */
+static void
+get_properties_single_reply (DBusGProxy *proxy,
+                             DBusGProxyCall *call,
+                             void *user_data)
+{
+  AsyncData *adata;
+  GError *error = NULL;
+  GPtrArray *result = NULL;
+  GSimpleAsyncResult *res = G_SIMPLE_ASYNC_RESULT (user_data);
+  MS2Client *client;
+
+  adata = g_simple_async_result_get_op_res_gpointer (res);
+  client = MS2_CLIENT (g_async_result_get_source_object (G_ASYNC_RESULT (res)));
+  adata->calls = g_slist_remove (adata->calls, call);
+
+  if (dbus_g_proxy_end_call (proxy, call, &error,
+                             dbus_g_type_get_collection ("GPtrArray",
+                                                         dbus_g_type_get_map ("GHashTable",
+                                                                              G_TYPE_STRING,
+                                                                              G_TYPE_VALUE)), &result,
+                             G_TYPE_INVALID)) {
+    adata->properties = take_single_result (result,
+                                            adata->object_path,
+                                            adata->keys);
+  } else if (is_unsupported_error (error)) {
+    client->priv->no_properties_batch = TRUE;
+    g_error_free (error);
+  } else {
+    check_timed_out (&error);
+    adata->error = error;
+  }
+
+  if (adata->properties || adata->error) {
+    cache_store_reply (res);
+    g_simple_async_result_complete (res);
+  } else {
+    /* Ask each interface, so provider reports why properties are missing */
+    ms2_client_get_properties_split_async (client, res);
+  }
+
+  g_object_unref (client);
+}
+
+/* Invoke synchronous GetPropertiesBatch method for just one object, so all
+   requested properties are obtained in one round trip. Returns NULL without
+   setting error if provider could not give any of them */
+static GHashTable *
+ms2_client_get_properties_single (MS2Client *client,
+                                  const gchar *object_path,
+                                  gchar **properties,
+                                  GError **error)
+{
+  DBusGProxy *gproxy;
+  GHashTable *collected_properties = NULL;
+  GPtrArray *paths;
+  GPtrArray *result = NULL;
+
+  gproxy = get_proxy (client, client->priv->root_path, MS2_PROVIDER_IFACE);
+
+  paths = g_ptr_array_new ();
+  g_ptr_array_add (paths, (gpointer) object_path);
+  if (dbus_g_proxy_call (gproxy,
+                         "GetPropertiesBatch", error,
+                         dbus_g_type_get_collection ("GPtrArray",
+                                                     DBUS_TYPE_G_OBJECT_PATH), paths,
+                         G_TYPE_STRV, properties,
+                         G_TYPE_INVALID,
+                         dbus_g_type_get_collection ("GPtrArray",
+                                                     dbus_g_type_get_map ("GHashTable",
+                                                                          G_TYPE_STRING,
+                                                                          G_TYPE_VALUE)), &result,
+                         G_TYPE_INVALID)) {
+    collected_properties = take_single_result (result,
+                                               object_path,
+                                               properties);
+  }
+
+  g_ptr_array_free (paths, TRUE);
+  g_object_unref (gproxy);
+
+  return collected_properties;
+}
+
+/* Free ChildPage, cancelling its request if it is still in flight */
+static void
+free_child_page (ChildPage *page)
+{
+  if (page->call) {
+    dbus_g_proxy_cancel_call (page->gproxy, page->call);
+  }
+  if (page->gproxy) {
+    g_object_unref (page->gproxy);
+  }
+  g_list_free_full (page->children, (GDestroyNotify) g_hash_table_unref);
+  g_clear_error (&page->error);
+  g_slice_free (ChildPage, page);
+}
+
+static void child_page_reply (DBusGProxy *proxy,
+                              DBusGProxyCall *call,
+                              void *user_data);
+
+/* Invoke asynchronous ListChildren method for a page of iterator */
+static void
+child_iterator_request_page (MS2ChildIterator *iter,
+                             ChildPage *page)
+{
+  page->start = g_get_monotonic_time ();
+  page->plain = iter->plain;
+  page->gproxy = get_proxy (iter->client,
+                            iter->object_path,
+                            page->plain?
+                            "org.gnome.UPnP.MediaContainer2":
+                            MS2_PAGED_CONTAINER_IFACE);
+  page->call = dbus_g_proxy_begin_call_with_timeout (page->gproxy,
+                                                     "ListChildren", child_page_reply,
+                                                     page, NULL,
+                                                     iter->timeout,
+                                                     G_TYPE_UINT, page->offset,
+                                                     G_TYPE_UINT, page->count,
+                                                     G_TYPE_STRV, iter->properties,
+                                                     G_TYPE_INVALID);
+}
+
+/* Adds a page to the iterator, after sibling or at the end if sibling is
+   NULL, and requests it */
+static void
+child_iterator_add_page (MS2ChildIterator *iter,
+                         GList *sibling,
+                         guint offset,
+                         guint count)
+{
+  ChildPage *page;
+
+  page = g_slice_new0 (ChildPage);
+  page->iter = iter;
+  page->offset = offset;
+  page->count = count;
+
+  if (sibling) {
+    g_queue_insert_after (iter->pages, sibling, page);
+  } else {
+    g_queue_push_tail (iter->pages, page);
+  }
+
+  child_iterator_request_page (iter, page);
+}
+
+/* Keeps read_ahead pages requested beyond the one being consumed */
+static void
+child_iterator_fill (MS2ChildIterator *iter)
+{
+  while (!iter->exhausted &&
+         g_queue_get_length (iter->pages) <= iter->read_ahead) {
+    child_iterator_add_page (iter, NULL, iter->next_offset, iter->page_size);
+    iter->next_offset += iter->page_size;
+  }
+}
+
+/* Hands the next child, the end of the listing or an error to the pending
+   consumer, if it is available */
+static void
+child_iterator_deliver (MS2ChildIterator *iter)
+{
+  ChildPage *page;
+  GHashTable *child;
+  GSimpleAsyncResult *res;
+
+  if (!iter->pending) {
+    return;
+  }
+
+  /* Drop pages already consumed */
+  while ((page = g_queue_peek_head (iter->pages)) &&
+         !page->call && !page->error && !page->children) {
+    free_child_page (g_queue_pop_head (iter->pages));
+  }
+
+  if (page && page->call) {
+    /* Still waiting for it */
+    return;
+  }
+
+  if (!page && !iter->exhausted) {
+    child_iterator_fill (iter);
+    return;
+  }
+
+  res = iter->pending;
+
+  if (page && page->error) {
+    g_simple_async_result_set_from_error (res, page->error);
+    iter->exhausted = TRUE;
+    iter->failed = TRUE;
+  } else if (page) {
+    child = page->children->data;
+    page->children = g_list_delete_link (page->children, page->children);
+    g_simple_async_result_set_op_res_gpointer (res,
+                                               child,
+                                               (GDestroyNotify) g_hash_table_unref);
+  }
+
+  /* Consumer may free the iterator from its callback */
+  iter->pending = NULL;
+  g_simple_async_result_complete_in_idle (res);
+  g_object_unref (res);
+
+  if (!iter->failed) {
+    child_iterator_fill (iter);
+  }
+}
+
+/* Callback invoked when ListChildren reply for a page of iterator is
+   received */
+static void
+child_page_reply (DBusGProxy *proxy,
+                  DBusGProxyCall *call,
+                  void *user_data)
+{
+  ChildPage *page = (ChildPage *) user_data;
+  GError *error = NULL;
+  GList *link;
+  GPtrArray *result = NULL;
+  MS2ChildIterator *iter = page->iter;
+  gboolean success;
+  gint64 latency;
+  guint length;
+  guint next_offset = 0;
+
+  page->call = NULL;
+
+  if (page->plain) {
+    success = dbus_g_proxy_end_call (proxy, call, &error,
+                                     dbus_g_type_get_collection ("GPtrArray",
+                                                                 dbus_g_type_get_map ("GHashTable",
+                                                                                      G_TYPE_STRING,
+                                                                                      G_TYPE_VALUE)), &result,
+                                     G_TYPE_INVALID);
+  } else {
+    success = dbus_g_proxy_end_call (proxy, call, &error,
+                                     dbus_g_type_get_collection ("GPtrArray",
+                                                                 dbus_g_type_get_map ("GHashTable",
+                                                                                      G_TYPE_STRING,
+                                                                                      G_TYPE_VALUE)), &result,
+                                     G_TYPE_UINT, &next_offset,
+                                     G_TYPE_INVALID);
+  }
+
+  g_object_unref (page->gproxy);
+  page->gproxy = NULL;
+
+  if (!success) {
+    if (!page->plain && is_unsupported_error (error)) {
+      /* Provider does not know the paged interface; use the standard one. All
+         pages in flight were requested through the paged interface, so each
+         one of them fails and is requested again */
+      g_error_free (error);
+      iter->plain = TRUE;
+      child_iterator_request_page (iter, page);
+    } else {
+      check_timed_out (&error);
+      page->error = error;
+      iter->exhausted = TRUE;
+      child_iterator_deliver (iter);
+    }
+    return;
+  }
+
+  page->children = gptrarray_to_glist (result);
+  g_ptr_array_free (result, TRUE);
+  length = g_list_length (page->children);
+
+  if (next_offset > page->offset && next_offset < page->offset + page->count) {
+    /* Provider could not send the whole page; ask for the rest of it, and do
+       not ask for more than it is able to send from now on */
+    link = g_queue_find (iter->pages, page);
+    child_iterator_add_page (iter,
+                             link,
+                             next_offset,
+                             page->offset + page->count - next_offset);
+    iter->max_page_size = MAX (length, MS2_CHILD_ITERATOR_MIN_PAGE);
+    iter->page_size = MIN (iter->page_size, iter->max_page_size);
+  } else if (length < page->count) {
+    /* Reached the end of the listing */
+    iter->exhausted = TRUE;
+  }
+
+  /* Adapt page size, so each page takes about the target latency: small pages
+     when provider is slow, so consumer gets children soon, and big pages when
+     it is fast, so round trips do not dominate */
+  latency = g_get_monotonic_time () - page->start;
+  if (latency < MS2_CHILD_ITERATOR_TARGET_LATENCY / 2) {
+    iter->page_size = MIN (iter->page_size * 2, iter->max_page_size);
+  } else if (latency > MS2_CHILD_ITERATOR_TARGET_LATENCY * 2) {
+    iter->page_size = MAX (iter->page_size / 2, MS2_CHILD_ITERATOR_MIN_PAGE);
+  }
+
+  child_iterator_deliver (iter);
+  child_iterator_fill (iter);
+}
+
+/* Callback invoked when iterator is cancelled. Pages in flight are cancelled,
+   and pages not consumed yet are dropped, so the consumer gets the error */
+static void
+child_iterator_cancelled (GCancellable *cancellable,
+                          MS2ChildIterator *iter)
+{
+  ChildPage *page;
+
+  while ((page = g_queue_pop_head (iter->pages))) {
+    free_child_page (page);
+  }
+
+  page = g_slice_new0 (ChildPage);
+  page->iter = iter;
+  g_cancellable_set_error_if_cancelled (cancellable, &page->error);
+  g_queue_push_tail (iter->pages, page);
+  iter->exhausted = TRUE;
+
+  child_iterator_deliver (iter);
+}
+
+/* Free WalkRequest */
+static void
+free_walk_request (WalkRequest *request)
+{
+  if (request->gproxy) {
+    g_object_unref (request->gproxy);
+  }
+  g_free (request->object_path);
+  g_slice_free (WalkRequest, request);
+}
+
+/* Queues a request to list containers or items of object_path */
+static void
+walk_add_request (WalkData *walk,
+                  const gchar *object_path,
+                  const gchar *operation,
+                  guint depth,
+                  guint offset,
+                  gboolean first)
+{
+  WalkRequest *request;
+
+  request = g_slice_new0 (WalkRequest);
+  request->walk = walk;
+  request->object_path = g_strdup (object_path);
+  request->operation = operation;
+  request->depth = depth;
+  request->offset = offset;
+
+  if (first) {
+    g_queue_push_head (walk->requests, request);
+  } else {
+    g_queue_push_tail (walk->requests, request);
+  }
+}
+
+static void walk_reply (DBusGProxy *proxy,
+                        DBusGProxyCall *call,
+                        void *user_data);
+
+/* Sends queued requests while below the concurrency limit, and finishes the
+   walk when nothing is left */
+static void
+walk_send (WalkData *walk)
+{
+  WalkRequest *request;
+
+  while (!walk->stopped &&
+         walk->in_flight < walk->max_requests &&
+         (request = g_queue_pop_head (walk->requests))) {
+    request->plain = walk->plain;
+    request->gproxy = get_proxy (walk->client,
+                                 request->object_path,
+                                 request->plain?
+                                 "org.gnome.UPnP.MediaContainer2":
+                                 MS2_PAGED_CONTAINER_IFACE);
+    walk->in_flight++;
+    walk->sent = g_list_prepend (walk->sent, request);
+    request->call =
+      dbus_g_proxy_begin_call_with_timeout (request->gproxy,
+                                            request->operation, walk_reply,
+                                            request, (GDestroyNotify) free_walk_request,
+                                            walk->timeout,
+                                            G_TYPE_UINT, request->offset,
+                                            G_TYPE_UINT, MS2_CLIENT_WALK_PAGE,
+                                            G_TYPE_STRV, walk->properties,
+                                            G_TYPE_INVALID);
+  }
+
+  if (walk->in_flight > 0) {
+    return;
+  }
+
+  if (walk->error) {
+    g_simple_async_result_set_from_error (walk->result, walk->error);
+  }
+  g_simple_async_result_complete (walk->result);
+
+  if (walk->cancelled_idle_id) {
+    g_source_remove (walk->cancelled_idle_id);
+  }
+  if (walk->cancellable) {
+    g_cancellable_disconnect (walk->cancellable, walk->cancelled_id);
+    g_object_unref (walk->cancellable);
+  }
+  g_queue_free_full (walk->requests, (GDestroyNotify) free_walk_request);
+  g_hash_table_unref (walk->visited);
+  g_strfreev (walk->properties);
+  g_clear_error (&walk->error);
+  g_object_unref (walk->result);
+  g_slice_free (WalkData, walk);
+}
+
+/* Finishes a cancelled walk, unless a reply has already done it */
+static gboolean
+walk_cancelled_idle (gpointer user_data)
+{
+  WalkData *walk = (WalkData *) user_data;
+
+  walk->cancelled_idle_id = 0;
+  walk_send (walk);
+
+  return FALSE;
+}
+
+/* Callback invoked when a walk is cancelled. Requests in flight are cancelled,
+   so their replies are neither waited for nor decoded; the walk is finished
+   from an idle, as this can be invoked from func */
+static void
+walk_cancelled (GCancellable *cancellable,
+                WalkData *walk)
+{
+  DBusGProxy *gproxy;
+  WalkRequest *request;
+
+  walk->stopped = TRUE;
+  g_clear_error (&walk->error);
+  g_cancellable_set_error_if_cancelled (cancellable, &walk->error);
+
+  while (walk->sent) {
+    request = walk->sent->data;
+    walk->sent = g_list_delete_link (walk->sent, walk->sent);
+    walk->in_flight--;
+    /* Cancelling the call frees the request */
+    gproxy = g_object_ref (request->gproxy);
+    dbus_g_proxy_cancel_call (gproxy, request->call);
+    g_object_unref (gproxy);
+  }
+
+  if (!walk->cancelled_idle_id) {
+    walk->cancelled_idle_id = g_idle_add (walk_cancelled_idle, walk);
+  }
+}
+
+/* Reports an object found while walking, and queues listing it if it is a
+   container to descend into */
+static void
+walk_add_object (WalkData *walk,
+                 GHashTable *object,
+                 gboolean is_container,
+                 guint depth)
+{
+  const gchar *object_path;
+
+  object_path = ms2_client_get_path (object);
+
+  if (is_container) {
+    /* A container may be reachable from several parents */
+    if (!object_path ||
+        g_hash_table_lookup_extended (walk->visited, object_path, NULL, NULL)) {
+      return;
+    }
+    g_hash_table_insert (walk->visited, g_strdup (object_path), NULL);
+  }
+
+  if (!walk->func (walk->client, object, depth, walk->user_data)) {
+    walk->stopped = TRUE;
+    return;
+  }
+
+  if (is_container && (walk->max_depth == 0 || depth < walk->max_depth)) {
+    walk_add_request (walk, object_path, "ListContainers", depth + 1, 0, FALSE);
+    walk_add_request (walk, object_path, "ListItems", depth + 1, 0, FALSE);
+  }
+}
+
+/* Callback invoked when ListContainers/ListItems reply is received while
+   walking */
+static void
+walk_reply (DBusGProxy *proxy,
+            DBusGProxyCall *call,
+            void *user_data)
+{
+  GError *error = NULL;
+  GList *object;
+  GList *objects;
+  GPtrArray *result = NULL;
+  WalkRequest *request = (WalkRequest *) user_data;
+  WalkData *walk = request->walk;
+  gboolean is_container;
+  gboolean success;
+  guint length;
+  guint next_offset = 0;
+
+  walk->in_flight--;
+  walk->sent = g_list_remove (walk->sent, request);
+
+  if (request->plain) {
+    success = dbus_g_proxy_end_call (proxy, call, &error,
+                                     dbus_g_type_get_collection ("GPtrArray",
+                                                                 dbus_g_type_get_map ("GHashTable",
+                                                                                      G_TYPE_STRING,
+                                                                                      G_TYPE_VALUE)), &result,
+                                     G_TYPE_INVALID);
+  } else {
+    success = dbus_g_proxy_end_call (proxy, call, &error,
+                                     dbus_g_type_get_collection ("GPtrArray",
+                                                                 dbus_g_type_get_map ("GHashTable",
+                                                                                      G_TYPE_STRING,
+                                                                                      G_TYPE_VALUE)), &result,
+                                     G_TYPE_UINT, &next_offset,
+                                     G_TYPE_INVALID);
+  }
+
+  if (!success) {
+    if (!request->plain && is_unsupported_error (error)) {
+      /* Provider does not know the paged interface; use the standard one.
+         Every request sent through the paged interface fails the same way,
+         so each one of them is queued again */
+      walk->plain = TRUE;
+      walk_add_request (walk,
+                        request->object_path,
+                        request->operation,
+                        request->depth,
+                        request->offset,
+                        TRUE);
+      g_error_free (error);
+    } else if (!walk->error) {
+      check_timed_out (&error);
+      walk->error = error;
+      walk->stopped = TRUE;
+    } else {
+      g_error_free (error);
+    }
+    walk_send (walk);
+    return;
+  }
+
+  objects = gptrarray_to_glist (result);
+  g_ptr_array_free (result, TRUE);
+  length = g_list_length (objects);
+  is_container = g_strcmp0 (request->operation, "ListContainers") == 0;
+
+  for (object = objects; object && !walk->stopped; object = g_list_next (object)) {
+    walk_add_object (walk, object->data, is_container, request->depth);
+  }
+  g_list_free_full (objects, (GDestroyNotify) g_hash_table_unref);
+
+  /* Finish this container before starting new ones */
+  if (next_offset > request->offset) {
+    walk_add_request (walk,
+                      request->object_path,
+                      request->operation,
+                      request->depth,
+                      next_offset,
+                      TRUE);
+  } else if (length >= MS2_CLIENT_WALK_PAGE) {
+    walk_add_request (walk,
+                      request->object_path,
+                      request->operation,
+                      request->depth,
+                      request->offset + length,
+                      TRUE);
+  }
+
+  walk_send (walk);
+}
+
+/* Free SearchHit */
+static void
+free_search_hit (SearchHit *hit)
+{
+  g_hash_table_unref (hit->properties);
+  g_slice_free (SearchHit, hit);
+}
+
+/* Orders hits by their position in provider's reply, so the best result of
+   each provider goes before the second best of any of them; ties are resolved
+   by arrival order */
+static gint
+compare_search_hits (gconstpointer a,
+                     gconstpointer b)
+{
+  const SearchHit *hit_a = *((const SearchHit **) a);
+  const SearchHit *hit_b = *((const SearchHit **) b);
+
+  if (hit_a->rank != hit_b->rank) {
+    return hit_a->rank < hit_b->rank? -1: 1;
+  }
+
+  if (hit_a->arrival != hit_b->arrival) {
+    return hit_a->arrival < hit_b->arrival? -1: 1;
+  }
+
+  return 0;
+}
+
+/* Frees a list of objects */
+static void
+free_object_list (GList *objects)
+{
+  g_list_free_full (objects, (GDestroyNotify) g_hash_table_unref);
+}
+
+/* Removes a reference to search, freeing it when there are no more */
+static void
+search_all_unref (SearchAllData *search)
+{
+  search->ref_count--;
+  if (search->ref_count > 0) {
+    return;
+  }
+
+  if (search->cancellable) {
+    g_cancellable_disconnect (search->cancellable, search->cancelled_id);
+    g_object_unref (search->cancellable);
+  }
+  g_free (search->query);
+  g_strfreev (search->properties);
+  g_ptr_array_free (search->hits, TRUE);
+  g_object_unref (search->result);
+  g_slice_free (SearchAllData, search);
+}
+
+/* Completes search with the hits merged so far, and cancels the requests still
+   in flight */
+static void
+search_all_complete (SearchAllData *search)
+{
+  GList *objects = NULL;
+  GList *provider;
+  SearchHit *hit;
+  guint i;
+
+  if (search->completed) {
+    return;
+  }
+
+  search->completed = TRUE;
+
+  for (provider = search->providers; provider; provider = g_list_next (provider)) {
+    g_cancellable_cancel (((SearchProvider *) provider->data)->cancellable);
+  }
+
+  g_ptr_array_sort (search->hits, compare_search_hits);
+  for (i = search->hits->len; i > 0; i--) {
+    hit = g_ptr_array_index (search->hits, i - 1);
+    objects = g_list_prepend (objects, g_hash_table_ref (hit->properties));
+  }
+
+  g_simple_async_result_set_op_res_gpointer (search->result,
+                                             objects,
+                                             (GDestroyNotify) free_object_list);
+  g_simple_async_result_complete (search->result);
+}
+
+/* Callback invoked when search is cancelled; it is finished with an error,
+   without waiting for the providers that have not replied yet */
+static void
+search_all_cancelled (GCancellable *cancellable,
+                      SearchAllData *search)
+{
+  GError *error = NULL;
+  GList *provider;
+
+  if (search->completed) {
+    return;
+  }
+
+  search->completed = TRUE;
+
+  for (provider = search->providers; provider; provider = g_list_next (provider)) {
+    g_cancellable_cancel (((SearchProvider *) provider->data)->cancellable);
+  }
+
+  g_cancellable_set_error_if_cancelled (cancellable, &error);
+  g_simple_async_result_set_from_error (search->result, error);
+  g_error_free (error);
+  g_simple_async_result_complete_in_idle (search->result);
+}
+
+/* Stops waiting for provider; search is completed when no provider is left */
+static void
+search_provider_done (SearchProvider *provider)
+{
+  SearchAllData *search = provider->search;
+
+  if (provider->done) {
+    return;
+  }
+
+  provider->done = TRUE;
+  if (provider->timeout_id) {
+    g_source_remove (provider->timeout_id);
+    provider->timeout_id = 0;
+  }
+
+  search->pending--;
+  if (search->pending == 0) {
+    search_all_complete (search);
+  }
+}
+
+/* Gives up waiting for a provider that did not reply in time */
+static gboolean
+search_provider_timeout (gpointer user_data)
+{
+  SearchProvider *provider = (SearchProvider *) user_data;
+
+  provider->timeout_id = 0;
+  g_cancellable_cancel (provider->cancellable);
+  search_provider_done (provider);
+
+  return FALSE;
+}
+
+/* Callback invoked when SearchObjects reply of a provider is received, or its
+   request is cancelled. Late replies, and replies once search is completed,
+   are dropped */
+static void
+search_provider_reply (GObject *source,
+                       GAsyncResult *res,
+                       gpointer user_data)
+{
+  GError *error = NULL;
+  GList *object;
+  GList *objects;
+  SearchHit *hit;
+  SearchProvider *provider = (SearchProvider *) user_data;
+  SearchAllData *search = provider->search;
+  guint rank = 0;
+
+  objects = ms2_client_search_objects_finish (provider->client, res, &error);
+
+  /* Providers that can not search just do not contribute results */
+  if (!provider->done && !search->completed && !error) {
+    for (object = objects; object; object = g_list_next (object)) {
+      hit = g_slice_new (SearchHit);
+      hit->rank = rank++;
+      hit->arrival = search->arrivals;
+      hit->properties = g_hash_table_ref (object->data);
+      g_ptr_array_add (search->hits, hit);
+    }
+    search->arrivals++;
+
+    if (objects &&
+        search->func &&
+        !search->func (provider->client, objects, search->user_data)) {
+      search_all_complete (search);
+    }
+  }
+
+  search_provider_done (provider);
+
+  if (error) {
+    g_error_free (error);
+  }
+  free_object_list (objects);
+
+  search->providers = g_list_remove (search->providers, provider);
+  g_object_unref (provider->cancellable);
+  g_object_unref (provider->client);
+  search_all_unref (search);
+  g_slice_free (SearchProvider, provider);
+}
+
+/* Callback invoked when providers are known, to send the search to all of
+   them */
+static void
+search_all_providers_reply (GObject *source,
+                            GAsyncResult *res,
+                            gpointer user_data)
+{
+  MS2Client *client;
+  SearchAllData *search = (SearchAllData *) user_data;
+  SearchProvider *provider;
+  gchar **p;
+  gchar **providers;
+
+  providers = ms2_observer_get_providers_finish (MS2_OBSERVER (source),
+                                                 res,
+                                                 NULL);
+  for (p = providers; p && *p && !search->completed; p++) {
+    client = ms2_client_new (*p);
+    if (!client) {
+      continue;
+    }
+
+    provider = g_slice_new0 (SearchProvider);
+    provider->search = search;
+    provider->client = client;
+    provider->cancellable = g_cancellable_new ();
+    search->providers = g_list_prepend (search->providers, provider);
+    search->ref_count++;
+    search->pending++;
+
+    if (search->timeout > 0) {
+      provider->timeout_id = g_timeout_add (search->timeout,
+                                            search_provider_timeout,
+                                            provider);
+    }
+
+    ms2_client_search_objects_async_full (client,
+                                          ms2_client_get_root_path (client),
+                                          search->query,
+                                          0,
+                                          search->max_count,
+                                          search->properties,
+                                          -1,
+                                          provider->cancellable,
+                                          search_provider_reply,
+                                          provider);
+  }
+  g_strfreev (providers);
+
+  if (search->pending == 0) {
+    search_all_complete (search);
+  }
+
+  search_all_unref (search);
+}
+
+/* Dispose function */
+static void
+ms2_client_dispose (GObject *object)
+{
+  MS2Client *client = MS2_CLIENT (object);
+
+  ms2_observer_remove_client (client, client->priv->name);
+  clear_proxies (client);
+
+  G_OBJECT_CLASS (ms2_client_parent_class)->dispose (object);
+}
+
+/* Finalize function */
+static void
+ms2_client_finalize (GObject *object)
+{
+  MS2Client *client = MS2_CLIENT (object);
+
+  g_free (client->priv->name);
+  g_free (client->priv->fullname);
+  g_free (client->priv->root_path);
+  g_hash_table_unref (client->priv->proxies);
+  g_queue_free (client->priv->proxies_lru);
+  if (client->priv->cache) {
+    g_hash_table_unref (client->priv->cache);
+  }
+
+  G_OBJECT_CLASS (ms2_client_parent_class)->finalize (object);
+}
+
+/* Class init function */
+static void
+ms2_client_class_init (MS2ClientClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (MS2ClientPrivate));
+
+  gobject_class->dispose = ms2_client_dispose;
+  gobject_class->finalize = ms2_client_finalize;
+
+  /**
+   * MS2Client::updated:
+   * @client: a #MS2Client
+   * @id: identifier of item that has changed
+   *
+   * Notifies when an item in provider has changed.
+   **/
+  signals[UPDATED] = g_signal_new ("updated",
+                                   G_TYPE_FROM_CLASS (klass),
+                                   G_SIGNAL_RUN_FIRST | G_SIGNAL_NO_RECURSE,
+                                   G_STRUCT_OFFSET (MS2ClientClass, updated),
+                                   NULL,
+                                   NULL,
+                                   g_cclosure_marshal_VOID__STRING,
+                                   G_TYPE_NONE,
+                                   1,
+                                   G_TYPE_STRING);
+
+  /**
+   * MS2Client::destroy:
+   * @client: a #MS2Client
+   *
+   * Notifies when a client is going to be destroyed. Usually this happens when
+   * provider goes away.
+   *
+   * User should not use the object, as provider is not present.
+   *
+   * After this, client will be automatically destroyed.
+   **/
+  signals[DESTROY] = g_signal_new ("destroy",
+                                   G_TYPE_FROM_CLASS (klass),
+                                   G_SIGNAL_RUN_LAST | G_SIGNAL_RUN_CLEANUP,
+                                   G_STRUCT_OFFSET (MS2ClientClass, destroy),
+                                   NULL,
+                                   NULL,
+                                   g_cclosure_marshal_VOID__VOID,
+                                   G_TYPE_NONE,
+                                   0);
+}
+
+/* Object init function */
+static void
+ms2_client_init (MS2Client *client)
+{
+  client->priv = MS2_CLIENT_GET_PRIVATE (client);
+  client->priv->proxies = g_hash_table_new (g_str_hash, g_str_equal);
+  client->priv->proxies_lru = g_queue_new ();
+}
+
+/****************** INTERNAL PUBLIC API (NOT TO BE EXPORTED) ******************/
+
+/* Notify destruction of client; client should not use this client any more*/
+void
+ms2_client_notify_destroy (MS2Client *client)
+{
+  g_return_if_fail (MS2_IS_CLIENT (client));
+
+  clear_proxies (client);
+  cache_invalidate (client, NULL);
+  g_signal_emit (client, signals[DESTROY], 0);
+}
+
+/* Notify update of object_path */
+void
+ms2_client_notify_updated (MS2Client *client,
+                           const gchar *object_path)
+{
+  cache_invalidate (client, object_path);
+  g_signal_emit (client, signals[UPDATED], 0, object_path);
+}
+
+/* Converts a listing reply, as given by dbus-glib, into the list returned to
+   users */
+GList *
+ms2_client_results_to_glist (GPtrArray *result)
+{
+  return gptrarray_to_glist (result);
+}
+
+/******************** PUBLIC API ********************/
+
+/**
+ * ms2_client_get_providers:
+ *
+ * Returns a list of running content providers following MediaServer2
+ * specification.
+ *
+ * The list is kept by #MS2Observer, so dbus is not asked on each call; see
+ * ms2_observer_get_providers_async() to obtain it without blocking, and
+ * ms2_observer_list_providers() to include those that dbus can activate.
+ *
+ * Returns: a new @NULL-terminated array of strings
+ **/
+gchar **
+ms2_client_get_providers ()
+{
+  MS2Observer *observer;
+
+  observer = ms2_observer_get_instance ();
+  if (!observer) {
+    return NULL;
+  }
+
+  return ms2_observer_get_providers (observer);
+}
+
+/**
+ * ms2_client_search_all_async:
+ * @query: query to perform
+ * @max_count: maximum number of objects to return from each provider, or 0 for
+ * no limit
+ * @properties: @NULL-terminated array of properties to request for each object
+ * @timeout: milliseconds to wait for each provider, or 0 to wait until it
+ * replies
+ * @func: function to invoke with the objects found by each provider, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when search is finished
+ * @user_data: the data to pass to @func and @callback
+ *
+ * Starts searching @query in all running MediaServer2 providers at the same
+ * time, below their root containers. Providers that dbus could activate are not
+ * started just to search them.
+ *
+ * As soon as a provider replies, @func is invoked with its client and the
+ * objects found, so results can be shown without waiting for slower
+ * providers. The list belongs to the search; add a reference to the elements
+ * to keep them. If @func returns @FALSE, the search is finished without
+ * waiting for the remaining providers.
+ *
+ * Providers that fail to search, or do not reply within @timeout, do not
+ * contribute any object. Requests still in flight when the search is finished
+ * are cancelled, so their replies are not decoded.
+ *
+ * When the search is finished, @callback will be called with @user_data. To
+ * finish the operation, call ms2_client_search_all_finish() with the
+ * #GAsyncResult returned by the @callback.
+ **/
+void
+ms2_client_search_all_async (const gchar *query,
+                             guint max_count,
+                             gchar **properties,
+                             guint timeout,
+                             MS2SearchFunc func,
+                             GAsyncReadyCallback callback,
+                             gpointer user_data)
+{
+  ms2_client_search_all_async_full (query,
+                                    max_count,
+                                    properties,
+                                    timeout,
+                                    func,
+                                    NULL,
+                                    callback,
+                                    user_data);
+}
+
+/**
+ * ms2_client_search_all_async_full:
+ * @query: query to perform
+ * @max_count: maximum number of objects to return from each provider, or 0 for
+ * no limit
+ * @properties: @NULL-terminated array of properties to request for each object
+ * @timeout: milliseconds to wait for each provider, or 0 to wait until it
+ * replies
+ * @func: function to invoke with the objects found by each provider, or @NULL
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when search is finished
+ * @user_data: the data to pass to @func and @callback
+ *
+ * Like ms2_client_search_all_async(), allowing to stop the search with
+ * @cancellable.
+ *
+ * Cancelling drops the requests in flight without waiting for their replies,
+ * and the search finishes with %G_IO_ERROR_CANCELLED, discarding the objects
+ * found so far. It can be cancelled from @func too.
+ **/
+void
+ms2_client_search_all_async_full (const gchar *query,
+                                  guint max_count,
+                                  gchar **properties,
+                                  guint timeout,
+                                  MS2SearchFunc func,
+                                  GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data)
+{
+  MS2Observer *observer;
+  SearchAllData *search;
+
+  g_return_if_fail (query);
+  g_return_if_fail (properties);
+
+  search = g_slice_new0 (SearchAllData);
+  search->ref_count = 1;
+  search->query = g_strdup (query);
+  search->max_count = max_count;
+  search->properties = g_strdupv (properties);
+  search->timeout = timeout;
+  search->func = func;
+  search->user_data = user_data;
+  search->result = g_simple_async_result_new (NULL,
+                                              callback,
+                                              user_data,
+                                              ms2_client_search_all_async);
+  search->hits = g_ptr_array_new_with_free_func ((GDestroyNotify) free_search_hit);
+
+  observer = ms2_observer_get_instance ();
+  if (!observer) {
+    search->completed = TRUE;
+    g_simple_async_result_complete_in_idle (search->result);
+    search_all_unref (search);
+    return;
+  }
+
+  ms2_observer_get_providers_async (observer,
+                                    search_all_providers_reply,
+                                    search);
+
+  if (cancellable) {
+    search->cancellable = g_object_ref (cancellable);
+    search->cancelled_id = g_cancellable_connect (cancellable,
+                                                  G_CALLBACK (search_all_cancelled),
+                                                  search,
+                                                  NULL);
+  }
+}
+
+/**
+ * ms2_client_search_all_finish:
+ * @res: a #GAsyncResult
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Finishes an operation started with ms2_client_search_all_async().
+ *
+ * Objects of all providers are merged: first the best result of each provider,
+ * then the second best of each one, and so on, with providers that replied
+ * earlier going first.
+ *
+ * Returns: a new #GList of #GHashTable. To free it, free first each element
+ * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ **/
+GList *
+ms2_client_search_all_finish (GAsyncResult *res,
+                              GError **error)
+{
+  GList *objects;
+
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
+                        ms2_client_search_all_async, NULL);
+
+  if (g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (res),
+                                             error)) {
+    return NULL;
+  }
+
+  objects = g_list_copy (g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res)));
+  g_list_foreach (objects, (GFunc) g_hash_table_ref, NULL);
+
+  return objects;
+}
+
+/**
+ * ms2_client_new:
+ * @provider: provider name.
+ *
+ * Create a new #MS2Client that will be used to obtain content from the provider
+ * specified.
+ *
+ * Providers can be obtained with ms2_client_get_providers().
+ *
+ * Returns: a new #MS2Client
+ **/
+MS2Client *ms2_client_new (const gchar *provider)
+{
+  DBusGConnection *connection;
+  GError *error = NULL;
+  MS2Client *client;
+
+  connection = dbus_g_bus_get (DBUS_BUS_SESSION, &error);
+  if (!connection) {
+    g_printerr ("Could not connect to session bus, %s\n", error->message);
+    g_clear_error (&error);
+    return NULL;
+  }
+
+  client = g_object_new (MS2_TYPE_CLIENT, NULL);
+  client->priv->bus = connection;
+  client->priv->name = g_strdup (provider);
+  client->priv->fullname = g_strconcat (MS2_DBUS_SERVICE_PREFIX, provider, NULL);
+  client->priv->root_path = g_strconcat (MS2_DBUS_PATH_PREFIX, provider, NULL);
+
+  ms2_observer_add_client (client, provider);
+
+  return client;
+}
+
+/**
+ * ms2_client_get_provider_name:
+ * @client: a #MS2Client
+ *
+ * Returns name of provider which client is attending
+ *
+ * Returns: name of provider
+ **/
+const gchar *
+ms2_client_get_provider_name (MS2Client *client)
+{
+  g_return_val_if_fail (MS2_IS_CLIENT (client), NULL);
+
+  return client->priv->name;
+}
+
+/**
+ * ms2_client_watch_path:
+ * @client: a #MS2Client
+ * @object_path: identifier of object to watch
+ *
+ * Restricts #MS2Client::updated signal to the objects being watched.
+ *
+ * By default, @client is notified of updates in any object of its provider.
+ * Once it watches some object, only updates in watched objects are notified,
+ * and dbus does not wake up the process for updates in other objects, unless
+ * other clients of the same provider are interested in them.
+ **/
+void
+ms2_client_watch_path (MS2Client *client,
+                       const gchar *object_path)
+{
+  g_return_if_fail (MS2_IS_CLIENT (client));
+  g_return_if_fail (object_path);
+
+  ms2_observer_watch_path (client, client->priv->name, object_path);
+}
+
+/**
+ * ms2_client_unwatch_path:
+ * @client: a #MS2Client
+ * @object_path: identifier of object to stop watching
+ *
+ * Stops watching an object watched with ms2_client_watch_path(). When no
+ * object is watched, @client is notified of updates in any object again.
+ **/
+void
+ms2_client_unwatch_path (MS2Client *client,
+                         const gchar *object_path)
+{
+  g_return_if_fail (MS2_IS_CLIENT (client));
+  g_return_if_fail (object_path);
+
+  ms2_observer_unwatch_path (client, client->priv->name, object_path);
+}
+
+/**
+ * ms2_client_set_cache_enabled:
+ * @client: a #MS2Client
+ * @enabled: @TRUE to cache properties
+ *
+ * Enables or disables caching the properties received from provider.
+ *
+ * When enabled, properties obtained with ms2_client_get_properties(),
+ * ms2_client_get_properties_batch() and the listing and searching functions are
+ * kept, and later requests for them are answered without asking the
+ * provider. Cached properties of an object are dropped when the provider
+ * notifies it has been updated, and all of them when provider goes away.
+ *
+ * Disabling the cache drops all cached properties. Cache is disabled by
+ * default.
+ **/
+void
+ms2_client_set_cache_enabled (MS2Client *client,
+                              gboolean enabled)
+{
+  g_return_if_fail (MS2_IS_CLIENT (client));
+
+  if (enabled && !client->priv->cache) {
+    client->priv->cache =
+      g_hash_table_new_full (g_str_hash,
+                             g_str_equal,
+                             (GDestroyNotify) g_free,
+                             (GDestroyNotify) g_hash_table_unref);
+  } else if (!enabled && client->priv->cache) {
+    g_hash_table_unref (client->priv->cache);
+    client->priv->cache = NULL;
+    client->priv->cache_generation++;
+  }
+}
+
+/**
+ * ms2_client_get_cache_enabled:
+ * @client: a #MS2Client
+ *
+ * Checks if properties received from provider are cached.
+ *
+ * Returns: @TRUE if cache is enabled
+ **/
+gboolean
+ms2_client_get_cache_enabled (MS2Client *client)
+{
+  g_return_val_if_fail (MS2_IS_CLIENT (client), FALSE);
+
+  return client->priv->cache != NULL;
+}
+
+/**
+ * ms2_client_get_properties_async:
+ * @client: a #MS2Client
+ * @object_path: media identifier to obtain properties from
+ * @properties: @NULL-terminated array of properties to request
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Starts an asynchronous request of properties.
+ *
+ * For more details, see ms2_client_get_properties(), which is the synchronous
+ * version of this call.
+ *
+ * When the result has been obtained, @callback will be called with
+ * @user_data. To finish the operation, call ms2_client_get_properties_finish()
+ * with the #GAsyncResult returned by the @callback.
+ **/
+void
+ms2_client_get_properties_async (MS2Client *client,
+                                 const gchar *object_path,
+                                 gchar **properties,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
+{
+  ms2_client_get_properties_async_full (client,
+                                        object_path,
+                                        properties,
+                                        -1,
+                                        NULL,
+                                        callback,
+                                        user_data);
+}
+
+/**
+ * ms2_client_get_properties_async_full:
+ * @client: a #MS2Client
+ * @object_path: media identifier to obtain properties from
+ * @properties: @NULL-terminated array of properties to request
+ * @timeout: milliseconds to wait for the reply, or -1 for the default
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Like ms2_client_get_properties_async(), but waiting at most @timeout for the
+ * reply, and allowing to cancel the request with @cancellable.
+ *
+ * Cancelling drops the request without waiting for its reply, so it is
+ * not decoded, and the operation finishes with %G_IO_ERROR_CANCELLED. This
+ * is useful to drop obsolete requests, e.g. when user navigates away before
+ * they are satisfied. If the reply does not arrive in time, the operation
+ * finishes with %G_IO_ERROR_TIMED_OUT.
+ **/
+void
+ms2_client_get_properties_async_full (MS2Client *client,
+                                      const gchar *object_path,
+                                      gchar **properties,
+                                      gint timeout,
+                                      GCancellable *cancellable,
+                                      GAsyncReadyCallback callback,
+                                      gpointer user_data)
+{
+  AsyncData *adata;
+  DBusGProxyCall *call;
+  GPtrArray *paths;
+  GSimpleAsyncResult *res;
+
+  g_return_if_fail (MS2_IS_CLIENT (client));
+  g_return_if_fail (properties);
+
+  res = g_simple_async_result_new (G_OBJECT (client),
+                                   callback,
+                                   user_data,
+                                   ms2_client_get_properties_async);
+  adata = g_slice_new0 (AsyncData);
+  adata->cache_generation = client->priv->cache_generation;
+  g_simple_async_result_set_op_res_gpointer (res,
+                                             adata,
+                                             (GDestroyNotify) free_async_data);
+
+  adata->properties = cache_lookup (client, object_path, properties);
+  if (adata->properties) {
+    g_simple_async_result_complete_in_idle (res);
+    g_object_unref (res);
+    return;
+  }
+
+  adata->object_path = g_strdup (object_path);
+  adata->keys = g_strdupv (properties);
+  adata->timeout = timeout;
+
+  /* An empty filter would mean all properties in GetPropertiesBatch */
+  if (!properties[0] || client->priv->no_properties_batch) {
+    ms2_client_get_properties_split_async (client, res);
+    watch_cancellable (res, cancellable);
+    g_object_unref (res);
+    return;
+  }
+
+  adata->gproxy = get_proxy (client,
+                             client->priv->root_path,
+                             MS2_PROVIDER_IFACE);
+
+  paths = g_ptr_array_new ();
+  g_ptr_array_add (paths, (gpointer) object_path);
+  call = dbus_g_proxy_begin_call_with_timeout (adata->gproxy,
+                                               "GetPropertiesBatch", get_properties_single_reply,
+                                               res, g_object_unref,
+                                               timeout,
+                                               dbus_g_type_get_collection ("GPtrArray",
+                                                                           DBUS_TYPE_G_OBJECT_PATH), paths,
+                                               G_TYPE_STRV, properties,
+                                               G_TYPE_INVALID);
+  adata->calls = g_slist_prepend (adata->calls, call);
+  g_ptr_array_free (paths, TRUE);
+
+  watch_cancellable (res, cancellable);
+}
+
+/**
+ * ms2_client_get_properties_finish:
+ * @client: a #MS2Client
+ * @res: a #GAsyncResult
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Finishes an asynchronous request of properties operation.
+ *
+ * Returns: a new #GHashTable
+ **/
+GHashTable *
+ms2_client_get_properties_finish (MS2Client *client,
+                                  GAsyncResult *res,
+                                  GError **error)
+{
+  AsyncData *adata;
+
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
+                        ms2_client_get_properties_async, NULL);
+
+  adata = g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res));
+
+  /* If there was an error, just return NULL to avoid partially-filled table */
+  if (adata->error) {
+    g_hash_table_unref (adata->properties);
+    adata->properties = NULL;
+    adata->children = NULL;
+  }
+
+  if (error) {
+    *error = adata->error;
+  }
+
+  return adata->properties;
+}
+
+/**
+ * ms2_client_get_properties:
+ * @client: a #MS2Client
+ * @object_path: media identifier to obtain properties from
+ * @properties: @NULL-terminated array of properties to request
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Gets the properties of media id. Properties will be returned in a hash table
+ * of <prop_id, prop_gvalue> pairs.
+ *
+ * All properties are requested in just one round trip, and only those requested
+ * are transferred. Providers not supporting it are asked once per interface
+ * requested properties belong to.
+ *
+ * Returns: a new #GHashTable
+ **/
+GHashTable *
+ms2_client_get_properties (MS2Client *client,
+                           const gchar *object_path,
+                           gchar **properties,
+                           GError **error)
+{
+  GError *single_error = NULL;
+  GHashTable *collected_properties;
+
+  g_return_val_if_fail (MS2_IS_CLIENT (client), NULL);
+  g_return_val_if_fail (properties, NULL);
+
+  collected_properties = cache_lookup (client, object_path, properties);
+  if (collected_properties) {
+    return collected_properties;
+  }
+
+  /* An empty filter would mean all properties in GetPropertiesBatch */
+  if (properties[0] && !client->priv->no_properties_batch) {
+    collected_properties = ms2_client_get_properties_single (client,
+                                                             object_path,
+                                                             properties,
+                                                             &single_error);
+    if (is_unsupported_error (single_error)) {
+      client->priv->no_properties_batch = TRUE;
+      g_clear_error (&single_error);
+    } else if (single_error) {
+      g_propagate_error (error, single_error);
+      return NULL;
+    }
+  }
+
+  /* Ask each interface, so provider reports why properties are missing */
+  if (!collected_properties) {
+    collected_properties = ms2_client_get_properties_split (client,
+                                                            object_path,
+                                                            properties,
+                                                            error);
+  }
+
+  if (collected_properties) {
+    cache_store (client, object_path, collected_properties, properties);
+  }
+
+  return collected_properties;
+}
+
+/**
+ * ms2_client_get_properties_batch_async:
+ * @client: a #MS2Client
+ * @object_paths: @NULL-terminated array of media identifiers to obtain
+ * properties from
+ * @properties: @NULL-terminated array of properties to request
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Starts asynchronously getting the properties of several medias.
+ *
+ * For more details, see ms2_client_get_properties_batch(), which is the
+ * synchronous version of this call.
+ *
+ * When the properties have been obtained, @callback will be called with
+ * @user_data. To finish the operation, call
+ * ms2_client_get_properties_batch_finish() with the #GAsyncResult returned by
+ * the @callback.
+ **/
+void
+ms2_client_get_properties_batch_async (MS2Client *client,
+                                       gchar **object_paths,
+                                       gchar **properties,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data)
+{
+  ms2_client_get_properties_batch_async_full (client,
+                                              object_paths,
+                                              properties,
+                                              -1,
+                                              NULL,
+                                              callback,
+                                              user_data);
+}
+
+/**
+ * ms2_client_get_properties_batch_async_full:
+ * @client: a #MS2Client
+ * @object_paths: @NULL-terminated array of media identifiers to obtain
+ * properties from
+ * @properties: @NULL-terminated array of properties to request
+ * @timeout: milliseconds to wait for the reply, or -1 for the default
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Like ms2_client_get_properties_batch_async(), with a @timeout and a
+ * @cancellable; see ms2_client_get_properties_async_full().
+ **/
+void
+ms2_client_get_properties_batch_async_full (MS2Client *client,
+                                            gchar **object_paths,
+                                            gchar **properties,
+                                            gint timeout,
+                                            GCancellable *cancellable,
+                                            GAsyncReadyCallback callback,
+                                            gpointer user_data)
+{
+  AsyncData *adata;
+  DBusGProxyCall *call;
+  GPtrArray *paths;
+  GSimpleAsyncResult *res;
+
+  g_return_if_fail (MS2_IS_CLIENT (client));
+  g_return_if_fail (object_paths);
+  g_return_if_fail (properties);
+
+  res = g_simple_async_result_new (G_OBJECT (client),
+                                   callback,
+                                   user_data,
+                                   ms2_client_get_properties_batch_async);
+  adata = g_slice_new0 (AsyncData);
+  adata->cache_generation = client->priv->cache_generation;
+  g_simple_async_result_set_op_res_gpointer (res,
+                                             adata,
+                                             (GDestroyNotify) free_async_data);
+
+  adata->children = cache_lookup_batch (client, object_paths, properties);
+  if (adata->children) {
+    g_simple_async_result_complete_in_idle (res);
+    g_object_unref (res);
+    return;
+  }
+
+  adata->object_paths = g_strdupv (object_paths);
+  adata->keys = g_strdupv (properties);
+  adata->gproxy = get_proxy (client,
+                             client->priv->root_path,
+                             MS2_PROVIDER_IFACE);
+
+  paths = strv_to_object_paths (object_paths);
+  call = dbus_g_proxy_begin_call_with_timeout (adata->gproxy,
+                                               "GetPropertiesBatch", list_elements_reply,
+                                               res, g_object_unref,
+                                               timeout,
+                                               dbus_g_type_get_collection ("GPtrArray",
+                                                                           DBUS_TYPE_G_OBJECT_PATH), paths,
+                                               G_TYPE_STRV, properties,
+                                               G_TYPE_INVALID);
+  adata->calls = g_slist_prepend (adata->calls, call);
+  g_ptr_array_free (paths, TRUE);
+
+  watch_cancellable (res, cancellable);
+}
+
+/**
+ * ms2_client_get_properties_batch_finish:
+ * @client: a #MS2Client
+ * @res: a #GAsyncResult
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Finishes an operation started with ms2_client_get_properties_batch_async().
+ *
+ * Returns: a new #GList of #GHashTable, in the same order than the requested
+ * medias. To free it, free first each element (g_hash_table_unref()) and
+ * finally the list itself (g_list_free())
+ **/
+GList *
+ms2_client_get_properties_batch_finish (MS2Client *client,
+                                        GAsyncResult *res,
+                                        GError **error)
+{
+  AsyncData *adata;
+
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
+                        ms2_client_get_properties_batch_async, NULL);
+
+  adata = g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res));
+
+  if (error) {
+    *error = adata->error;
+  }
+
+  return adata->children;
+}
+
+/**
+ * ms2_client_get_properties_batch:
+ * @client: a #MS2Client
+ * @object_paths: @NULL-terminated array of media identifiers to obtain
+ * properties from
+ * @properties: @NULL-terminated array of properties to request
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Gets the properties of several medias in just one request, which provider
+ * can resolve concurrently. Properties of each media will be returned in a hash
+ * table of <prop_id, prop_gvalue> pairs; medias not belonging to provider get
+ * an empty table.
+ *
+ * Providers refuse to handle more than 1024 medias in a request, or requests
+ * whose reply would be too big, failing with a LimitsExceeded error.
+ *
+ * Returns: a new #GList of #GHashTable, in the same order than the requested
+ * medias. To free it, free first each element (g_hash_table_unref()) and
+ * finally the list itself (g_list_free())
+ **/
+GList *
+ms2_client_get_properties_batch (MS2Client *client,
+                                 gchar **object_paths,
+                                 gchar **properties,
+                                 GError **error)
+{
+  DBusGProxy *gproxy;
+  GList *objects = NULL;
+  GPtrArray *paths;
+  GPtrArray *result = NULL;
+
+  g_return_val_if_fail (MS2_IS_CLIENT (client), NULL);
+  g_return_val_if_fail (object_paths, NULL);
+  g_return_val_if_fail (properties, NULL);
+
+  objects = cache_lookup_batch (client, object_paths, properties);
+  if (objects) {
+    return objects;
+  }
+
+  gproxy = get_proxy (client, client->priv->root_path, MS2_PROVIDER_IFACE);
+
+  paths = strv_to_object_paths (object_paths);
+  if (dbus_g_proxy_call (gproxy,
+                         "GetPropertiesBatch", error,
+                         dbus_g_type_get_collection ("GPtrArray",
+                                                     DBUS_TYPE_G_OBJECT_PATH), paths,
+                         G_TYPE_STRV, properties,
+                         G_TYPE_INVALID,
+                         dbus_g_type_get_collection ("GPtrArray",
+                                                     dbus_g_type_get_map ("GHashTable",
+                                                                          G_TYPE_STRING,
+                                                                          G_TYPE_VALUE)), &result,
+                         G_TYPE_INVALID)) {
+    objects = gptrarray_to_glist (result);
+    g_ptr_array_free (result, TRUE);
+    cache_store_batch (client, object_paths, objects, properties);
+  }
+
+  g_ptr_array_free (paths, TRUE);
+  g_object_unref (gproxy);
+
+  return objects;
+}
+
+/**
+ * ms2_client_list_children_async:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get children from
+ * @offset: number of children to skip
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Starts an asynchronous list children.
+ *
+ * For more details, see ms2_client_list_children(), which is the synchronous
+ * version of this call.
+ *
+ * When the children have been obtained, @callback will be called with
+ * @user_data. To finish the operation, call ms2_client_list_children_finish()
+ * with the #GAsyncResult returned by the @callback.
+ **/
+void
+ms2_client_list_children_async (MS2Client *client,
+                                const gchar *object_path,
+                                guint offset,
+                                guint max_count,
+                                gchar **properties,
+                                GAsyncReadyCallback callback,
+                                gpointer user_data)
+{
+  ms2_client_list_children_async_full (client,
+                                       object_path,
+                                       offset,
+                                       max_count,
+                                       properties,
+                                       -1,
+                                       NULL,
+                                       callback,
+                                       user_data);
+}
+
+/**
+ * ms2_client_list_children_async_full:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get children from
+ * @offset: number of children to skip
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @timeout: milliseconds to wait for the reply, or -1 for the default
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Like ms2_client_list_children_async(), with a @timeout and a @cancellable;
+ * see ms2_client_get_properties_async_full().
+ **/
+void
+ms2_client_list_children_async_full (MS2Client *client,
+                                     const gchar *object_path,
+                                     guint offset,
+                                     guint max_count,
+                                     gchar **properties,
+                                     gint timeout,
+                                     GCancellable *cancellable,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data)
+{
+  ms2_client_list_elements_async (client,
+                                  "ListChildren",
+                                  object_path,
+                                  NULL,
+                                  offset,
+                                  max_count,
+                                  properties,
+                                  timeout,
+                                  cancellable,
+                                  callback,
+                                  user_data,
+                                  ms2_client_list_elements_async);
+}
+
+/**
+ * ms2_client_list_children_finish:
+ * @client: a #MS2Client
+ * @res: a #GAsyncResult
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Finishes an asynchronous listing children operation.
+ *
+ * Returns: a new #GList of #GHashTAble. To free it, free first each element
+ * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ **/
+GList *
+ms2_client_list_children_finish (MS2Client *client,
+                                 GAsyncResult *res,
+                                 GError **error)
+{
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
+                        ms2_client_list_elements_async, NULL);
+
+  return ms2_client_list_elements_finish (client, res, error);
+}
+
+/**
+ * ms2_client_list_children:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get children from
+ * @offset: number of children to skip
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Gets the list of children directly under the container id. Each child consist
+ * of a hash table of <prop_id, prop_gvalue> pairs.
+ *
+ * Returns: a new #GList of #GHashTable. To free it, free first each element
+ * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ **/
+GList *
+ms2_client_list_children (MS2Client *client,
+                          const gchar *object_path,
+                          guint offset,
+                          guint max_count,
+                          gchar **properties,
+                          GError **error)
+{
+  return ms2_client_list_elements (client,
+                                   "ListChildren",
+                                   object_path,
+                                   NULL,
+                                   offset,
+                                   max_count,
+                                   properties,
+                                   error);
+}
+
+/**
+ * ms2_client_list_containers_async:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get containers from
+ * @offset: number of containers to skip
+ * @max_count: maximum number of containers to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each container
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Starts an asynchronous list containers.
+ *
+ * For more details, see ms2_client_list_containers(), which is the synchronous
+ * version of this call.
+ *
+ * When the containers have been obtained, @callback will be called with
+ * @user_data. To finish the operation, call ms2_client_list_containers_finish()
+ * with the #GAsyncResult returned by the @callback.
+ **/
+void
+ms2_client_list_containers_async (MS2Client *client,
+                                  const gchar *object_path,
+                                  guint offset,
+                                  guint max_count,
+                                  gchar **properties,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data)
+{
+  ms2_client_list_containers_async_full (client,
+                                         object_path,
+                                         offset,
+                                         max_count,
+                                         properties,
+                                         -1,
+                                         NULL,
+                                         callback,
+                                         user_data);
+}
+
+/**
+ * ms2_client_list_containers_async_full:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get containers from
+ * @offset: number of containers to skip
+ * @max_count: maximum number of containers to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each container
+ * @timeout: milliseconds to wait for the reply, or -1 for the default
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Like ms2_client_list_containers_async(), with a @timeout and a @cancellable;
+ * see ms2_client_get_properties_async_full().
+ **/
+void
+ms2_client_list_containers_async_full (MS2Client *client,
+                                       const gchar *object_path,
+                                       guint offset,
+                                       guint max_count,
+                                       gchar **properties,
+                                       gint timeout,
+                                       GCancellable *cancellable,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data)
+{
+  ms2_client_list_elements_async (client,
+                                  "ListContainers",
+                                  object_path,
+                                  NULL,
+                                  offset,
+                                  max_count,
+                                  properties,
+                                  timeout,
+                                  cancellable,
+                                  callback,
+                                  user_data,
+                                  ms2_client_list_elements_async);
+}
+
+/**
+ * ms2_client_list_containers_finish:
+ * @client: a #MS2Client
+ * @res: a #GAsyncResult
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Finishes an asynchronous listing containers operation.
+ *
+ * Returns: a new #GList of #GHashTAble. To free it, free first each element
+ * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ **/
+GList *
+ms2_client_list_containers_finish (MS2Client *client,
+                                   GAsyncResult *res,
+                                   GError **error)
+{
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
+                        ms2_client_list_elements_async, NULL);
+
+  return ms2_client_list_elements_finish (client, res, error);
+}
+
+/**
+ * ms2_client_list_containers:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get containers from
+ * @offset: number of containers to skip
+ * @max_count: maximum number of containers to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each container
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Gets the list of containers directly under the container id. Each container
+ * consist of a hash table of <prop_id, prop_gvalue> pairs.
+ *
+ * Returns: a new #GList of #GHashTable. To free it, free first each element
+ * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ **/
+GList *
+ms2_client_list_containers (MS2Client *client,
+                          const gchar *object_path,
+                          guint offset,
+                          guint max_count,
+                          gchar **properties,
+                          GError **error)
+{
+  return ms2_client_list_elements (client,
+                                   "ListContainers",
+                                   object_path,
+                                   NULL,
+                                   offset,
+                                   max_count,
+                                   properties,
+                                   error);
+}
+
+/**
+ * ms2_client_list_items_async:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get items from
+ * @offset: number of items to skip
+ * @max_count: maximum number of items to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each item
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Starts an asynchronous list items.
+ *
+ * For more details, see ms2_client_list_items(), which is the synchronous
+ * version of this call.
+ *
+ * When the items have been obtained, @callback will be called with
+ * @user_data. To finish the operation, call ms2_client_list_items_finish() with
+ * the #GAsyncResult returned by the @callback.
+ **/
+void
+ms2_client_list_items_async (MS2Client *client,
+                             const gchar *object_path,
+                             guint offset,
+                             guint max_count,
+                             gchar **properties,
+                             GAsyncReadyCallback callback,
+                             gpointer user_data)
+{
+  ms2_client_list_items_async_full (client,
+                                    object_path,
+                                    offset,
+                                    max_count,
+                                    properties,
+                                    -1,
+                                    NULL,
+                                    callback,
+                                    user_data);
+}
+
+/**
+ * ms2_client_list_items_async_full:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get items from
+ * @offset: number of items to skip
+ * @max_count: maximum number of items to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each item
+ * @timeout: milliseconds to wait for the reply, or -1 for the default
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Like ms2_client_list_items_async(), with a @timeout and a @cancellable; see
+ * ms2_client_get_properties_async_full().
+ **/
+void
+ms2_client_list_items_async_full (MS2Client *client,
+                                  const gchar *object_path,
+                                  guint offset,
+                                  guint max_count,
+                                  gchar **properties,
+                                  gint timeout,
+                                  GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data)
+{
+  ms2_client_list_elements_async (client,
+                                  "ListItems",
+                                  object_path,
+                                  NULL,
+                                  offset,
+                                  max_count,
+                                  properties,
+                                  timeout,
+                                  cancellable,
+                                  callback,
+                                  user_data,
+                                  ms2_client_list_elements_async);
+}
+
+/**
+ * ms2_client_list_items_finish:
+ * @client: a #MS2Client
+ * @res: a #GAsyncResult
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Finishes an asynchronous listing items operation.
+ *
+ * Returns: a new #GList of #GHashTAble. To free it, free first each element
+ * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ **/
+GList *
+ms2_client_list_items_finish (MS2Client *client,
+                              GAsyncResult *res,
+                              GError **error)
+{
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
+                        ms2_client_list_elements_async, NULL);
+
+  return ms2_client_list_elements_finish (client, res, error);
+}
+
+/**
+ * ms2_client_list_items:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get items from
+ * @offset: number of items to skip
+ * @max_count: maximum number of items to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each item
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Gets the list of items directly under the container id. Each item consist of
+ * a hash table of <prop_id, prop_gvalue> pairs.
+ *
+ * Returns: a new #GList of #GHashTable. To free it, free first each element
+ * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ **/
+GList *
+ms2_client_list_items (MS2Client *client,
+                       const gchar *object_path,
+                       guint offset,
+                       guint max_count,
+                       gchar **properties,
+                       GError **error)
+{
+  return ms2_client_list_elements (client,
+                                   "ListItems",
+                                   object_path,
+                                   NULL,
+                                   offset,
+                                   max_count,
+                                   properties,
+                                   error);
+}
+
+/**
+ * ms2_client_search_objects_async:
+ * @client: a #MS2Client
+ * @object_path: container identifier to start search from
+ * @query: query to perform
+ * @offset: number of children to skip
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Starts an asynchronous search.
+ *
+ * For more details, see ms2_client_search_objects(), which is the synchronous
+ * version of this call.
+ *
+ * When the result has been obtained, @callback will be called with
+ * @user_data. To finish the operation, call ms2_client_search_objects_finish()
+ * with the #GAsyncResult returned by the @callback.
+ **/
+void
+ms2_client_search_objects_async (MS2Client *client,
+                                 const gchar *object_path,
+                                 const gchar *query,
+                                 guint offset,
+                                 guint max_count,
+                                 gchar **properties,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
+{
+  ms2_client_search_objects_async_full (client,
+                                        object_path,
+                                        query,
+                                        offset,
+                                        max_count,
+                                        properties,
+                                        -1,
+                                        NULL,
+                                        callback,
+                                        user_data);
+}
+
+/**
+ * ms2_client_search_objects_async_full:
+ * @client: a #MS2Client
+ * @object_path: container identifier to start search from
+ * @query: query to perform
+ * @offset: number of children to skip
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @timeout: milliseconds to wait for the reply, or -1 for the default
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Like ms2_client_search_objects_async(), with a @timeout and a @cancellable;
+ * see ms2_client_get_properties_async_full().
+ **/
+void
+ms2_client_search_objects_async_full (MS2Client *client,
+                                      const gchar *object_path,
+                                      const gchar *query,
+                                      guint offset,
+                                      guint max_count,
+                                      gchar **properties,
+                                      gint timeout,
+                                      GCancellable *cancellable,
+                                      GAsyncReadyCallback callback,
+                                      gpointer user_data)
+{
+  ms2_client_list_elements_async (client,
+                                  "SearchObjects",
+                                  object_path,
+                                  query,
+                                  offset,
+                                  max_count,
+                                  properties,
+                                  timeout,
+                                  cancellable,
+                                  callback,
+                                  user_data,
+                                  ms2_client_search_objects_async);
+}
+
+
+/**
+ * ms2_client_search_objects_finish:
+ * @client: a #MS2Client
+ * @res: a #GAsyncResult
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Finishes an asynchronous search operation.
+ *
+ * Returns: a new #GList of #GHashTAble. To free it, free first each element
+ * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ **/
+GList *
+ms2_client_search_objects_finish (MS2Client *client,
+                                  GAsyncResult *res,
+                                  GError **error)
+{
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
+                        ms2_client_search_objects_async, NULL);
+
+  return ms2_client_list_elements_finish (client, res, error);
+}
+
+/**
+ * ms2_client_search_objects:
+ * @client: a #MS2Client
+ * @object_path: container identifier to start search fromç
+ * @query: query to perform
+ * @offset: number of children to skip
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Searchs for children below this container. Each child consist
+ * of a hash table of <prop_id, prop_gvalue> pairs.
+ *
+ * Returns: a new #GList of #GHashTable. To free it, free first each element
+ * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ **/
+GList *
+ms2_client_search_objects (MS2Client *client,
+                           const gchar *object_path,
+                           const gchar *query,
+                           guint offset,
+                           guint max_count,
+                           gchar **properties,
+                           GError **error)
+{
+  return ms2_client_list_elements (client,
+                                   "SearchObjects",
+                                   object_path,
+                                   query,
+                                   offset,
+                                   max_count,
+                                   properties,
+                                   error);
+}
+
+/**
+ * ms2_client_list_children_set_async:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get children from
+ * @offset: number of children to skip
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Starts an asynchronous list children, returning them as a #MS2ResultSet.
+ *
+ * For more details, see ms2_client_list_children_set(), which is the
+ * synchronous version of this call.
+ *
+ * When the children have been obtained, @callback will be called with
+ * @user_data. To finish the operation, call
+ * ms2_client_list_children_set_finish() with the #GAsyncResult returned by the
+ * @callback.
+ **/
+void
+ms2_client_list_children_set_async (MS2Client *client,
+                                    const gchar *object_path,
+                                    guint offset,
+                                    guint max_count,
+                                    gchar **properties,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data)
+{
+  ms2_client_list_children_set_async_full (client,
+                                           object_path,
+                                           offset,
+                                           max_count,
+                                           properties,
+                                           -1,
+                                           NULL,
+                                           callback,
+                                           user_data);
+}
+
+/**
+ * ms2_client_list_children_set_async_full:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get children from
+ * @offset: number of children to skip
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @timeout: milliseconds to wait for the reply, or -1 for the default
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Like ms2_client_list_children_set_async(), with a @timeout and a
+ * @cancellable; see ms2_client_get_properties_async_full().
+ **/
+void
+ms2_client_list_children_set_async_full (MS2Client *client,
+                                         const gchar *object_path,
+                                         guint offset,
+                                         guint max_count,
+                                         gchar **properties,
+                                         gint timeout,
+                                         GCancellable *cancellable,
+                                         GAsyncReadyCallback callback,
+                                         gpointer user_data)
+{
+  g_return_if_fail (MS2_IS_CLIENT (client));
+  g_return_if_fail (properties);
+
+  ms2_client_list_set_async (client,
+                             "ListChildren",
+                             object_path,
+                             NULL,
+                             offset,
+                             max_count,
+                             properties,
+                             timeout,
+                             cancellable,
+                             callback,
+                             user_data,
+                             ms2_client_list_children_set_async);
+}
+
 /**
- * ms2_client_get_properties_finish:
+ * ms2_client_list_children_set_finish:
  * @client: a #MS2Client
  * @res: a #GAsyncResult
  * @error: a #GError location to store the error ocurring, or @NULL to ignore
  *
- * Finishes an asynchronous request of properties operation.
+ * Finishes an asynchronous listing children operation.
  *
- * Returns: a new #GHashTable
+ * Returns: a new #MS2ResultSet, or @NULL on error. Use ms2_result_set_unref()
+ * to free it
  **/
-GHashTable *
-ms2_client_get_properties_finish (MS2Client *client,
-                                  GAsyncResult *res,
-                                  GError **error)
+MS2ResultSet *
+ms2_client_list_children_set_finish (MS2Client *client,
+                                     GAsyncResult *res,
+                                     GError **error)
 {
-  AsyncData *adata;
-
   g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
-                        ms2_client_get_properties_async, NULL);
-
-  adata = g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res));
-
-  /* If there was an error, just return NULL to avoid partially-filled table */
-  if (adata->error) {
-    g_hash_table_unref (adata->properties);
-    adata->properties = NULL;
-    adata->children = NULL;
-  }
-
-  if (error) {
-    *error = adata->error;
-  }
+                        ms2_client_list_children_set_async, NULL);
 
-  return adata->properties;
+  return ms2_client_list_set_finish (client, res, error);
 }
 
 /**
- * ms2_client_get_properties:
+ * ms2_client_list_children_set:
  * @client: a #MS2Client
- * @object_path: media identifier to obtain properties from
- * @properties: @NULL-terminated array of properties to request
+ * @object_path: container identifier to get children from
+ * @offset: number of children to skip
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
  * @error: a #GError location to store the error ocurring, or @NULL to ignore
  *
- * Gets the properties of media id. Properties will be returned in a hash table
- * of <prop_id, prop_gvalue> pairs.
+ * Gets the children directly under the container id, like
+ * ms2_client_list_children(). Children are decoded straight from the reply into
+ * a compact #MS2ResultSet, without creating a hash table and #GValue for each
+ * child and property, so this is the preferred call for large listings.
  *
- * Returns: a new #GHashTable
+ * Only MediaServer2 properties holding strings, object paths, integers,
+ * booleans or arrays of strings are kept; use ms2_client_list_children() to get
+ * any other value.
+ *
+ * Returns: a new #MS2ResultSet, or @NULL on error. Use ms2_result_set_unref()
+ * to free it
  **/
-GHashTable *
-ms2_client_get_properties (MS2Client *client,
-                           const gchar *object_path,
-                           gchar **properties,
-                           GError **error)
+MS2ResultSet *
+ms2_client_list_children_set (MS2Client *client,
+                              const gchar *object_path,
+                              guint offset,
+                              guint max_count,
+                              gchar **properties,
+                              GError **error)
 {
-  DBusGProxy *gproxy;
-  GHashTable *collected_properties;
-  GHashTable *prop_result;
-  GValue *v;
-  gboolean error_happened = FALSE;
-  gchar ***prop_by_iface;
-  gchar **prop;
-  gint i;
-  gint num_props;
-  gpointer prop_result_key;
-  gpointer prop_result_value;
-
   g_return_val_if_fail (MS2_IS_CLIENT (client), NULL);
   g_return_val_if_fail (properties, NULL);
 
-  gproxy = dbus_g_proxy_new_for_name (client->priv->bus,
-                                      client->priv->fullname,
-                                      object_path,
-                                      "org.freedesktop.DBus.Properties");
-
-  collected_properties = g_hash_table_new_full (g_str_hash,
-                                                g_str_equal,
-                                                (GDestroyNotify) g_free,
-                                                (GDestroyNotify) free_gvalue);
-
-  prop_by_iface = split_properties_by_interface (properties);
-  for (i = 0; i < 3; i++) {
-    num_props = g_strv_length (prop_by_iface[i]);
-    /* If only one property is required, then invoke "Get" method */
-    if (num_props == 1) {
-      v = g_new0 (GValue, 1);
-      if (dbus_g_proxy_call (gproxy,
-                             "Get", error,
-                             G_TYPE_STRING, IFACES[i],
-                             G_TYPE_STRING, prop_by_iface[i][0],
-                             G_TYPE_INVALID,
-                             G_TYPE_VALUE, v,
-                             G_TYPE_INVALID)) {
-        g_hash_table_insert (collected_properties,
-                             g_strdup (prop_by_iface[i][0]),
-                             v);
-      } else {
-        error_happened = TRUE;
-        break;
-      }
-    } else if (num_props > 1) {
-      /* If several properties are required, use "GetAll" method */
-      if (dbus_g_proxy_call (gproxy,
-                             "GetAll", error,
-                             G_TYPE_STRING, IFACES[i],
-                             G_TYPE_INVALID,
-                             dbus_g_type_get_map ("GHashTable",
-                                                  G_TYPE_STRING,
-                                                  G_TYPE_VALUE), &prop_result,
-                            G_TYPE_INVALID)) {
-        /* Get only requested keys */
-        for (prop = prop_by_iface[i]; *prop; prop++) {
-          if (g_hash_table_lookup_extended (prop_result,
-                                            *prop,
-                                            &prop_result_key,
-                                            &prop_result_value)) {
-            g_hash_table_insert (collected_properties,
-                                 prop_result_key,
-                                 prop_result_value);
-            g_hash_table_steal (prop_result, *prop);
-          }
-        }
-        g_hash_table_unref (prop_result);
-      } else {
-        error_happened = TRUE;
-        break;
-      }
-    }
-  }
-
-  g_object_unref (gproxy);
-
-  g_free (prop_by_iface[0]);
-  g_free (prop_by_iface[1]);
-  g_free (prop_by_iface[2]);
-  g_free (prop_by_iface);
-
-  if (error_happened) {
-    if (collected_properties) {
-      g_hash_table_unref (collected_properties);
-    }
-    return NULL;
-  } else {
-    return collected_properties;
-  }
+  return ms2_client_list_set (client,
+                              "ListChildren",
+                              object_path,
+                              NULL,
+                              offset,
+                              max_count,
+                              properties,
+                              error);
 }
 
 /**
- * ms2_client_list_children_async:
+ * ms2_client_search_objects_set_async:
  * @client: a #MS2Client
- * @object_path: container identifier to get children from
+ * @object_path: container identifier to start search from
+ * @query: query to perform
  * @offset: number of children to skip
  * @max_count: maximum number of children to return, or 0 for no limit
  * @properties: @NULL-terminated array of properties to request for each child
  * @callback: a #GAsyncReadyCallback to call when request is satisfied
  * @user_data: the data to pass to callback function
  *
- * Starts an asynchronous list children.
+ * Starts an asynchronous search, returning the result as a #MS2ResultSet.
  *
- * For more details, see ms2_client_list_children(), which is the synchronous
- * version of this call.
+ * For more details, see ms2_client_search_objects_set(), which is the
+ * synchronous version of this call.
  *
- * When the children have been obtained, @callback will be called with
- * @user_data. To finish the operation, call ms2_client_list_children_finish()
- * with the #GAsyncResult returned by the @callback.
+ * When the result has been obtained, @callback will be called with
+ * @user_data. To finish the operation, call
+ * ms2_client_search_objects_set_finish() with the #GAsyncResult returned by the
+ * @callback.
  **/
 void
-ms2_client_list_children_async (MS2Client *client,
-                                const gchar *object_path,
-                                guint offset,
-                                guint max_count,
-                                gchar **properties,
-                                GAsyncReadyCallback callback,
-                                gpointer user_data)
+ms2_client_search_objects_set_async (MS2Client *client,
+                                     const gchar *object_path,
+                                     const gchar *query,
+                                     guint offset,
+                                     guint max_count,
+                                     gchar **properties,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data)
 {
-  ms2_client_list_elements_async (client,
-                                  "ListChildren",
-                                  object_path,
-                                  offset,
-                                  max_count,
-                                  properties,
-                                  callback,
-                                  user_data);
+  ms2_client_search_objects_set_async_full (client,
+                                            object_path,
+                                            query,
+                                            offset,
+                                            max_count,
+                                            properties,
+                                            -1,
+                                            NULL,
+                                            callback,
+                                            user_data);
 }
 
 /**
- * ms2_client_list_children_finish:
+ * ms2_client_search_objects_set_async_full:
+ * @client: a #MS2Client
+ * @object_path: container identifier to start search from
+ * @query: query to perform
+ * @offset: number of children to skip
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @timeout: milliseconds to wait for the reply, or -1 for the default
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Like ms2_client_search_objects_set_async(), with a @timeout and a
+ * @cancellable; see ms2_client_get_properties_async_full().
+ **/
+void
+ms2_client_search_objects_set_async_full (MS2Client *client,
+                                          const gchar *object_path,
+                                          const gchar *query,
+                                          guint offset,
+                                          guint max_count,
+                                          gchar **properties,
+                                          gint timeout,
+                                          GCancellable *cancellable,
+                                          GAsyncReadyCallback callback,
+                                          gpointer user_data)
+{
+  g_return_if_fail (MS2_IS_CLIENT (client));
+  g_return_if_fail (query);
+  g_return_if_fail (properties);
+
+  ms2_client_list_set_async (client,
+                             "SearchObjects",
+                             object_path,
+                             query,
+                             offset,
+                             max_count,
+                             properties,
+                             timeout,
+                             cancellable,
+                             callback,
+                             user_data,
+                             ms2_client_search_objects_set_async);
+}
+
+/**
+ * ms2_client_search_objects_set_finish:
  * @client: a #MS2Client
  * @res: a #GAsyncResult
  * @error: a #GError location to store the error ocurring, or @NULL to ignore
  *
- * Finishes an asynchronous listing children operation.
+ * Finishes an asynchronous search operation.
  *
- * Returns: a new #GList of #GHashTAble. To free it, free first each element
- * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ * Returns: a new #MS2ResultSet, or @NULL on error. Use ms2_result_set_unref()
+ * to free it
  **/
-GList *
-ms2_client_list_children_finish (MS2Client *client,
-                                 GAsyncResult *res,
-                                 GError **error)
+MS2ResultSet *
+ms2_client_search_objects_set_finish (MS2Client *client,
+                                      GAsyncResult *res,
+                                      GError **error)
 {
-  return ms2_client_list_elements_finish (client, res, error);
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
+                        ms2_client_search_objects_set_async, NULL);
+
+  return ms2_client_list_set_finish (client, res, error);
 }
 
 /**
- * ms2_client_list_children:
+ * ms2_client_search_objects_set:
  * @client: a #MS2Client
- * @object_path: container identifier to get children from
+ * @object_path: container identifier to start search from
+ * @query: query to perform
  * @offset: number of children to skip
  * @max_count: maximum number of children to return, or 0 for no limit
  * @properties: @NULL-terminated array of properties to request for each child
  * @error: a #GError location to store the error ocurring, or @NULL to ignore
  *
- * Gets the list of children directly under the container id. Each child consist
- * of a hash table of <prop_id, prop_gvalue> pairs.
+ * Searchs for children below this container, like ms2_client_search_objects(),
+ * returning them as a compact #MS2ResultSet. As with
+ * ms2_client_list_children_set(), values of other types or properties are not
+ * kept.
  *
- * Returns: a new #GList of #GHashTable. To free it, free first each element
- * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ * Returns: a new #MS2ResultSet, or @NULL on error. Use ms2_result_set_unref()
+ * to free it
  **/
-GList *
-ms2_client_list_children (MS2Client *client,
-                          const gchar *object_path,
-                          guint offset,
-                          guint max_count,
-                          gchar **properties,
-                          GError **error)
+MS2ResultSet *
+ms2_client_search_objects_set (MS2Client *client,
+                               const gchar *object_path,
+                               const gchar *query,
+                               guint offset,
+                               guint max_count,
+                               gchar **properties,
+                               GError **error)
 {
-  return ms2_client_list_elements (client,
-                                   "ListChildren",
-                                   object_path,
-                                   offset,
-                                   max_count,
-                                   properties,
-                                   error);
+  g_return_val_if_fail (MS2_IS_CLIENT (client), NULL);
+  g_return_val_if_fail (query, NULL);
+  g_return_val_if_fail (properties, NULL);
+
+  return ms2_client_list_set (client,
+                              "SearchObjects",
+                              object_path,
+                              query,
+                              offset,
+                              max_count,
+                              properties,
+                              error);
 }
 
 /**
- * ms2_client_list_containers_async:
+ * ms2_client_list_children_cursor_async:
  * @client: a #MS2Client
- * @object_path: container identifier to get containers from
- * @offset: number of containers to skip
- * @max_count: maximum number of containers to return, or 0 for no limit
- * @properties: @NULL-terminated array of properties to request for each container
+ * @object_path: container identifier to get children from
+ * @cursor: cursor returned by a previous call, or @NULL to start from the first
+ * child
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
  * @callback: a #GAsyncReadyCallback to call when request is satisfied
  * @user_data: the data to pass to callback function
  *
- * Starts an asynchronous list containers.
+ * Starts an asynchronous list children from a cursor.
  *
- * For more details, see ms2_client_list_containers(), which is the synchronous
- * version of this call.
+ * For more details, see ms2_client_list_children_cursor(), which is the
+ * synchronous version of this call.
  *
- * When the containers have been obtained, @callback will be called with
- * @user_data. To finish the operation, call ms2_client_list_containers_finish()
- * with the #GAsyncResult returned by the @callback.
+ * When the children have been obtained, @callback will be called with
+ * @user_data. To finish the operation, call
+ * ms2_client_list_children_cursor_finish() with the #GAsyncResult returned by
+ * the @callback.
  **/
 void
-ms2_client_list_containers_async (MS2Client *client,
-                                  const gchar *object_path,
-                                  guint offset,
-                                  guint max_count,
-                                  gchar **properties,
-                                  GAsyncReadyCallback callback,
-                                  gpointer user_data)
+ms2_client_list_children_cursor_async (MS2Client *client,
+                                       const gchar *object_path,
+                                       const gchar *cursor,
+                                       guint max_count,
+                                       gchar **properties,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data)
 {
-  ms2_client_list_elements_async (client,
-                                  "ListContainers",
+  ms2_client_list_children_cursor_async_full (client,
+                                              object_path,
+                                              cursor,
+                                              max_count,
+                                              properties,
+                                              -1,
+                                              NULL,
+                                              callback,
+                                              user_data);
+}
+
+/**
+ * ms2_client_list_children_cursor_async_full:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get children from
+ * @cursor: cursor returned by a previous call, or @NULL to start from the first
+ * child
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @timeout: milliseconds to wait for the reply, or -1 for the default
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Like ms2_client_list_children_cursor_async(), with a @timeout and a
+ * @cancellable; see ms2_client_get_properties_async_full().
+ **/
+void
+ms2_client_list_children_cursor_async_full (MS2Client *client,
+                                            const gchar *object_path,
+                                            const gchar *cursor,
+                                            guint max_count,
+                                            gchar **properties,
+                                            gint timeout,
+                                            GCancellable *cancellable,
+                                            GAsyncReadyCallback callback,
+                                            gpointer user_data)
+{
+  ms2_client_children_from_async (client,
                                   object_path,
-                                  offset,
+                                  NULL,
+                                  cursor,
                                   max_count,
                                   properties,
+                                  timeout,
+                                  cancellable,
                                   callback,
                                   user_data);
 }
 
 /**
- * ms2_client_list_containers_finish:
+ * ms2_client_list_children_cursor_finish:
  * @client: a #MS2Client
  * @res: a #GAsyncResult
+ * @next_cursor: (out) (allow-none): location to store the cursor pointing to
+ * next page, or @NULL to ignore
  * @error: a #GError location to store the error ocurring, or @NULL to ignore
  *
- * Finishes an asynchronous listing containers operation.
+ * Finishes an asynchronous listing children from a cursor operation.
  *
  * Returns: a new #GList of #GHashTAble. To free it, free first each element
  * (g_hash_table_unref()) and finally the list itself (g_list_free())
  **/
-GList *
-ms2_client_list_containers_finish (MS2Client *client,
-                                   GAsyncResult *res,
-                                   GError **error)
+GList *
+ms2_client_list_children_cursor_finish (MS2Client *client,
+                                        GAsyncResult *res,
+                                        gchar **next_cursor,
+                                        GError **error)
 {
-  return ms2_client_list_elements_finish (client, res, error);
+  return ms2_client_children_from_finish (client, res, next_cursor, error);
 }
 
 /**
- * ms2_client_list_containers:
+ * ms2_client_list_children_cursor:
  * @client: a #MS2Client
- * @object_path: container identifier to get containers from
- * @offset: number of containers to skip
- * @max_count: maximum number of containers to return, or 0 for no limit
- * @properties: @NULL-terminated array of properties to request for each container
+ * @object_path: container identifier to get children from
+ * @cursor: cursor returned by a previous call, or @NULL to start from the first
+ * child
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @next_cursor: (out) (allow-none): location to store the cursor pointing to
+ * next page, or @NULL to ignore
  * @error: a #GError location to store the error ocurring, or @NULL to ignore
  *
- * Gets the list of containers directly under the container id. Each container
- * consist of a hash table of <prop_id, prop_gvalue> pairs.
+ * Gets a page of children directly under the container id. Unlike
+ * ms2_client_list_children(), pages are chained with an opaque cursor, which
+ * lets the provider continue from where previous page finished instead of
+ * skipping the elements already returned.
+ *
+ * @next_cursor is set to @NULL when there are no more children; otherwise it
+ * must be freed with g_free().
  *
  * Returns: a new #GList of #GHashTable. To free it, free first each element
  * (g_hash_table_unref()) and finally the list itself (g_list_free())
  **/
 GList *
-ms2_client_list_containers (MS2Client *client,
-                          const gchar *object_path,
-                          guint offset,
-                          guint max_count,
-                          gchar **properties,
-                          GError **error)
+ms2_client_list_children_cursor (MS2Client *client,
+                                 const gchar *object_path,
+                                 const gchar *cursor,
+                                 guint max_count,
+                                 gchar **properties,
+                                 gchar **next_cursor,
+                                 GError **error)
 {
-  return ms2_client_list_elements (client,
-                                   "ListContainers",
+  return ms2_client_children_from (client,
                                    object_path,
-                                   offset,
+                                   NULL,
+                                   cursor,
                                    max_count,
                                    properties,
+                                   next_cursor,
                                    error);
 }
 
 /**
- * ms2_client_list_items_async:
+ * ms2_client_search_objects_cursor_async:
  * @client: a #MS2Client
- * @object_path: container identifier to get items from
- * @offset: number of items to skip
- * @max_count: maximum number of items to return, or 0 for no limit
- * @properties: @NULL-terminated array of properties to request for each item
+ * @object_path: container identifier to start search from
+ * @query: query to perform
+ * @cursor: cursor returned by a previous call, or @NULL to start from the first
+ * result
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
  * @callback: a #GAsyncReadyCallback to call when request is satisfied
  * @user_data: the data to pass to callback function
  *
- * Starts an asynchronous list items.
+ * Starts an asynchronous search from a cursor.
  *
- * For more details, see ms2_client_list_items(), which is the synchronous
- * version of this call.
+ * For more details, see ms2_client_search_objects_cursor(), which is the
+ * synchronous version of this call.
  *
- * When the items have been obtained, @callback will be called with
- * @user_data. To finish the operation, call ms2_client_list_items_finish() with
- * the #GAsyncResult returned by the @callback.
+ * When the result has been obtained, @callback will be called with
+ * @user_data. To finish the operation, call
+ * ms2_client_search_objects_cursor_finish() with the #GAsyncResult returned by
+ * the @callback.
  **/
 void
-ms2_client_list_items_async (MS2Client *client,
-                             const gchar *object_path,
-                             guint offset,
-                             guint max_count,
-                             gchar **properties,
-                             GAsyncReadyCallback callback,
-                             gpointer user_data)
+ms2_client_search_objects_cursor_async (MS2Client *client,
+                                        const gchar *object_path,
+                                        const gchar *query,
+                                        const gchar *cursor,
+                                        guint max_count,
+                                        gchar **properties,
+                                        GAsyncReadyCallback callback,
+                                        gpointer user_data)
 {
-  ms2_client_list_elements_async (client,
-                                  "ListItems",
+  ms2_client_search_objects_cursor_async_full (client,
+                                               object_path,
+                                               query,
+                                               cursor,
+                                               max_count,
+                                               properties,
+                                               -1,
+                                               NULL,
+                                               callback,
+                                               user_data);
+}
+
+/**
+ * ms2_client_search_objects_cursor_async_full:
+ * @client: a #MS2Client
+ * @object_path: container identifier to start search from
+ * @query: query to perform
+ * @cursor: cursor returned by a previous call, or @NULL to start from the first
+ * result
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @timeout: milliseconds to wait for the reply, or -1 for the default
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when request is satisfied
+ * @user_data: the data to pass to callback function
+ *
+ * Like ms2_client_search_objects_cursor_async(), with a @timeout and a
+ * @cancellable; see ms2_client_get_properties_async_full().
+ **/
+void
+ms2_client_search_objects_cursor_async_full (MS2Client *client,
+                                             const gchar *object_path,
+                                             const gchar *query,
+                                             const gchar *cursor,
+                                             guint max_count,
+                                             gchar **properties,
+                                             gint timeout,
+                                             GCancellable *cancellable,
+                                             GAsyncReadyCallback callback,
+                                             gpointer user_data)
+{
+  g_return_if_fail (query);
+
+  ms2_client_children_from_async (client,
                                   object_path,
-                                  offset,
+                                  query,
+                                  cursor,
                                   max_count,
                                   properties,
+                                  timeout,
+                                  cancellable,
                                   callback,
                                   user_data);
 }
 
 /**
- * ms2_client_list_items_finish:
+ * ms2_client_search_objects_cursor_finish:
  * @client: a #MS2Client
  * @res: a #GAsyncResult
+ * @next_cursor: (out) (allow-none): location to store the cursor pointing to
+ * next page, or @NULL to ignore
  * @error: a #GError location to store the error ocurring, or @NULL to ignore
  *
- * Finishes an asynchronous listing items operation.
+ * Finishes an asynchronous search from a cursor operation.
  *
  * Returns: a new #GList of #GHashTAble. To free it, free first each element
  * (g_hash_table_unref()) and finally the list itself (g_list_free())
  **/
 GList *
-ms2_client_list_items_finish (MS2Client *client,
-                              GAsyncResult *res,
-                              GError **error)
+ms2_client_search_objects_cursor_finish (MS2Client *client,
+                                         GAsyncResult *res,
+                                         gchar **next_cursor,
+                                         GError **error)
 {
-  return ms2_client_list_elements_finish (client, res, error);
+  return ms2_client_children_from_finish (client, res, next_cursor, error);
 }
 
 /**
- * ms2_client_list_items:
+ * ms2_client_search_objects_cursor:
  * @client: a #MS2Client
- * @object_path: container identifier to get items from
- * @offset: number of items to skip
- * @max_count: maximum number of items to return, or 0 for no limit
- * @properties: @NULL-terminated array of properties to request for each item
+ * @object_path: container identifier to start search from
+ * @query: query to perform
+ * @cursor: cursor returned by a previous call, or @NULL to start from the first
+ * result
+ * @max_count: maximum number of children to return, or 0 for no limit
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @next_cursor: (out) (allow-none): location to store the cursor pointing to
+ * next page, or @NULL to ignore
  * @error: a #GError location to store the error ocurring, or @NULL to ignore
  *
- * Gets the list of items directly under the container id. Each item consist of
- * a hash table of <prop_id, prop_gvalue> pairs.
+ * Searchs for a page of children below this container. Pages are chained with
+ * an opaque cursor, like in ms2_client_list_children_cursor().
  *
  * Returns: a new #GList of #GHashTable. To free it, free first each element
  * (g_hash_table_unref()) and finally the list itself (g_list_free())
  **/
 GList *
-ms2_client_list_items (MS2Client *client,
-                       const gchar *object_path,
-                       guint offset,
-                       guint max_count,
-                       gchar **properties,
-                       GError **error)
+ms2_client_search_objects_cursor (MS2Client *client,
+                                  const gchar *object_path,
+                                  const gchar *query,
+                                  const gchar *cursor,
+                                  guint max_count,
+                                  gchar **properties,
+                                  gchar **next_cursor,
+                                  GError **error)
 {
-  return ms2_client_list_elements (client,
-                                   "ListItems",
+  g_return_val_if_fail (query, NULL);
+
+  return ms2_client_children_from (client,
                                    object_path,
-                                   offset,
+                                   query,
+                                   cursor,
                                    max_count,
                                    properties,
+                                   next_cursor,
                                    error);
 }
 
 /**
- * ms2_client_search_objects_async:
+ * ms2_child_iterator_new:
  * @client: a #MS2Client
- * @object_path: container identifier to start search from
- * @query: query to perform
- * @offset: number of children to skip
- * @max_count: maximum number of children to return, or 0 for no limit
+ * @object_path: container identifier to get children from
  * @properties: @NULL-terminated array of properties to request for each child
- * @callback: a #GAsyncReadyCallback to call when request is satisfied
- * @user_data: the data to pass to callback function
+ * @read_ahead: number of pages to request beyond the one being consumed
  *
- * Starts an asynchronous search.
+ * Creates an iterator over the children of a container, which returns them one
+ * by one with ms2_child_iterator_next_async().
  *
- * For more details, see ms2_client_search_objects(), which is the synchronous
- * version of this call.
+ * Children are requested in pages, keeping @read_ahead pages in flight ahead of
+ * the consumer, so a sequential walk does not wait a round trip each page. Page
+ * size grows while the provider answers quickly, and shrinks when it is slow.
  *
- * When the result has been obtained, @callback will be called with
- * @user_data. To finish the operation, call ms2_client_search_objects_finish()
- * with the #GAsyncResult returned by the @callback.
+ * Returns: a new #MS2ChildIterator; free it with ms2_child_iterator_free()
  **/
-void
-ms2_client_search_objects_async (MS2Client *client,
-                                 const gchar *object_path,
-                                 const gchar *query,
-                                 guint offset,
-                                 guint max_count,
-                                 gchar **properties,
-                                 GAsyncReadyCallback callback,
-                                 gpointer user_data)
+MS2ChildIterator *
+ms2_child_iterator_new (MS2Client *client,
+                        const gchar *object_path,
+                        gchar **properties,
+                        guint read_ahead)
 {
-  AsyncData *adata;
-  GSimpleAsyncResult *res;
+  return ms2_child_iterator_new_full (client,
+                                      object_path,
+                                      properties,
+                                      read_ahead,
+                                      -1,
+                                      NULL);
+}
 
-  g_return_if_fail (MS2_IS_CLIENT (client));
+/**
+ * ms2_child_iterator_new_full:
+ * @client: a #MS2Client
+ * @object_path: container identifier to get children from
+ * @properties: @NULL-terminated array of properties to request for each child
+ * @read_ahead: number of pages to request beyond the one being consumed
+ * @timeout: milliseconds to wait for each page, or -1 for the default
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ *
+ * Like ms2_child_iterator_new(), waiting at most @timeout for each page, and
+ * allowing to stop the iterator with @cancellable.
+ *
+ * Cancelling drops the pages in flight without waiting for their replies, as
+ * well as the children not consumed yet; the pending or next request started
+ * with ms2_child_iterator_next_async() fails with %G_IO_ERROR_CANCELLED. A page
+ * not received in time makes it fail with %G_IO_ERROR_TIMED_OUT. The iterator
+ * must still be freed with ms2_child_iterator_free().
+ *
+ * Returns: a new #MS2ChildIterator; free it with ms2_child_iterator_free()
+ **/
+MS2ChildIterator *
+ms2_child_iterator_new_full (MS2Client *client,
+                             const gchar *object_path,
+                             gchar **properties,
+                             guint read_ahead,
+                             gint timeout,
+                             GCancellable *cancellable)
+{
+  MS2ChildIterator *iter;
 
-  res = g_simple_async_result_new (G_OBJECT (client),
-                                   callback,
-                                   user_data,
-                                   ms2_client_search_objects_async);
-  adata = g_slice_new0 (AsyncData);
-  g_simple_async_result_set_op_res_gpointer (res,
-                                             adata,
-                                             (GDestroyNotify) free_async_data);
+  g_return_val_if_fail (MS2_IS_CLIENT (client), NULL);
+  g_return_val_if_fail (object_path, NULL);
+  g_return_val_if_fail (properties, NULL);
 
-  adata->gproxy = dbus_g_proxy_new_for_name (client->priv->bus,
-                                             client->priv->fullname,
-                                             object_path,
-                                             "org.gnome.UPnP.MediaContainer2");
+  iter = g_slice_new0 (MS2ChildIterator);
+  iter->client = g_object_ref (client);
+  iter->object_path = g_strdup (object_path);
+  iter->properties = g_strdupv (properties);
+  iter->read_ahead = read_ahead;
+  iter->pages = g_queue_new ();
+  iter->page_size = MS2_CHILD_ITERATOR_MIN_PAGE;
+  iter->max_page_size = MS2_CHILD_ITERATOR_MAX_PAGE;
+  iter->timeout = timeout;
+
+  child_iterator_fill (iter);
+
+  if (cancellable) {
+    iter->cancellable = g_object_ref (cancellable);
+    iter->cancelled_id = g_cancellable_connect (cancellable,
+                                                G_CALLBACK (child_iterator_cancelled),
+                                                iter,
+                                                NULL);
+  }
 
-  dbus_g_proxy_begin_call (adata->gproxy,
-                           "SearchObjects", search_objects_reply,
-                           res, g_object_unref,
-                           G_TYPE_STRING, query,
-                           G_TYPE_UINT, offset,
-                           G_TYPE_UINT, max_count,
-                           G_TYPE_STRV, properties,
-                           G_TYPE_INVALID);
+  return iter;
 }
 
+/**
+ * ms2_child_iterator_next_async:
+ * @iter: a #MS2ChildIterator
+ * @callback: a #GAsyncReadyCallback to call when next child is available
+ * @user_data: the data to pass to callback function
+ *
+ * Starts getting the next child. Only one request can be in progress at a time.
+ *
+ * When the child is available, @callback will be called with @user_data. To
+ * finish the operation, call ms2_child_iterator_next_finish() with the
+ * #GAsyncResult returned by the @callback.
+ **/
+void
+ms2_child_iterator_next_async (MS2ChildIterator *iter,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data)
+{
+  g_return_if_fail (iter);
+  g_return_if_fail (!iter->pending);
+
+  iter->pending = g_simple_async_result_new (G_OBJECT (iter->client),
+                                             callback,
+                                             user_data,
+                                             ms2_child_iterator_next_async);
+
+  /* Once an error is reported there are no more children */
+  if (iter->failed) {
+    g_simple_async_result_complete_in_idle (iter->pending);
+    g_object_unref (iter->pending);
+    iter->pending = NULL;
+    return;
+  }
+
+  child_iterator_deliver (iter);
+}
 
 /**
- * ms2_client_search_objects_finish:
- * @client: a #MS2Client
+ * ms2_child_iterator_next_finish:
+ * @iter: a #MS2ChildIterator
  * @res: a #GAsyncResult
  * @error: a #GError location to store the error ocurring, or @NULL to ignore
  *
- * Finishes an asynchronous search operation.
+ * Finishes an operation started with ms2_child_iterator_next_async().
  *
- * Returns: a new #GList of #GHashTAble. To free it, free first each element
- * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ * Returns: a new #GHashTable with the properties of next child, or @NULL when
+ * there are no more children or an error happened
  **/
-GList *
-ms2_client_search_objects_finish (MS2Client *client,
-                                  GAsyncResult *res,
-                                  GError **error)
+GHashTable *
+ms2_child_iterator_next_finish (MS2ChildIterator *iter,
+                                GAsyncResult *res,
+                                GError **error)
 {
-  AsyncData *adata;
+  GHashTable *child;
 
   g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
-                        ms2_client_search_objects_async, NULL);
+                        ms2_child_iterator_next_async, NULL);
 
-  adata = g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res));
+  if (g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (res),
+                                             error)) {
+    return NULL;
+  }
 
-  if (error) {
-    *error = adata->error;
+  child = g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res));
+
+  return child? g_hash_table_ref (child): NULL;
+}
+
+/**
+ * ms2_child_iterator_free:
+ * @iter: a #MS2ChildIterator
+ *
+ * Frees the iterator, cancelling the requests in flight. A request started with
+ * ms2_child_iterator_next_async() and not finished yet fails with
+ * %G_IO_ERROR_CANCELLED.
+ **/
+void
+ms2_child_iterator_free (MS2ChildIterator *iter)
+{
+  ChildPage *page;
+
+  g_return_if_fail (iter);
+
+  if (iter->pending) {
+    g_simple_async_result_set_error (iter->pending,
+                                     G_IO_ERROR,
+                                     G_IO_ERROR_CANCELLED,
+                                     "Iterator has been freed");
+    g_simple_async_result_complete_in_idle (iter->pending);
+    g_object_unref (iter->pending);
   }
 
-  return adata->children;
+  if (iter->cancellable) {
+    g_cancellable_disconnect (iter->cancellable, iter->cancelled_id);
+    g_object_unref (iter->cancellable);
+  }
+
+  while ((page = g_queue_pop_head (iter->pages))) {
+    free_child_page (page);
+  }
+  g_queue_free (iter->pages);
+  g_strfreev (iter->properties);
+  g_free (iter->object_path);
+  g_object_unref (iter->client);
+  g_slice_free (MS2ChildIterator, iter);
 }
 
 /**
- * ms2_client_search_objects:
+ * ms2_client_walk_async:
  * @client: a #MS2Client
- * @object_path: container identifier to start search fromç
- * @query: query to perform
- * @offset: number of children to skip
- * @max_count: maximum number of children to return, or 0 for no limit
- * @properties: @NULL-terminated array of properties to request for each child
- * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ * @object_path: container identifier to start walking from
+ * @properties: @NULL-terminated array of properties to request for each object
+ * @max_depth: deepest level to descend to, or 0 for no limit
+ * @max_requests: maximum number of requests in flight
+ * @func: function to invoke with each object found
+ * @callback: a #GAsyncReadyCallback to call when walk is finished
+ * @user_data: the data to pass to @func and @callback
  *
- * Searchs for children below this container. Each child consist
- * of a hash table of <prop_id, prop_gvalue> pairs.
+ * Starts walking the tree below a container, invoking @func with the properties
+ * of each object found and its depth, being 1 the children of @object_path. The
+ * properties table belongs to the walk; add a reference to keep it. If @func
+ * returns @FALSE, the walk is stopped.
  *
- * Returns: a new #GList of #GHashTable. To free it, free first each element
- * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ * Containers are listed with up to @max_requests requests in flight, so the
+ * walk goes as fast as provider can serve them concurrently. Containers
+ * reachable through several parents are reported and walked only once. Objects
+ * are not reported in any particular order.
+ *
+ * When the walk is finished, @callback will be called with @user_data. To
+ * finish the operation, call ms2_client_walk_finish() with the #GAsyncResult
+ * returned by the @callback.
  **/
-GList *
-ms2_client_search_objects (MS2Client *client,
-                           const gchar *object_path,
-                           const gchar *query,
-                           guint offset,
-                           guint max_count,
-                           gchar **properties,
-                           GError **error)
+void
+ms2_client_walk_async (MS2Client *client,
+                       const gchar *object_path,
+                       gchar **properties,
+                       guint max_depth,
+                       guint max_requests,
+                       MS2WalkFunc func,
+                       GAsyncReadyCallback callback,
+                       gpointer user_data)
 {
-  DBusGProxy *gproxy;
-  GList *children = NULL;
-  GPtrArray *result = NULL;
-
-  g_return_val_if_fail (MS2_IS_CLIENT (client), NULL);
-  g_return_val_if_fail (properties, NULL);
+  ms2_client_walk_async_full (client,
+                              object_path,
+                              properties,
+                              max_depth,
+                              max_requests,
+                              func,
+                              -1,
+                              NULL,
+                              callback,
+                              user_data);
+}
 
-  gproxy = dbus_g_proxy_new_for_name (client->priv->bus,
-                                      client->priv->fullname,
-                                      object_path,
-                                      "org.gnome.UPnP.MediaContainer2");
+/**
+ * ms2_client_walk_async_full:
+ * @client: a #MS2Client
+ * @object_path: container identifier to start walking from
+ * @properties: @NULL-terminated array of properties to request for each object
+ * @max_depth: deepest level to descend to, or 0 for no limit
+ * @max_requests: maximum number of requests in flight
+ * @func: function to invoke with each object found
+ * @timeout: milliseconds to wait for each reply, or -1 for the default
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when walk is finished
+ * @user_data: the data to pass to @func and @callback
+ *
+ * Like ms2_client_walk_async(), waiting at most @timeout for each listing
+ * request, and allowing to stop the walk with @cancellable.
+ *
+ * Cancelling drops the requests in flight without waiting for their replies,
+ * and the walk finishes with %G_IO_ERROR_CANCELLED. It can be cancelled from
+ * @func too. If a listing is not received in time, the walk finishes with
+ * %G_IO_ERROR_TIMED_OUT.
+ **/
+void
+ms2_client_walk_async_full (MS2Client *client,
+                            const gchar *object_path,
+                            gchar **properties,
+                            guint max_depth,
+                            guint max_requests,
+                            MS2WalkFunc func,
+                            gint timeout,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data)
+{
+  GPtrArray *walk_properties;
+  WalkData *walk;
+  gchar **prop;
 
-  if (dbus_g_proxy_call (gproxy,
-                         "SearchObjects", error,
-                         G_TYPE_STRING, query,
-                         G_TYPE_UINT, offset,
-                         G_TYPE_UINT, max_count,
-                         G_TYPE_STRV, properties,
-                         G_TYPE_INVALID,
-                         dbus_g_type_get_collection ("GPtrArray",
-                                                     dbus_g_type_get_map ("GHashTable",
-                                                                          G_TYPE_STRING,
-                                                                          G_TYPE_VALUE)), &result,
-                         G_TYPE_INVALID)) {
-    children = gptrarray_to_glist (result);
-    g_ptr_array_free (result, TRUE);
+  g_return_if_fail (MS2_IS_CLIENT (client));
+  g_return_if_fail (object_path);
+  g_return_if_fail (properties);
+  g_return_if_fail (func);
+
+  walk = g_slice_new0 (WalkData);
+  walk->client = client;
+  walk->max_depth = max_depth;
+  walk->max_requests = MAX (max_requests, 1);
+  walk->func = func;
+  walk->user_data = user_data;
+  walk->timeout = timeout;
+  walk->result = g_simple_async_result_new (G_OBJECT (client),
+                                            callback,
+                                            user_data,
+                                            ms2_client_walk_async);
+  walk->visited = g_hash_table_new_full (g_str_hash,
+                                         g_str_equal,
+                                         (GDestroyNotify) g_free,
+                                         NULL);
+  walk->requests = g_queue_new ();
+
+  /* Path is needed to descend into containers */
+  walk_properties = g_ptr_array_new ();
+  for (prop = properties; *prop; prop++) {
+    g_ptr_array_add (walk_properties, g_strdup (*prop));
+  }
+  if (!g_strv_contains ((const gchar * const *) properties, MS2_PROP_PATH)) {
+    g_ptr_array_add (walk_properties, g_strdup (MS2_PROP_PATH));
   }
+  g_ptr_array_add (walk_properties, NULL);
+  walk->properties = (gchar **) g_ptr_array_free (walk_properties, FALSE);
+
+  g_hash_table_insert (walk->visited, g_strdup (object_path), NULL);
+  walk_add_request (walk, object_path, "ListContainers", 1, 0, FALSE);
+  walk_add_request (walk, object_path, "ListItems", 1, 0, FALSE);
+  walk_send (walk);
+
+  if (cancellable) {
+    walk->cancellable = g_object_ref (cancellable);
+    walk->cancelled_id = g_cancellable_connect (cancellable,
+                                                G_CALLBACK (walk_cancelled),
+                                                walk,
+                                                NULL);
+  }
+}
 
-  g_object_unref (gproxy);
+/**
+ * ms2_client_walk_finish:
+ * @client: a #MS2Client
+ * @res: a #GAsyncResult
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Finishes an operation started with ms2_client_walk_async().
+ *
+ * Returns: @TRUE if the walk finished without errors
+ **/
+gboolean
+ms2_client_walk_finish (MS2Client *client,
+                        GAsyncResult *res,
+                        GError **error)
+{
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
+                        ms2_client_walk_async, FALSE);
 
-  return children;
+  return !g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (res),
+                                                 error);
 }
 
 const gchar *
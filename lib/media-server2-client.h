@@ -28,6 +28,7 @@
 #include <gio/gio.h>
 
 #include "media-server2-common.h"
+#include "media-server2-result-set.h"
 
 #define MS2_TYPE_CLIENT                         \
   (ms2_client_get_type ())
@@ -57,6 +58,7 @@
 
 typedef struct _MS2Client        MS2Client;
 typedef struct _MS2ClientPrivate MS2ClientPrivate;
+typedef struct _MS2ChildIterator MS2ChildIterator;
 
 struct _MS2Client {
 
@@ -78,20 +80,68 @@ struct _MS2ClientClass {
   void (*destroy) (MS2Client *client);
 };
 
+typedef gboolean (*MS2WalkFunc) (MS2Client *client,
+                                 GHashTable *properties,
+                                 guint depth,
+                                 gpointer user_data);
+
+typedef gboolean (*MS2SearchFunc) (MS2Client *client,
+                                   GList *objects,
+                                   gpointer user_data);
+
 GType ms2_client_get_type (void);
 
 gchar **ms2_client_get_providers (void);
 
+void ms2_client_search_all_async (const gchar *query,
+                                  guint max_count,
+                                  gchar **properties,
+                                  guint timeout,
+                                  MS2SearchFunc func,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data);
+
+void ms2_client_search_all_async_full (const gchar *query,
+                                       guint max_count,
+                                       gchar **properties,
+                                       guint timeout,
+                                       MS2SearchFunc func,
+                                       GCancellable *cancellable,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data);
+
+GList *ms2_client_search_all_finish (GAsyncResult *res,
+                                     GError **error);
+
 MS2Client *ms2_client_new (const gchar *provider);
 
 const gchar *ms2_client_get_provider_name (MS2Client *client);
 
+void ms2_client_watch_path (MS2Client *client,
+                            const gchar *object_path);
+
+void ms2_client_unwatch_path (MS2Client *client,
+                              const gchar *object_path);
+
+void ms2_client_set_cache_enabled (MS2Client *client,
+                                   gboolean enabled);
+
+gboolean ms2_client_get_cache_enabled (MS2Client *client);
+
 void ms2_client_get_properties_async (MS2Client *client,
                                       const gchar *object_path,
                                       gchar **properties,
                                       GAsyncReadyCallback callback,
                                       gpointer user_data);
 
+void ms2_client_get_properties_async_full (MS2Client *client,
+                                           const gchar *object_path,
+                                           gchar **properties,
+                                           gint timeout,
+                                           GCancellable *cancellable,
+                                           GAsyncReadyCallback callback,
+                                           gpointer user_data);
+
 GHashTable *ms2_client_get_properties_finish (MS2Client *client,
                                               GAsyncResult *res,
                                               GError **error);
@@ -101,6 +151,29 @@ GHashTable *ms2_client_get_properties (MS2Client *client,
                                        gchar **properties,
                                        GError **error);
 
+void ms2_client_get_properties_batch_async (MS2Client *client,
+                                            gchar **object_paths,
+                                            gchar **properties,
+                                            GAsyncReadyCallback callback,
+                                            gpointer user_data);
+
+void ms2_client_get_properties_batch_async_full (MS2Client *client,
+                                                 gchar **object_paths,
+                                                 gchar **properties,
+                                                 gint timeout,
+                                                 GCancellable *cancellable,
+                                                 GAsyncReadyCallback callback,
+                                                 gpointer user_data);
+
+GList *ms2_client_get_properties_batch_finish (MS2Client *client,
+                                               GAsyncResult *res,
+                                               GError **error);
+
+GList *ms2_client_get_properties_batch (MS2Client *client,
+                                        gchar **object_paths,
+                                        gchar **properties,
+                                        GError **error);
+
 void ms2_client_list_children_async (MS2Client *client,
                                      const gchar *object_path,
                                      guint offset,
@@ -109,6 +182,16 @@ void ms2_client_list_children_async (MS2Client *client,
                                      GAsyncReadyCallback callback,
                                      gpointer user_data);
 
+void ms2_client_list_children_async_full (MS2Client *client,
+                                          const gchar *object_path,
+                                          guint offset,
+                                          guint max_count,
+                                          gchar **properties,
+                                          gint timeout,
+                                          GCancellable *cancellable,
+                                          GAsyncReadyCallback callback,
+                                          gpointer user_data);
+
 GList *ms2_client_list_children_finish (MS2Client *client,
                                         GAsyncResult *res,
                                         GError **error);
@@ -128,6 +211,16 @@ void ms2_client_list_containers_async (MS2Client *client,
                                        GAsyncReadyCallback callback,
                                        gpointer user_data);
 
+void ms2_client_list_containers_async_full (MS2Client *client,
+                                            const gchar *object_path,
+                                            guint offset,
+                                            guint max_count,
+                                            gchar **properties,
+                                            gint timeout,
+                                            GCancellable *cancellable,
+                                            GAsyncReadyCallback callback,
+                                            gpointer user_data);
+
 GList *ms2_client_list_containers_finish (MS2Client *client,
                                           GAsyncResult *res,
                                           GError **error);
@@ -147,6 +240,16 @@ void ms2_client_list_items_async (MS2Client *client,
                                   GAsyncReadyCallback callback,
                                   gpointer user_data);
 
+void ms2_client_list_items_async_full (MS2Client *client,
+                                       const gchar *object_path,
+                                       guint offset,
+                                       guint max_count,
+                                       gchar **properties,
+                                       gint timeout,
+                                       GCancellable *cancellable,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data);
+
 GList *ms2_client_list_items_finish (MS2Client *client,
                                      GAsyncResult *res,
                                      GError **error);
@@ -175,10 +278,193 @@ void ms2_client_search_objects_async (MS2Client *client,
                                       GAsyncReadyCallback callback,
                                       gpointer user_data);
 
+void ms2_client_search_objects_async_full (MS2Client *client,
+                                           const gchar *object_path,
+                                           const gchar *query,
+                                           guint offset,
+                                           guint max_count,
+                                           gchar **properties,
+                                           gint timeout,
+                                           GCancellable *cancellable,
+                                           GAsyncReadyCallback callback,
+                                           gpointer user_data);
+
 GList *ms2_client_search_objects_finish (MS2Client *client,
                                          GAsyncResult *res,
                                          GError **error);
 
+MS2ResultSet *ms2_client_list_children_set (MS2Client *client,
+                                            const gchar *object_path,
+                                            guint offset,
+                                            guint max_count,
+                                            gchar **properties,
+                                            GError **error);
+
+void ms2_client_list_children_set_async (MS2Client *client,
+                                         const gchar *object_path,
+                                         guint offset,
+                                         guint max_count,
+                                         gchar **properties,
+                                         GAsyncReadyCallback callback,
+                                         gpointer user_data);
+
+void ms2_client_list_children_set_async_full (MS2Client *client,
+                                              const gchar *object_path,
+                                              guint offset,
+                                              guint max_count,
+                                              gchar **properties,
+                                              gint timeout,
+                                              GCancellable *cancellable,
+                                              GAsyncReadyCallback callback,
+                                              gpointer user_data);
+
+MS2ResultSet *ms2_client_list_children_set_finish (MS2Client *client,
+                                                   GAsyncResult *res,
+                                                   GError **error);
+
+MS2ResultSet *ms2_client_search_objects_set (MS2Client *client,
+                                             const gchar *object_path,
+                                             const gchar *query,
+                                             guint offset,
+                                             guint max_count,
+                                             gchar **properties,
+                                             GError **error);
+
+void ms2_client_search_objects_set_async (MS2Client *client,
+                                          const gchar *object_path,
+                                          const gchar *query,
+                                          guint offset,
+                                          guint max_count,
+                                          gchar **properties,
+                                          GAsyncReadyCallback callback,
+                                          gpointer user_data);
+
+void ms2_client_search_objects_set_async_full (MS2Client *client,
+                                               const gchar *object_path,
+                                               const gchar *query,
+                                               guint offset,
+                                               guint max_count,
+                                               gchar **properties,
+                                               gint timeout,
+                                               GCancellable *cancellable,
+                                               GAsyncReadyCallback callback,
+                                               gpointer user_data);
+
+MS2ResultSet *ms2_client_search_objects_set_finish (MS2Client *client,
+                                                    GAsyncResult *res,
+                                                    GError **error);
+
+void ms2_client_list_children_cursor_async (MS2Client *client,
+                                            const gchar *object_path,
+                                            const gchar *cursor,
+                                            guint max_count,
+                                            gchar **properties,
+                                            GAsyncReadyCallback callback,
+                                            gpointer user_data);
+
+void ms2_client_list_children_cursor_async_full (MS2Client *client,
+                                                 const gchar *object_path,
+                                                 const gchar *cursor,
+                                                 guint max_count,
+                                                 gchar **properties,
+                                                 gint timeout,
+                                                 GCancellable *cancellable,
+                                                 GAsyncReadyCallback callback,
+                                                 gpointer user_data);
+
+GList *ms2_client_list_children_cursor_finish (MS2Client *client,
+                                               GAsyncResult *res,
+                                               gchar **next_cursor,
+                                               GError **error);
+
+GList *ms2_client_list_children_cursor (MS2Client *client,
+                                        const gchar *object_path,
+                                        const gchar *cursor,
+                                        guint max_count,
+                                        gchar **properties,
+                                        gchar **next_cursor,
+                                        GError **error);
+
+void ms2_client_search_objects_cursor_async (MS2Client *client,
+                                             const gchar *object_path,
+                                             const gchar *query,
+                                             const gchar *cursor,
+                                             guint max_count,
+                                             gchar **properties,
+                                             GAsyncReadyCallback callback,
+                                             gpointer user_data);
+
+void ms2_client_search_objects_cursor_async_full (MS2Client *client,
+                                                  const gchar *object_path,
+                                                  const gchar *query,
+                                                  const gchar *cursor,
+                                                  guint max_count,
+                                                  gchar **properties,
+                                                  gint timeout,
+                                                  GCancellable *cancellable,
+                                                  GAsyncReadyCallback callback,
+                                                  gpointer user_data);
+
+GList *ms2_client_search_objects_cursor_finish (MS2Client *client,
+                                                GAsyncResult *res,
+                                                gchar **next_cursor,
+                                                GError **error);
+
+GList *ms2_client_search_objects_cursor (MS2Client *client,
+                                         const gchar *object_path,
+                                         const gchar *query,
+                                         const gchar *cursor,
+                                         guint max_count,
+                                         gchar **properties,
+                                         gchar **next_cursor,
+                                         GError **error);
+
+MS2ChildIterator *ms2_child_iterator_new (MS2Client *client,
+                                          const gchar *object_path,
+                                          gchar **properties,
+                                          guint read_ahead);
+
+MS2ChildIterator *ms2_child_iterator_new_full (MS2Client *client,
+                                               const gchar *object_path,
+                                               gchar **properties,
+                                               guint read_ahead,
+                                               gint timeout,
+                                               GCancellable *cancellable);
+
+void ms2_child_iterator_next_async (MS2ChildIterator *iter,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data);
+
+GHashTable *ms2_child_iterator_next_finish (MS2ChildIterator *iter,
+                                            GAsyncResult *res,
+                                            GError **error);
+
+void ms2_child_iterator_free (MS2ChildIterator *iter);
+
+void ms2_client_walk_async (MS2Client *client,
+                            const gchar *object_path,
+                            gchar **properties,
+                            guint max_depth,
+                            guint max_requests,
+                            MS2WalkFunc func,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data);
+
+void ms2_client_walk_async_full (MS2Client *client,
+                                 const gchar *object_path,
+                                 gchar **properties,
+                                 guint max_depth,
+                                 guint max_requests,
+                                 MS2WalkFunc func,
+                                 gint timeout,
+                                 GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data);
+
+gboolean ms2_client_walk_finish (MS2Client *client,
+                                 GAsyncResult *res,
+                                 GError **error);
+
 const gchar *ms2_client_get_root_path (MS2Client *client);
 
 const gchar *ms2_client_get_path (GHashTable *properties);
@@ -96,6 +96,70 @@
   "   <signal name=\"Updated\"/>"                                       \
   "  </interface>"
 
+#define PAGEDCONTAINER2_IFACE                                           \
+  "  <interface name=\"org.gnome.Grilo.MediaContainer2\">"              \
+  "    <method name=\"ListChildren\">"                                  \
+  "      <arg name=\"offset\"      direction=\"in\"  type=\"u\"/>"      \
+  "      <arg name=\"max\"         direction=\"in\"  type=\"u\"/>"      \
+  "      <arg name=\"filter\"      direction=\"in\"  type=\"as\"/>"     \
+  "      <arg name=\"objects\"     direction=\"out\" type=\"aa{sv}\"/>" \
+  "      <arg name=\"next_offset\" direction=\"out\" type=\"u\"/>"      \
+  "    </method>"                                                       \
+  "    <method name=\"ListContainers\">"                                \
+  "      <arg name=\"offset\"      direction=\"in\"  type=\"u\"/>"      \
+  "      <arg name=\"max\"         direction=\"in\"  type=\"u\"/>"      \
+  "      <arg name=\"filter\"      direction=\"in\"  type=\"as\"/>"     \
+  "      <arg name=\"objects\"     direction=\"out\" type=\"aa{sv}\"/>" \
+  "      <arg name=\"next_offset\" direction=\"out\" type=\"u\"/>"      \
+  "    </method>"                                                       \
+  "    <method name=\"ListItems\">"                                     \
+  "      <arg name=\"offset\"      direction=\"in\"  type=\"u\"/>"      \
+  "      <arg name=\"max\"         direction=\"in\"  type=\"u\"/>"      \
+  "      <arg name=\"filter\"      direction=\"in\"  type=\"as\"/>"     \
+  "      <arg name=\"objects\"     direction=\"out\" type=\"aa{sv}\"/>" \
+  "      <arg name=\"next_offset\" direction=\"out\" type=\"u\"/>"      \
+  "    </method>"                                                       \
+  "    <method name=\"SearchObjects\">"                                 \
+  "      <arg name=\"query\"       direction=\"in\"  type=\"s\"/>"      \
+  "      <arg name=\"offset\"      direction=\"in\"  type=\"u\"/>"      \
+  "      <arg name=\"max\"         direction=\"in\"  type=\"u\"/>"      \
+  "      <arg name=\"filter\"      direction=\"in\"  type=\"as\"/>"     \
+  "      <arg name=\"objects\"     direction=\"out\" type=\"aa{sv}\"/>" \
+  "      <arg name=\"next_offset\" direction=\"out\" type=\"u\"/>"      \
+  "    </method>"                                                       \
+  "    <method name=\"ListChildrenFrom\">"                              \
+  "      <arg name=\"cursor\"      direction=\"in\"  type=\"s\"/>"      \
+  "      <arg name=\"max\"         direction=\"in\"  type=\"u\"/>"      \
+  "      <arg name=\"filter\"      direction=\"in\"  type=\"as\"/>"     \
+  "      <arg name=\"objects\"     direction=\"out\" type=\"aa{sv}\"/>" \
+  "      <arg name=\"next_cursor\" direction=\"out\" type=\"s\"/>"      \
+  "    </method>"                                                       \
+  "    <method name=\"SearchObjectsFrom\">"                             \
+  "      <arg name=\"query\"       direction=\"in\"  type=\"s\"/>"      \
+  "      <arg name=\"cursor\"      direction=\"in\"  type=\"s\"/>"      \
+  "      <arg name=\"max\"         direction=\"in\"  type=\"u\"/>"      \
+  "      <arg name=\"filter\"      direction=\"in\"  type=\"as\"/>"     \
+  "      <arg name=\"objects\"     direction=\"out\" type=\"aa{sv}\"/>" \
+  "      <arg name=\"next_cursor\" direction=\"out\" type=\"s\"/>"      \
+  "    </method>"                                                       \
+  "  </interface>"
+
+#define PROVIDER_IFACE                                                  \
+  "  <interface name=\"org.gnome.Grilo.MediaServer2\">"                 \
+  "    <method name=\"GetPropertiesBatch\">"                            \
+  "      <arg name=\"paths\"   direction=\"in\"  type=\"ao\"/>"         \
+  "      <arg name=\"filter\"  direction=\"in\"  type=\"as\"/>"         \
+  "      <arg name=\"objects\" direction=\"out\" type=\"aa{sv}\"/>"     \
+  "    </method>"                                                       \
+  "  </interface>"
+
+#define STATS_IFACE                                                     \
+  "  <interface name=\"org.gnome.UPnP.MediaServer2.Stats\">"            \
+  "    <method name=\"GetStats\">"                                      \
+  "      <arg name=\"stats\" direction=\"out\" type=\"a{sv}\"/>"        \
+  "    </method>"                                                       \
+  "  </interface>"
+
 #define INTROSPECTABLE_IFACE                                    \
   "  <interface name=\"org.freedesktop.DBus.Introspectable\">"  \
   "    <method name=\"Introspect\">"                            \
@@ -120,10 +184,28 @@
   INTROSPECTION_OPEN                            \
   MEDIAOBJECT2_IFACE                            \
   MEDIACONTAINER2_IFACE                         \
+  PAGEDCONTAINER2_IFACE                         \
   INTROSPECTABLE_IFACE                          \
   PROPERTIES_IFACE                              \
   INTROSPECTION_CLOSE
 
+#define ROOT_INTROSPECTION                      \
+  INTROSPECTION_OPEN                            \
+  MEDIAOBJECT2_IFACE                            \
+  MEDIACONTAINER2_IFACE                         \
+  PAGEDCONTAINER2_IFACE                         \
+  PROVIDER_IFACE                                \
+  STATS_IFACE                                   \
+  INTROSPECTABLE_IFACE                          \
+  PROPERTIES_IFACE                              \
+  INTROSPECTION_CLOSE
+
+#define STATS_INTROSPECTION                     \
+  INTROSPECTION_OPEN                            \
+  STATS_IFACE                                   \
+  INTROSPECTABLE_IFACE                          \
+  INTROSPECTION_CLOSE
+
 #define ITEM_INTROSPECTION                      \
   INTROSPECTION_OPEN                            \
   MEDIAOBJECT2_IFACE                            \
@@ -21,6 +21,7 @@
  */
 
 #include <dbus/dbus-glib-lowlevel.h>
+#include <string.h>
 
 #include "media-server2-private.h"
 #include "media-server2-observer.h"
@@ -41,12 +42,46 @@ enum {
  * Private MS2Observer structure
  *   clients: a table with the clients
  *   proxy: proxy to dbus service
+ *   connection: connection to session bus
+ *   all_updates: a table with the number of clients of each provider that are
+ *                notified of updates in any object
+ *   paths: a table with the clients watching each object path
+ *   watches: a table with the object paths watched by each client
+ *   providers: a table with the flags of each known provider
+ *   providers_changed: providers that have come or gone while seeding the
+ *                      providers table
+ *   providers_pending: number of requests seeding providers without reply yet
+ *   providers_ready: providers table has been seeded
+ *   providers_waiting: operations waiting for providers table to be seeded
  */
 struct _MS2ObserverPrivate {
   GHashTable *clients;
   DBusGProxy *proxy;
+  DBusConnection *connection;
+  GHashTable *all_updates;
+  GHashTable *paths;
+  GHashTable *watches;
+  GHashTable *providers;
+  GHashTable *providers_changed;
+  guint providers_pending;
+  gboolean providers_ready;
+  GList *providers_waiting;
 };
 
+/*
+ * Structure to store data for ms2_observer_get_providers_async_full()
+ *   observer: observer the providers are requested to
+ *   timeout_id: source that gives up waiting for the providers
+ *   cancellable: cancellable that gives up waiting for the providers
+ *   cancelled_id: handler connected to cancellable
+ */
+typedef struct {
+  MS2Observer *observer;
+  guint timeout_id;
+  GCancellable *cancellable;
+  gulong cancelled_id;
+} ProvidersData;
+
 static MS2Observer *observer_instance = NULL;
 static guint32 signals[LAST_SIGNAL] = { 0 };
 
@@ -54,6 +89,428 @@ G_DEFINE_TYPE (MS2Observer, ms2_observer, G_TYPE_OBJECT);
 
 /******************** PRIVATE API ********************/
 
+/* Sets or clears flag of provider, forgetting it when no flag is left */
+static void
+update_provider (MS2Observer *observer,
+                 const gchar *provider,
+                 guint flag,
+                 gboolean set)
+{
+  guint flags;
+
+  flags = GPOINTER_TO_UINT (g_hash_table_lookup (observer->priv->providers,
+                                                 provider));
+  flags = set? (flags | flag): (flags & ~flag);
+
+  if (flags) {
+    g_hash_table_insert (observer->priv->providers,
+                         g_strdup (provider),
+                         GUINT_TO_POINTER (flags));
+  } else {
+    g_hash_table_remove (observer->priv->providers, provider);
+  }
+}
+
+/* Sets flag of the providers among dbus names. Providers that have come or
+   gone while seeding are already up to date, so they are not changed */
+static void
+add_providers (MS2Observer *observer,
+               gchar **names,
+               guint flag)
+{
+  const gchar *provider;
+  gchar **name;
+
+  for (name = names; name && *name; name++) {
+    if (!g_str_has_prefix (*name, MS2_DBUS_SERVICE_PREFIX)) {
+      continue;
+    }
+    provider = *name + MS2_DBUS_SERVICE_PREFIX_LENGTH;
+    if (flag == MS2_PROVIDER_RUNNING &&
+        g_hash_table_lookup (observer->priv->providers_changed, provider)) {
+      continue;
+    }
+    update_provider (observer, provider, flag, TRUE);
+  }
+}
+
+/* Clears flag of all providers */
+static void
+clear_providers (MS2Observer *observer,
+                 guint flag)
+{
+  GHashTableIter iter;
+  gpointer value;
+  guint flags;
+
+  g_hash_table_iter_init (&iter, observer->priv->providers);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    flags = GPOINTER_TO_UINT (value) & ~flag;
+    if (flags) {
+      g_hash_table_iter_replace (&iter, GUINT_TO_POINTER (flags));
+    } else {
+      g_hash_table_iter_remove (&iter);
+    }
+  }
+}
+
+/* Returns a new sorted array with the names of known providers having any of
+   flags */
+static gchar **
+providers_to_strv (MS2Observer *observer,
+                   guint flags)
+{
+  GList *name;
+  GList *names;
+  gchar **providers;
+  gint i = 0;
+
+  names = g_list_sort (g_hash_table_get_keys (observer->priv->providers),
+                       (GCompareFunc) strcmp);
+
+  providers = g_new (gchar *, g_list_length (names) + 1);
+  for (name = names; name; name = g_list_next (name)) {
+    if (GPOINTER_TO_UINT (g_hash_table_lookup (observer->priv->providers,
+                                               name->data)) & flags) {
+      providers[i++] = g_strdup (name->data);
+    }
+  }
+  providers[i] = NULL;
+
+  g_list_free (names);
+
+  return providers;
+}
+
+/* Free ProvidersData */
+static void
+free_providers_data (ProvidersData *pdata)
+{
+  if (pdata->timeout_id) {
+    g_source_remove (pdata->timeout_id);
+  }
+  if (pdata->cancellable) {
+    g_cancellable_disconnect (pdata->cancellable, pdata->cancelled_id);
+    g_object_unref (pdata->cancellable);
+  }
+  g_slice_free (ProvidersData, pdata);
+}
+
+/* Stops waiting for the providers table to be seeded, completing res with
+   error if it is not NULL */
+static void
+providers_wait_done (MS2Observer *observer,
+                     GSimpleAsyncResult *res,
+                     GError *error)
+{
+  ProvidersData *pdata;
+
+  observer->priv->providers_waiting =
+    g_list_remove (observer->priv->providers_waiting, res);
+
+  pdata = g_simple_async_result_get_op_res_gpointer (res);
+  if (pdata->timeout_id) {
+    g_source_remove (pdata->timeout_id);
+    pdata->timeout_id = 0;
+  }
+
+  if (error) {
+    g_simple_async_result_set_from_error (res, error);
+  }
+  g_simple_async_result_complete_in_idle (res);
+  g_object_unref (res);
+}
+
+/* Gives up waiting for the providers when they are not known in time */
+static gboolean
+providers_wait_timeout (gpointer user_data)
+{
+  GError *error;
+  GSimpleAsyncResult *res = G_SIMPLE_ASYNC_RESULT (user_data);
+  ProvidersData *pdata;
+
+  pdata = g_simple_async_result_get_op_res_gpointer (res);
+  pdata->timeout_id = 0;
+
+  error = g_error_new (G_IO_ERROR,
+                       G_IO_ERROR_TIMED_OUT,
+                       "Timed out waiting for the list of providers");
+  providers_wait_done (pdata->observer, res, error);
+  g_error_free (error);
+
+  return FALSE;
+}
+
+/* Callback invoked when waiting for the providers is cancelled */
+static void
+providers_wait_cancelled (GCancellable *cancellable,
+                          GSimpleAsyncResult *res)
+{
+  GError *error = NULL;
+  ProvidersData *pdata;
+
+  pdata = g_simple_async_result_get_op_res_gpointer (res);
+
+  /* Providers are already known */
+  if (!g_list_find (pdata->observer->priv->providers_waiting, res)) {
+    return;
+  }
+
+  g_cancellable_set_error_if_cancelled (cancellable, &error);
+  providers_wait_done (pdata->observer, res, error);
+  g_error_free (error);
+}
+
+/* Marks providers table as seeded, and completes operations waiting for it */
+static void
+providers_seeded (MS2Observer *observer)
+{
+  observer->priv->providers_ready = TRUE;
+  g_hash_table_remove_all (observer->priv->providers_changed);
+
+  while (observer->priv->providers_waiting) {
+    providers_wait_done (observer,
+                         observer->priv->providers_waiting->data,
+                         NULL);
+  }
+}
+
+/* Sets flag of the providers in reply of ListNames or ListActivatableNames */
+static void
+seed_providers_reply (MS2Observer *observer,
+                      DBusGProxy *proxy,
+                      DBusGProxyCall *call,
+                      guint flag)
+{
+  GError *error = NULL;
+  gchar **names = NULL;
+
+  if (dbus_g_proxy_end_call (proxy, call, &error,
+                             G_TYPE_STRV, &names,
+                             G_TYPE_INVALID)) {
+    /* A synchronous seed done meanwhile is more recent */
+    if (!observer->priv->providers_ready) {
+      add_providers (observer, names, flag);
+    }
+    g_strfreev (names);
+  } else {
+    g_printerr ("Could not get list of dbus names, %s\n", error->message);
+    g_error_free (error);
+  }
+
+  observer->priv->providers_pending--;
+  if (observer->priv->providers_pending == 0 &&
+      !observer->priv->providers_ready) {
+    providers_seeded (observer);
+  }
+}
+
+/* Callback invoked when ListNames reply is received */
+static void
+list_names_reply (DBusGProxy *proxy,
+                  DBusGProxyCall *call,
+                  void *user_data)
+{
+  seed_providers_reply (MS2_OBSERVER (user_data),
+                        proxy,
+                        call,
+                        MS2_PROVIDER_RUNNING);
+}
+
+/* Callback invoked when ListActivatableNames reply is received */
+static void
+list_activatable_names_reply (DBusGProxy *proxy,
+                              DBusGProxyCall *call,
+                              void *user_data)
+{
+  seed_providers_reply (MS2_OBSERVER (user_data),
+                        proxy,
+                        call,
+                        MS2_PROVIDER_ACTIVATABLE);
+}
+
+/* Synchronously seeds providers table, if replies to the requests sent when
+   observer was created have not been received yet */
+static void
+seed_providers (MS2Observer *observer)
+{
+  GError *error = NULL;
+  gchar **names = NULL;
+
+  if (observer->priv->providers_ready) {
+    return;
+  }
+
+  if (dbus_g_proxy_call (observer->priv->proxy,
+                         "ListNames", &error,
+                         G_TYPE_INVALID,
+                         G_TYPE_STRV, &names,
+                         G_TYPE_INVALID)) {
+    add_providers (observer, names, MS2_PROVIDER_RUNNING);
+    g_strfreev (names);
+  } else {
+    g_printerr ("Could not get list of dbus names, %s\n", error->message);
+    g_clear_error (&error);
+  }
+
+  if (dbus_g_proxy_call (observer->priv->proxy,
+                         "ListActivatableNames", &error,
+                         G_TYPE_INVALID,
+                         G_TYPE_STRV, &names,
+                         G_TYPE_INVALID)) {
+    add_providers (observer, names, MS2_PROVIDER_ACTIVATABLE);
+    g_strfreev (names);
+  } else {
+    g_printerr ("Could not get list of activatable dbus names, %s\n",
+                error->message);
+    g_clear_error (&error);
+  }
+
+  providers_seeded (observer);
+}
+
+/* Callback invoked when ListActivatableNames reply is received after
+   activatable services have changed */
+static void
+activatable_names_changed_reply (DBusGProxy *proxy,
+                                 DBusGProxyCall *call,
+                                 void *user_data)
+{
+  GError *error = NULL;
+  MS2Observer *observer = MS2_OBSERVER (user_data);
+  gchar **names = NULL;
+
+  if (dbus_g_proxy_end_call (proxy, call, &error,
+                             G_TYPE_STRV, &names,
+                             G_TYPE_INVALID)) {
+    clear_providers (observer, MS2_PROVIDER_ACTIVATABLE);
+    add_providers (observer, names, MS2_PROVIDER_ACTIVATABLE);
+    g_strfreev (names);
+  } else {
+    g_printerr ("Could not get list of activatable dbus names, %s\n",
+                error->message);
+    g_error_free (error);
+  }
+}
+
+/* Callback invoked when services that dbus can activate have changed */
+static void
+activatable_services_changed (DBusGProxy *proxy,
+                              MS2Observer *observer)
+{
+  dbus_g_proxy_begin_call (proxy,
+                           "ListActivatableNames",
+                           activatable_names_changed_reply,
+                           observer, NULL,
+                           G_TYPE_INVALID);
+}
+
+/* Returns the match rule for Updated signals of provider, or only for those
+   of object_path if it is not NULL */
+static gchar *
+updated_match_rule (const gchar *provider,
+                    const gchar *object_path)
+{
+  if (object_path) {
+    return g_strdup_printf ("type='signal',"
+                            "sender='" MS2_DBUS_SERVICE_PREFIX "%s',"
+                            "interface='org.gnome.UPnP.MediaContainer2',"
+                            "member='Updated',"
+                            "path='%s'",
+                            provider,
+                            object_path);
+  } else {
+    return g_strdup_printf ("type='signal',"
+                            "sender='" MS2_DBUS_SERVICE_PREFIX "%s',"
+                            "interface='org.gnome.UPnP.MediaContainer2',"
+                            "member='Updated'",
+                            provider);
+  }
+}
+
+/* Asks dbus to send Updated signals of provider, or only those of object_path
+   if it is not NULL. Does not wait for the reply */
+static void
+add_updated_match (MS2Observer *observer,
+                   const gchar *provider,
+                   const gchar *object_path)
+{
+  gchar *rule;
+
+  rule = updated_match_rule (provider, object_path);
+  dbus_bus_add_match (observer->priv->connection, rule, NULL);
+  g_free (rule);
+}
+
+/* Undoes add_updated_match() */
+static void
+remove_updated_match (MS2Observer *observer,
+                      const gchar *provider,
+                      const gchar *object_path)
+{
+  gchar *rule;
+
+  rule = updated_match_rule (provider, object_path);
+  dbus_bus_remove_match (observer->priv->connection, rule, NULL);
+  g_free (rule);
+}
+
+/* Adds a client notified of updates in any object of provider */
+static void
+ref_all_updates (MS2Observer *observer,
+                 const gchar *provider)
+{
+  guint count;
+
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (observer->priv->all_updates,
+                                                 provider));
+  if (count == 0) {
+    add_updated_match (observer, provider, NULL);
+  }
+
+  g_hash_table_insert (observer->priv->all_updates,
+                       g_strdup (provider),
+                       GUINT_TO_POINTER (count + 1));
+}
+
+/* Removes a client notified of updates in any object of provider */
+static void
+unref_all_updates (MS2Observer *observer,
+                   const gchar *provider)
+{
+  guint count;
+
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (observer->priv->all_updates,
+                                                 provider));
+  if (count > 1) {
+    g_hash_table_insert (observer->priv->all_updates,
+                         g_strdup (provider),
+                         GUINT_TO_POINTER (count - 1));
+  } else if (count == 1) {
+    g_hash_table_remove (observer->priv->all_updates, provider);
+    remove_updated_match (observer, provider, NULL);
+  }
+}
+
+/* Removes client from the ones watching object_path */
+static void
+remove_path_watcher (MS2Observer *observer,
+                     MS2Client *client,
+                     const gchar *provider,
+                     const gchar *object_path)
+{
+  GList *clients;
+
+  clients = g_hash_table_lookup (observer->priv->paths, object_path);
+  clients = g_list_remove (clients, client);
+  if (clients) {
+    g_hash_table_insert (observer->priv->paths, g_strdup (object_path), clients);
+  } else {
+    g_hash_table_remove (observer->priv->paths, object_path);
+    remove_updated_match (observer, provider, object_path);
+  }
+}
+
 /* Callback invoked when a NameOwner is changed in dbus */
 static void
 name_owner_changed (DBusGProxy *proxy,
@@ -71,8 +528,16 @@ name_owner_changed (DBusGProxy *proxy,
 
   name += MS2_DBUS_SERVICE_PREFIX_LENGTH;
 
+  /* Replies to requests seeding the providers may be older */
+  if (!observer->priv->providers_ready) {
+    g_hash_table_insert (observer->priv->providers_changed,
+                         g_strdup (name),
+                         GUINT_TO_POINTER (TRUE));
+  }
+
   /* Check if it has been removed */
   if (*new_owner == '\0') {
+    update_provider (observer, name, MS2_PROVIDER_RUNNING, FALSE);
     clients = g_hash_table_lookup (observer->priv->clients, name);
     g_list_foreach (clients, (GFunc) ms2_client_notify_destroy, NULL);
     return;
@@ -80,45 +545,62 @@ name_owner_changed (DBusGProxy *proxy,
 
   /* Check if it has been added */
   if (*old_owner == '\0') {
+    update_provider (observer, name, MS2_PROVIDER_RUNNING, TRUE);
     g_signal_emit (observer, signals[NEW], 0, name);
   }
 }
 
 /* Check for Updated signal and notify appropriate MS2Client, which will send a
-   signal */
+   signal: those watching the object, and those not watching any object in
+   particular */
 static DBusHandlerResult
 listen_updated_signal (DBusConnection *connection,
                        DBusMessage *message,
                        void *user_data)
 {
+  GList *client;
   GList *clients;
   MS2Observer *observer = MS2_OBSERVER (user_data);
-  gchar **path;
+  const gchar *end;
+  const gchar *object_path;
+  gchar *provider;
 
-  if (dbus_message_is_signal (message,
-                              "org.gnome.UPnP.MediaContainer2",
-                              "Updated")) {
-    dbus_message_get_path_decomposed (message, &path);
+  if (!dbus_message_is_signal (message,
+                               "org.gnome.UPnP.MediaContainer2",
+                               "Updated")) {
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
 
-    if (g_strv_length (path) < 5) {
-      g_printerr ("Wrong object path %s\n", dbus_message_get_path (message));
-      dbus_free_string_array (path);
-      return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-    }
+  object_path = dbus_message_get_path (message);
+  if (!g_str_has_prefix (object_path, MS2_DBUS_PATH_PREFIX) ||
+      object_path[strlen (MS2_DBUS_PATH_PREFIX)] == '\0') {
+    g_printerr ("Wrong object path %s\n", object_path);
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
 
-    /* Check if there is a client for this provider; if so, then notify all of
-       them */
-    clients = g_hash_table_lookup (observer->priv->clients, path[4]);
-    dbus_free_string_array (path);
+  /* Lists are copied, as clients can stop watching while being notified */
+  clients = g_list_copy (g_hash_table_lookup (observer->priv->paths,
+                                              object_path));
+  g_list_foreach (clients,
+                  (GFunc) ms2_client_notify_updated,
+                  (gpointer) object_path);
+  g_list_free (clients);
 
-    g_list_foreach (clients,
-                    (GFunc) ms2_client_notify_updated,
-                    (gpointer) dbus_message_get_path (message));
+  provider = (gchar *) object_path + strlen (MS2_DBUS_PATH_PREFIX);
+  end = strchr (provider, '/');
+  provider = end? g_strndup (provider, end - provider): g_strdup (provider);
 
-    return DBUS_HANDLER_RESULT_HANDLED;
+  clients = g_list_copy (g_hash_table_lookup (observer->priv->clients,
+                                              provider));
+  for (client = clients; client; client = g_list_next (client)) {
+    if (!g_hash_table_lookup (observer->priv->watches, client->data)) {
+      ms2_client_notify_updated (client->data, object_path);
+    }
   }
+  g_list_free (clients);
+  g_free (provider);
 
-  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  return DBUS_HANDLER_RESULT_HANDLED;
 }
 
 /* Creates an instance of observer */
@@ -157,12 +639,33 @@ create_instance ()
                                observer,
                                NULL);
 
-  /* Listen for Updated signal */
+  /* Listen for changes in services that can be activated */
+  dbus_g_proxy_add_signal (observer->priv->proxy,
+                           "ActivatableServicesChanged",
+                           G_TYPE_INVALID);
+  dbus_g_proxy_connect_signal (observer->priv->proxy,
+                               "ActivatableServicesChanged",
+                               G_CALLBACK (activatable_services_changed),
+                               observer,
+                               NULL);
+
+  /* Seed the known providers; from now on they are tracked through
+     NameOwnerChanged */
+  observer->priv->providers_pending = 2;
+  dbus_g_proxy_begin_call (observer->priv->proxy,
+                           "ListNames",
+                           list_names_reply,
+                           observer, NULL,
+                           G_TYPE_INVALID);
+  dbus_g_proxy_begin_call (observer->priv->proxy,
+                           "ListActivatableNames",
+                           list_activatable_names_reply,
+                           observer, NULL,
+                           G_TYPE_INVALID);
+
+  /* Listen for Updated signal; match rules are added as clients need them */
   connection = dbus_g_connection_get_connection (gconnection);
-  dbus_bus_add_match (connection,
-                      "interface='org.gnome.UPnP.MediaContainer2',"
-                      "member='Updated'",
-                      NULL);
+  observer->priv->connection = connection;
   dbus_connection_add_filter (connection,
                               listen_updated_signal,
                               observer,
@@ -204,6 +707,23 @@ ms2_observer_init (MS2Observer *client)
                                                  g_str_equal,
                                                  g_free,
                                                  NULL);
+  client->priv->providers = g_hash_table_new_full (g_str_hash,
+                                                   g_str_equal,
+                                                   g_free,
+                                                   NULL);
+  client->priv->providers_changed = g_hash_table_new_full (g_str_hash,
+                                                           g_str_equal,
+                                                           g_free,
+                                                           NULL);
+  client->priv->all_updates = g_hash_table_new_full (g_str_hash,
+                                                     g_str_equal,
+                                                     g_free,
+                                                     NULL);
+  client->priv->paths = g_hash_table_new_full (g_str_hash,
+                                               g_str_equal,
+                                               g_free,
+                                               NULL);
+  client->priv->watches = g_hash_table_new (g_direct_hash, g_direct_equal);
 }
 
 /****************** INTERNAL PUBLIC API (NOT TO BE EXPORTED) ******************/
@@ -224,6 +744,8 @@ ms2_observer_add_client (MS2Client *client,
   clients = g_hash_table_lookup (observer->priv->clients, provider);
   clients = g_list_prepend (clients, client);
   g_hash_table_insert (observer->priv->clients, g_strdup (provider), clients);
+
+  ref_all_updates (observer, provider);
 }
 
 /* Remove a client */
@@ -232,6 +754,8 @@ ms2_observer_remove_client (MS2Client *client,
                             const gchar *provider)
 {
   GList *clients;
+  GList *path;
+  GList *paths;
   GList *remove_client;
   MS2Observer *observer;
 
@@ -250,7 +774,91 @@ ms2_observer_remove_client (MS2Client *client,
     } else {
       g_hash_table_remove (observer->priv->clients, provider);
     }
+
+    paths = g_hash_table_lookup (observer->priv->watches, client);
+    if (paths) {
+      g_hash_table_remove (observer->priv->watches, client);
+      for (path = paths; path; path = g_list_next (path)) {
+        remove_path_watcher (observer, client, provider, path->data);
+        g_free (path->data);
+      }
+      g_list_free (paths);
+    } else {
+      unref_all_updates (observer, provider);
+    }
+  }
+}
+
+/* Notify client of updates in object_path; once a client watches some path, it
+   is not notified of updates in other objects */
+void
+ms2_observer_watch_path (MS2Client *client,
+                         const gchar *provider,
+                         const gchar *object_path)
+{
+  GList *clients;
+  GList *paths;
+  MS2Observer *observer;
+
+  observer = ms2_observer_get_instance ();
+  if (!observer) {
+    return;
+  }
+
+  paths = g_hash_table_lookup (observer->priv->watches, client);
+  if (g_list_find_custom (paths, object_path, (GCompareFunc) strcmp)) {
+    return;
+  }
+
+  clients = g_hash_table_lookup (observer->priv->paths, object_path);
+  if (!clients) {
+    add_updated_match (observer, provider, object_path);
+  }
+  clients = g_list_prepend (clients, client);
+  g_hash_table_insert (observer->priv->paths, g_strdup (object_path), clients);
+
+  /* Rule for the path is in place before the one for the whole provider is
+     removed, so no update is lost */
+  if (!paths) {
+    unref_all_updates (observer, provider);
+  }
+
+  paths = g_list_prepend (paths, g_strdup (object_path));
+  g_hash_table_insert (observer->priv->watches, client, paths);
+}
+
+/* Stop notifying client of updates in object_path; when it does not watch any
+   path, it is notified of updates in all objects again */
+void
+ms2_observer_unwatch_path (MS2Client *client,
+                           const gchar *provider,
+                           const gchar *object_path)
+{
+  GList *path;
+  GList *paths;
+  MS2Observer *observer;
+
+  observer = ms2_observer_get_instance ();
+  if (!observer) {
+    return;
+  }
+
+  paths = g_hash_table_lookup (observer->priv->watches, client);
+  path = g_list_find_custom (paths, object_path, (GCompareFunc) strcmp);
+  if (!path) {
+    return;
+  }
+
+  g_free (path->data);
+  paths = g_list_delete_link (paths, path);
+  if (paths) {
+    g_hash_table_insert (observer->priv->watches, client, paths);
+  } else {
+    g_hash_table_remove (observer->priv->watches, client);
+    ref_all_updates (observer, provider);
   }
+
+  remove_path_watcher (observer, client, provider, object_path);
 }
 
 /******************** PUBLIC API ********************/
@@ -270,3 +878,187 @@ MS2Observer *ms2_observer_get_instance ()
 
   return observer_instance;
 }
+
+/**
+ * ms2_observer_get_providers:
+ * @observer: a #MS2Observer
+ *
+ * Returns the content providers following MediaServer2 specification that are
+ * running. Use ms2_observer_list_providers() to include those that dbus can
+ * activate on demand.
+ *
+ * Providers are requested to dbus once, when the observer is created, and then
+ * kept up to date as they come and go, so this does not need to contact dbus
+ * unless it is called before the first reply is received.
+ *
+ * Returns: a new @NULL-terminated array of strings
+ **/
+gchar **
+ms2_observer_get_providers (MS2Observer *observer)
+{
+  g_return_val_if_fail (MS2_IS_OBSERVER (observer), NULL);
+
+  seed_providers (observer);
+
+  return providers_to_strv (observer, MS2_PROVIDER_RUNNING);
+}
+
+/**
+ * ms2_observer_get_providers_async:
+ * @observer: a #MS2Observer
+ * @callback: a #GAsyncReadyCallback to call when providers are known
+ * @user_data: the data to pass to callback function
+ *
+ * Starts an asynchronous request of the content providers.
+ *
+ * For more details, see ms2_observer_get_providers(), which is the synchronous
+ * version of this call.
+ *
+ * When the providers are known, @callback will be called with @user_data. To
+ * finish the operation, call ms2_observer_get_providers_finish() with the
+ * #GAsyncResult returned by the @callback.
+ **/
+void
+ms2_observer_get_providers_async (MS2Observer *observer,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data)
+{
+  ms2_observer_get_providers_async_full (observer,
+                                         -1,
+                                         NULL,
+                                         callback,
+                                         user_data);
+}
+
+/**
+ * ms2_observer_get_providers_async_full:
+ * @observer: a #MS2Observer
+ * @timeout: milliseconds to wait for the providers to be known, or -1 for no
+ * limit
+ * @cancellable: (allow-none): a #GCancellable, or @NULL
+ * @callback: a #GAsyncReadyCallback to call when providers are known
+ * @user_data: the data to pass to callback function
+ *
+ * Like ms2_observer_get_providers_async(), waiting at most @timeout for dbus to
+ * tell the providers, and allowing to stop waiting with @cancellable. The
+ * operation then finishes with %G_IO_ERROR_TIMED_OUT or
+ * %G_IO_ERROR_CANCELLED.
+ *
+ * Once the providers are known, the operation finishes at once.
+ **/
+void
+ms2_observer_get_providers_async_full (MS2Observer *observer,
+                                       gint timeout,
+                                       GCancellable *cancellable,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data)
+{
+  GSimpleAsyncResult *res;
+  ProvidersData *pdata;
+
+  g_return_if_fail (MS2_IS_OBSERVER (observer));
+
+  res = g_simple_async_result_new (G_OBJECT (observer),
+                                   callback,
+                                   user_data,
+                                   ms2_observer_get_providers_async);
+  pdata = g_slice_new0 (ProvidersData);
+  pdata->observer = observer;
+  g_simple_async_result_set_op_res_gpointer (res,
+                                             pdata,
+                                             (GDestroyNotify) free_providers_data);
+
+  if (observer->priv->providers_ready) {
+    g_simple_async_result_complete_in_idle (res);
+    g_object_unref (res);
+    return;
+  }
+
+  observer->priv->providers_waiting =
+    g_list_prepend (observer->priv->providers_waiting, res);
+
+  if (timeout >= 0) {
+    pdata->timeout_id = g_timeout_add (timeout, providers_wait_timeout, res);
+  }
+
+  if (cancellable) {
+    pdata->cancellable = g_object_ref (cancellable);
+    pdata->cancelled_id = g_cancellable_connect (cancellable,
+                                                 G_CALLBACK (providers_wait_cancelled),
+                                                 res,
+                                                 NULL);
+  }
+}
+
+/**
+ * ms2_observer_get_providers_finish:
+ * @observer: a #MS2Observer
+ * @res: a #GAsyncResult
+ * @error: a #GError location to store the error ocurring, or @NULL to ignore
+ *
+ * Finishes an asynchronous request of the content providers.
+ *
+ * Returns: a new @NULL-terminated array of strings, or @NULL if the operation
+ * timed out or was cancelled
+ **/
+gchar **
+ms2_observer_get_providers_finish (MS2Observer *observer,
+                                   GAsyncResult *res,
+                                   GError **error)
+{
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) ==
+                        ms2_observer_get_providers_async, NULL);
+
+  if (g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (res),
+                                             error)) {
+    return NULL;
+  }
+
+  return providers_to_strv (observer, MS2_PROVIDER_RUNNING);
+}
+
+/**
+ * ms2_observer_list_providers:
+ * @observer: a #MS2Observer
+ * @flags: states of the providers to return
+ *
+ * Returns the content providers following MediaServer2 specification that are
+ * in any of the states in @flags; e.g. %MS2_PROVIDER_RUNNING |
+ * %MS2_PROVIDER_ACTIVATABLE returns both those running and those that dbus can
+ * activate on demand.
+ *
+ * Returns: a new @NULL-terminated array of strings
+ **/
+gchar **
+ms2_observer_list_providers (MS2Observer *observer,
+                             MS2ProviderFlags flags)
+{
+  g_return_val_if_fail (MS2_IS_OBSERVER (observer), NULL);
+
+  seed_providers (observer);
+
+  return providers_to_strv (observer, flags);
+}
+
+/**
+ * ms2_observer_get_provider_flags:
+ * @observer: a #MS2Observer
+ * @provider: provider name
+ *
+ * Returns the state of a content provider: whether it is running, and whether
+ * dbus can activate it on demand.
+ *
+ * Returns: flags of @provider, or 0 if it is not known
+ **/
+MS2ProviderFlags
+ms2_observer_get_provider_flags (MS2Observer *observer,
+                                 const gchar *provider)
+{
+  g_return_val_if_fail (MS2_IS_OBSERVER (observer), 0);
+  g_return_val_if_fail (provider, 0);
+
+  seed_providers (observer);
+
+  return GPOINTER_TO_UINT (g_hash_table_lookup (observer->priv->providers,
+                                                provider));
+}
@@ -25,6 +25,7 @@
 
 #include <glib-object.h>
 #include <glib.h>
+#include <gio/gio.h>
 
 #include "media-server2-common.h"
 
@@ -54,6 +55,12 @@
                               MS2_TYPE_OBSERVER,        \
                               MS2ObserverClass))
 
+/* State of a provider */
+typedef enum {
+  MS2_PROVIDER_RUNNING     = 1 << 0,
+  MS2_PROVIDER_ACTIVATABLE = 1 << 1
+} MS2ProviderFlags;
+
 typedef struct _MS2Observer        MS2Observer;
 typedef struct _MS2ObserverPrivate MS2ObserverPrivate;
 
@@ -79,4 +86,26 @@ GType ms2_observer_get_type (void);
 
 MS2Observer *ms2_observer_get_instance (void);
 
+gchar **ms2_observer_get_providers (MS2Observer *observer);
+
+void ms2_observer_get_providers_async (MS2Observer *observer,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data);
+
+void ms2_observer_get_providers_async_full (MS2Observer *observer,
+                                            gint timeout,
+                                            GCancellable *cancellable,
+                                            GAsyncReadyCallback callback,
+                                            gpointer user_data);
+
+gchar **ms2_observer_get_providers_finish (MS2Observer *observer,
+                                           GAsyncResult *res,
+                                           GError **error);
+
+gchar **ms2_observer_list_providers (MS2Observer *observer,
+                                     MS2ProviderFlags flags);
+
+MS2ProviderFlags ms2_observer_get_provider_flags (MS2Observer *observer,
+                                                  const gchar *provider);
+
 #endif /* _MEDIA_SERVER2_OBSERVER_H_ */
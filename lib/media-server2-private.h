@@ -23,6 +23,7 @@
 #ifndef _MEDIA_SERVER2_PRIVATE_H_
 #define _MEDIA_SERVER2_PRIVATE_H_
 
+#include <dbus/dbus.h>
 #include <glib.h>
 
 #include "media-server2-client.h"
@@ -33,12 +34,122 @@
 
 #define MS2_DBUS_SERVICE_PREFIX_LENGTH 28
 
+/* Methods served by the root object of each provider */
+#define MS2_PROVIDER_IFACE "org.gnome.Grilo.MediaServer2"
+
+/* Runtime statistics, served by the root object of each provider and by the
+   object at MS2_DBUS_STATS_PATH for the whole process */
+#define MS2_STATS_IFACE     "org.gnome.UPnP.MediaServer2.Stats"
+#define MS2_DBUS_STATS_PATH "/org/gnome/UPnP/MediaServer2"
+
+/* Listing methods that report where to continue truncated replies */
+#define MS2_PAGED_CONTAINER_IFACE "org.gnome.Grilo.MediaContainer2"
+
+/*
+ * Description of a MediaServer2 property, generated at build time from
+ * media-server2-introspection.h
+ *   name: property name
+ *   interface: interface the property belongs to
+ *   signature: dbus signature of property value
+ *   default_value: value used when unknown, for numeric and boolean properties
+ */
+typedef struct {
+  const gchar *name;
+  const gchar *interface;
+  const gchar *signature;
+  gint64 default_value;
+} MS2PropertyDesc;
+
+extern const MS2PropertyDesc ms2_property_table[];
+
+extern const guint ms2_n_properties;
+
+extern const gchar *ms2_mediaobject2_properties[];
+
+extern const gchar *ms2_mediaitem2_properties[];
+
+extern const gchar *ms2_mediacontainer2_properties[];
+
+extern const gchar *ms2_all_properties[];
+
+const MS2PropertyDesc *ms2_property_lookup (const gchar *property);
+
+/* Methods whose requests are accounted in statistics */
+typedef enum {
+  MS2_STATS_GET,
+  MS2_STATS_GET_ALL,
+  MS2_STATS_LIST_CHILDREN,
+  MS2_STATS_LIST_CONTAINERS,
+  MS2_STATS_LIST_ITEMS,
+  MS2_STATS_SEARCH_OBJECTS,
+  MS2_STATS_GET_PROPERTIES_BATCH,
+  MS2_STATS_N_METHODS
+} MS2StatsMethod;
+
+typedef struct _MS2Stats MS2Stats;
+
+void ms2_arena_enter (void);
+
+void ms2_arena_leave (void);
+
+gpointer ms2_arena_alloc0 (gsize size);
+
+gchar *ms2_arena_strdup (const gchar *str);
+
+GValue *ms2_arena_new_value (void);
+
+void ms2_arena_value_set_string (GValue *value, const gchar *str);
+
+GHashTable *ms2_arena_new_table (void);
+
+gboolean ms2_arena_has_table (GHashTable *table);
+
+void ms2_arena_free_value (GValue *value);
+
 void ms2_client_notify_destroy (MS2Client *client);
 
 void ms2_client_notify_updated (MS2Client *client, const gchar *object_path);
 
+GList *ms2_client_results_to_glist (GPtrArray *result);
+
+MS2ResultSet *ms2_result_set_new_from_message (DBusMessage *message);
+
 void ms2_observer_add_client (MS2Client *client, const gchar *provider);
 
 void ms2_observer_remove_client (MS2Client *client, const gchar *provider);
 
+void ms2_observer_watch_path (MS2Client *client, const gchar *provider, const gchar *object_path);
+
+void ms2_observer_unwatch_path (MS2Client *client, const gchar *provider, const gchar *object_path);
+
+MS2Stats *ms2_stats_new (void);
+
+void ms2_stats_free (MS2Stats *stats);
+
+MS2Stats *ms2_stats_get_global (void);
+
+void ms2_stats_begin (MS2Stats *stats, MS2StatsMethod method);
+
+void ms2_stats_end (MS2Stats *stats);
+
+void ms2_stats_add_backend_time (MS2Stats *stats, gint64 start);
+
+void ms2_stats_add_marshal_time (MS2Stats *stats, gint64 start);
+
+void ms2_stats_add_bytes (MS2Stats *stats, gsize bytes);
+
+void ms2_stats_append (MS2Stats *stats, DBusMessageIter *dict);
+
+void ms2_stats_append_uint (DBusMessageIter *dict, const gchar *key, guint32 value);
+
+void ms2_stats_append_uint64 (DBusMessageIter *dict, const gchar *key, guint64 value);
+
+guint ms2_server_id_to_index (MS2Server *server, const gchar *id);
+
+const gchar *ms2_server_index_to_id (MS2Server *server, guint index);
+
+MS2Server *ms2_server_new_offline (const gchar *name);
+
+gsize ms2_server_append_objects (DBusMessage *m, GList *objects);
+
 #endif /* _MEDIA_SERVER2_PRIVATE_H_ */
@@ -0,0 +1,679 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <dbus/dbus-glib.h>
+#include <string.h>
+
+#include "media-server2-private.h"
+
+/*
+ * Values of one property for all objects in a result set
+ *   desc: property description; its name is shared by all result sets
+ *   dbus_type: dbus type of values
+ *   element_type: dbus type of elements, if values are arrays
+ *   strings: values, if they are strings or object paths
+ *   strvs: values, if they are arrays of strings or object paths
+ *   numbers: values, if they are numbers or booleans
+ *   present: which objects have a value, if they are numbers or booleans
+ */
+typedef struct {
+  const MS2PropertyDesc *desc;
+  gint dbus_type;
+  gint element_type;
+  const gchar **strings;
+  const gchar ***strvs;
+  gint64 *numbers;
+  guint8 *present;
+} MS2ResultColumn;
+
+/*
+ * MS2ResultSet structure
+ *   ref_count: number of references
+ *   length: number of objects
+ *   strings: storage for all strings in the set; repeated strings are stored
+ *            once
+ *   columns: values of each property, in the same order than
+ *            ms2_property_table; NULL if no object has the property
+ */
+struct _MS2ResultSet {
+  gint ref_count;
+  guint length;
+  GStringChunk *strings;
+  MS2ResultColumn **columns;
+};
+
+/******************** PRIVATE API ********************/
+
+/* Returns the column of property, or NULL if no object has it */
+static MS2ResultColumn *
+get_column (MS2ResultSet *set,
+            const gchar *property)
+{
+  const MS2PropertyDesc *desc;
+
+  desc = ms2_property_lookup (property);
+  if (!desc) {
+    return NULL;
+  }
+
+  return set->columns[desc - ms2_property_table];
+}
+
+/* Checks if dbus type is supported in columns */
+static gboolean
+is_supported_type (gint dbus_type,
+                   gint element_type)
+{
+  switch (dbus_type) {
+  case DBUS_TYPE_STRING:
+  case DBUS_TYPE_OBJECT_PATH:
+  case DBUS_TYPE_INT32:
+  case DBUS_TYPE_UINT32:
+  case DBUS_TYPE_INT64:
+  case DBUS_TYPE_UINT64:
+  case DBUS_TYPE_BOOLEAN:
+    return TRUE;
+  case DBUS_TYPE_ARRAY:
+    return element_type == DBUS_TYPE_STRING ||
+      element_type == DBUS_TYPE_OBJECT_PATH;
+  default:
+    return FALSE;
+  }
+}
+
+/* Returns the column where values of desc with the given type are stored,
+   creating it if needed, or NULL if values of that type can not be stored */
+static MS2ResultColumn *
+ensure_column (MS2ResultSet *set,
+               const MS2PropertyDesc *desc,
+               gint dbus_type,
+               gint element_type)
+{
+  MS2ResultColumn *column;
+
+  column = set->columns[desc - ms2_property_table];
+  if (column) {
+    /* All values of a property must have the same type */
+    if (column->dbus_type != dbus_type ||
+        column->element_type != element_type) {
+      return NULL;
+    }
+    return column;
+  }
+
+  if (!is_supported_type (dbus_type, element_type)) {
+    return NULL;
+  }
+
+  column = g_slice_new0 (MS2ResultColumn);
+  column->desc = desc;
+  column->dbus_type = dbus_type;
+  column->element_type = element_type;
+
+  switch (dbus_type) {
+  case DBUS_TYPE_STRING:
+  case DBUS_TYPE_OBJECT_PATH:
+    column->strings = g_new0 (const gchar *, set->length);
+    break;
+  case DBUS_TYPE_ARRAY:
+    column->strvs = g_new0 (const gchar **, set->length);
+    break;
+  default:
+    column->numbers = g_new0 (gint64, set->length);
+    column->present = g_new0 (guint8, set->length);
+    break;
+  }
+
+  set->columns[desc - ms2_property_table] = column;
+
+  return column;
+}
+
+/* Free MS2ResultColumn */
+static void
+free_column (MS2ResultColumn *column,
+             guint length)
+{
+  guint i;
+
+  if (column->strvs) {
+    for (i = 0; i < length; i++) {
+      g_free (column->strvs[i]);
+    }
+  }
+
+  g_free (column->strings);
+  g_free (column->strvs);
+  g_free (column->numbers);
+  g_free (column->present);
+  g_slice_free (MS2ResultColumn, column);
+}
+
+/* Stores the value in variant as the property of object index */
+static void
+store_value (MS2ResultSet *set,
+             guint index,
+             const MS2PropertyDesc *desc,
+             DBusMessageIter *variant)
+{
+  DBusMessageIter array;
+  GPtrArray *strv;
+  MS2ResultColumn *column;
+  dbus_bool_t b;
+  dbus_int32_t i;
+  dbus_int64_t x;
+  dbus_uint32_t u;
+  dbus_uint64_t t;
+  const gchar *s;
+  gint dbus_type;
+  gint element_type = DBUS_TYPE_INVALID;
+
+  dbus_type = dbus_message_iter_get_arg_type (variant);
+  if (dbus_type == DBUS_TYPE_ARRAY) {
+    element_type = dbus_message_iter_get_element_type (variant);
+  }
+
+  column = ensure_column (set, desc, dbus_type, element_type);
+  if (!column) {
+    return;
+  }
+
+  switch (dbus_type) {
+  case DBUS_TYPE_STRING:
+  case DBUS_TYPE_OBJECT_PATH:
+    dbus_message_iter_get_basic (variant, &s);
+    column->strings[index] = g_string_chunk_insert_const (set->strings, s);
+    return;
+  case DBUS_TYPE_ARRAY:
+    strv = g_ptr_array_new ();
+    dbus_message_iter_recurse (variant, &array);
+    while (dbus_message_iter_get_arg_type (&array) != DBUS_TYPE_INVALID) {
+      dbus_message_iter_get_basic (&array, &s);
+      g_ptr_array_add (strv, g_string_chunk_insert_const (set->strings, s));
+      dbus_message_iter_next (&array);
+    }
+    g_ptr_array_add (strv, NULL);
+    g_free (column->strvs[index]);
+    column->strvs[index] = (const gchar **) g_ptr_array_free (strv, FALSE);
+    return;
+  case DBUS_TYPE_INT32:
+    dbus_message_iter_get_basic (variant, &i);
+    column->numbers[index] = i;
+    break;
+  case DBUS_TYPE_UINT32:
+    dbus_message_iter_get_basic (variant, &u);
+    column->numbers[index] = u;
+    break;
+  case DBUS_TYPE_INT64:
+    dbus_message_iter_get_basic (variant, &x);
+    column->numbers[index] = x;
+    break;
+  case DBUS_TYPE_UINT64:
+    dbus_message_iter_get_basic (variant, &t);
+    column->numbers[index] = t;
+    break;
+  case DBUS_TYPE_BOOLEAN:
+    dbus_message_iter_get_basic (variant, &b);
+    column->numbers[index] = b;
+    break;
+  }
+
+  column->present[index] = TRUE;
+}
+
+/* Returns value of property of object index as a new GValue, with the same
+   type dbus-glib would have given it, or NULL if object does not have it */
+static GValue *
+column_get_value (MS2ResultColumn *column,
+                  guint index)
+{
+  GPtrArray *paths;
+  GValue *value;
+  const gchar **s;
+
+  if (column->present && !column->present[index]) {
+    return NULL;
+  }
+
+  if ((column->strings && !column->strings[index]) ||
+      (column->strvs && !column->strvs[index])) {
+    return NULL;
+  }
+
+  value = g_new0 (GValue, 1);
+
+  switch (column->dbus_type) {
+  case DBUS_TYPE_STRING:
+    g_value_init (value, G_TYPE_STRING);
+    g_value_set_string (value, column->strings[index]);
+    break;
+  case DBUS_TYPE_OBJECT_PATH:
+    g_value_init (value, DBUS_TYPE_G_OBJECT_PATH);
+    g_value_set_boxed (value, column->strings[index]);
+    break;
+  case DBUS_TYPE_ARRAY:
+    if (column->element_type == DBUS_TYPE_STRING) {
+      g_value_init (value, G_TYPE_STRV);
+      g_value_set_boxed (value, column->strvs[index]);
+    } else {
+      paths = g_ptr_array_new ();
+      for (s = column->strvs[index]; *s; s++) {
+        g_ptr_array_add (paths, g_strdup (*s));
+      }
+      g_value_init (value,
+                    dbus_g_type_get_collection ("GPtrArray",
+                                                DBUS_TYPE_G_OBJECT_PATH));
+      g_value_take_boxed (value, paths);
+    }
+    break;
+  case DBUS_TYPE_INT32:
+    g_value_init (value, G_TYPE_INT);
+    g_value_set_int (value, column->numbers[index]);
+    break;
+  case DBUS_TYPE_UINT32:
+    g_value_init (value, G_TYPE_UINT);
+    g_value_set_uint (value, column->numbers[index]);
+    break;
+  case DBUS_TYPE_INT64:
+    g_value_init (value, G_TYPE_INT64);
+    g_value_set_int64 (value, column->numbers[index]);
+    break;
+  case DBUS_TYPE_UINT64:
+    g_value_init (value, G_TYPE_UINT64);
+    g_value_set_uint64 (value, column->numbers[index]);
+    break;
+  case DBUS_TYPE_BOOLEAN:
+    g_value_init (value, G_TYPE_BOOLEAN);
+    g_value_set_boolean (value, column->numbers[index]);
+    break;
+  }
+
+  return value;
+}
+
+/* Free gvalue */
+static void
+free_gvalue (GValue *v)
+{
+  if (v) {
+    g_value_unset (v);
+    g_free (v);
+  }
+}
+
+/* Moves iter into the properties dictionary of an object, which may come
+   wrapped in a struct */
+static void
+recurse_object (DBusMessageIter *object,
+                DBusMessageIter *dict)
+{
+  DBusMessageIter st;
+
+  if (dbus_message_iter_get_arg_type (object) == DBUS_TYPE_STRUCT) {
+    dbus_message_iter_recurse (object, &st);
+    dbus_message_iter_recurse (&st, dict);
+  } else {
+    dbus_message_iter_recurse (object, dict);
+  }
+}
+
+/****************** INTERNAL PUBLIC API (NOT TO BE EXPORTED) ******************/
+
+/* Builds a result set from the objects in first argument of message, an array
+   of property dictionaries as replied by listing methods. Only MediaServer2
+   properties are kept */
+MS2ResultSet *
+ms2_result_set_new_from_message (DBusMessage *message)
+{
+  DBusMessageIter array;
+  DBusMessageIter dict;
+  DBusMessageIter entry;
+  DBusMessageIter iter;
+  DBusMessageIter variant;
+  MS2ResultSet *set;
+  const MS2PropertyDesc *desc;
+  const gchar *key;
+  guint index;
+
+  set = g_slice_new0 (MS2ResultSet);
+  set->ref_count = 1;
+  set->strings = g_string_chunk_new (1024);
+  set->columns = g_new0 (MS2ResultColumn *, ms2_n_properties);
+
+  if (!dbus_message_iter_init (message, &iter) ||
+      dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_ARRAY) {
+    return set;
+  }
+
+  /* Columns are sized up front */
+  dbus_message_iter_recurse (&iter, &array);
+  while (dbus_message_iter_get_arg_type (&array) != DBUS_TYPE_INVALID) {
+    set->length++;
+    dbus_message_iter_next (&array);
+  }
+
+  dbus_message_iter_recurse (&iter, &array);
+  for (index = 0; index < set->length; index++) {
+    recurse_object (&array, &dict);
+    while (dbus_message_iter_get_arg_type (&dict) == DBUS_TYPE_DICT_ENTRY) {
+      dbus_message_iter_recurse (&dict, &entry);
+      dbus_message_iter_get_basic (&entry, &key);
+      desc = ms2_property_lookup (key);
+      if (desc) {
+        dbus_message_iter_next (&entry);
+        dbus_message_iter_recurse (&entry, &variant);
+        store_value (set, index, desc, &variant);
+      }
+      dbus_message_iter_next (&dict);
+    }
+    dbus_message_iter_next (&array);
+  }
+
+  return set;
+}
+
+/******************** PUBLIC API ********************/
+
+/**
+ * ms2_result_set_ref:
+ * @set: a #MS2ResultSet
+ *
+ * Adds a reference to the result set.
+ *
+ * Returns: @set
+ **/
+MS2ResultSet *
+ms2_result_set_ref (MS2ResultSet *set)
+{
+  g_return_val_if_fail (set, NULL);
+
+  g_atomic_int_inc (&set->ref_count);
+
+  return set;
+}
+
+/**
+ * ms2_result_set_unref:
+ * @set: a #MS2ResultSet
+ *
+ * Removes a reference to the result set, freeing it when there are no more
+ * references. Strings obtained from it are not valid any more.
+ **/
+void
+ms2_result_set_unref (MS2ResultSet *set)
+{
+  guint i;
+
+  g_return_if_fail (set);
+
+  if (!g_atomic_int_dec_and_test (&set->ref_count)) {
+    return;
+  }
+
+  for (i = 0; i < ms2_n_properties; i++) {
+    if (set->columns[i]) {
+      free_column (set->columns[i], set->length);
+    }
+  }
+  g_free (set->columns);
+  g_string_chunk_free (set->strings);
+  g_slice_free (MS2ResultSet, set);
+}
+
+/**
+ * ms2_result_set_get_length:
+ * @set: a #MS2ResultSet
+ *
+ * Returns the number of objects in the result set.
+ *
+ * Returns: number of objects
+ **/
+guint
+ms2_result_set_get_length (MS2ResultSet *set)
+{
+  g_return_val_if_fail (set, 0);
+
+  return set->length;
+}
+
+/**
+ * ms2_result_set_has_property:
+ * @set: a #MS2ResultSet
+ * @index: position of object in result set
+ * @property: property name
+ *
+ * Checks if object has a value for the property.
+ *
+ * Returns: @TRUE if object has the property
+ **/
+gboolean
+ms2_result_set_has_property (MS2ResultSet *set,
+                             guint index,
+                             const gchar *property)
+{
+  MS2ResultColumn *column;
+
+  g_return_val_if_fail (set, FALSE);
+  g_return_val_if_fail (index < set->length, FALSE);
+
+  column = get_column (set, property);
+  if (!column) {
+    return FALSE;
+  }
+
+  if (column->strings) {
+    return column->strings[index] != NULL;
+  } else if (column->strvs) {
+    return column->strvs[index] != NULL;
+  } else {
+    return column->present[index];
+  }
+}
+
+/**
+ * ms2_result_set_get_string:
+ * @set: a #MS2ResultSet
+ * @index: position of object in result set
+ * @property: property name
+ *
+ * Returns the value of a string or object path property of object. The string
+ * belongs to the result set; it must not be modified nor freed.
+ *
+ * Returns: property value, or @NULL if object does not have it
+ **/
+const gchar *
+ms2_result_set_get_string (MS2ResultSet *set,
+                           guint index,
+                           const gchar *property)
+{
+  MS2ResultColumn *column;
+
+  g_return_val_if_fail (set, NULL);
+  g_return_val_if_fail (index < set->length, NULL);
+
+  column = get_column (set, property);
+  if (!column || !column->strings) {
+    return NULL;
+  }
+
+  return column->strings[index];
+}
+
+/**
+ * ms2_result_set_get_integer:
+ * @set: a #MS2ResultSet
+ * @index: position of object in result set
+ * @property: property name
+ *
+ * Returns the value of a numeric property of object.
+ *
+ * Returns: property value, or the unknown value of the property if object does
+ * not have it
+ **/
+gint64
+ms2_result_set_get_integer (MS2ResultSet *set,
+                            guint index,
+                            const gchar *property)
+{
+  MS2ResultColumn *column;
+  const MS2PropertyDesc *desc;
+
+  g_return_val_if_fail (set, MS2_UNKNOWN_INT);
+  g_return_val_if_fail (index < set->length, MS2_UNKNOWN_INT);
+
+  desc = ms2_property_lookup (property);
+  if (!desc) {
+    return MS2_UNKNOWN_INT;
+  }
+
+  column = set->columns[desc - ms2_property_table];
+  if (!column || !column->present || !column->present[index]) {
+    return desc->default_value;
+  }
+
+  return column->numbers[index];
+}
+
+/**
+ * ms2_result_set_get_boolean:
+ * @set: a #MS2ResultSet
+ * @index: position of object in result set
+ * @property: property name
+ *
+ * Returns the value of a boolean property of object.
+ *
+ * Returns: property value, or @FALSE if object does not have it
+ **/
+gboolean
+ms2_result_set_get_boolean (MS2ResultSet *set,
+                            guint index,
+                            const gchar *property)
+{
+  MS2ResultColumn *column;
+
+  g_return_val_if_fail (set, FALSE);
+  g_return_val_if_fail (index < set->length, FALSE);
+
+  column = get_column (set, property);
+  if (!column || column->dbus_type != DBUS_TYPE_BOOLEAN) {
+    return FALSE;
+  }
+
+  return column->numbers[index] != 0;
+}
+
+/**
+ * ms2_result_set_get_strv:
+ * @set: a #MS2ResultSet
+ * @index: position of object in result set
+ * @property: property name
+ *
+ * Returns the value of an array of strings or object paths property of
+ * object. The array belongs to the result set; it must not be modified nor
+ * freed.
+ *
+ * Returns: a @NULL-terminated array, or @NULL if object does not have it
+ **/
+const gchar * const *
+ms2_result_set_get_strv (MS2ResultSet *set,
+                         guint index,
+                         const gchar *property)
+{
+  MS2ResultColumn *column;
+
+  g_return_val_if_fail (set, NULL);
+  g_return_val_if_fail (index < set->length, NULL);
+
+  column = get_column (set, property);
+  if (!column || !column->strvs) {
+    return NULL;
+  }
+
+  return (const gchar * const *) column->strvs[index];
+}
+
+/**
+ * ms2_result_set_get_properties:
+ * @set: a #MS2ResultSet
+ * @index: position of object in result set
+ *
+ * Returns the properties of object in a hash table of <prop_id, prop_gvalue>
+ * pairs, as returned by ms2_client_get_properties(), so they can be used with
+ * ms2_client_get_path() and similar functions.
+ *
+ * Returns: a new #GHashTable
+ **/
+GHashTable *
+ms2_result_set_get_properties (MS2ResultSet *set,
+                               guint index)
+{
+  GHashTable *properties;
+  GValue *value;
+  guint i;
+
+  g_return_val_if_fail (set, NULL);
+  g_return_val_if_fail (index < set->length, NULL);
+
+  properties = g_hash_table_new_full (g_str_hash,
+                                      g_str_equal,
+                                      (GDestroyNotify) g_free,
+                                      (GDestroyNotify) free_gvalue);
+
+  for (i = 0; i < ms2_n_properties; i++) {
+    if (set->columns[i]) {
+      value = column_get_value (set->columns[i], index);
+      if (value) {
+        g_hash_table_insert (properties,
+                             g_strdup (ms2_property_table[i].name),
+                             value);
+      }
+    }
+  }
+
+  return properties;
+}
+
+/**
+ * ms2_result_set_to_glist:
+ * @set: a #MS2ResultSet
+ *
+ * Returns the properties of all objects, in the same format than listing
+ * functions like ms2_client_list_children(). Only values kept in the result
+ * set are included.
+ *
+ * Returns: a new #GList of #GHashTable. To free it, free first each element
+ * (g_hash_table_unref()) and finally the list itself (g_list_free())
+ **/
+GList *
+ms2_result_set_to_glist (MS2ResultSet *set)
+{
+  GList *list = NULL;
+  guint i;
+
+  g_return_val_if_fail (set, NULL);
+
+  for (i = set->length; i > 0; i--) {
+    list = g_list_prepend (list, ms2_result_set_get_properties (set, i - 1));
+  }
+
+  return list;
+}
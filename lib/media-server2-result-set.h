@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef _MEDIA_SERVER2_RESULT_SET_H_
+#define _MEDIA_SERVER2_RESULT_SET_H_
+
+#include <glib.h>
+
+#include "media-server2-common.h"
+
+typedef struct _MS2ResultSet MS2ResultSet;
+
+MS2ResultSet *ms2_result_set_ref (MS2ResultSet *set);
+
+void ms2_result_set_unref (MS2ResultSet *set);
+
+guint ms2_result_set_get_length (MS2ResultSet *set);
+
+gboolean ms2_result_set_has_property (MS2ResultSet *set,
+                                      guint index,
+                                      const gchar *property);
+
+const gchar *ms2_result_set_get_string (MS2ResultSet *set,
+                                        guint index,
+                                        const gchar *property);
+
+gint64 ms2_result_set_get_integer (MS2ResultSet *set,
+                                   guint index,
+                                   const gchar *property);
+
+gboolean ms2_result_set_get_boolean (MS2ResultSet *set,
+                                     guint index,
+                                     const gchar *property);
+
+const gchar * const *ms2_result_set_get_strv (MS2ResultSet *set,
+                                              guint index,
+                                              const gchar *property);
+
+GHashTable *ms2_result_set_get_properties (MS2ResultSet *set,
+                                           guint index);
+
+GList *ms2_result_set_to_glist (MS2ResultSet *set);
+
+#endif /* _MEDIA_SERVER2_RESULT_SET_H_ */
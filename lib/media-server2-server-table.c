@@ -38,16 +38,33 @@ free_value (GValue *value)
   g_free (value);
 }
 
+/* Returns a new gvalue to be stored in properties, taken from the arena if
+   properties is a reply table */
+static GValue *
+new_value (GHashTable *properties)
+{
+  if (ms2_arena_has_table (properties)) {
+    return ms2_arena_new_value ();
+  } else {
+    return g_new0 (GValue, 1);
+  }
+}
+
 /* Puts a string in a gvalue */
 static GValue *
-str_to_value (const gchar *str)
+str_to_value (GHashTable *properties,
+              const gchar *str)
 {
   GValue *val = NULL;
 
   if (str) {
-    val = g_new0 (GValue, 1);
+    val = new_value (properties);
     g_value_init (val, G_TYPE_STRING);
-    g_value_set_string (val, str);
+    if (ms2_arena_has_table (properties)) {
+      ms2_arena_value_set_string (val, str);
+    } else {
+      g_value_set_string (val, str);
+    }
   }
 
   return val;
@@ -55,11 +72,12 @@ str_to_value (const gchar *str)
 
 /* Puts an int in a gvalue */
 static GValue *
-int_to_value (gint number)
+int_to_value (GHashTable *properties,
+              gint number)
 {
   GValue *val = NULL;
 
-  val = g_new0 (GValue, 1);
+  val = new_value (properties);
   g_value_init (val, G_TYPE_INT);
   g_value_set_int (val, number);
 
@@ -68,11 +86,12 @@ int_to_value (gint number)
 
 /* Puts an int64 in a gvalue */
 static GValue *
-int64_to_value (gint64 number)
+int64_to_value (GHashTable *properties,
+                gint64 number)
 {
   GValue *val = NULL;
 
-  val = g_new0 (GValue, 1);
+  val = new_value (properties);
   g_value_init (val, G_TYPE_INT64);
   g_value_set_int64 (val, number);
 
@@ -81,11 +100,12 @@ int64_to_value (gint64 number)
 
 /* Puts an uint in a gvalue */
 static GValue *
-uint_to_value (guint number)
+uint_to_value (GHashTable *properties,
+               guint number)
 {
   GValue *val = NULL;
 
-  val = g_new0 (GValue, 1);
+  val = new_value (properties);
   g_value_init (val, G_TYPE_UINT);
   g_value_set_uint (val, number);
 
@@ -94,11 +114,12 @@ uint_to_value (guint number)
 
 /* Puts a boolean in a gvalue */
 static GValue *
-bool_to_value (gboolean boolean)
+bool_to_value (GHashTable *properties,
+               gboolean boolean)
 {
   GValue *val = NULL;
 
-  val = g_new0 (GValue, 1);
+  val = new_value (properties);
   g_value_init (val, G_TYPE_BOOLEAN);
   g_value_set_boolean (val, boolean);
 
@@ -107,11 +128,12 @@ bool_to_value (gboolean boolean)
 
 /* Puts a gptrarray in a gvalue */
 static GValue *
-ptrarray_to_value (GPtrArray *array)
+ptrarray_to_value (GHashTable *properties,
+                   GPtrArray *array)
 {
   GValue *val = NULL;
 
-  val = g_new0 (GValue, 1);
+  val = new_value (properties);
   g_value_init (val, DBUS_TYPE_G_ARRAY_OF_STRING);
   g_value_take_boxed (val, array);
 
@@ -133,13 +155,13 @@ id_to_object_path (MS2Server *server,
                                NULL);
   } else {
     if (is_container) {
-      object_path = g_strdup_printf (MS2_DBUS_PATH_PREFIX "%s/containers/%d",
+      object_path = g_strdup_printf (MS2_DBUS_PATH_PREFIX "%s/containers/%u",
                                      ms2_server_get_name (server),
-                                     g_quark_from_string (id));
+                                     ms2_server_id_to_index (server, id));
     } else {
-      object_path = g_strdup_printf (MS2_DBUS_PATH_PREFIX "%s/items/%d",
+      object_path = g_strdup_printf (MS2_DBUS_PATH_PREFIX "%s/items/%u",
                                      ms2_server_get_name (server),
-                                     g_quark_from_string (id));
+                                     ms2_server_id_to_index (server, id));
     }
   }
 
@@ -168,6 +190,35 @@ ms2_server_new_properties_hashtable ()
   return properties;
 }
 
+/**
+ * ms2_server_new_reply_properties_hashtable:
+ *
+ * Creates a new #GHashTable suitable to store properties of an object that is
+ * going to be sent in the reply of the ongoing request, like the children
+ * returned by a #GetChildrenFunc.
+ *
+ * Values set with ms2_server_set_*() functions are taken from a request-scoped
+ * arena, so building long lists does not hit the heap. The table is emptied
+ * when the request is replied, so it must not be kept after that.
+ *
+ * If no request is being handled it is the same as
+ * ms2_server_new_properties_hashtable().
+ *
+ * Returns: a new #GHashTable
+ **/
+GHashTable *
+ms2_server_new_reply_properties_hashtable ()
+{
+  GHashTable *properties;
+
+  properties = ms2_arena_new_table ();
+  if (!properties) {
+    properties = ms2_server_new_properties_hashtable ();
+  }
+
+  return properties;
+}
+
 /**
  * ms2_server_set_path:
  * @server: a #MS2Server
@@ -192,7 +243,9 @@ ms2_server_set_path (MS2Server *server,
 
   if (id) {
     object_path = id_to_object_path (server, id, is_container);
-    g_hash_table_insert (properties, MS2_PROP_PATH, str_to_value (object_path));
+    g_hash_table_insert (properties,
+                         MS2_PROP_PATH,
+                         str_to_value (properties, object_path));
     g_free (object_path);
   }
 }
@@ -221,7 +274,7 @@ ms2_server_set_parent (MS2Server *server,
     object_path = id_to_object_path (server, parent, TRUE);
     g_hash_table_insert (properties,
                          MS2_PROP_PARENT,
-                         str_to_value (object_path));
+                         str_to_value (properties, object_path));
     g_free (object_path);
   }
 }
@@ -244,7 +297,7 @@ ms2_server_set_display_name (MS2Server *server,
   if (display_name) {
     g_hash_table_insert (properties,
                          MS2_PROP_DISPLAY_NAME,
-                         str_to_value (display_name));
+                         str_to_value (properties, display_name));
   }
 }
 
@@ -272,42 +325,42 @@ ms2_server_set_item_type (MS2Server *server,
   case MS2_ITEM_TYPE_CONTAINER:
     g_hash_table_insert (properties,
                          MS2_PROP_TYPE,
-                         str_to_value (MS2_TYPE_CONTAINER));
+                         str_to_value (properties, MS2_TYPE_CONTAINER));
     break;
   case MS2_ITEM_TYPE_ITEM:
     g_hash_table_insert (properties,
                          MS2_PROP_TYPE,
-                         str_to_value (MS2_TYPE_ITEM));
+                         str_to_value (properties, MS2_TYPE_ITEM));
     break;
   case MS2_ITEM_TYPE_VIDEO:
     g_hash_table_insert (properties,
                          MS2_PROP_TYPE,
-                         str_to_value (MS2_TYPE_VIDEO));
+                         str_to_value (properties, MS2_TYPE_VIDEO));
     break;
   case MS2_ITEM_TYPE_MOVIE:
     g_hash_table_insert (properties,
                          MS2_PROP_TYPE,
-                         str_to_value (MS2_TYPE_MOVIE));
+                         str_to_value (properties, MS2_TYPE_MOVIE));
     break;
   case MS2_ITEM_TYPE_AUDIO:
     g_hash_table_insert (properties,
                          MS2_PROP_TYPE,
-                         str_to_value (MS2_TYPE_AUDIO));
+                         str_to_value (properties, MS2_TYPE_AUDIO));
     break;
   case MS2_ITEM_TYPE_MUSIC:
     g_hash_table_insert (properties,
                          MS2_PROP_TYPE,
-                         str_to_value (MS2_TYPE_MUSIC));
+                         str_to_value (properties, MS2_TYPE_MUSIC));
     break;
   case MS2_ITEM_TYPE_IMAGE:
     g_hash_table_insert (properties,
                          MS2_PROP_TYPE,
-                         str_to_value (MS2_TYPE_IMAGE));
+                         str_to_value (properties, MS2_TYPE_IMAGE));
     break;
   case MS2_ITEM_TYPE_PHOTO:
     g_hash_table_insert (properties,
                          MS2_PROP_TYPE,
-                         str_to_value (MS2_TYPE_PHOTO));
+                         str_to_value (properties, MS2_TYPE_PHOTO));
     break;
   }
 }
@@ -330,7 +383,7 @@ ms2_server_set_mime_type (MS2Server *server,
   if (mime_type) {
     g_hash_table_insert (properties,
                          MS2_PROP_MIME_TYPE,
-                         str_to_value (mime_type));
+                         str_to_value (properties, mime_type));
   }
 }
 
@@ -352,7 +405,7 @@ ms2_server_set_artist (MS2Server *server,
   if (artist) {
     g_hash_table_insert (properties,
                          MS2_PROP_ARTIST,
-                         str_to_value (artist));
+                         str_to_value (properties, artist));
   }
 }
 
@@ -374,7 +427,7 @@ ms2_server_set_album (MS2Server *server,
   if (album) {
     g_hash_table_insert (properties,
                          MS2_PROP_ALBUM,
-                         str_to_value (album));
+                         str_to_value (properties, album));
   }
 }
 
@@ -399,7 +452,7 @@ ms2_server_set_date (MS2Server *server,
   if (date) {
     g_hash_table_insert (properties,
                          MS2_PROP_ALBUM,
-                         str_to_value (date));
+                         str_to_value (properties, date));
   }
 }
 
@@ -424,7 +477,7 @@ ms2_server_set_dlna_profile (MS2Server *server,
   if (dlna_profile) {
     g_hash_table_insert (properties,
                          MS2_PROP_DLNA_PROFILE,
-                         str_to_value (dlna_profile));
+                         str_to_value (properties, dlna_profile));
   }
 }
 
@@ -446,7 +499,7 @@ ms2_server_set_thumbnail (MS2Server *server,
   if (thumbnail) {
     g_hash_table_insert (properties,
                          MS2_PROP_THUMBNAIL,
-                         str_to_value (thumbnail));
+                         str_to_value (properties, thumbnail));
   }
 }
 
@@ -468,7 +521,7 @@ ms2_server_set_album_art (MS2Server *server,
   if (album_art) {
     g_hash_table_insert (properties,
                          MS2_PROP_ALBUM_ART,
-                         str_to_value (album_art));
+                         str_to_value (properties, album_art));
   }
 }
 
@@ -490,7 +543,7 @@ ms2_server_set_genre (MS2Server *server,
   if (genre) {
     g_hash_table_insert (properties,
                          MS2_PROP_GENRE,
-                         str_to_value (genre));
+                         str_to_value (properties, genre));
   }
 }
 
@@ -513,7 +566,7 @@ ms2_server_set_size (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_SIZE,
-                       int64_to_value (size));
+                       int64_to_value (properties, size));
 }
 
 /**
@@ -533,7 +586,7 @@ ms2_server_set_duration (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_DURATION,
-                       int_to_value (duration));
+                       int_to_value (properties, duration));
 }
 
 /**
@@ -553,7 +606,7 @@ ms2_server_set_bitrate (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_BITRATE,
-                       int_to_value (bitrate));
+                       int_to_value (properties, bitrate));
 }
 
 /**
@@ -574,7 +627,7 @@ ms2_server_set_sample_rate (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_SAMPLE_RATE,
-                       int_to_value (sample_rate));
+                       int_to_value (properties, sample_rate));
 }
 
 /**
@@ -595,7 +648,7 @@ ms2_server_set_bits_per_sample (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_BITS_PER_SAMPLE,
-                       int_to_value (bits_per_sample));
+                       int_to_value (properties, bits_per_sample));
 }
 
 /**
@@ -615,7 +668,7 @@ ms2_server_set_width (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_WIDTH,
-                       int_to_value (width));
+                       int_to_value (properties, width));
 }
 
 /**
@@ -635,7 +688,7 @@ ms2_server_set_height (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_HEIGHT,
-                       int_to_value (height));
+                       int_to_value (properties, height));
 }
 
 /**
@@ -655,7 +708,7 @@ ms2_server_set_color_depth (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_COLOR_DEPTH,
-                       int_to_value (depth));
+                       int_to_value (properties, depth));
 }
 
 /**
@@ -675,7 +728,7 @@ ms2_server_set_pixel_width (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_PIXEL_WIDTH,
-                       int_to_value (pixel_width));
+                       int_to_value (properties, pixel_width));
 }
 
 /**
@@ -695,7 +748,7 @@ ms2_server_set_pixel_height (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_PIXEL_HEIGHT,
-                       int_to_value (pixel_height));
+                       int_to_value (properties, pixel_height));
 }
 
 /**
@@ -725,7 +778,7 @@ ms2_server_set_urls (MS2Server *server,
 
     g_hash_table_insert (properties,
                          MS2_PROP_URLS,
-                         ptrarray_to_value (url_array));
+                         ptrarray_to_value (properties, url_array));
   }
 }
 
@@ -746,7 +799,7 @@ ms2_server_set_searchable (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_SEARCHABLE,
-                       bool_to_value (searchable));
+                       bool_to_value (properties, searchable));
 }
 
 /**
@@ -766,7 +819,7 @@ ms2_server_set_child_count (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_CHILD_COUNT,
-                       uint_to_value (child_count));
+                       uint_to_value (properties, child_count));
 }
 
 /**
@@ -786,7 +839,7 @@ ms2_server_set_item_count (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_ITEM_COUNT,
-                       uint_to_value (item_count));
+                       uint_to_value (properties, item_count));
 }
 
 /**
@@ -806,5 +859,5 @@ ms2_server_set_container_count (MS2Server *server,
 
   g_hash_table_insert (properties,
                        MS2_PROP_CONTAINER_COUNT,
-                       uint_to_value (container_count));
+                       uint_to_value (properties, container_count));
 }
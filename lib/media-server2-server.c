@@ -21,37 +21,122 @@
  */
 
 #include <dbus/dbus-glib-lowlevel.h>
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "media-server2-private.h"
 #include "media-server2-server.h"
 #include "media-server2-introspection.h"
+#include "media-server2-trace.h"
 
 #define DBUS_TYPE_G_ARRAY_OF_STRING                             \
   (dbus_g_type_get_collection ("GPtrArray", G_TYPE_STRING))
 
+/* Default max. size of replies; system bus refuses messages bigger than 32MB,
+   and estimations are not exact */
+#define MS2_DEFAULT_MAX_REPLY_BYTES (24 * 1024 * 1024)
+
+/* Size of a property in replies used until it is learnt. A property takes at
+   least this on the wire (key, variant signature and value), so replies that
+   would fit are never cut because of it */
+#define MS2_MIN_PROPERTY_BYTES 16
+
+/* Max. number of objects that can be asked in a GetPropertiesBatch request */
+#define MS2_MAX_BATCH_PATHS 1024
+
+/* Max. number of identifiers remembered; when exceeded, the oldest quarter is
+   forgotten, and their object paths become unknown */
+#define MS2_SERVER_MAX_IDS (1024 * 1024)
+
+/* First line of identifiers file, followed by ids_base */
+#define MS2_IDS_BASE_PREFIX "base "
+
 #define MS2_SERVER_GET_PRIVATE(o)                                       \
   G_TYPE_INSTANCE_GET_PRIVATE((o), MS2_TYPE_SERVER, MS2ServerPrivate)
 
+enum {
+  REGISTERED,
+  LAST_SIGNAL
+};
+
 /*
  * Private MS2Server structure
  *   name: provider name
  *   data: holds stuff for owner
  *   list_children: function to get children
  *   search_objects: function to search objects
+ *   list_children_from: function to get children from a cursor
+ *   search_objects_from: function to search objects from a cursor
  *   get_properties: function to get properties
+ *   get_properties_batch: function to get properties of several objects
+ *   pending_name: ongoing request of the dbus name, if any
+ *   registered: TRUE if dbus name has been acquired
+ *   registration_start: monotonic time when registration started
+ *   registration_time: microseconds it took to register, or -1 if pending
+ *   ids: backend identifiers, indexed by the number used in object paths
+ *        minus ids_base
+ *   ids_base: number used in object paths for the first element of ids
+ *   id_index: maps backend identifiers to their index in ids
+ *   connection: connection to DBus session
+ *   updated_window: interval (ms) to coalesce Updated signals; 0 to disable
+ *   updated_max: max. number of Updated signals per interval; 0 is unlimited
+ *   updated_queue: containers pending to emit Updated, in order
+ *   updated_pending: set of containers in updated_queue
+ *   updated_flush_id: source of the timer flushing updated_queue
+ *   updated_emitted: number of Updated signals emitted
+ *   updated_coalesced: number of Updated signals merged with pending ones
+ *   max_reply_items: max. number of objects in a reply; 0 is unlimited
+ *   max_reply_bytes: max. estimated size of a reply; 0 is unlimited
+ *   property_bytes: estimated size of a property in replies, learnt from
+ *                   previous ones; 0 if still unknown
+ *   truncated_replies: number of replies to standard listing methods that
+ *                      could not hold every element
+ *   request_serial: serial of the request being handled, or 0 if none
+ *   stats: statistics about requests handled
  */
 struct _MS2ServerPrivate {
   gchar *name;
   gpointer *data;
   ListChildrenFunc list_children;
   SearchObjectsFunc search_objects;
+  ListChildrenFromFunc list_children_from;
+  SearchObjectsFromFunc search_objects_from;
   GetPropertiesFunc get_properties;
+  GetPropertiesBatchFunc get_properties_batch;
+  DBusPendingCall *pending_name;
+  gboolean registered;
+  gint64 registration_start;
+  gint64 registration_time;
+  GPtrArray *ids;
+  guint ids_base;
+  GHashTable *id_index;
+  DBusConnection *connection;
+  guint updated_window;
+  guint updated_max;
+  GQueue *updated_queue;
+  GHashTable *updated_pending;
+  guint updated_flush_id;
+  guint updated_emitted;
+  guint updated_coalesced;
+  guint max_reply_items;
+  gsize max_reply_bytes;
+  gsize property_bytes;
+  guint truncated_replies;
+  guint32 request_serial;
+  MS2Stats *stats;
 };
 
+static guint32 signals[LAST_SIGNAL] = { 0 };
+
+/* Number of servers alive in the process */
+static guint n_servers = 0;
+
 /* dbus message signatures */
 static const gchar introspect_sgn[] = { DBUS_TYPE_INVALID };
 
+static const gchar getstats_sgn[] = { DBUS_TYPE_INVALID };
+
 static const gchar get_sgn[]  = { DBUS_TYPE_STRING, /* interface */
                                   DBUS_TYPE_STRING, /* property */
                                   DBUS_TYPE_INVALID };
@@ -70,69 +155,21 @@ static const gchar searchobjects_sgn[] = { DBUS_TYPE_STRING,                  /*
                                            DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, /* filter */
                                            DBUS_TYPE_INVALID };
 
+static const gchar getpropertiesbatch_sgn[] = { DBUS_TYPE_ARRAY, DBUS_TYPE_OBJECT_PATH, /* paths */
+                                                DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,      /* filter */
+                                                DBUS_TYPE_INVALID };
+
+static const gchar listchildrenfrom_sgn[] = { DBUS_TYPE_STRING,                  /* cursor */
+                                              DBUS_TYPE_UINT32,                  /* max */
+                                              DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, /* filter */
+                                              DBUS_TYPE_INVALID };
+
+static const gchar searchobjectsfrom_sgn[] = { DBUS_TYPE_STRING,                  /* query */
+                                               DBUS_TYPE_STRING,                  /* cursor */
+                                               DBUS_TYPE_UINT32,                  /* max */
+                                               DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, /* filter */
+                                               DBUS_TYPE_INVALID };
 
-/* Properties in interfaces */
-static const gchar *mediaobject2_properties[] = { MS2_PROP_PARENT,
-                                                  MS2_PROP_TYPE,
-                                                  MS2_PROP_PATH,
-                                                  MS2_PROP_DISPLAY_NAME,
-                                                  NULL };
-
-static const gchar *mediaitem2_properties[] = { MS2_PROP_URLS,
-                                                MS2_PROP_MIME_TYPE,
-                                                MS2_PROP_SIZE,
-                                                MS2_PROP_ARTIST,
-                                                MS2_PROP_ALBUM,
-                                                MS2_PROP_DATE,
-                                                MS2_PROP_GENRE,
-                                                MS2_PROP_DLNA_PROFILE,
-                                                MS2_PROP_DURATION,
-                                                MS2_PROP_BITRATE,
-                                                MS2_PROP_SAMPLE_RATE,
-                                                MS2_PROP_BITS_PER_SAMPLE,
-                                                MS2_PROP_WIDTH,
-                                                MS2_PROP_HEIGHT,
-                                                MS2_PROP_COLOR_DEPTH,
-                                                MS2_PROP_PIXEL_WIDTH,
-                                                MS2_PROP_PIXEL_HEIGHT,
-                                                MS2_PROP_THUMBNAIL,
-                                                MS2_PROP_ALBUM_ART,
-                                                NULL };
-
-static const gchar *mediacontainer2_properties[] = { MS2_PROP_CHILD_COUNT,
-                                                     MS2_PROP_ITEM_COUNT,
-                                                     MS2_PROP_CONTAINER_COUNT,
-                                                     MS2_PROP_SEARCHABLE,
-                                                     NULL };
-
-static const gchar *all_properties[] = { MS2_PROP_PARENT,
-                                         MS2_PROP_TYPE,
-                                         MS2_PROP_PATH,
-                                         MS2_PROP_DISPLAY_NAME,
-                                         MS2_PROP_URLS,
-                                         MS2_PROP_MIME_TYPE,
-                                         MS2_PROP_SIZE,
-                                         MS2_PROP_ARTIST,
-                                         MS2_PROP_ALBUM,
-                                         MS2_PROP_DATE,
-                                         MS2_PROP_GENRE,
-                                         MS2_PROP_DLNA_PROFILE,
-                                         MS2_PROP_DURATION,
-                                         MS2_PROP_BITRATE,
-                                         MS2_PROP_SAMPLE_RATE,
-                                         MS2_PROP_BITS_PER_SAMPLE,
-                                         MS2_PROP_WIDTH,
-                                         MS2_PROP_HEIGHT,
-                                         MS2_PROP_COLOR_DEPTH,
-                                         MS2_PROP_PIXEL_WIDTH,
-                                         MS2_PROP_PIXEL_HEIGHT,
-                                         MS2_PROP_THUMBNAIL,
-                                         MS2_PROP_ALBUM_ART,
-                                         MS2_PROP_CHILD_COUNT,
-                                         MS2_PROP_ITEM_COUNT,
-                                         MS2_PROP_CONTAINER_COUNT,
-                                         MS2_PROP_SEARCHABLE,
-                                         NULL };
 
 G_DEFINE_TYPE (MS2Server, ms2_server, G_TYPE_OBJECT);
 
@@ -142,8 +179,7 @@ G_DEFINE_TYPE (MS2Server, ms2_server, G_TYPE_OBJECT);
 static void
 free_value (GValue *value)
 {
-  g_value_unset (value);
-  g_free (value);
+  ms2_arena_free_value (value);
 }
 
 /* Puts a string in a gvalue */
@@ -153,9 +189,9 @@ str_to_value (const gchar *str)
   GValue *val = NULL;
 
   if (str) {
-    val = g_new0 (GValue, 1);
+    val = ms2_arena_new_value ();
     g_value_init (val, G_TYPE_STRING);
-    g_value_set_string (val, str);
+    ms2_arena_value_set_string (val, str);
   }
 
   return val;
@@ -167,7 +203,7 @@ int_to_value (gint number)
 {
   GValue *val = NULL;
 
-  val = g_new0 (GValue, 1);
+  val = ms2_arena_new_value ();
   g_value_init (val, G_TYPE_INT);
   g_value_set_int (val, number);
 
@@ -180,7 +216,7 @@ int64_to_value (gint64 number)
 {
   GValue *val = NULL;
 
-  val = g_new0 (GValue, 1);
+  val = ms2_arena_new_value ();
   g_value_init (val, G_TYPE_INT64);
   g_value_set_int64 (val, number);
 
@@ -193,7 +229,7 @@ uint_to_value (guint number)
 {
   GValue *val = NULL;
 
-  val = g_new0 (GValue, 1);
+  val = ms2_arena_new_value ();
   g_value_init (val, G_TYPE_UINT);
   g_value_set_uint (val, number);
 
@@ -206,7 +242,7 @@ bool_to_value (gboolean b)
 {
   GValue *val = NULL;
 
-  val = g_new0 (GValue, 1);
+  val = ms2_arena_new_value ();
   g_value_init (val, G_TYPE_BOOLEAN);
   g_value_set_boolean (val, b);
 
@@ -219,84 +255,22 @@ ptrarray_to_value (GPtrArray *array)
 {
   GValue *val = NULL;
 
-  val = g_new0 (GValue, 1);
+  val = ms2_arena_new_value ();
   g_value_init (val, DBUS_TYPE_G_ARRAY_OF_STRING);
   g_value_take_boxed (val, array);
 
   return val;
 }
 
-/* Search for string needle in NULL-terminated string array strv; search is done
-   by comparing pointers */
-static gboolean
-lookup_in_strv (gchar **strv,
-                const gchar *needle)
-{
-  gint i;
-  if (!strv || !needle) {
-    return FALSE;
-  }
-
-  for (i = 0; strv[i] && strv[i] != needle; i++);
-  return (strv[i] != NULL);
-}
-
 /* Searches for property in properties and return its value; if is not found,
    then returns a default value for that property */
 static GValue *
 properties_lookup_with_default (GHashTable *properties,
                                 const gchar *property)
 {
-  GPtrArray *ptrarray;
+  const MS2PropertyDesc *desc;
   GValue *ret_value;
   GValue *propvalue;
-  const gchar *intern_property;
-  static gchar **int_type_properties = NULL;
-  static gchar **int64_type_properties = NULL;
-  static gchar **uint_type_properties = NULL;
-  static gchar **bool_type_properties = NULL;
-  static gchar **gptrarray_type_properties = NULL;
-
-  /* Initialize data */
-  if (!int_type_properties) {
-    int_type_properties = g_new (gchar *, 10);
-    int_type_properties[0] = (gchar *) g_intern_static_string (MS2_PROP_DURATION);
-    int_type_properties[1] = (gchar *) g_intern_static_string (MS2_PROP_BITRATE);
-    int_type_properties[2] = (gchar *) g_intern_static_string (MS2_PROP_SAMPLE_RATE);
-    int_type_properties[3] = (gchar *) g_intern_static_string (MS2_PROP_BITS_PER_SAMPLE);
-    int_type_properties[4] = (gchar *) g_intern_static_string (MS2_PROP_WIDTH);
-    int_type_properties[5] = (gchar *) g_intern_static_string (MS2_PROP_HEIGHT);
-    int_type_properties[6] = (gchar *) g_intern_static_string (MS2_PROP_COLOR_DEPTH);
-    int_type_properties[7] = (gchar *) g_intern_static_string (MS2_PROP_PIXEL_WIDTH);
-    int_type_properties[8] = (gchar *) g_intern_static_string (MS2_PROP_PIXEL_HEIGHT);
-    int_type_properties[9] = NULL;
-  }
-
-  if (!int64_type_properties) {
-    int64_type_properties = g_new (gchar *, 2);
-    int64_type_properties[0] = (gchar *) g_intern_static_string (MS2_PROP_SIZE);
-    int64_type_properties[1] = NULL;
-  }
-
-  if (!uint_type_properties) {
-    uint_type_properties = g_new (gchar *, 4);
-    uint_type_properties[0] = (gchar *) g_intern_static_string (MS2_PROP_CHILD_COUNT);
-    uint_type_properties[1] = (gchar *) g_intern_static_string (MS2_PROP_ITEM_COUNT);
-    uint_type_properties[2] = (gchar *) g_intern_static_string (MS2_PROP_CONTAINER_COUNT);
-    uint_type_properties[3] = NULL;
-  }
-
-  if (!bool_type_properties) {
-    bool_type_properties = g_new (gchar *, 2);
-    bool_type_properties[0] = (gchar *) g_intern_static_string (MS2_PROP_SEARCHABLE);
-    bool_type_properties[1] = NULL;
-  }
-
-  if (!gptrarray_type_properties) {
-    gptrarray_type_properties = g_new (gchar *, 2);
-    gptrarray_type_properties[0] = (gchar *) g_intern_static_string (MS2_PROP_URLS);
-    gptrarray_type_properties[1] = NULL;
-  }
 
   if (properties) {
     propvalue = g_hash_table_lookup (properties, property);
@@ -306,7 +280,7 @@ properties_lookup_with_default (GHashTable *properties,
 
   if (propvalue) {
     /* Make a copy and return it */
-    ret_value = g_new0 (GValue, 1);
+    ret_value = ms2_arena_new_value ();
     g_value_init (ret_value, G_VALUE_TYPE (propvalue));
     g_value_copy (propvalue, ret_value);
 
@@ -314,111 +288,54 @@ properties_lookup_with_default (GHashTable *properties,
   }
 
   /* Use a default value */
-  intern_property = g_intern_string (property);
-  if (lookup_in_strv (int_type_properties, intern_property)) {
-    ret_value = int_to_value (MS2_UNKNOWN_INT);
-  } else if (lookup_in_strv (int64_type_properties, intern_property)) {
-    ret_value = int64_to_value (MS2_UNKNOWN_INT);
-  } else if (lookup_in_strv (uint_type_properties, intern_property)) {
-    ret_value = uint_to_value (MS2_UNKNOWN_UINT);
-  } else if (lookup_in_strv (bool_type_properties, intern_property)) {
-    ret_value = bool_to_value (FALSE);
-  } else if (lookup_in_strv (gptrarray_type_properties, intern_property)) {
-    ptrarray = g_ptr_array_sized_new (0);
-    ret_value = ptrarray_to_value (ptrarray);
-  } else {
+  desc = ms2_property_lookup (property);
+  if (!desc) {
+    return str_to_value (MS2_UNKNOWN_STR);
+  }
+
+  switch (desc->signature[0]) {
+  case DBUS_TYPE_INT32:
+    ret_value = int_to_value (desc->default_value);
+    break;
+  case DBUS_TYPE_INT64:
+    ret_value = int64_to_value (desc->default_value);
+    break;
+  case DBUS_TYPE_UINT32:
+    ret_value = uint_to_value (desc->default_value);
+    break;
+  case DBUS_TYPE_BOOLEAN:
+    ret_value = bool_to_value (desc->default_value);
+    break;
+  case DBUS_TYPE_ARRAY:
+    ret_value = ptrarray_to_value (g_ptr_array_sized_new (0));
+    break;
+  default:
     ret_value = str_to_value (MS2_UNKNOWN_STR);
   }
 
   return ret_value;
 }
 
-/* Check if property makes sense in the interface */
+/* Check if property makes sense in the interface; if interface is NULL, any
+   interface is fine */
 static gboolean
 is_property_valid (const gchar *interface,
                    const gchar *property)
 {
-  const gchar *prop_intern;
-  gboolean found;
-  int i;
-  static gchar **mo2_properties_intern = NULL;
-  static gchar **mi2_properties_intern = NULL;
-  static gchar **mc2_properties_intern = NULL;
-
-  /* Initialize MediaObject2 properties interns */
-  if (!mo2_properties_intern) {
-    mo2_properties_intern = g_new (gchar *,
-                                   g_strv_length ((gchar **) mediaobject2_properties) + 1);
-    for (i = 0; mediaobject2_properties[i]; i++) {
-      mo2_properties_intern[i] =
-        (gchar *) g_intern_static_string (mediaobject2_properties[i]);
-    }
-    mo2_properties_intern[i] = NULL;
-  }
-
-  /* Initialize MediaItem2 properties interns */
-  if (!mi2_properties_intern) {
-    mi2_properties_intern = g_new (gchar *,
-                                   g_strv_length ((gchar **) mediaitem2_properties) + 1);
-    for (i = 0; mediaitem2_properties[i]; i++) {
-      mi2_properties_intern[i] =
-        (gchar *) g_intern_static_string (mediaitem2_properties[i]);
-    }
-    mi2_properties_intern[i] = NULL;
-  }
-
-  /* Initialize MediaContainer2 properties interns */
-  if (!mc2_properties_intern) {
-    mc2_properties_intern = g_new (gchar *,
-                                   g_strv_length ((gchar **) mediacontainer2_properties) + 1);
-    for (i = 0; mediacontainer2_properties[i]; i++) {
-      mc2_properties_intern[i] =
-        (gchar *) g_intern_static_string (mediacontainer2_properties[i]);
-    }
-    mc2_properties_intern[i] = NULL;
-  }
-
-  prop_intern = g_intern_string (property);
-
-  /* Check MediaObject2 interface */
-  if (!interface || g_strcmp0 (interface, "org.gnome.UPnP.MediaObject2") == 0) {
-    found = lookup_in_strv (mo2_properties_intern, prop_intern);
-
-    if (found) {
-      return TRUE;
-    }
-
-    /* If not found, but interface is NULL, maybe property is in next interface */
-    if (!found && interface) {
-      return FALSE;
-    }
-  }
+  const MS2PropertyDesc *desc;
 
-  /* Check MediaItem2 interface */
-  if (!interface || g_strcmp0 (interface, "org.gnome.UPnP.MediaItem2") == 0) {
-    found = lookup_in_strv (mi2_properties_intern, prop_intern);
-
-    if (found) {
-      return TRUE;
-    }
-
-    /* If not found, but interface is NULL, maybe property is in next interface */
-    if (!found && interface) {
-      return FALSE;
-    }
-  }
-
-  /* Check MediaContainer2 interface */
-  if (!interface || g_strcmp0 (interface, "org.gnome.UPnP.MediaContainer2") == 0) {
-    return lookup_in_strv (mc2_properties_intern, prop_intern);
+  desc = ms2_property_lookup (property);
+  if (!desc) {
+    return FALSE;
   }
 
-  return FALSE;
+  return !interface || g_strcmp0 (interface, desc->interface) == 0;
 }
 
 /* Returns the id suitable to be used with server backend */
 static gchar *
-get_id_from_message (DBusMessage *m)
+get_id_from_message (MS2Server *server,
+                     DBusMessage *m)
 {
   gchar **path;
   gchar *id;
@@ -436,7 +353,7 @@ get_id_from_message (DBusMessage *m)
   if (path_length == 5) {
     id = g_strdup (MS2_ROOT);
   } else if (path_length == 7) {
-    id =  g_strdup (g_quark_to_string (atoi (path[6])));
+    id = g_strdup (ms2_server_index_to_id (server, atoi (path[6])));
   } else {
     id = NULL;
   }
@@ -446,6 +363,39 @@ get_id_from_message (DBusMessage *m)
   return id;
 }
 
+/* Returns the id of the object pointed by path, or NULL if path is not an
+   object of server */
+static gchar *
+get_id_from_path (MS2Server *server,
+                  const gchar *path)
+{
+  gchar **parts;
+  gchar *id = NULL;
+  guint length;
+
+  if (!g_str_has_prefix (path, MS2_DBUS_PATH_PREFIX)) {
+    return NULL;
+  }
+
+  /* Same paths as in get_id_from_message(), but with a leading "" */
+  parts = g_strsplit (path, "/", -1);
+  length = g_strv_length (parts);
+
+  if (length >= 6 && g_strcmp0 (parts[5], server->priv->name) == 0) {
+    if (length == 6) {
+      id = g_strdup (MS2_ROOT);
+    } else if (length == 8 &&
+               (g_strcmp0 (parts[6], "items") == 0 ||
+                g_strcmp0 (parts[6], "containers") == 0)) {
+      id = g_strdup (ms2_server_index_to_id (server, atoi (parts[7])));
+    }
+  }
+
+  g_strfreev (parts);
+
+  return id;
+}
+
 /* Request value of property in the interface */
 static GValue *
 get_property_value (MS2Server *server,
@@ -457,6 +407,7 @@ get_property_value (MS2Server *server,
   GValue *v;
   const gchar *prop[2] = { NULL };
   gchar *id;
+  gint64 start;
 
   /* Check everything is right */
   if (!property ||
@@ -467,17 +418,19 @@ get_property_value (MS2Server *server,
 
   /* If asking for Path, we already can use object_path */
   if (g_strcmp0 (property, MS2_PROP_PATH) == 0) {
-    v = g_new0 (GValue, 1);
+    v = ms2_arena_new_value ();
     g_value_init (v, G_TYPE_STRING);
-    g_value_set_string (v, dbus_message_get_path (message));
+    ms2_arena_value_set_string (v, dbus_message_get_path (message));
   } else {
-    id = get_id_from_message (message);
+    id = get_id_from_message (server, message);
     prop[0] = property;
+    start = g_get_monotonic_time ();
     propresult = server->priv->get_properties (server,
                                                id,
                                                prop,
                                                server->priv->data,
                                                NULL);
+    ms2_stats_add_backend_time (server->priv->stats, start);
     g_free (id);
     v = properties_lookup_with_default (propresult, property);
 
@@ -550,10 +503,11 @@ add_variant (DBusMessage *m,
 {
   DBusMessageIter iternew;
   DBusMessageIter sub;
+  const MS2PropertyDesc *desc;
   const gchar *str_value;
   gboolean bool_value;
   gint int_value;
-  gint int64_value;
+  gint64 int64_value;
   guint uint_value;
 
   if (!iter) {
@@ -561,12 +515,11 @@ add_variant (DBusMessage *m,
     iter = &iternew;
   }
 
+  desc = ms2_property_lookup (key);
+
   if (G_VALUE_HOLDS_STRING (v)) {
     str_value = g_value_get_string (v);
-    if (g_strcmp0 (key, "Path") == 0 ||
-        g_strcmp0 (key, "Parent") == 0 ||
-        g_strcmp0 (key, "Thumbnail") == 0 ||
-        g_strcmp0 (key, "AlbumArt") == 0) {
+    if (desc && desc->signature[0] == DBUS_TYPE_OBJECT_PATH) {
       dbus_message_iter_open_container (iter, DBUS_TYPE_VARIANT, "o", &sub);
       dbus_message_iter_append_basic (&sub, DBUS_TYPE_OBJECT_PATH, &str_value);
     } else {
@@ -581,7 +534,7 @@ add_variant (DBusMessage *m,
     dbus_message_iter_close_container (iter, &sub);
   } else if (G_VALUE_HOLDS_INT64 (v)) {
     int64_value = g_value_get_int64 (v);
-    dbus_message_iter_open_container (iter, DBUS_TYPE_VARIANT, "i", &sub);
+    dbus_message_iter_open_container (iter, DBUS_TYPE_VARIANT, "x", &sub);
     dbus_message_iter_append_basic (&sub, DBUS_TYPE_INT64, &int64_value);
     dbus_message_iter_close_container (iter, &sub);
   } else if (G_VALUE_HOLDS_UINT (v)) {
@@ -595,7 +548,7 @@ add_variant (DBusMessage *m,
     dbus_message_iter_append_basic (&sub, DBUS_TYPE_BOOLEAN, &bool_value);
     dbus_message_iter_close_container (iter, &sub);
   } else if (G_VALUE_HOLDS_BOXED (v)) {
-    if (g_strcmp0 (key, "URLs") == 0) {
+    if (desc && g_strcmp0 (desc->signature, "as") == 0) {
       dbus_message_iter_open_container (iter, DBUS_TYPE_VARIANT, "as", &sub);
       add_gptrarray_as_as (m, &sub, g_value_get_boxed (v));
     } else {
@@ -606,6 +559,53 @@ add_variant (DBusMessage *m,
   }
 }
 
+/* Returns an estimation of the bytes needed to marshal a string */
+static gsize
+estimate_string_size (const gchar *str)
+{
+  /* length + string + nul + padding */
+  return 4 + (str? strlen (str): 0) + 1 + 3;
+}
+
+/* Returns an estimation of the bytes needed to marshal a GHashTable as a
+   dictionary */
+static gsize
+estimate_hashtable_size (GHashTable *t)
+{
+  GHashTableIter iter;
+  GPtrArray *array;
+  GValue *v;
+  gchar *key;
+  gsize size = 8;
+  guint i;
+
+  if (!t) {
+    return size;
+  }
+
+  g_hash_table_iter_init (&iter, t);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &key, (gpointer *) &v)) {
+    if (!v) {
+      continue;
+    }
+    /* Dict entry alignment + key + variant signature */
+    size += 8 + estimate_string_size (key) + 4;
+    if (G_VALUE_HOLDS_STRING (v)) {
+      size += estimate_string_size (g_value_get_string (v));
+    } else if (G_VALUE_HOLDS_BOXED (v)) {
+      size += 8;
+      array = g_value_get_boxed (v);
+      for (i = 0; array && i < array->len; i++) {
+        size += estimate_string_size (g_ptr_array_index (array, i));
+      }
+    } else {
+      size += 16;
+    }
+  }
+
+  return size;
+}
+
 /* Adds a GHashTable as a dictionary to dbus message */
 static void
 add_hashtable_as_dict (DBusMessage *m,
@@ -647,14 +647,24 @@ add_hashtable_as_dict (DBusMessage *m,
   dbus_message_iter_close_container (iter, &sub_array);
 }
 
-/* Adds a GList as an array of pairs <string, variant> to dbus message */
-static void
+/* Adds a GList as an array of pairs <string, variant> to dbus message. Stops
+   adding elements once max_bytes (if not 0) would be exceeded, though at least
+   one element is always added. Returns the number of elements added, and their
+   estimated size in bytes if not NULL */
+static guint
 add_glist_as_array (DBusMessage *m,
                     DBusMessageIter *iter,
-                    GList *l)
+                    GList *l,
+                    gsize max_bytes,
+                    gsize *bytes)
 {
   DBusMessageIter iternew;
   DBusMessageIter sub_array;
+  gsize element_size;
+  gsize size = 0;
+  guint added = 0;
+
+  MS2_TRACE1 (marshal__start, dbus_message_get_reply_serial (m));
 
   if (!iter) {
     dbus_message_iter_init_append (m, &iternew);
@@ -664,11 +674,138 @@ add_glist_as_array (DBusMessage *m,
   /* Add an array */
   dbus_message_iter_open_container (iter, DBUS_TYPE_ARRAY, "a{sv}", &sub_array);
   while (l) {
+    if (max_bytes > 0 || bytes) {
+      element_size = estimate_hashtable_size (l->data);
+      if (max_bytes > 0 && size + element_size > max_bytes && added > 0) {
+        break;
+      }
+      size += element_size;
+    }
     add_hashtable_as_dict (m, &sub_array, l->data);
+    added++;
     l = g_list_next (l);
   }
 
   dbus_message_iter_close_container (iter, &sub_array);
+
+  MS2_TRACE3 (marshal__done, dbus_message_get_reply_serial (m), added, size);
+
+  if (bytes) {
+    *bytes = size;
+  }
+
+  return added;
+}
+
+/* Returns how many elements must be asked to backend, given the max requested
+   by client and the number of properties asked for each one */
+static guint
+get_reply_max_count (MS2Server *server,
+                     guint max_count,
+                     guint n_properties)
+{
+  gsize fit;
+  gsize property_bytes;
+
+  if (max_count == 0) {
+    max_count = G_MAXUINT;
+  }
+
+  if (server->priv->max_reply_items > 0) {
+    max_count = MIN (max_count, server->priv->max_reply_items);
+  }
+
+  /* Do not make backend collect elements that will not fit in the reply
+     anyway. Estimation is doubled, so replies are not cut short just because
+     elements are smaller than the previous ones. Until a reply has been sent,
+     the smallest size a property can take bounds the first listing */
+  property_bytes = server->priv->property_bytes > 0?
+    server->priv->property_bytes: MS2_MIN_PROPERTY_BYTES;
+  if (server->priv->max_reply_bytes > 0 && n_properties > 0) {
+    fit = server->priv->max_reply_bytes / (property_bytes * n_properties);
+    max_count = MIN (max_count, MAX (fit, 1) * 2);
+  }
+
+  return max_count;
+}
+
+/* Updates the estimated size of properties with a reply of sent elements with
+   n_properties each, taking bytes */
+static void
+learn_reply_size (MS2Server *server,
+                  gsize bytes,
+                  guint sent,
+                  guint n_properties)
+{
+  gsize property_bytes;
+
+  if (sent == 0 || n_properties == 0) {
+    return;
+  }
+
+  property_bytes = MAX (bytes / ((gsize) sent * n_properties), 1);
+  if (server->priv->property_bytes > 0) {
+    property_bytes = (server->priv->property_bytes * 7 + property_bytes) / 8;
+  }
+  server->priv->property_bytes = MAX (property_bytes, 1);
+}
+
+/* Sends a reply with children, that were asked with n_properties each. If
+   extended, also adds the offset where client must continue listing, or 0 if
+   reply is complete */
+static void
+send_children_reply (MS2Server *server,
+                     DBusConnection *c,
+                     DBusMessage *m,
+                     GList *children,
+                     guint offset,
+                     guint max_count,
+                     guint backend_count,
+                     guint n_properties,
+                     gboolean extended)
+{
+  DBusMessage *r;
+  gboolean truncated;
+  gint64 start;
+  gsize bytes;
+  guint length;
+  guint next_offset = 0;
+  guint sent;
+
+  start = g_get_monotonic_time ();
+  r = dbus_message_new_method_return (m);
+  sent = add_glist_as_array (r, NULL, children,
+                             server->priv->max_reply_bytes, &bytes);
+  ms2_stats_add_marshal_time (server->priv->stats, start);
+  ms2_stats_add_bytes (server->priv->stats, bytes);
+  learn_reply_size (server, bytes, sent, n_properties);
+
+  /* Truncated if not everything fitted, or if more elements could have been
+     returned than the ones asked to backend */
+  length = g_list_length (children);
+  truncated = sent < length ||
+    (backend_count < (max_count? max_count: G_MAXUINT) &&
+     length == backend_count);
+
+  if (truncated && offset <= G_MAXUINT - sent) {
+    next_offset = offset + sent;
+  }
+
+  if (extended) {
+    dbus_message_append_args (r,
+                              DBUS_TYPE_UINT32, &next_offset,
+                              DBUS_TYPE_INVALID);
+  } else if (truncated) {
+    /* Standard interface has no way to tell client */
+    server->priv->truncated_replies++;
+    g_message ("%s on %s truncated to %u elements",
+               dbus_message_get_member (m),
+               dbus_message_get_path (m),
+               sent);
+  }
+
+  dbus_connection_send (c, r, NULL);
+  dbus_message_unref (r);
 }
 
 /* Introspect message handler */
@@ -702,6 +839,7 @@ handle_get_message (DBusConnection *c,
   DBusMessage *r;
   gchar *interface = NULL;
   gchar *property = NULL;
+  gint64 start;
   MS2Server *server = MS2_SERVER (userdata);
 
   /* Check signature */
@@ -710,18 +848,22 @@ handle_get_message (DBusConnection *c,
                            DBUS_TYPE_STRING, &interface,
                            DBUS_TYPE_STRING, &property,
                            DBUS_TYPE_INVALID);
+    ms2_stats_begin (server->priv->stats, MS2_STATS_GET);
     value = get_property_value (server, m, interface, property);
     if (!value) {
       g_printerr ("Invalid property %s in interface %s\n",
                   property,
                   interface);
     } else {
+      start = g_get_monotonic_time ();
       r = dbus_message_new_method_return (m);
       add_variant (r, NULL, property, value);
+      ms2_stats_add_marshal_time (server->priv->stats, start);
       dbus_connection_send (c, r, NULL);
       dbus_message_unref (r);
       free_value (value);
     }
+    ms2_stats_end (server->priv->stats);
     return DBUS_HANDLER_RESULT_HANDLED;
   } else {
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
@@ -740,6 +882,7 @@ handle_get_all_message (DBusConnection *c,
   const gchar **prop;
   gchar *id;
   gchar *interface;
+  gint64 start;
 
   /* Check signature */
   if (dbus_message_has_signature (m, getall_sgn)) {
@@ -748,56 +891,271 @@ handle_get_all_message (DBusConnection *c,
                            DBUS_TYPE_INVALID);
     /* Get what properties we should ask */
     if (g_strcmp0 (interface, "org.gnome.UPnP.MediaObject2") == 0) {
-      prop = mediaobject2_properties;
+      prop = ms2_mediaobject2_properties;
     } else if (g_strcmp0 (interface, "org.gnome.UPnP.MediaItem2") == 0) {
-      prop = mediaitem2_properties;
+      prop = ms2_mediaitem2_properties;
     } else if (g_strcmp0 (interface, "org.gnome.UPnP.MediaContainer2") == 0) {
-      prop = mediacontainer2_properties;
+      prop = ms2_mediacontainer2_properties;
     } else if (g_strcmp0 (interface, "") == 0) {
-      prop = all_properties;
+      prop = ms2_all_properties;
     } else {
       return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     }
 
     if (prop && server->priv->get_properties) {
-      id = get_id_from_message (m);
+      id = get_id_from_message (server, m);
       if (!id) {
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
       }
 
+      ms2_stats_begin (server->priv->stats, MS2_STATS_GET_ALL);
+      start = g_get_monotonic_time ();
       propresult = server->priv->get_properties (server,
                                                  id,
                                                  prop,
                                                  server->priv->data,
                                                  NULL);
+      ms2_stats_add_backend_time (server->priv->stats, start);
       g_free (id);
     } else {
+      ms2_stats_begin (server->priv->stats, MS2_STATS_GET_ALL);
       propresult = NULL;
     }
+    start = g_get_monotonic_time ();
     r = dbus_message_new_method_return (m);
     add_hashtable_as_dict (r, NULL, propresult);
+    ms2_stats_add_marshal_time (server->priv->stats, start);
+    ms2_stats_add_bytes (server->priv->stats,
+                         estimate_hashtable_size (propresult));
     dbus_connection_send (c, r, NULL);
     dbus_message_unref (r);
     if (propresult) {
       g_hash_table_unref (propresult);
     }
+    ms2_stats_end (server->priv->stats);
     return DBUS_HANDLER_RESULT_HANDLED;
   } else {
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
   }
 }
 
+/* Gets properties of each object in ids; the result has the same length as
+   ids, with NULL for objects whose properties could not be obtained */
+static GList *
+get_properties_batch (MS2Server *server,
+                      const gchar **ids,
+                      const gchar **properties)
+{
+  GList *result = NULL;
+  const gchar **id;
+
+  if (server->priv->get_properties_batch) {
+    return server->priv->get_properties_batch (server,
+                                               ids,
+                                               properties,
+                                               server->priv->data,
+                                               NULL);
+  }
+
+  for (id = ids; *id; id++) {
+    result = g_list_prepend (result,
+                             server->priv->get_properties (server,
+                                                           *id,
+                                                           properties,
+                                                           server->priv->data,
+                                                           NULL));
+  }
+
+  return g_list_reverse (result);
+}
+
+/* Returns a new table with the properties in filter, taken from properties
+   or with a default value if missing. path is the object properties belong
+   to */
+static GHashTable *
+properties_with_defaults (GHashTable *properties,
+                          const gchar **filter,
+                          const gchar *path)
+{
+  GHashTable *table;
+  GValue *value;
+  const gchar **property;
+
+  table = g_hash_table_new_full (g_str_hash,
+                                 g_str_equal,
+                                 NULL,
+                                 (GDestroyNotify) free_value);
+
+  for (property = filter; *property; property++) {
+    if (g_strcmp0 (*property, MS2_PROP_PATH) == 0 &&
+        (!properties || !g_hash_table_lookup (properties, MS2_PROP_PATH))) {
+      value = str_to_value (path);
+    } else {
+      value = properties_lookup_with_default (properties, *property);
+    }
+    g_hash_table_insert (table, (gpointer) *property, value);
+  }
+
+  return table;
+}
+
+/* Sends an error reply to m */
+static void
+send_error_reply (DBusConnection *c,
+                  DBusMessage *m,
+                  const gchar *name,
+                  const gchar *message)
+{
+  DBusMessage *r;
+
+  r = dbus_message_new_error (m, name, message);
+  dbus_connection_send (c, r, NULL);
+  dbus_message_unref (r);
+}
+
+/* GetPropertiesBatch message handler */
+static DBusHandlerResult
+handle_get_properties_batch_message (DBusConnection *c,
+                                     DBusMessage *m,
+                                     void *userdata)
+{
+  DBusMessage *r;
+  GHashTable *table;
+  GList *batch;
+  GList *objects = NULL;
+  GList *result;
+  const gchar **properties;
+  gchar **filter;
+  gchar **ids;
+  gchar **paths;
+  gchar *id;
+  gboolean *valid;
+  gint64 start;
+  gsize bytes;
+  gint i;
+  gint nids = 0;
+  gint nitems;
+  gint npaths;
+  MS2Server *server = MS2_SERVER (userdata);
+
+  /* Check signature */
+  if (!dbus_message_has_signature (m, getpropertiesbatch_sgn)) {
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+
+  dbus_message_get_args (m, NULL,
+                         DBUS_TYPE_ARRAY, DBUS_TYPE_OBJECT_PATH, &paths, &npaths,
+                         DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &filter, &nitems,
+                         DBUS_TYPE_INVALID);
+
+  ms2_stats_begin (server->priv->stats, MS2_STATS_GET_PROPERTIES_BATCH);
+
+  if (npaths > MS2_MAX_BATCH_PATHS) {
+    send_error_reply (c, m, DBUS_ERROR_LIMITS_EXCEEDED,
+                      "Too many objects requested");
+    dbus_free_string_array (paths);
+    dbus_free_string_array (filter);
+    ms2_stats_end (server->priv->stats);
+    return DBUS_HANDLER_RESULT_HANDLED;
+  }
+
+  /* No filter means all properties */
+  properties = nitems > 0? (const gchar **) filter: ms2_all_properties;
+
+  /* Objects not belonging to server get an empty dictionary */
+  ids = g_new0 (gchar *, npaths + 1);
+  valid = g_new0 (gboolean, npaths);
+  for (i = 0; i < npaths; i++) {
+    id = get_id_from_path (server, paths[i]);
+    if (id) {
+      ids[nids++] = id;
+      valid[i] = TRUE;
+    }
+  }
+
+  if (nids > 0 && server->priv->get_properties) {
+    start = g_get_monotonic_time ();
+    batch = get_properties_batch (server, (const gchar **) ids, properties);
+    ms2_stats_add_backend_time (server->priv->stats, start);
+  } else {
+    batch = NULL;
+  }
+
+  /* Properties explicitly asked get a default value, as Get does */
+  result = batch;
+  for (i = 0; i < npaths; i++) {
+    if (valid[i] && server->priv->get_properties) {
+      if (nitems > 0) {
+        table = properties_with_defaults (result? result->data: NULL,
+                                          properties,
+                                          paths[i]);
+      } else {
+        table = result && result->data?
+          g_hash_table_ref (result->data): NULL;
+      }
+      objects = g_list_prepend (objects, table);
+      result = g_list_next (result);
+    } else {
+      objects = g_list_prepend (objects, NULL);
+    }
+  }
+  objects = g_list_reverse (objects);
+
+  /* Reply must hold every object, so it can not be truncated */
+  bytes = 0;
+  for (result = objects; result; result = g_list_next (result)) {
+    bytes += estimate_hashtable_size (result->data);
+  }
+
+  if (server->priv->max_reply_bytes > 0 &&
+      bytes > server->priv->max_reply_bytes) {
+    send_error_reply (c, m, DBUS_ERROR_LIMITS_EXCEEDED,
+                      "Reply would be too big; ask for fewer objects");
+  } else {
+    start = g_get_monotonic_time ();
+    r = dbus_message_new_method_return (m);
+    add_glist_as_array (r, NULL, objects, 0, &bytes);
+    ms2_stats_add_marshal_time (server->priv->stats, start);
+    ms2_stats_add_bytes (server->priv->stats, bytes);
+    dbus_connection_send (c, r, NULL);
+    dbus_message_unref (r);
+  }
+
+  for (result = batch; result; result = g_list_next (result)) {
+    if (result->data) {
+      g_hash_table_unref (result->data);
+    }
+  }
+  for (result = objects; result; result = g_list_next (result)) {
+    if (result->data) {
+      g_hash_table_unref (result->data);
+    }
+  }
+  g_list_free (batch);
+  g_list_free (objects);
+  g_strfreev (ids);
+  g_free (valid);
+  dbus_free_string_array (paths);
+  dbus_free_string_array (filter);
+
+  ms2_stats_end (server->priv->stats);
+
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
 /* ListFoo message handler */
 static DBusHandlerResult
 handle_list_elements_message (ListType list_type,
+                              gboolean extended,
                               DBusConnection *c,
                               DBusMessage *m,
                               void *userdata)
 {
-  DBusMessage *r;
   GList *children;
+  guint backend_count;
   gchar **filter;
   gchar *id;
+  gint64 start;
   guint max_count;
   guint offset;
   gint nitems;
@@ -810,33 +1168,40 @@ handle_list_elements_message (ListType list_type,
                            DBUS_TYPE_UINT32, &max_count,
                            DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &filter, &nitems,
                            DBUS_TYPE_INVALID);
+    ms2_stats_begin (server->priv->stats,
+                     list_type == LIST_CONTAINERS? MS2_STATS_LIST_CONTAINERS:
+                     list_type == LIST_ITEMS? MS2_STATS_LIST_ITEMS:
+                     MS2_STATS_LIST_CHILDREN);
+    backend_count = get_reply_max_count (server, max_count, nitems);
     if (!server->priv->list_children || nitems == 0) {
       children = NULL;
     } else {
-      id = get_id_from_message (m);
+      id = get_id_from_message (server, m);
       if (!id) {
+        ms2_stats_end (server->priv->stats);
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
       }
+      start = g_get_monotonic_time ();
       children = server->priv->list_children (server,
                                               id,
                                               list_type,
                                               offset,
-                                              max_count? max_count: G_MAXUINT,
+                                              backend_count,
                                               (const gchar **) filter,
                                               server->priv->data,
                                               NULL);
+      ms2_stats_add_backend_time (server->priv->stats, start);
       g_free (id);
       dbus_free_string_array (filter);
     }
 
-    r = dbus_message_new_method_return (m);
-    add_glist_as_array (r, NULL, children);
-    dbus_connection_send (c, r, NULL);
-    dbus_message_unref (r);
+    send_children_reply (server, c, m, children, offset, max_count,
+                         backend_count, nitems, extended);
     if (children) {
       g_list_foreach (children, (GFunc) g_hash_table_unref, NULL);
       g_list_free (children);
     }
+    ms2_stats_end (server->priv->stats);
     return DBUS_HANDLER_RESULT_HANDLED;
   } else {
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
@@ -845,15 +1210,17 @@ handle_list_elements_message (ListType list_type,
 
 /* SearchObjects message handler */
 static DBusHandlerResult
-handle_search_objects_message (DBusConnection *c,
+handle_search_objects_message (gboolean extended,
+                               DBusConnection *c,
                                DBusMessage *m,
                                void *userdata)
 {
-  DBusMessage *r;
   GList *children;
+  guint backend_count;
   gchar **filter;
   gchar *id;
   gchar *query;
+  gint64 start;
   guint max_count;
   guint offset;
   gint nitems;
@@ -867,120 +1234,631 @@ handle_search_objects_message (DBusConnection *c,
                            DBUS_TYPE_UINT32, &max_count,
                            DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &filter, &nitems,
                            DBUS_TYPE_INVALID);
+    ms2_stats_begin (server->priv->stats, MS2_STATS_SEARCH_OBJECTS);
+    backend_count = get_reply_max_count (server, max_count, nitems);
     if (!server->priv->search_objects || nitems == 0) {
       children = NULL;
     } else {
-      id = get_id_from_message (m);
+      id = get_id_from_message (server, m);
       if (!id) {
+        ms2_stats_end (server->priv->stats);
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
       }
+      start = g_get_monotonic_time ();
       children = server->priv->search_objects (server,
                                                id,
                                                query,
                                                offset,
-                                               max_count? max_count: G_MAXUINT,
+                                               backend_count,
                                                (const gchar **) filter,
                                                server->priv->data,
                                                NULL);
+      ms2_stats_add_backend_time (server->priv->stats, start);
       g_free (id);
       dbus_free_string_array (filter);
     }
 
-    r = dbus_message_new_method_return (m);
-    add_glist_as_array (r, NULL, children);
-    dbus_connection_send (c, r, NULL);
-    dbus_message_unref (r);
+    send_children_reply (server, c, m, children, offset, max_count,
+                         backend_count, nitems, extended);
     if (children) {
       g_list_foreach (children, (GFunc) g_hash_table_unref, NULL);
       g_list_free (children);
     }
+    ms2_stats_end (server->priv->stats);
     return DBUS_HANDLER_RESULT_HANDLED;
   } else {
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
   }
 }
 
-/* Items interface handler */
-static DBusHandlerResult
-items_handler (DBusConnection *c,
-               DBusMessage *m,
-               void *userdata)
+/* Splits a cursor given to clients in the number of elements to skip and the
+   cursor given by backend */
+static const gchar *
+parse_cursor (const gchar *cursor,
+              guint *skip)
 {
-  if (dbus_message_is_method_call (m,
-                                   "org.freedesktop.DBus.Introspectable",
-                                   "Introspect")) {
-    return handle_introspect_message (c, m, userdata,
-                                      ITEM_INTROSPECTION);
-  } else if (dbus_message_is_method_call (m,
-                                          "org.freedesktop.DBus.Properties",
-                                          "Get")) {
-    return handle_get_message (c, m, userdata);
-  } else if (dbus_message_is_method_call (m,
-                                          "org.freedesktop.DBus.Properties",
-                                          "GetAll")) {
-    return handle_get_all_message (c, m, userdata);
-  } else {
-    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  gchar *end;
+
+  *skip = 0;
+  if (!cursor || !*cursor) {
+    return "";
   }
-}
 
-/* Containers interface handler */
-static DBusHandlerResult
-containers_handler (DBusConnection *c,
-                    DBusMessage *m,
-                    void *userdata)
-{
-  if (dbus_message_is_method_call (m,
-                                   "org.freedesktop.DBus.Introspectable",
-                                   "Introspect")) {
-    return handle_introspect_message (c, m, userdata,
-                                      CONTAINER_INTROSPECTION);
-  } else if (dbus_message_is_method_call (m,
-                                          "org.freedesktop.DBus.Properties",
-                                          "Get")) {
-    return handle_get_message (c, m, userdata);
-  } else if (dbus_message_is_method_call (m,
-                                          "org.freedesktop.DBus.Properties",
-                                          "GetAll")) {
-    return handle_get_all_message (c, m, userdata);
-  } else if (dbus_message_is_method_call (m,
-                                          "org.gnome.UPnP.MediaContainer2",
-                                          "ListChildren")) {
-    return handle_list_elements_message (LIST_ALL, c, m, userdata);
-  } else if (dbus_message_is_method_call (m,
-                                          "org.gnome.UPnP.MediaContainer2",
-                                          "ListContainers")) {
-    return handle_list_elements_message (LIST_CONTAINERS, c, m, userdata);
-  } else if (dbus_message_is_method_call (m,
-                                          "org.gnome.UPnP.MediaContainer2",
-                                          "ListItems")) {
-    return handle_list_elements_message (LIST_ITEMS, c, m, userdata);
-  } else if (dbus_message_is_method_call (m,
-                                          "org.gnome.UPnP.MediaContainer2",
-                                          "SearchObjects")) {
-    return handle_search_objects_message (c, m, userdata);
-  } else {
-    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  *skip = strtoul (cursor, &end, 10);
+  if (end == cursor || *end != ':') {
+    *skip = 0;
+    return cursor;
   }
-}
 
-/* Root category handler */
-static DBusHandlerResult
-root_handler (DBusConnection *c,
-              DBusMessage *m,
-              void *userdata)
-{
-  return containers_handler (c, m, userdata);
+  return end + 1;
 }
 
-/* Registers the MS2Server object in dbus */
-static gboolean
-ms2_server_dbus_register (MS2Server *server,
-                          const gchar *name)
+/* Gets children, or searchs objects if query is not NULL, starting at the
+   position pointed by backend cursor. Backends not supporting cursors are
+   asked using the offset stored in cursor */
+static GList *
+get_children_from (MS2Server *server,
+                   const gchar *id,
+                   const gchar *query,
+                   const gchar *cursor,
+                   guint max_count,
+                   const gchar **filter,
+                   gchar **next_cursor)
+{
+  GList *children = NULL;
+  guint length;
+  guint offset;
+
+  *next_cursor = NULL;
+
+  if (!query && server->priv->list_children_from) {
+    return server->priv->list_children_from (server,
+                                             id,
+                                             cursor,
+                                             max_count,
+                                             filter,
+                                             next_cursor,
+                                             server->priv->data,
+                                             NULL);
+  }
+
+  if (query && server->priv->search_objects_from) {
+    return server->priv->search_objects_from (server,
+                                              id,
+                                              query,
+                                              cursor,
+                                              max_count,
+                                              filter,
+                                              next_cursor,
+                                              server->priv->data,
+                                              NULL);
+  }
+
+  offset = strtoul (cursor, NULL, 10);
+  if (!query && server->priv->list_children) {
+    children = server->priv->list_children (server,
+                                            id,
+                                            LIST_ALL,
+                                            offset,
+                                            max_count,
+                                            filter,
+                                            server->priv->data,
+                                            NULL);
+  } else if (query && server->priv->search_objects) {
+    children = server->priv->search_objects (server,
+                                             id,
+                                             query,
+                                             offset,
+                                             max_count,
+                                             filter,
+                                             server->priv->data,
+                                             NULL);
+  }
+
+  length = g_list_length (children);
+  if (length > 0 && length == max_count && max_count != G_MAXUINT) {
+    *next_cursor = g_strdup_printf ("%u", offset + length);
+  }
+
+  return children;
+}
+
+/* Replies with a page of children, or objects matching query if not NULL,
+   starting at cursor */
+static void
+handle_children_from (MS2Server *server,
+                      DBusConnection *c,
+                      DBusMessage *m,
+                      const gchar *id,
+                      const gchar *query,
+                      const gchar *cursor,
+                      guint max_count,
+                      const gchar **filter)
+{
+  DBusMessage *r;
+  GList *children;
+  GList *page;
+  const gchar *backend_cursor;
+  gchar *backend_next = NULL;
+  gchar *next_cursor;
+  gint64 start;
+  gsize bytes;
+  guint count;
+  guint i;
+  guint sent;
+  guint skip;
+
+  ms2_stats_begin (server->priv->stats,
+                   query? MS2_STATS_SEARCH_OBJECTS: MS2_STATS_LIST_CHILDREN);
+
+  /* Elements left out of a truncated reply are skipped from the same backend
+     cursor in next request */
+  backend_cursor = parse_cursor (cursor, &skip);
+  count = get_reply_max_count (server,
+                               max_count,
+                               filter? g_strv_length ((gchar **) filter): 0);
+  count = count > G_MAXUINT - skip? G_MAXUINT: count + skip;
+
+  if (filter) {
+    start = g_get_monotonic_time ();
+    children = get_children_from (server, id, query, backend_cursor, count,
+                                  filter, &backend_next);
+    ms2_stats_add_backend_time (server->priv->stats, start);
+  } else {
+    children = NULL;
+  }
+
+  page = children;
+  for (i = 0; page && i < skip; i++) {
+    g_hash_table_unref (page->data);
+    page = g_list_next (page);
+  }
+
+  start = g_get_monotonic_time ();
+  r = dbus_message_new_method_return (m);
+  sent = add_glist_as_array (r, NULL, page, server->priv->max_reply_bytes,
+                             &bytes);
+  if (filter) {
+    learn_reply_size (server, bytes, sent, g_strv_length ((gchar **) filter));
+  }
+
+  if (sent < g_list_length (page)) {
+    next_cursor = g_strdup_printf ("%u:%s", skip + sent, backend_cursor);
+  } else if (backend_next && *backend_next) {
+    next_cursor = g_strdup_printf ("0:%s", backend_next);
+  } else {
+    next_cursor = g_strdup ("");
+  }
+
+  dbus_message_append_args (r,
+                            DBUS_TYPE_STRING, &next_cursor,
+                            DBUS_TYPE_INVALID);
+  ms2_stats_add_marshal_time (server->priv->stats, start);
+  ms2_stats_add_bytes (server->priv->stats, bytes);
+  dbus_connection_send (c, r, NULL);
+  dbus_message_unref (r);
+
+  g_list_foreach (page, (GFunc) g_hash_table_unref, NULL);
+  g_list_free (children);
+  g_free (backend_next);
+  g_free (next_cursor);
+
+  ms2_stats_end (server->priv->stats);
+}
+
+/* ListChildrenFrom message handler */
+static DBusHandlerResult
+handle_list_children_from_message (DBusConnection *c,
+                                   DBusMessage *m,
+                                   void *userdata)
+{
+  gchar **filter;
+  gchar *cursor;
+  gchar *id;
+  guint max_count;
+  gint nitems;
+  MS2Server *server = MS2_SERVER (userdata);
+
+  /* Check signature */
+  if (dbus_message_has_signature (m, listchildrenfrom_sgn)) {
+    id = get_id_from_message (server, m);
+    if (!id) {
+      return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+    dbus_message_get_args (m, NULL,
+                           DBUS_TYPE_STRING, &cursor,
+                           DBUS_TYPE_UINT32, &max_count,
+                           DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &filter, &nitems,
+                           DBUS_TYPE_INVALID);
+    handle_children_from (server, c, m, id, NULL, cursor, max_count,
+                          nitems > 0? (const gchar **) filter: NULL);
+    g_free (id);
+    dbus_free_string_array (filter);
+    return DBUS_HANDLER_RESULT_HANDLED;
+  } else {
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+}
+
+/* SearchObjectsFrom message handler */
+static DBusHandlerResult
+handle_search_objects_from_message (DBusConnection *c,
+                                    DBusMessage *m,
+                                    void *userdata)
+{
+  gchar **filter;
+  gchar *cursor;
+  gchar *id;
+  gchar *query;
+  guint max_count;
+  gint nitems;
+  MS2Server *server = MS2_SERVER (userdata);
+
+  /* Check signature */
+  if (dbus_message_has_signature (m, searchobjectsfrom_sgn)) {
+    id = get_id_from_message (server, m);
+    if (!id) {
+      return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+    dbus_message_get_args (m, NULL,
+                           DBUS_TYPE_STRING, &query,
+                           DBUS_TYPE_STRING, &cursor,
+                           DBUS_TYPE_UINT32, &max_count,
+                           DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &filter, &nitems,
+                           DBUS_TYPE_INVALID);
+    handle_children_from (server, c, m, id, query, cursor, max_count,
+                          nitems > 0? (const gchar **) filter: NULL);
+    g_free (id);
+    dbus_free_string_array (filter);
+    return DBUS_HANDLER_RESULT_HANDLED;
+  } else {
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+}
+
+/* Starts handling request m; returns the serial of the request it is nested
+   in, if any */
+static guint32
+begin_request (MS2Server *server,
+               DBusMessage *m)
+{
+  guint32 outer;
+
+  MS2_TRACE3 (request__start,
+              dbus_message_get_serial (m),
+              dbus_message_get_path (m),
+              dbus_message_get_member (m));
+
+  /* Values built to reply are released all together when done */
+  ms2_arena_enter ();
+
+  outer = server->priv->request_serial;
+  server->priv->request_serial = dbus_message_get_serial (m);
+
+  return outer;
+}
+
+/* Finishes handling request m, that was nested in request outer */
+static void
+end_request (MS2Server *server,
+             DBusMessage *m,
+             guint32 outer,
+             DBusHandlerResult result)
+{
+  server->priv->request_serial = outer;
+
+  ms2_arena_leave ();
+
+  MS2_TRACE2 (request__done,
+              dbus_message_get_serial (m),
+              result == DBUS_HANDLER_RESULT_HANDLED);
+}
+
+/* Items interface handler */
+static DBusHandlerResult
+items_handler (DBusConnection *c,
+               DBusMessage *m,
+               void *userdata)
+{
+  DBusHandlerResult result;
+  guint32 outer;
+
+  outer = begin_request (MS2_SERVER (userdata), m);
+
+  if (dbus_message_is_method_call (m,
+                                   "org.freedesktop.DBus.Introspectable",
+                                   "Introspect")) {
+    result = handle_introspect_message (c, m, userdata,
+                                        ITEM_INTROSPECTION);
+  } else if (dbus_message_is_method_call (m,
+                                          "org.freedesktop.DBus.Properties",
+                                          "Get")) {
+    result = handle_get_message (c, m, userdata);
+  } else if (dbus_message_is_method_call (m,
+                                          "org.freedesktop.DBus.Properties",
+                                          "GetAll")) {
+    result = handle_get_all_message (c, m, userdata);
+  } else {
+    result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+
+  end_request (MS2_SERVER (userdata), m, outer, result);
+
+  return result;
+}
+
+/* Containers interface handler */
+static DBusHandlerResult
+containers_handler (DBusConnection *c,
+                    DBusMessage *m,
+                    void *userdata)
+{
+  DBusHandlerResult result;
+  guint32 outer;
+
+  outer = begin_request (MS2_SERVER (userdata), m);
+
+  if (dbus_message_is_method_call (m,
+                                   "org.freedesktop.DBus.Introspectable",
+                                   "Introspect")) {
+    result = handle_introspect_message (c, m, userdata,
+                                        CONTAINER_INTROSPECTION);
+  } else if (dbus_message_is_method_call (m,
+                                          "org.freedesktop.DBus.Properties",
+                                          "Get")) {
+    result = handle_get_message (c, m, userdata);
+  } else if (dbus_message_is_method_call (m,
+                                          "org.freedesktop.DBus.Properties",
+                                          "GetAll")) {
+    result = handle_get_all_message (c, m, userdata);
+  } else if (dbus_message_is_method_call (m,
+                                          "org.gnome.UPnP.MediaContainer2",
+                                          "ListChildren")) {
+    result = handle_list_elements_message (LIST_ALL, FALSE, c, m, userdata);
+  } else if (dbus_message_is_method_call (m,
+                                          "org.gnome.UPnP.MediaContainer2",
+                                          "ListContainers")) {
+    result = handle_list_elements_message (LIST_CONTAINERS, FALSE, c, m,
+                                           userdata);
+  } else if (dbus_message_is_method_call (m,
+                                          "org.gnome.UPnP.MediaContainer2",
+                                          "ListItems")) {
+    result = handle_list_elements_message (LIST_ITEMS, FALSE, c, m, userdata);
+  } else if (dbus_message_is_method_call (m,
+                                          "org.gnome.UPnP.MediaContainer2",
+                                          "SearchObjects")) {
+    result = handle_search_objects_message (FALSE, c, m, userdata);
+  } else if (dbus_message_is_method_call (m,
+                                          MS2_PAGED_CONTAINER_IFACE,
+                                          "ListChildren")) {
+    result = handle_list_elements_message (LIST_ALL, TRUE, c, m, userdata);
+  } else if (dbus_message_is_method_call (m,
+                                          MS2_PAGED_CONTAINER_IFACE,
+                                          "ListContainers")) {
+    result = handle_list_elements_message (LIST_CONTAINERS, TRUE, c, m,
+                                           userdata);
+  } else if (dbus_message_is_method_call (m,
+                                          MS2_PAGED_CONTAINER_IFACE,
+                                          "ListItems")) {
+    result = handle_list_elements_message (LIST_ITEMS, TRUE, c, m, userdata);
+  } else if (dbus_message_is_method_call (m,
+                                          MS2_PAGED_CONTAINER_IFACE,
+                                          "SearchObjects")) {
+    result = handle_search_objects_message (TRUE, c, m, userdata);
+  } else if (dbus_message_is_method_call (m,
+                                          MS2_PAGED_CONTAINER_IFACE,
+                                          "ListChildrenFrom")) {
+    result = handle_list_children_from_message (c, m, userdata);
+  } else if (dbus_message_is_method_call (m,
+                                          MS2_PAGED_CONTAINER_IFACE,
+                                          "SearchObjectsFrom")) {
+    result = handle_search_objects_from_message (c, m, userdata);
+  } else {
+    result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+
+  end_request (MS2_SERVER (userdata), m, outer, result);
+
+  return result;
+}
+
+/* GetStats message handler; server is NULL for the statistics of the whole
+   process */
+static DBusHandlerResult
+handle_get_stats_message (DBusConnection *c,
+                          DBusMessage *m,
+                          MS2Server *server)
+{
+  DBusMessage *r;
+  DBusMessageIter dict;
+  DBusMessageIter iter;
+  MS2AllocationStats arena;
+
+  /* Check signature */
+  if (!dbus_message_has_signature (m, getstats_sgn)) {
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+
+  r = dbus_message_new_method_return (m);
+  dbus_message_iter_init_append (r, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+
+  if (server) {
+    ms2_stats_append (server->priv->stats, &dict);
+    ms2_stats_append_uint (&dict, "ids", g_hash_table_size (server->priv->id_index));
+    ms2_stats_append_uint (&dict, "updated-pending",
+                           g_queue_get_length (server->priv->updated_queue));
+    ms2_stats_append_uint (&dict, "updated-emitted",
+                           server->priv->updated_emitted);
+    ms2_stats_append_uint (&dict, "updated-coalesced",
+                           server->priv->updated_coalesced);
+    ms2_stats_append_uint (&dict, "truncated-replies",
+                           server->priv->truncated_replies);
+  } else {
+    ms2_stats_append (ms2_stats_get_global (), &dict);
+    ms2_stats_append_uint (&dict, "providers", n_servers);
+    ms2_server_get_allocation_stats (&arena);
+    ms2_stats_append_uint64 (&dict, "arena.requests", arena.requests);
+    ms2_stats_append_uint64 (&dict, "arena.allocations", arena.allocations);
+    ms2_stats_append_uint64 (&dict, "arena.bytes", arena.bytes);
+    ms2_stats_append_uint64 (&dict, "arena.chunks", arena.chunks);
+    ms2_stats_append_uint64 (&dict, "arena.peak_bytes", arena.peak_bytes);
+  }
+
+  dbus_message_iter_close_container (&iter, &dict);
+  dbus_connection_send (c, r, NULL);
+  dbus_message_unref (r);
+
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+/* Process-wide statistics handler */
+static DBusHandlerResult
+stats_handler (DBusConnection *c,
+               DBusMessage *m,
+               void *userdata)
+{
+  if (dbus_message_is_method_call (m,
+                                   "org.freedesktop.DBus.Introspectable",
+                                   "Introspect")) {
+    return handle_introspect_message (c, m, userdata,
+                                      STATS_INTROSPECTION);
+  } else if (dbus_message_is_method_call (m, MS2_STATS_IFACE, "GetStats")) {
+    return handle_get_stats_message (c, m, NULL);
+  } else {
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+}
+
+/* Root category handler */
+static DBusHandlerResult
+root_handler (DBusConnection *c,
+              DBusMessage *m,
+              void *userdata)
+{
+  DBusHandlerResult result;
+  guint32 outer;
+
+  if (dbus_message_is_method_call (m,
+                                   "org.freedesktop.DBus.Introspectable",
+                                   "Introspect")) {
+    return handle_introspect_message (c, m, userdata,
+                                      ROOT_INTROSPECTION);
+  } else if (dbus_message_is_method_call (m,
+                                          MS2_PROVIDER_IFACE,
+                                          "GetPropertiesBatch")) {
+    outer = begin_request (MS2_SERVER (userdata), m);
+    result = handle_get_properties_batch_message (c, m, userdata);
+    end_request (MS2_SERVER (userdata), m, outer, result);
+    return result;
+  } else if (dbus_message_is_method_call (m, MS2_STATS_IFACE, "GetStats")) {
+    return handle_get_stats_message (c, m, MS2_SERVER (userdata));
+  } else {
+    return containers_handler (c, m, userdata);
+  }
+}
+
+/* Sends Updated signal for container id */
+static void
+emit_updated (MS2Server *server,
+              const gchar *id)
+{
+  DBusMessage *message;
+  gchar *object_path;
+
+  /* Get object path */
+  if (g_strcmp0 (id, MS2_ROOT) == 0) {
+    object_path = g_strconcat (MS2_DBUS_PATH_PREFIX,
+                               server->priv->name,
+                               NULL);
+  } else {
+    object_path = g_strdup_printf (MS2_DBUS_PATH_PREFIX "%s/containers/%u",
+                                   server->priv->name,
+                                   ms2_server_id_to_index (server, id));
+  }
+
+  message = dbus_message_new_signal (object_path,
+                                     "org.gnome.UPnP.MediaContainer2",
+                                     "Updated");
+  dbus_connection_send (server->priv->connection, message, NULL);
+  dbus_message_unref (message);
+  server->priv->updated_emitted++;
+
+  g_free (object_path);
+}
+
+/* Emits the pending Updated signals, up to the allowed ones per interval */
+static gboolean
+flush_updated (gpointer user_data)
+{
+  MS2Server *server = MS2_SERVER (user_data);
+  gchar *id;
+  guint emitted = 0;
+
+  while ((server->priv->updated_max == 0 ||
+          emitted < server->priv->updated_max) &&
+         (id = g_queue_pop_head (server->priv->updated_queue))) {
+    g_hash_table_remove (server->priv->updated_pending, id);
+    emit_updated (server, id);
+    g_free (id);
+    emitted++;
+  }
+
+  /* Leftovers wait for next interval */
+  if (g_queue_is_empty (server->priv->updated_queue)) {
+    server->priv->updated_flush_id = 0;
+    return FALSE;
+  } else {
+    return TRUE;
+  }
+}
+
+/* Queues an Updated signal for container id, unless it is already queued or
+   the root is; root being updated means any object could have changed */
+static void
+queue_updated (MS2Server *server,
+               const gchar *id)
+{
+  gchar *queued_id;
+
+  if (g_hash_table_lookup (server->priv->updated_pending, id) ||
+      g_hash_table_lookup (server->priv->updated_pending, MS2_ROOT)) {
+    server->priv->updated_coalesced++;
+    return;
+  }
+
+  /* Too many containers to notify in one interval; a single signal on root
+     replaces all of them */
+  if (server->priv->updated_max > 0 &&
+      g_queue_get_length (server->priv->updated_queue) >=
+      server->priv->updated_max) {
+    server->priv->updated_coalesced +=
+      g_queue_get_length (server->priv->updated_queue);
+    g_hash_table_remove_all (server->priv->updated_pending);
+    while ((queued_id = g_queue_pop_head (server->priv->updated_queue))) {
+      g_free (queued_id);
+    }
+    id = MS2_ROOT;
+  }
+
+  queued_id = g_strdup (id);
+  g_queue_push_tail (server->priv->updated_queue, queued_id);
+  g_hash_table_insert (server->priv->updated_pending,
+                       queued_id,
+                       GINT_TO_POINTER (TRUE));
+
+  if (!server->priv->updated_flush_id) {
+    server->priv->updated_flush_id =
+      g_timeout_add (server->priv->updated_window, flush_updated, server);
+  }
+}
+
+/* Registers the MS2Server object paths in dbus */
+static void
+ms2_server_dbus_register_paths (MS2Server *server,
+                                DBusConnection *connection,
+                                const gchar *name)
 {
-  DBusConnection *connection;
-  DBusError error;
-  gchar *dbus_name;
   gchar *dbus_path;
   gchar *dbus_path_items;
   gchar *dbus_path_containers;
@@ -993,15 +1871,47 @@ ms2_server_dbus_register (MS2Server *server,
   static const DBusObjectPathVTable vtable_containers = {
     .message_function = containers_handler
   };
+  static const DBusObjectPathVTable vtable_stats = {
+    .message_function = stats_handler
+  };
+
+  dbus_path = g_strconcat (MS2_DBUS_PATH_PREFIX, name, NULL);
+  dbus_path_items = g_strconcat (dbus_path, "/items", NULL);
+  dbus_path_containers = g_strconcat (dbus_path, "/containers", NULL);
+
+  dbus_connection_register_object_path (connection, dbus_path, &vtable_root, server);
+  dbus_connection_register_fallback (connection, dbus_path_items, &vtable_items, server);
+  dbus_connection_register_fallback (connection, dbus_path_containers, &vtable_containers, server);
+
+  /* Process-wide statistics are registered by the first server */
+  dbus_connection_try_register_object_path (connection, MS2_DBUS_STATS_PATH, &vtable_stats, NULL, NULL);
+
+  g_free (dbus_path);
+  g_free (dbus_path_items);
+  g_free (dbus_path_containers);
+}
+
+/* Registers the MS2Server object in dbus */
+static gboolean
+ms2_server_dbus_register (MS2Server *server,
+                          const gchar *name)
+{
+  DBusConnection *connection;
+  DBusError error;
+  gchar *dbus_name;
 
   dbus_error_init (&error);
 
+  server->priv->registration_start = g_get_monotonic_time ();
+
   connection = dbus_bus_get (DBUS_BUS_SESSION, &error);
   if (!connection) {
     g_printerr ("Could not connect to session bus, %s\n", error.message);
     return FALSE;
   }
 
+  server->priv->connection = connection;
+
   /* Request name */
   dbus_name = g_strconcat (MS2_DBUS_SERVICE_PREFIX, name, NULL);
   if (dbus_bus_request_name (connection,
@@ -1015,20 +1925,119 @@ ms2_server_dbus_register (MS2Server *server,
   g_free (dbus_name);
 
   /* Register object paths */
-  dbus_path = g_strconcat (MS2_DBUS_PATH_PREFIX, name, NULL);
-  dbus_path_items = g_strconcat (dbus_path, "/items", NULL);
-  dbus_path_containers = g_strconcat (dbus_path, "/containers", NULL);
+  ms2_server_dbus_register_paths (server, connection, name);
 
-  dbus_connection_register_object_path (connection, dbus_path, &vtable_root, server);
-  dbus_connection_register_fallback (connection, dbus_path_items, &vtable_items, server);
-  dbus_connection_register_fallback (connection, dbus_path_containers, &vtable_containers, server);
+  dbus_connection_setup_with_g_main(connection, NULL);
 
-  g_free (dbus_path);
-  g_free (dbus_path_items);
-  g_free (dbus_path_containers);
+  server->priv->registered = TRUE;
+  server->priv->registration_time =
+    g_get_monotonic_time () - server->priv->registration_start;
+
+  return TRUE;
+}
+
+/* Invoked when bus replies to name request */
+static void
+request_name_reply (DBusPendingCall *pending,
+                    void *user_data)
+{
+  DBusError error;
+  DBusMessage *reply;
+  MS2Server *server = MS2_SERVER (user_data);
+  dbus_uint32_t result = 0;
+
+  reply = dbus_pending_call_steal_reply (pending);
+  dbus_pending_call_unref (server->priv->pending_name);
+  server->priv->pending_name = NULL;
+
+  dbus_error_init (&error);
+  if (dbus_set_error_from_message (&error, reply) ||
+      !dbus_message_get_args (reply, &error,
+                              DBUS_TYPE_UINT32, &result,
+                              DBUS_TYPE_INVALID)) {
+    g_printerr ("Failed to request name %s%s, %s\n",
+                MS2_DBUS_SERVICE_PREFIX,
+                server->priv->name,
+                error.message);
+    dbus_error_free (&error);
+  } else if (result != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+    g_printerr ("Failed to request name %s%s, name is already taken\n",
+                MS2_DBUS_SERVICE_PREFIX,
+                server->priv->name);
+  } else {
+    server->priv->registered = TRUE;
+  }
+  dbus_message_unref (reply);
+
+  server->priv->registration_time =
+    g_get_monotonic_time () - server->priv->registration_start;
+
+  /* Handlers could drop the last reference */
+  g_object_ref (server);
+  g_signal_emit (server, signals[REGISTERED], 0, server->priv->registered);
+  g_object_unref (server);
+}
+
+/* Registers the MS2Server object in dbus without waiting for the name; object
+   paths are registered straight away, and "registered" signal is emitted when
+   bus replies */
+static gboolean
+ms2_server_dbus_register_async (MS2Server *server,
+                                const gchar *name)
+{
+  DBusConnection *connection;
+  DBusError error;
+  DBusMessage *message;
+  dbus_uint32_t flags = DBUS_NAME_FLAG_DO_NOT_QUEUE;
+  gchar *dbus_name;
+
+  dbus_error_init (&error);
+
+  server->priv->registration_start = g_get_monotonic_time ();
+  server->priv->registration_time = -1;
+
+  connection = dbus_bus_get (DBUS_BUS_SESSION, &error);
+  if (!connection) {
+    g_printerr ("Could not connect to session bus, %s\n", error.message);
+    return FALSE;
+  }
+
+  server->priv->connection = connection;
 
   dbus_connection_setup_with_g_main(connection, NULL);
 
+  /* Register object paths */
+  ms2_server_dbus_register_paths (server, connection, name);
+
+  /* Request name */
+  dbus_name = g_strconcat (MS2_DBUS_SERVICE_PREFIX, name, NULL);
+  message = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
+                                          DBUS_PATH_DBUS,
+                                          DBUS_INTERFACE_DBUS,
+                                          "RequestName");
+  dbus_message_append_args (message,
+                            DBUS_TYPE_STRING, &dbus_name,
+                            DBUS_TYPE_UINT32, &flags,
+                            DBUS_TYPE_INVALID);
+
+  if (!dbus_connection_send_with_reply (connection,
+                                        message,
+                                        &server->priv->pending_name,
+                                        DBUS_TIMEOUT_USE_DEFAULT) ||
+      !server->priv->pending_name) {
+    g_printerr ("Failed to request name %s, connection is closed\n", dbus_name);
+    dbus_message_unref (message);
+    g_free (dbus_name);
+    return FALSE;
+  }
+
+  dbus_pending_call_set_notify (server->priv->pending_name,
+                                request_name_reply,
+                                server,
+                                NULL);
+  dbus_message_unref (message);
+  g_free (dbus_name);
+
   return TRUE;
 }
 
@@ -1037,18 +2046,13 @@ static void
 ms2_server_dbus_unregister (MS2Server *server,
                             const gchar *name)
 {
-  DBusConnection *connection;
-  DBusError error;
+  DBusConnection *connection = server->priv->connection;
   gchar *dbus_name;
   gchar *dbus_path;
   gchar *dbus_path_containers;
   gchar *dbus_path_items;
 
-  dbus_error_init (&error);
-
-  connection = dbus_bus_get (DBUS_BUS_SESSION, &error);
   if (!connection) {
-    g_printerr ("Could not connect to session bus, %s\n", error.message);
     return;
   }
 
@@ -1078,8 +2082,26 @@ ms2_server_finalize (GObject *object)
 {
   MS2Server *server = MS2_SERVER (object);
 
+  if (server->priv->pending_name) {
+    dbus_pending_call_cancel (server->priv->pending_name);
+    dbus_pending_call_unref (server->priv->pending_name);
+  }
+
+  if (server->priv->updated_flush_id) {
+    g_source_remove (server->priv->updated_flush_id);
+  }
+  g_queue_free_full (server->priv->updated_queue, g_free);
+  g_hash_table_unref (server->priv->updated_pending);
+
   ms2_server_dbus_unregister (server, server->priv->name);
+  if (server->priv->connection) {
+    dbus_connection_unref (server->priv->connection);
+  }
   g_free (server->priv->name);
+  g_hash_table_unref (server->priv->id_index);
+  g_ptr_array_unref (server->priv->ids);
+  ms2_stats_free (server->priv->stats);
+  n_servers--;
 
   G_OBJECT_CLASS (ms2_server_parent_class)->finalize (object);
 }
@@ -1093,6 +2115,25 @@ ms2_server_class_init (MS2ServerClass *klass)
   g_type_class_add_private (klass, sizeof (MS2ServerPrivate));
 
   gobject_class->finalize = ms2_server_finalize;
+
+  /**
+   * MS2Server::registered:
+   * @server: a #MS2Server
+   * @success: %TRUE if dbus name was acquired
+   *
+   * Notifies when the request of the dbus name started by
+   * ms2_server_new_async() has been replied.
+   **/
+  signals[REGISTERED] = g_signal_new ("registered",
+                                      G_TYPE_FROM_CLASS (klass),
+                                      G_SIGNAL_RUN_LAST,
+                                      G_STRUCT_OFFSET (MS2ServerClass, registered),
+                                      NULL,
+                                      NULL,
+                                      g_cclosure_marshal_VOID__BOOLEAN,
+                                      G_TYPE_NONE,
+                                      1,
+                                      G_TYPE_BOOLEAN);
 }
 
 /* Object init function */
@@ -1100,6 +2141,109 @@ static void
 ms2_server_init (MS2Server *server)
 {
   server->priv = MS2_SERVER_GET_PRIVATE (server);
+  server->priv->registration_time = -1;
+
+  /* Index 0 is never used */
+  server->priv->ids = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (server->priv->ids, NULL);
+  server->priv->id_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+  server->priv->updated_queue = g_queue_new ();
+  server->priv->updated_pending = g_hash_table_new (g_str_hash, g_str_equal);
+
+  server->priv->max_reply_bytes = MS2_DEFAULT_MAX_REPLY_BYTES;
+
+  server->priv->stats = ms2_stats_new ();
+  n_servers++;
+}
+
+/* Forgets the oldest identifiers if there are more than MS2_SERVER_MAX_IDS */
+static void
+forget_oldest_ids (MS2Server *server)
+{
+  const gchar *id;
+  guint i;
+  guint n;
+
+  if (g_hash_table_size (server->priv->id_index) <= MS2_SERVER_MAX_IDS) {
+    return;
+  }
+
+  n = server->priv->ids->len / 4;
+  for (i = 0; i < n; i++) {
+    id = g_ptr_array_index (server->priv->ids, i);
+    if (id) {
+      g_hash_table_remove (server->priv->id_index, id);
+    }
+  }
+
+  g_ptr_array_remove_range (server->priv->ids, 0, n);
+  server->priv->ids_base += n;
+}
+
+/****************** INTERNAL PUBLIC API (NOT TO BE EXPORTED) ******************/
+
+/* Returns the number identifying id in object paths, adding it if needed */
+guint
+ms2_server_id_to_index (MS2Server *server,
+                        const gchar *id)
+{
+  gchar *new_id;
+  gpointer index;
+  guint new_index;
+
+  index = g_hash_table_lookup (server->priv->id_index, id);
+  if (index) {
+    return GPOINTER_TO_UINT (index);
+  }
+
+  new_id = g_strdup (id);
+  g_ptr_array_add (server->priv->ids, new_id);
+  new_index = server->priv->ids_base + server->priv->ids->len - 1;
+  g_hash_table_insert (server->priv->id_index,
+                       new_id,
+                       GUINT_TO_POINTER (new_index));
+  forget_oldest_ids (server);
+
+  return new_index;
+}
+
+/* Returns the id identified by index in object paths, or NULL if unknown */
+const gchar *
+ms2_server_index_to_id (MS2Server *server,
+                        guint index)
+{
+  if (index < server->priv->ids_base ||
+      index - server->priv->ids_base >= server->priv->ids->len) {
+    return NULL;
+  }
+
+  return g_ptr_array_index (server->priv->ids, index - server->priv->ids_base);
+}
+
+/* Returns a new server not registered in dbus, used to measure marshalling */
+MS2Server *
+ms2_server_new_offline (const gchar *name)
+{
+  MS2Server *server;
+
+  server = g_object_new (MS2_TYPE_SERVER, NULL);
+  server->priv->name = g_strdup (name);
+
+  return server;
+}
+
+/* Adds objects to message as an array of dictionaries, like listing replies
+   do. Returns their estimated size in bytes */
+gsize
+ms2_server_append_objects (DBusMessage *m,
+                           GList *objects)
+{
+  gsize bytes;
+
+  add_glist_as_array (m, NULL, objects, 0, &bytes);
+
+  return bytes;
 }
 
 /********************* PUBLIC API *********************/
@@ -1139,6 +2283,42 @@ ms2_server_new (const gchar *name,
   }
 }
 
+/**
+ * ms2_server_new_async:
+ * @name: the name used when registered in DBus
+ * @data: user defined data
+ *
+ * Creates a new #MS2Server like ms2_server_new(), but without blocking until
+ * name "org.gnome.UPnP.MediaServer2.<name>" is acquired. This allows
+ * requesting names for several servers at the same time.
+ *
+ * When bus replies, #MS2Server::registered signal is emitted telling if name
+ * was acquired. In case of failure, user should destroy the server.
+ *
+ * Returns: a new #MS2Server, or @NULL if it can not be registered in DBus
+ **/
+MS2Server *
+ms2_server_new_async (const gchar *name,
+                      gpointer data)
+{
+  MS2Server *server;
+
+  g_return_val_if_fail (name, NULL);
+
+  server = g_object_new (MS2_TYPE_SERVER, NULL);
+
+  server->priv->data = data;
+  server->priv->name = g_strdup (name);
+
+  /* Register object in DBus */
+  if (!ms2_server_dbus_register_async (server, name)) {
+    g_object_unref (server);
+    return NULL;
+  } else {
+    return server;
+  }
+}
+
 /**
  * ms2_server_set_get_properties_func:
  * @server: a #MS2Server
@@ -1155,6 +2335,26 @@ ms2_server_set_get_properties_func (MS2Server *server,
   server->priv->get_properties = get_properties_func;
 }
 
+/**
+ * ms2_server_set_get_properties_batch_func:
+ * @server: a #MS2Server
+ * @get_properties_batch_func: user-defined function to request properties of
+ * several objects
+ *
+ * Defines which function must be used when requesting properties of several
+ * objects at once. Backends able to resolve objects concurrently should set
+ * it; otherwise the function set with ms2_server_set_get_properties_func() is
+ * used for each object.
+ **/
+void
+ms2_server_set_get_properties_batch_func (MS2Server *server,
+                                          GetPropertiesBatchFunc get_properties_batch_func)
+{
+  g_return_if_fail (MS2_IS_SERVER (server));
+
+  server->priv->get_properties_batch = get_properties_batch_func;
+}
+
 /**
  * ms2_server_set_list_children_func:
  * @server: a #MS2Server
@@ -1187,6 +2387,45 @@ ms2_server_set_search_objects_func (MS2Server *server,
   server->priv->search_objects = search_objects_func;
 }
 
+/**
+ * ms2_server_set_list_children_from_func:
+ * @server: a #MS2Server
+ * @list_children_from_func: user-defined function to request children from a
+ * cursor
+ *
+ * Defines which function must be used when requesting children from a cursor.
+ * Backends able to keep their position between pages should set it; otherwise
+ * cursors are translated into offsets for the function set with
+ * ms2_server_set_list_children_func().
+ **/
+void
+ms2_server_set_list_children_from_func (MS2Server *server,
+                                        ListChildrenFromFunc list_children_from_func)
+{
+  g_return_if_fail (MS2_IS_SERVER (server));
+
+  server->priv->list_children_from = list_children_from_func;
+}
+
+/**
+ * ms2_server_set_search_objects_from_func:
+ * @server: a #MS2Server
+ * @search_objects_from_func: user-defined function to search objects from a
+ * cursor
+ *
+ * Defines which function must be used when searching objects from a cursor.
+ * Otherwise cursors are translated into offsets for the function set with
+ * ms2_server_set_search_objects_func().
+ **/
+void
+ms2_server_set_search_objects_from_func (MS2Server *server,
+                                         SearchObjectsFromFunc search_objects_from_func)
+{
+  g_return_if_fail (MS2_IS_SERVER (server));
+
+  server->priv->search_objects_from = search_objects_from_func;
+}
+
 /**
  * ms2_server_updated:
  * @server: a #MS2Server
@@ -1201,45 +2440,163 @@ ms2_server_set_search_objects_func (MS2Server *server,
  * when child containers are modified: instead the signal should be emitted on
  * the child in this case. It up to client to follow these rules when invoking
  * this method
+ *
+ * If a coalescing window has been set with ms2_server_set_updated_window(), the
+ * signal is delayed until the end of current interval.
  **/
 void
 ms2_server_updated (MS2Server *server,
                     const gchar *id)
 {
-  DBusError error;
-  DBusConnection *connection;
-  DBusMessage *message;
-  gchar *object_path;
-
   g_return_if_fail (MS2_IS_SERVER (server));
 
-  dbus_error_init (&error);
+  if (!server->priv->connection) {
+    return;
+  }
 
-  connection = dbus_bus_get (DBUS_BUS_SESSION, &error);
+  if (server->priv->updated_window == 0) {
+    emit_updated (server, id);
+  } else {
+    queue_updated (server, id);
+  }
+}
 
-  if (!connection) {
-    g_printerr ("Could not connect to session bus, %s\n", error.message);
+/**
+ * ms2_server_updated_batch:
+ * @server: a #MS2Server
+ * @ids: a @NULL-terminated array of identifiers of items that have changed
+ *
+ * Like ms2_server_updated(), but notifying several items at once. Repeated
+ * identifiers are notified only once.
+ *
+ * Signals are emitted right away, unless a coalescing window has been set with
+ * ms2_server_set_updated_window().
+ **/
+void
+ms2_server_updated_batch (MS2Server *server,
+                          const gchar **ids)
+{
+  GHashTable *emitted;
+  gint i;
+
+  g_return_if_fail (MS2_IS_SERVER (server));
+  g_return_if_fail (ids);
+
+  if (!server->priv->connection) {
     return;
   }
 
-  /* Get object path */
-  if (g_strcmp0 (id, MS2_ROOT) == 0) {
-    object_path = g_strconcat (MS2_DBUS_PATH_PREFIX,
-                               server->priv->name,
-                               NULL);
-  } else {
-    object_path = g_strdup_printf (MS2_DBUS_PATH_PREFIX "%s/containers/%d",
-                                   server->priv->name,
-                                   g_quark_from_string (id));
+  if (server->priv->updated_window > 0) {
+    for (i = 0; ids[i]; i++) {
+      queue_updated (server, ids[i]);
+    }
+    return;
   }
 
-  message = dbus_message_new_signal (object_path,
-                                     "org.gnome.UPnP.MediaContainer2",
-                                     "Updated");
-  dbus_connection_send (connection, message, NULL);
-  dbus_message_unref (message);
+  emitted = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; ids[i]; i++) {
+    if (g_hash_table_lookup (emitted, ids[i])) {
+      server->priv->updated_coalesced++;
+    } else {
+      g_hash_table_insert (emitted, (gpointer) ids[i], GINT_TO_POINTER (TRUE));
+      emit_updated (server, ids[i]);
+    }
+  }
+  g_hash_table_unref (emitted);
+}
 
-  g_free (object_path);
+/**
+ * ms2_server_set_updated_window:
+ * @server: a #MS2Server
+ * @window_ms: interval, in milliseconds, to coalesce Updated signals
+ * @max_per_flush: max. number of signals to emit per interval, or 0 for no
+ * limit
+ *
+ * Instead of emitting Updated signals as soon as they are requested, @server
+ * will queue them and emit them every @window_ms, notifying each item only once
+ * per interval. If more than @max_per_flush items become pending, they are
+ * replaced by a single signal on the root container.
+ *
+ * A @window_ms of 0 disables coalescing, which is the default; pending signals
+ * are emitted right away.
+ **/
+void
+ms2_server_set_updated_window (MS2Server *server,
+                               guint window_ms,
+                               guint max_per_flush)
+{
+  g_return_if_fail (MS2_IS_SERVER (server));
+
+  server->priv->updated_window = window_ms;
+  server->priv->updated_max = max_per_flush;
+
+  /* Restart the timer with the new interval */
+  if (server->priv->updated_flush_id) {
+    g_source_remove (server->priv->updated_flush_id);
+    server->priv->updated_flush_id = 0;
+  }
+
+  if (window_ms == 0) {
+    server->priv->updated_max = 0;
+    flush_updated (server);
+  } else if (!g_queue_is_empty (server->priv->updated_queue)) {
+    server->priv->updated_flush_id =
+      g_timeout_add (window_ms, flush_updated, server);
+  }
+}
+
+/**
+ * ms2_server_set_reply_limits:
+ * @server: a #MS2Server
+ * @max_items: max. number of objects to ask backend per listing, or 0 for no
+ * limit
+ * @max_bytes: max. size, in bytes, of a listing reply, or 0 for no limit
+ *
+ * Limits the size of replies to ListChildren, ListContainers, ListItems and
+ * SearchObjects, so huge containers do not end in replies bigger than what the
+ * bus accepts. Backends are not asked for more objects than the ones expected
+ * to fit, given the size of previous replies. Objects that do not fit are
+ * dropped from the reply; clients using the paged variants of those methods are
+ * told the offset where to continue, while truncated replies to the standard
+ * methods are logged and counted in the statistics. GetPropertiesBatch requests
+ * whose reply would exceed @max_bytes are refused.
+ *
+ * By default there is no limit in items, and replies are kept under 24MB.
+ **/
+void
+ms2_server_set_reply_limits (MS2Server *server,
+                             guint max_items,
+                             gsize max_bytes)
+{
+  g_return_if_fail (MS2_IS_SERVER (server));
+
+  server->priv->max_reply_items = max_items;
+  server->priv->max_reply_bytes = max_bytes;
+}
+
+/**
+ * ms2_server_get_updated_stats:
+ * @server: a #MS2Server
+ * @emitted: (out) (allow-none): number of Updated signals emitted, or @NULL
+ * @coalesced: (out) (allow-none): number of Updated signals merged with a
+ * pending one, or @NULL
+ *
+ * Returns counters about the Updated signals requested to @server.
+ **/
+void
+ms2_server_get_updated_stats (MS2Server *server,
+                              guint *emitted,
+                              guint *coalesced)
+{
+  g_return_if_fail (MS2_IS_SERVER (server));
+
+  if (emitted) {
+    *emitted = server->priv->updated_emitted;
+  }
+
+  if (coalesced) {
+    *coalesced = server->priv->updated_coalesced;
+  }
 }
 
 /**
@@ -1257,3 +2614,203 @@ ms2_server_get_name (MS2Server *server)
 
   return server->priv->name;
 }
+
+/**
+ * ms2_server_is_registered:
+ * @server: a #MS2Server
+ *
+ * Checks if dbus name has already been acquired.
+ *
+ * Returns: %TRUE if @server owns its dbus name
+ **/
+gboolean
+ms2_server_is_registered (MS2Server *server)
+{
+  g_return_val_if_fail (MS2_IS_SERVER (server), FALSE);
+
+  return server->priv->registered;
+}
+
+/**
+ * ms2_server_get_request_serial:
+ * @server: a #MS2Server
+ *
+ * Returns the serial of the DBus request @server is handling, so backends can
+ * relate the work done for it, for instance in their own tracepoints. Requests
+ * handled while a backend iterates the main loop are nested: once they are
+ * done, the serial of the outer request is returned again.
+ *
+ * Returns: the serial of the request, or 0 if no request is being handled
+ **/
+guint32
+ms2_server_get_request_serial (MS2Server *server)
+{
+  g_return_val_if_fail (MS2_IS_SERVER (server), 0);
+
+  return server->priv->request_serial;
+}
+
+/**
+ * ms2_server_get_registration_time:
+ * @server: a #MS2Server
+ *
+ * Returns how long it took to register @server in DBus, from its creation
+ * until the request of the name was replied.
+ *
+ * Returns: registration time in microseconds, or -1 if still in progress
+ **/
+gint64
+ms2_server_get_registration_time (MS2Server *server)
+{
+  g_return_val_if_fail (MS2_IS_SERVER (server), -1);
+
+  return server->priv->registration_time;
+}
+
+/**
+ * ms2_server_save_ids:
+ * @server: a #MS2Server
+ * @filename: file to store the identifiers
+ * @error: a #GError, or @NULL
+ *
+ * Stores how identifiers are mapped to object paths, so they can be restored
+ * with ms2_server_load_ids() in a later run. This way, object paths known by
+ * clients remain valid when the server is restarted.
+ *
+ * Returns: %TRUE if identifiers were stored
+ **/
+gboolean
+ms2_server_save_ids (MS2Server *server,
+                     const gchar *filename,
+                     GError **error)
+{
+  GString *contents;
+  gboolean success;
+  gchar *escaped_id;
+  guint i;
+
+  g_return_val_if_fail (MS2_IS_SERVER (server), FALSE);
+  g_return_val_if_fail (filename, FALSE);
+
+  /* Identifiers below the base have been forgotten; keep it, so the rest are
+     still valid when loaded */
+  contents = g_string_new ("");
+  g_string_append_printf (contents,
+                          MS2_IDS_BASE_PREFIX "%u\n",
+                          server->priv->ids_base);
+  for (i = 0; i < server->priv->ids->len; i++) {
+    if (g_ptr_array_index (server->priv->ids, i)) {
+      escaped_id = g_strescape (g_ptr_array_index (server->priv->ids, i), NULL);
+      g_string_append_printf (contents,
+                              "%u\t%s\n",
+                              server->priv->ids_base + i,
+                              escaped_id);
+      g_free (escaped_id);
+    }
+  }
+
+  success = g_file_set_contents (filename,
+                                 contents->str,
+                                 contents->len,
+                                 error);
+  g_string_free (contents, TRUE);
+
+  return success;
+}
+
+/**
+ * ms2_server_load_ids:
+ * @server: a #MS2Server
+ * @filename: file storing the identifiers
+ * @error: a #GError, or @NULL
+ *
+ * Restores identifiers stored with ms2_server_save_ids(). It should be invoked
+ * before @server starts handling requests; identifiers or indexes already in
+ * use are skipped.
+ *
+ * Returns: %TRUE if identifiers were loaded
+ **/
+gboolean
+ms2_server_load_ids (MS2Server *server,
+                     const gchar *filename,
+                     GError **error)
+{
+  gchar **line;
+  gchar **lines;
+  gchar *contents;
+  gchar *end;
+  gchar *id;
+  gchar *tab;
+  gulong base;
+  gulong index;
+  gulong max_index;
+
+  g_return_val_if_fail (MS2_IS_SERVER (server), FALSE);
+  g_return_val_if_fail (filename, FALSE);
+
+  if (!g_file_get_contents (filename, &contents, NULL, error)) {
+    return FALSE;
+  }
+
+  lines = g_strsplit (contents, "\n", -1);
+  g_free (contents);
+
+  /* Restore the base the file was saved with, unless server is already using
+     identifiers */
+  if (lines[0] && g_str_has_prefix (lines[0], MS2_IDS_BASE_PREFIX)) {
+    errno = 0;
+    base = strtoul (lines[0] + strlen (MS2_IDS_BASE_PREFIX), &end, 10);
+    if (errno != 0 || *end != '\0' || base > G_MAXUINT) {
+      g_warning ("Skipping invalid identifiers base in %s", filename);
+    } else if (base > server->priv->ids_base &&
+               g_hash_table_size (server->priv->id_index) == 0) {
+      g_ptr_array_set_size (server->priv->ids, 0);
+      server->priv->ids_base = base;
+    }
+  }
+
+  /* A valid file never has indexes beyond one per line, so anything bigger
+     would only make the table grow with empty slots */
+  max_index = server->priv->ids_base + server->priv->ids->len +
+    g_strv_length (lines);
+
+  for (line = lines; *line; line++) {
+    tab = strchr (*line, '\t');
+    if (!tab) {
+      continue;
+    }
+    *tab = '\0';
+    errno = 0;
+    index = strtoul (*line, &end, 10);
+    if (errno != 0 || end == *line || *end != '\0' ||
+        index == 0 || index >= max_index ||
+        index < server->priv->ids_base) {
+      g_warning ("Skipping invalid identifier index '%s' in %s",
+                 *line,
+                 filename);
+      continue;
+    }
+
+    if (ms2_server_index_to_id (server, index)) {
+      continue;
+    }
+
+    id = g_strcompress (tab + 1);
+    if (g_hash_table_lookup (server->priv->id_index, id)) {
+      g_free (id);
+      continue;
+    }
+
+    if (index - server->priv->ids_base >= server->priv->ids->len) {
+      g_ptr_array_set_size (server->priv->ids,
+                            index - server->priv->ids_base + 1);
+    }
+    g_ptr_array_index (server->priv->ids, index - server->priv->ids_base) = id;
+    g_hash_table_insert (server->priv->id_index, id, GUINT_TO_POINTER (index));
+  }
+
+  g_strfreev (lines);
+  forget_oldest_ids (server);
+
+  return TRUE;
+}
@@ -70,8 +70,27 @@ typedef struct _MS2ServerClass MS2ServerClass;
 struct _MS2ServerClass {
 
   GObjectClass parent_class;
+
+  void (*registered) (MS2Server *server,
+                      gboolean success);
 };
 
+/*
+ * Statistics about memory used to build replies, since the beginning
+ *   requests: number of requests handled; nested requests are not counted
+ *   allocations: number of allocations taken from the arena
+ *   bytes: bytes taken from the arena
+ *   chunks: number of chunks the arena had to get
+ *   peak_bytes: max. bytes used by a single request
+ */
+typedef struct {
+  guint64 requests;
+  guint64 allocations;
+  guint64 bytes;
+  guint64 chunks;
+  gsize peak_bytes;
+} MS2AllocationStats;
+
 typedef enum {
   LIST_ALL,
   LIST_CONTAINERS,
@@ -84,6 +103,16 @@ typedef GHashTable * (*GetPropertiesFunc) (MS2Server *server,
                                            gpointer data,
                                            GError **error);
 
+/*
+ * Returns a list with the properties of each object in ids, in the same order;
+ * elements are NULL for objects whose properties could not be obtained
+ */
+typedef GList * (*GetPropertiesBatchFunc) (MS2Server *server,
+                                           const gchar **ids,
+                                           const gchar **properties,
+                                           gpointer data,
+                                           GError **error);
+
 typedef GList * (*ListChildrenFunc) (MS2Server *server,
                                      const gchar *id,
                                      ListType list_type,
@@ -102,27 +131,96 @@ typedef GList * (*SearchObjectsFunc) (MS2Server *server,
                                       gpointer data,
                                       GError **error);
 
+/*
+ * Cursor functions: cursor is NULL or empty to start from the beginning; when
+ * there are more elements, next_cursor must be set to a new string pointing to
+ * them
+ */
+typedef GList * (*ListChildrenFromFunc) (MS2Server *server,
+                                         const gchar *id,
+                                         const gchar *cursor,
+                                         guint max_count,
+                                         const gchar **properties,
+                                         gchar **next_cursor,
+                                         gpointer data,
+                                         GError **error);
+
+typedef GList * (*SearchObjectsFromFunc) (MS2Server *server,
+                                          const gchar *id,
+                                          const gchar *query,
+                                          const gchar *cursor,
+                                          guint max_count,
+                                          const gchar **properties,
+                                          gchar **next_cursor,
+                                          gpointer data,
+                                          GError **error);
+
 GType ms2_server_get_type (void);
 
 MS2Server *ms2_server_new (const gchar *name,
                            gpointer data);
 
+MS2Server *ms2_server_new_async (const gchar *name,
+                                 gpointer data);
+
 void ms2_server_set_get_properties_func (MS2Server *server,
                                          GetPropertiesFunc get_properties_func);
 
+void ms2_server_set_get_properties_batch_func (MS2Server *server,
+                                               GetPropertiesBatchFunc get_properties_batch_func);
+
 void ms2_server_set_list_children_func (MS2Server *server,
                                         ListChildrenFunc list_children_func);
 
 void ms2_server_set_search_objects_func (MS2Server *server,
                                          SearchObjectsFunc search_objects_func);
 
+void ms2_server_set_list_children_from_func (MS2Server *server,
+                                             ListChildrenFromFunc list_children_from_func);
+
+void ms2_server_set_search_objects_from_func (MS2Server *server,
+                                              SearchObjectsFromFunc search_objects_from_func);
+
 void ms2_server_updated (MS2Server *server,
                          const gchar *id);
 
+void ms2_server_updated_batch (MS2Server *server,
+                               const gchar **ids);
+
+void ms2_server_set_updated_window (MS2Server *server,
+                                    guint window_ms,
+                                    guint max_per_flush);
+
+void ms2_server_set_reply_limits (MS2Server *server,
+                                  guint max_items,
+                                  gsize max_bytes);
+
+void ms2_server_get_updated_stats (MS2Server *server,
+                                   guint *emitted,
+                                   guint *coalesced);
+
 const gchar *ms2_server_get_name (MS2Server *server);
 
+gboolean ms2_server_is_registered (MS2Server *server);
+
+gint64 ms2_server_get_registration_time (MS2Server *server);
+
+guint32 ms2_server_get_request_serial (MS2Server *server);
+
+void ms2_server_get_allocation_stats (MS2AllocationStats *stats);
+
+gboolean ms2_server_save_ids (MS2Server *server,
+                              const gchar *filename,
+                              GError **error);
+
+gboolean ms2_server_load_ids (MS2Server *server,
+                              const gchar *filename,
+                              GError **error);
+
 GHashTable *ms2_server_new_properties_hashtable (void);
 
+GHashTable *ms2_server_new_reply_properties_hashtable (void);
+
 void ms2_server_set_path (MS2Server *server,
                           GHashTable *properties,
                           const gchar *id,
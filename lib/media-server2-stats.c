@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <string.h>
+
+#include "media-server2-private.h"
+
+/* Latencies are kept in buckets of powers of 2 microseconds: bucket 0 holds
+   0us, and bucket i holds [2^(i-1), 2^i) us. Last one holds everything
+   above */
+#define MS2_STATS_BUCKETS 24
+
+enum {
+  LATENCY_BACKEND,
+  LATENCY_MARSHAL,
+  LATENCY_TOTAL,
+  LATENCY_LAST
+};
+
+/*
+ * Request being handled
+ *   method: method requested
+ *   start: monotonic time when request started
+ *   backend: microseconds spent in backend functions
+ *   marshal: microseconds spent building the reply
+ */
+typedef struct {
+  MS2StatsMethod method;
+  gint64 start;
+  gint64 backend;
+  gint64 marshal;
+} MS2StatsRequest;
+
+/*
+ * Statistics about requests
+ *   requests: requests handled, per method
+ *   in_flight: requests being handled, per method
+ *   latency: histograms of latencies, per method and kind
+ *   latency_sum: total microseconds spent, per method and kind
+ *   bytes: estimated bytes of objects sent
+ *   current: stack of requests being handled; requests are nested when
+ *            backends iterate the main loop
+ */
+struct _MS2Stats {
+  guint64 requests[MS2_STATS_N_METHODS];
+  guint in_flight[MS2_STATS_N_METHODS];
+  guint64 latency[MS2_STATS_N_METHODS][LATENCY_LAST][MS2_STATS_BUCKETS];
+  guint64 latency_sum[MS2_STATS_N_METHODS][LATENCY_LAST];
+  guint64 bytes;
+  GSList *current;
+};
+
+static const gchar *method_names[MS2_STATS_N_METHODS] = {
+  "Get",
+  "GetAll",
+  "ListChildren",
+  "ListContainers",
+  "ListItems",
+  "SearchObjects",
+  "GetPropertiesBatch"
+};
+
+static const gchar *latency_names[LATENCY_LAST] = {
+  "backend",
+  "marshal",
+  "total"
+};
+
+static MS2Stats global_stats = { { 0 } };
+
+/******************** PRIVATE API ********************/
+
+/* Returns the bucket where latency goes */
+static guint
+get_bucket (gint64 latency)
+{
+  guint bucket = 0;
+
+  while (latency > 0 && bucket < MS2_STATS_BUCKETS - 1) {
+    latency >>= 1;
+    bucket++;
+  }
+
+  return bucket;
+}
+
+/* Accounts a finished request */
+static void
+record_request (MS2Stats *stats,
+                MS2StatsRequest *request,
+                gint64 total)
+{
+  gint64 latency[LATENCY_LAST];
+  gint i;
+
+  latency[LATENCY_BACKEND] = request->backend;
+  latency[LATENCY_MARSHAL] = request->marshal;
+  latency[LATENCY_TOTAL] = total;
+
+  stats->requests[request->method]++;
+  stats->in_flight[request->method]--;
+  for (i = 0; i < LATENCY_LAST; i++) {
+    stats->latency[request->method][i][get_bucket (latency[i])]++;
+    stats->latency_sum[request->method][i] += latency[i];
+  }
+}
+
+/* Adds a <key, variant> entry to the dictionary */
+static void
+append_entry (DBusMessageIter *dict,
+              const gchar *key,
+              gint type,
+              gconstpointer value)
+{
+  DBusMessageIter entry;
+  DBusMessageIter variant;
+  gchar signature[2] = { type, '\0' };
+
+  dbus_message_iter_open_container (dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+  dbus_message_iter_append_basic (&entry, DBUS_TYPE_STRING, &key);
+  dbus_message_iter_open_container (&entry, DBUS_TYPE_VARIANT, signature, &variant);
+  dbus_message_iter_append_basic (&variant, type, value);
+  dbus_message_iter_close_container (&entry, &variant);
+  dbus_message_iter_close_container (dict, &entry);
+}
+
+/* Adds a <key, array of uint64> entry to the dictionary */
+static void
+append_histogram (DBusMessageIter *dict,
+                  const gchar *key,
+                  const guint64 *values,
+                  gint n_values)
+{
+  DBusMessageIter array;
+  DBusMessageIter entry;
+  DBusMessageIter variant;
+
+  dbus_message_iter_open_container (dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+  dbus_message_iter_append_basic (&entry, DBUS_TYPE_STRING, &key);
+  dbus_message_iter_open_container (&entry, DBUS_TYPE_VARIANT, "at", &variant);
+  dbus_message_iter_open_container (&variant, DBUS_TYPE_ARRAY, "t", &array);
+  dbus_message_iter_append_fixed_array (&array, DBUS_TYPE_UINT64, &values, n_values);
+  dbus_message_iter_close_container (&variant, &array);
+  dbus_message_iter_close_container (&entry, &variant);
+  dbus_message_iter_close_container (dict, &entry);
+}
+
+/****************** INTERNAL PUBLIC API (NOT TO BE EXPORTED) ******************/
+
+/* Returns new statistics */
+MS2Stats *
+ms2_stats_new (void)
+{
+  return g_slice_new0 (MS2Stats);
+}
+
+/* Frees statistics */
+void
+ms2_stats_free (MS2Stats *stats)
+{
+  g_slist_free_full (stats->current, g_free);
+  g_slice_free (MS2Stats, stats);
+}
+
+/* Returns statistics aggregating all servers in the process */
+MS2Stats *
+ms2_stats_get_global (void)
+{
+  return &global_stats;
+}
+
+/* Starts accounting a request of method */
+void
+ms2_stats_begin (MS2Stats *stats,
+                 MS2StatsMethod method)
+{
+  MS2StatsRequest *request;
+
+  request = g_new0 (MS2StatsRequest, 1);
+  request->method = method;
+  request->start = g_get_monotonic_time ();
+
+  stats->current = g_slist_prepend (stats->current, request);
+  stats->in_flight[method]++;
+  global_stats.in_flight[method]++;
+}
+
+/* Finishes accounting current request */
+void
+ms2_stats_end (MS2Stats *stats)
+{
+  MS2StatsRequest *request;
+  gint64 total;
+
+  g_return_if_fail (stats->current);
+
+  request = stats->current->data;
+  stats->current = g_slist_delete_link (stats->current, stats->current);
+
+  total = g_get_monotonic_time () - request->start;
+  record_request (stats, request, total);
+  record_request (&global_stats, request, total);
+
+  g_free (request);
+}
+
+/* Accounts the time since start as spent in backend by current request */
+void
+ms2_stats_add_backend_time (MS2Stats *stats,
+                            gint64 start)
+{
+  MS2StatsRequest *request;
+
+  if (stats->current) {
+    request = stats->current->data;
+    request->backend += g_get_monotonic_time () - start;
+  }
+}
+
+/* Accounts the time since start as spent building the reply of current
+   request */
+void
+ms2_stats_add_marshal_time (MS2Stats *stats,
+                            gint64 start)
+{
+  MS2StatsRequest *request;
+
+  if (stats->current) {
+    request = stats->current->data;
+    request->marshal += g_get_monotonic_time () - start;
+  }
+}
+
+/* Accounts bytes sent */
+void
+ms2_stats_add_bytes (MS2Stats *stats,
+                     gsize bytes)
+{
+  stats->bytes += bytes;
+  global_stats.bytes += bytes;
+}
+
+/* Adds the statistics to an a{sv} dictionary being built:
+     requests.<method>: requests handled (t)
+     in-flight.<method>: requests being handled (u)
+     latency.<method>.<kind>: histogram of latencies (at), where kind is
+       backend, marshal or total
+     latency-sum.<method>.<kind>: total microseconds spent (t)
+     latency-buckets: upper bound in microseconds of each bucket (at)
+     bytes-sent: estimated bytes of objects sent (t) */
+void
+ms2_stats_append (MS2Stats *stats,
+                  DBusMessageIter *dict)
+{
+  gchar *key;
+  guint64 bounds[MS2_STATS_BUCKETS];
+  gint i;
+  gint method;
+
+  for (method = 0; method < MS2_STATS_N_METHODS; method++) {
+    key = g_strconcat ("requests.", method_names[method], NULL);
+    append_entry (dict, key, DBUS_TYPE_UINT64, &stats->requests[method]);
+    g_free (key);
+
+    key = g_strconcat ("in-flight.", method_names[method], NULL);
+    append_entry (dict, key, DBUS_TYPE_UINT32, &stats->in_flight[method]);
+    g_free (key);
+
+    for (i = 0; i < LATENCY_LAST; i++) {
+      key = g_strconcat ("latency.", method_names[method], ".",
+                         latency_names[i], NULL);
+      append_histogram (dict, key, stats->latency[method][i], MS2_STATS_BUCKETS);
+      g_free (key);
+
+      key = g_strconcat ("latency-sum.", method_names[method], ".",
+                         latency_names[i], NULL);
+      append_entry (dict, key, DBUS_TYPE_UINT64, &stats->latency_sum[method][i]);
+      g_free (key);
+    }
+  }
+
+  bounds[0] = 0;
+  for (i = 1; i < MS2_STATS_BUCKETS - 1; i++) {
+    bounds[i] = ((guint64) 1 << i) - 1;
+  }
+  bounds[MS2_STATS_BUCKETS - 1] = G_MAXUINT64;
+  append_histogram (dict, "latency-buckets", bounds, MS2_STATS_BUCKETS);
+
+  append_entry (dict, "bytes-sent", DBUS_TYPE_UINT64, &stats->bytes);
+}
+
+/* Adds a uint32 entry to an a{sv} dictionary being built */
+void
+ms2_stats_append_uint (DBusMessageIter *dict,
+                       const gchar *key,
+                       guint32 value)
+{
+  append_entry (dict, key, DBUS_TYPE_UINT32, &value);
+}
+
+/* Adds a uint64 entry to an a{sv} dictionary being built */
+void
+ms2_stats_append_uint64 (DBusMessageIter *dict,
+                         const gchar *key,
+                         guint64 value)
+{
+  append_entry (dict, key, DBUS_TYPE_UINT64, &value);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef _MEDIA_SERVER2_TRACE_H_
+#define _MEDIA_SERVER2_TRACE_H_
+
+/*
+ * Static tracepoints, under the "grilo_ms2" provider. They are only built when
+ * MS2_ENABLE_TRACEPOINTS is defined (see the "tracepoints" build option), and
+ * cost a nop when nobody is tracing. List them with:
+ *
+ *   perf list 'sdt_grilo_ms2:*'
+ *
+ *   request__start (serial, path, member): dbus request is dispatched
+ *   request__done (serial, handled): dbus request was dispatched
+ *   marshal__start (serial): reply to request serial starts being built
+ *   marshal__done (serial, objects, bytes): objects were added to reply
+ *
+ * This header is not installed; grilo-ms2 has its own tracepoints.
+ */
+
+#ifdef MS2_ENABLE_TRACEPOINTS
+
+#include <sys/sdt.h>
+
+#define MS2_TRACE1(name, a)                     \
+  DTRACE_PROBE1 (grilo_ms2, name, a)
+#define MS2_TRACE2(name, a, b)                  \
+  DTRACE_PROBE2 (grilo_ms2, name, a, b)
+#define MS2_TRACE3(name, a, b, c)               \
+  DTRACE_PROBE3 (grilo_ms2, name, a, b, c)
+#define MS2_TRACE4(name, a, b, c, d)            \
+  DTRACE_PROBE4 (grilo_ms2, name, a, b, c, d)
+
+#else
+
+#define MS2_TRACE1(name, a)
+#define MS2_TRACE2(name, a, b)
+#define MS2_TRACE3(name, a, b, c)
+#define MS2_TRACE4(name, a, b, c, d)
+
+#endif /* MS2_ENABLE_TRACEPOINTS */
+
+#endif /* _MEDIA_SERVER2_TRACE_H_ */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Authors: Juan A. Suarez Romero <jasuarez@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef _GRILO_MEDIASERVER2_TRACE_H_
+#define _GRILO_MEDIASERVER2_TRACE_H_
+
+/*
+ * Static tracepoints of grilo-ms2, under the same "grilo_ms2" provider than
+ * the ones in the library. Request is the serial of the dbus request the
+ * operation was started for, as given by ms2_server_get_request_serial(), and
+ * matches the serial in request__start and request__done.
+ *
+ *   operation__start (request, operation, source, kind, count): Grilo
+ *     operation is started; kind is "browse", "search" or "resolve"
+ *   operation__result (request, operation, source, remaining): a result was
+ *     delivered
+ *   operation__error (request, operation, source): operation failed
+ */
+
+#ifdef MS2_ENABLE_TRACEPOINTS
+
+#include <sys/sdt.h>
+
+#define GRILO_MS2_TRACE3(name, a, b, c)                 \
+  DTRACE_PROBE3 (grilo_ms2, name, a, b, c)
+#define GRILO_MS2_TRACE4(name, a, b, c, d)              \
+  DTRACE_PROBE4 (grilo_ms2, name, a, b, c, d)
+#define GRILO_MS2_TRACE5(name, a, b, c, d, e)           \
+  DTRACE_PROBE5 (grilo_ms2, name, a, b, c, d, e)
+
+#else
+
+#define GRILO_MS2_TRACE3(name, a, b, c)
+#define GRILO_MS2_TRACE4(name, a, b, c, d)
+#define GRILO_MS2_TRACE5(name, a, b, c, d, e)
+
+#endif /* MS2_ENABLE_TRACEPOINTS */
+
+#endif /* _GRILO_MEDIASERVER2_TRACE_H_ */
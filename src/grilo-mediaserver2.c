@@ -22,13 +22,39 @@
 
 #include <dbus/dbus-glib-bindings.h>
 #include <dbus/dbus-glib.h>
+#include <errno.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
 #include <grilo.h>
+#include <signal.h>
 #include <stdio.h>
 
 #include <media-server2-server.h>
 #include <media-server2-client.h>
+#include "grilo-mediaserver2-trace.h"
 
 #define GRILO_MS2_CONFIG_FILE "grilo-mediaserver2.conf"
+#define GRILO_MS2_MANIFEST_FILE "sources.manifest"
+
+/* Max. number of media locations remembered per source */
+#define GRILO_MS2_MAX_LOCATIONS 10000
+
+/* Changes are notified at most every interval (in milliseconds), and with no
+   more than the given containers per source and interval. A notification
+   touching more containers is notified through root instead */
+#define GRILO_MS2_UPDATE_INTERVAL 1000
+#define GRILO_MS2_MAX_UPDATES     32
+
+/* Cursors not used for a while (in seconds) are released, unless set otherwise
+   with --cursor-timeout */
+#define GRILO_MS2_CURSOR_TIMEOUT 60
+
+/* Max. number of medias read ahead by a cursor. Once reached, the operation is
+   cancelled and restarted from that position when needed */
+#define GRILO_MS2_CURSOR_MAX_PENDING 1000
+
+/* Max. number of resolutions running at the same time for a batch request */
+#define GRILO_MS2_BATCH_MAX_RUNNING 32
 
 #define grl_media_set_grilo_ms2_parent(media, parent)           \
   grl_data_set_string(GRL_DATA(media),                          \
@@ -40,15 +66,26 @@
                       GRL_METADATA_KEY_GRILO_MS2_PARENT)
 
 static GHashTable *servers = NULL;
+static GHashTable *lazy_sources = NULL;
+static GHashTable *locations = NULL;
+static GHashTable *cursors = NULL;
+static guint last_cursor = 0;
 static GList *providers_names = NULL;
 static GrlRegistry *registry = NULL;
+static guint save_manifest_id = 0;
+static GMainLoop *main_loop = NULL;
+static gint64 last_activity = 0;
+static gchar *exec_path = NULL;
 
 static GrlKeyID GRL_METADATA_KEY_GRILO_MS2_PARENT = GRL_METADATA_KEY_INVALID;
 
 static gboolean dups;
+static gboolean lazy;
 static gchar **args = NULL;
 static gchar *conffile = NULL;
 static gint limit = 0;
+static gint idle_timeout = 0;
+static gint cursor_timeout = GRILO_MS2_CURSOR_TIMEOUT;
 
 static GOptionEntry entries[] = {
   { "config-file", 'c', 0,
@@ -63,6 +100,18 @@ static GOptionEntry entries[] = {
     G_OPTION_ARG_INT, &limit,
     "Limit max. number of children (0 = unlimited)",
     NULL },
+  { "lazy", 'L', 0,
+    G_OPTION_ARG_NONE, &lazy,
+    "Register sources from the cached manifest and activate plugins on first request",
+    NULL },
+  { "idle-timeout", 'i', 0,
+    G_OPTION_ARG_INT, &idle_timeout,
+    "Exit after the given minutes without requests (0 = never)",
+    NULL },
+  { "cursor-timeout", 't', 0,
+    G_OPTION_ARG_INT, &cursor_timeout,
+    "Release cursors after the given seconds without use",
+    NULL },
   { G_OPTION_REMAINING, '\0', 0,
     G_OPTION_ARG_FILENAME_ARRAY, &args,
     "Grilo module to load",
@@ -75,6 +124,7 @@ typedef struct {
   GHashTable *properties;
   GList *children;
   GList *keys;
+  GrlMedia *media;
   GrlSource *source;
   GrlOperationOptions *options;
   MS2Server *server;
@@ -83,9 +133,80 @@ typedef struct {
   gchar *parent_id;
   guint offset;
   guint operation_id;
+  guint32 request;
   ListType list_type;
 } GriloMs2Data;
 
+/*
+ * Source registered from the manifest, whose plugin is activated on demand
+ *   source_id: Grilo source identifier
+ *   plugin_id: identifier of the plugin providing the source
+ *   source: the source itself, once the plugin has been activated
+ */
+typedef struct {
+  gchar *source_id;
+  gchar *plugin_id;
+  GrlSource *source;
+} GriloMs2LazySource;
+
+/*
+ * Where a media was exposed, so changes on it can be notified
+ *   id: identifier of the media, only for containers
+ *   parent_id: identifier of the container the media was listed in
+ */
+typedef struct {
+  gchar *id;
+  gchar *parent_id;
+} GriloMs2Location;
+
+/*
+ * Grilo operation kept alive between pages requested through a cursor
+ *   ref_count: references held by the cursors table, the running operation
+ *              and the requests using the cursor
+ *   serial: number identifying the cursor
+ *   server: server the cursor belongs to
+ *   source: source medias are taken from
+ *   id: identifier of the container where operation is done
+ *   query: text being searched, or NULL if browsing
+ *   filter: properties requested, comma-separated
+ *   keys: Grilo keys requested to source
+ *   position: position in source of the next media to give
+ *   pending: medias already received but not given yet
+ *   given: medias given in the last page, in case it must be given again
+ *   given_position: position in source of the first media in given
+ *   operation_id: identifier of the Grilo operation
+ *   request: serial of the dbus request that started the operation
+ *   running: TRUE if operation has not finished yet
+ *   cancelled: TRUE if operation was cancelled because too many medias were
+ *              pending
+ *   finished: TRUE if source has no more medias
+ *   error: error reported by source, if any
+ *   expire_id: timeout releasing the cursor
+ *   released: TRUE if cursor is not in the cursors table anymore
+ */
+typedef struct {
+  guint ref_count;
+  guint serial;
+  MS2Server *server;
+  GrlSource *source;
+  gchar *id;
+  gchar *query;
+  gchar *filter;
+  GList *keys;
+  guint position;
+  GQueue *pending;
+  GQueue *given;
+  guint given_position;
+  guint operation_id;
+  guint32 request;
+  gboolean running;
+  gboolean cancelled;
+  gboolean finished;
+  GError *error;
+  guint expire_id;
+  gboolean released;
+} GriloMs2Cursor;
+
 static GHashTable *
 get_properties_cb (MS2Server *server,
                    const gchar *id,
@@ -93,6 +214,13 @@ get_properties_cb (MS2Server *server,
                    gpointer data,
                    GError **error);
 
+static GList *
+get_properties_batch_cb (MS2Server *server,
+                         const gchar **ids,
+                         const gchar **properties,
+                         gpointer data,
+                         GError **error);
+
 static GList *
 list_children_cb (MS2Server *server,
                   const gchar *id,
@@ -113,6 +241,27 @@ search_objects_cb (MS2Server *server,
                    gpointer data,
                    GError **error);
 
+static GList *
+list_children_from_cb (MS2Server *server,
+                       const gchar *id,
+                       const gchar *cursor,
+                       guint max_count,
+                       const gchar **properties,
+                       gchar **next_cursor,
+                       gpointer data,
+                       GError **error);
+
+static GList *
+search_objects_from_cb (MS2Server *server,
+                        const gchar *id,
+                        const gchar *query,
+                        const gchar *cursor,
+                        guint max_count,
+                        const gchar **properties,
+                        gchar **next_cursor,
+                        gpointer data,
+                        GError **error);
+
 /* Fix invalid characters so string can be used in a dbus name */
 static void
 sanitize (gchar *string)
@@ -179,6 +328,205 @@ unserialize_media (GrlSource *source, const gchar *serial)
   return media;
 }
 
+/* Records that a request has been received, delaying idle exit */
+static void
+touch_activity ()
+{
+  last_activity = g_get_monotonic_time ();
+}
+
+static void
+free_lazy_source (GriloMs2LazySource *lazy_source)
+{
+  g_free (lazy_source->source_id);
+  g_free (lazy_source->plugin_id);
+  g_slice_free (GriloMs2LazySource, lazy_source);
+}
+
+/* Returns the Grilo source attended by server; if it was registered from the
+   manifest, its plugin is activated the first time it is needed */
+static GrlSource *
+get_source (MS2Server *server, gpointer data)
+{
+  GError *error = NULL;
+  GriloMs2LazySource *lazy_source;
+
+  if (data) {
+    return GRL_SOURCE (data);
+  }
+
+  if (!lazy_sources) {
+    return NULL;
+  }
+
+  lazy_source = g_hash_table_lookup (lazy_sources,
+                                     ms2_server_get_name (server));
+  if (!lazy_source) {
+    return NULL;
+  }
+
+  if (!lazy_source->source) {
+    lazy_source->source = grl_registry_lookup_source (registry,
+                                                      lazy_source->source_id);
+  }
+
+  if (!lazy_source->source) {
+    g_debug ("Activating %s plugin to serve %s source",
+             lazy_source->plugin_id,
+             lazy_source->source_id);
+    if (!grl_registry_activate_plugin_by_id (registry,
+                                             lazy_source->plugin_id,
+                                             &error)) {
+      g_warning ("Unable to activate %s plugin: %s",
+                 lazy_source->plugin_id,
+                 error->message);
+      g_clear_error (&error);
+      return NULL;
+    }
+    /* Activating the plugin emits "source-added", which binds the source */
+    if (!lazy_source->source) {
+      lazy_source->source = grl_registry_lookup_source (registry,
+                                                        lazy_source->source_id);
+    }
+  }
+
+  return lazy_source->source;
+}
+
+static void
+free_location (GriloMs2Location *location)
+{
+  g_free (location->id);
+  g_free (location->parent_id);
+  g_slice_free (GriloMs2Location, location);
+}
+
+/* Remembers the container media was listed in */
+static void
+remember_location (MS2Server *server,
+                   GrlMedia *media,
+                   const gchar *parent_id)
+{
+  GHashTable *source_locations;
+  GriloMs2Location *location;
+  const gchar *media_id;
+
+  media_id = grl_media_get_id (media);
+  if (!media_id || !parent_id) {
+    return;
+  }
+
+  source_locations = g_hash_table_lookup (locations,
+                                          ms2_server_get_name (server));
+  if (!source_locations) {
+    source_locations = g_hash_table_new_full (g_str_hash,
+                                              g_str_equal,
+                                              g_free,
+                                              (GDestroyNotify) free_location);
+    g_hash_table_insert (locations,
+                         g_strdup (ms2_server_get_name (server)),
+                         source_locations);
+  } else if (g_hash_table_size (source_locations) >= GRILO_MS2_MAX_LOCATIONS) {
+    /* Forgotten medias will be notified through root */
+    g_hash_table_remove_all (source_locations);
+  }
+
+  location = g_slice_new0 (GriloMs2Location);
+  location->parent_id = g_strdup (parent_id);
+  if (grl_media_is_container (media)) {
+    location->id = serialize_media (media);
+  }
+
+  g_hash_table_replace (source_locations, g_strdup (media_id), location);
+}
+
+/* Invoked when source notifies changes in its content */
+static void
+content_changed_cb (GrlSource *source,
+                    GPtrArray *changed_medias,
+                    GrlSourceChangeType change_type,
+                    gboolean location_unknown,
+                    gpointer user_data)
+{
+  GHashTable *source_locations;
+  GHashTable *updates;
+  GriloMs2Location *location;
+  GrlMedia *media;
+  MS2Server *server;
+  const gchar *root_ids[] = { MS2_ROOT, NULL };
+  gchar **ids;
+  gchar *name;
+  guint i;
+
+  name = g_strdup (grl_source_get_id (source));
+  sanitize (name);
+
+  server = g_hash_table_lookup (servers, name);
+  if (!server) {
+    g_free (name);
+    return;
+  }
+
+  source_locations = g_hash_table_lookup (locations, name);
+  g_free (name);
+
+  updates = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  for (i = 0; i < changed_medias->len; i++) {
+    media = g_ptr_array_index (changed_medias, i);
+    location = NULL;
+    if (source_locations && grl_media_get_id (media)) {
+      location = g_hash_table_lookup (source_locations,
+                                      grl_media_get_id (media));
+    }
+
+    if (location_unknown || !location) {
+      /* We do not know where the media is, so notify the whole tree */
+      g_hash_table_add (updates, g_strdup (MS2_ROOT));
+    } else if (change_type == GRL_CONTENT_CHANGED && location->id) {
+      /* Modified containers notify about themselves, not their parent */
+      g_hash_table_add (updates, g_strdup (location->id));
+    } else {
+      g_hash_table_add (updates, g_strdup (location->parent_id));
+    }
+
+    if (location && change_type == GRL_CONTENT_REMOVED) {
+      g_hash_table_remove (source_locations, grl_media_get_id (media));
+    }
+  }
+
+  if (g_hash_table_size (updates) > GRILO_MS2_MAX_UPDATES) {
+    ms2_server_updated_batch (server, root_ids);
+  } else {
+    ids = (gchar **) g_hash_table_get_keys_as_array (updates, NULL);
+    ms2_server_updated_batch (server, (const gchar **) ids);
+    g_free (ids);
+  }
+
+  g_hash_table_unref (updates);
+}
+
+/* Starts propagating the changes notified by source */
+static void
+watch_source_changes (GrlSource *source)
+{
+  GError *error = NULL;
+
+  if (!(grl_source_supported_operations (source) & GRL_OP_NOTIFY_CHANGE)) {
+    return;
+  }
+
+  g_signal_connect (source, "content-changed",
+                    G_CALLBACK (content_changed_cb), NULL);
+
+  if (!grl_source_notify_change_start (source, &error)) {
+    g_debug ("Unable to watch changes in %s: %s",
+             grl_source_get_id (source),
+             error->message);
+    g_error_free (error);
+  }
+}
+
 /* Given a null-terminated array of MediaServerSpec2 properties, returns a list
    with the corresponding Grilo metadata keys */
 static GList *
@@ -420,11 +768,16 @@ resolve_cb (GrlSource *source,
   GriloMs2Data *grdata = (GriloMs2Data *) user_data;
 
   if (error) {
+    GRILO_MS2_TRACE3 (operation__error, grdata->request, operation_id,
+                      grl_source_get_id (source));
     grdata->error = g_error_copy (error);
     grdata->updated = TRUE;
     return;
   }
 
+  GRILO_MS2_TRACE4 (operation__result, grdata->request, operation_id,
+                    grl_source_get_id (source), 0);
+
   /* Special case: for root media, if there is no title use the source's name */
   if (grl_media_get_id (media) == NULL &&
       !grl_data_has_key (GRL_DATA (media), GRL_METADATA_KEY_TITLE)) {
@@ -460,11 +813,16 @@ browse_cb (GrlSource *source,
   gboolean add_media = FALSE;
 
   if (error) {
+    GRILO_MS2_TRACE3 (operation__error, grdata->request, browse_id,
+                      grl_source_get_id (source));
     grdata->error = g_error_copy (error);
     grdata->updated = TRUE;
     return;
   }
 
+  GRILO_MS2_TRACE4 (operation__result, grdata->request, browse_id,
+                    grl_source_get_id (source), remaining);
+
   if (media) {
     if ((grdata->list_type == LIST_ITEMS && !grl_media_is_container (media)) ||
         (grdata->list_type == LIST_CONTAINERS && grl_media_is_container (media))) {
@@ -482,8 +840,9 @@ browse_cb (GrlSource *source,
     if (grdata->parent_id) {
       grl_media_set_grilo_ms2_parent (media,
                                       grdata->parent_id);
+      remember_location (grdata->server, media, grdata->parent_id);
     }
-    prop_table = ms2_server_new_properties_hashtable ();
+    prop_table = ms2_server_new_reply_properties_hashtable ();
     fill_properties_table (grdata->server,
                            prop_table,
                            grdata->keys,
@@ -521,50 +880,62 @@ wait_for_result (GriloMs2Data *grdata)
   g_main_loop_unref (mainloop);
 }
 
-static GHashTable *
-get_properties_cb (MS2Server *server,
-                   const gchar *id,
-                   const gchar **properties,
-                   gpointer data,
-                   GError **error)
+/* Starts resolving properties of id; use wait_for_result() and finish_resolve()
+   to get them */
+static GriloMs2Data *
+start_resolve (MS2Server *server,
+               GrlSource *source,
+               const gchar *id,
+               const gchar **properties)
 {
-  GHashTable *properties_table = NULL;
-  GrlMedia *media;
   GriloMs2Data *grdata;
 
   grdata = g_slice_new0 (GriloMs2Data);
   grdata->server = g_object_ref (server);
-  grdata->source = (GrlSource *) data;
+  grdata->request = ms2_server_get_request_serial (server);
+  grdata->source = source;
   grdata->options = grl_operation_options_new (NULL);
   grdata->keys = get_grilo_keys (properties, &grdata->other_keys);
 
   grl_operation_options_set_resolution_flags (grdata->options,
                                               GRL_RESOLVE_FULL |
                                               GRL_RESOLVE_IDLE_RELAY);
-  media = unserialize_media (grdata->source, id);
+  grdata->media = unserialize_media (grdata->source, id);
 
   if (grdata->keys) {
-    grl_source_resolve (grdata->source,
-                        media,
-                        grdata->keys,
-                        grdata->options,
-                        resolve_cb,
-                        grdata);
+    grdata->operation_id = grl_source_resolve (grdata->source,
+                                               grdata->media,
+                                               grdata->keys,
+                                               grdata->options,
+                                               resolve_cb,
+                                               grdata);
+    GRILO_MS2_TRACE5 (operation__start, grdata->request, grdata->operation_id,
+                      grl_source_get_id (grdata->source), "resolve", 1);
   } else {
-    resolve_cb (grdata->source, 0, media, grdata, NULL);
+    resolve_cb (grdata->source, 0, grdata->media, grdata, NULL);
   }
 
-  wait_for_result (grdata);
+  return grdata;
+}
+
+/* Frees a finished resolution, returning the properties obtained */
+static GHashTable *
+finish_resolve (GriloMs2Data *grdata,
+                GError **error)
+{
+  GHashTable *properties_table = NULL;
 
   if (grdata->error) {
     if (error) {
       *error = grdata->error;
+    } else {
+      g_error_free (grdata->error);
     }
   } else {
     properties_table = grdata->properties;
   }
 
-  g_object_unref (media);
+  g_object_unref (grdata->media);
   g_list_free (grdata->keys);
   g_list_free (grdata->other_keys);
   g_free (grdata->parent_id);
@@ -575,6 +946,74 @@ get_properties_cb (MS2Server *server,
   return properties_table;
 }
 
+static GHashTable *
+get_properties_cb (MS2Server *server,
+                   const gchar *id,
+                   const gchar **properties,
+                   gpointer data,
+                   GError **error)
+{
+  GrlSource *source;
+  GriloMs2Data *grdata;
+
+  touch_activity ();
+
+  source = get_source (server, data);
+  if (!source) {
+    if (error) {
+      *error = g_error_new (0, 0, "source is not available");
+    }
+    return NULL;
+  }
+
+  grdata = start_resolve (server, source, id, properties);
+  wait_for_result (grdata);
+
+  return finish_resolve (grdata, error);
+}
+
+static GList *
+get_properties_batch_cb (MS2Server *server,
+                         const gchar **ids,
+                         const gchar **properties,
+                         gpointer data,
+                         GError **error)
+{
+  GQueue *running;
+  GList *result = NULL;
+  GrlSource *source;
+  const gchar **id;
+
+  touch_activity ();
+
+  source = get_source (server, data);
+  if (!source) {
+    if (error) {
+      *error = g_error_new (0, 0, "source is not available");
+    }
+    return NULL;
+  }
+
+  /* Resolutions progress concurrently, though only some of them are running at
+     the same time; a new one is started as soon as the oldest finishes */
+  running = g_queue_new ();
+  id = ids;
+  while (*id || !g_queue_is_empty (running)) {
+    if (*id && g_queue_get_length (running) < GRILO_MS2_BATCH_MAX_RUNNING) {
+      g_queue_push_tail (running,
+                         start_resolve (server, source, *id, properties));
+      id++;
+      continue;
+    }
+    wait_for_result (g_queue_peek_head (running));
+    result = g_list_prepend (result,
+                             finish_resolve (g_queue_pop_head (running), NULL));
+  }
+  g_queue_free (running);
+
+  return g_list_reverse (result);
+}
+
 static GList *
 list_children_cb (MS2Server *server,
                   const gchar *id,
@@ -587,12 +1026,24 @@ list_children_cb (MS2Server *server,
 {
   GList *children;
   GrlMedia *media;
+  GrlSource *source;
   GriloMs2Data *grdata;
   gint count;
 
+  touch_activity ();
+
+  source = get_source (server, data);
+  if (!source) {
+    if (error) {
+      *error = g_error_new (0, 0, "source is not available");
+    }
+    return NULL;
+  }
+
   grdata = g_slice_new0 (GriloMs2Data);
   grdata->server = g_object_ref (server);
-  grdata->source = (GrlSource *) data;
+  grdata->request = ms2_server_get_request_serial (server);
+  grdata->source = source;
   grdata->options = grl_operation_options_new (NULL);
   grdata->keys = get_grilo_keys (properties, &grdata->other_keys);
   grdata->parent_id = g_strdup (id);
@@ -624,6 +1075,9 @@ list_children_cb (MS2Server *server,
                                                 grdata->options,
                                                 browse_cb,
                                                 grdata);
+      GRILO_MS2_TRACE5 (operation__start, grdata->request,
+                        grdata->operation_id,
+                        grl_source_get_id (grdata->source), "browse", count);
       break;
     case LIST_CONTAINERS:
     case LIST_ITEMS:
@@ -636,6 +1090,9 @@ list_children_cb (MS2Server *server,
                                                 grdata->options,
                                                 browse_cb,
                                                 grdata);
+      GRILO_MS2_TRACE5 (operation__start, grdata->request,
+                        grdata->operation_id,
+                        grl_source_get_id (grdata->source), "browse", count);
       break;
     default:
       /* Protection. It should never be reached, unless ListType is extended */
@@ -678,9 +1135,12 @@ search_objects_cb (MS2Server *server,
                    GError **error)
 {
   GList *objects;
+  GrlSource *source;
   GriloMs2Data *grdata;
   gint count;
 
+  touch_activity ();
+
   /* Browse is only allowed in root container */
   if (g_strcmp0 (id, MS2_ROOT) != 0) {
     if (error) {
@@ -690,9 +1150,18 @@ search_objects_cb (MS2Server *server,
     return NULL;
   }
 
+  source = get_source (server, data);
+  if (!source) {
+    if (error) {
+      *error = g_error_new (0, 0, "source is not available");
+    }
+    return NULL;
+  }
+
   grdata = g_slice_new0 (GriloMs2Data);
   grdata->server = g_object_ref (server);
-  grdata->source = (GrlSource *) data;
+  grdata->request = ms2_server_get_request_serial (server);
+  grdata->source = source;
   grdata->options = grl_operation_options_new (NULL);
   grdata->keys = get_grilo_keys (properties, &grdata->other_keys);
   grdata->parent_id = g_strdup (id);
@@ -711,12 +1180,14 @@ search_objects_cb (MS2Server *server,
                                                      limit - offset);
     grl_operation_options_set_count (grdata->options, count);
     grl_operation_options_set_skip (grdata->options, offset);
-    grl_source_search (grdata->source,
-                       query,
-                       grdata->keys,
-                       grdata->options,
-                       browse_cb,
-                       grdata);
+    grdata->operation_id = grl_source_search (grdata->source,
+                                              query,
+                                              grdata->keys,
+                                              grdata->options,
+                                              browse_cb,
+                                              grdata);
+    GRILO_MS2_TRACE5 (operation__start, grdata->request, grdata->operation_id,
+                      grl_source_get_id (grdata->source), "search", count);
   }
 
   wait_for_result (grdata);
@@ -742,6 +1213,692 @@ search_objects_cb (MS2Server *server,
   return objects;
 }
 
+static GriloMs2Cursor *
+ref_cursor (GriloMs2Cursor *cursor)
+{
+  cursor->ref_count++;
+
+  return cursor;
+}
+
+static void
+unref_cursor (GriloMs2Cursor *cursor)
+{
+  cursor->ref_count--;
+  if (cursor->ref_count > 0) {
+    return;
+  }
+
+  g_queue_free_full (cursor->pending, g_object_unref);
+  g_queue_free_full (cursor->given, g_object_unref);
+  g_list_free (cursor->keys);
+  g_free (cursor->id);
+  g_free (cursor->query);
+  g_free (cursor->filter);
+  if (cursor->error) {
+    g_error_free (cursor->error);
+  }
+  g_object_unref (cursor->source);
+  g_object_unref (cursor->server);
+  g_slice_free (GriloMs2Cursor, cursor);
+}
+
+/* Forgets the cursor; if its operation is still running, it is cancelled. The
+   cursor is freed once Grilo and the requests using it are done with it */
+static void
+release_cursor (GriloMs2Cursor *cursor)
+{
+  if (cursor->released) {
+    return;
+  }
+
+  if (cursor->expire_id) {
+    g_source_remove (cursor->expire_id);
+    cursor->expire_id = 0;
+  }
+
+  g_hash_table_remove (cursors, GUINT_TO_POINTER (cursor->serial));
+  cursor->released = TRUE;
+
+  if (cursor->running) {
+    grl_operation_cancel (cursor->operation_id);
+  }
+
+  unref_cursor (cursor);
+}
+
+static gboolean
+cursor_expired_cb (gpointer user_data)
+{
+  GriloMs2Cursor *cursor = (GriloMs2Cursor *) user_data;
+
+  cursor->expire_id = 0;
+  release_cursor (cursor);
+
+  return FALSE;
+}
+
+/* Releases all the cursors of server */
+static void
+release_server_cursors (MS2Server *server)
+{
+  GHashTableIter iter;
+  GList *cursor;
+  GList *server_cursors = NULL;
+  GriloMs2Cursor *c;
+
+  if (!cursors) {
+    return;
+  }
+
+  g_hash_table_iter_init (&iter, cursors);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &c)) {
+    if (c->server == server) {
+      server_cursors = g_list_prepend (server_cursors, c);
+    }
+  }
+
+  for (cursor = server_cursors; cursor; cursor = g_list_next (cursor)) {
+    release_cursor (cursor->data);
+  }
+  g_list_free (server_cursors);
+}
+
+static void
+cursor_browse_cb (GrlSource *source,
+                  guint operation_id,
+                  GrlMedia *media,
+                  guint remaining,
+                  gpointer user_data,
+                  const GError *error)
+{
+  GriloMs2Cursor *cursor = (GriloMs2Cursor *) user_data;
+
+  if (error) {
+    GRILO_MS2_TRACE3 (operation__error, cursor->request, operation_id,
+                      grl_source_get_id (source));
+  } else {
+    GRILO_MS2_TRACE4 (operation__result, cursor->request, operation_id,
+                      grl_source_get_id (source), remaining);
+  }
+
+  if (media) {
+    g_queue_push_tail (cursor->pending, media);
+  }
+
+  if (error && !cursor->cancelled && !cursor->released) {
+    cursor->error = g_error_copy (error);
+  }
+
+  if (remaining && !error) {
+    /* Do not read too far ahead */
+    if (!cursor->cancelled &&
+        g_queue_get_length (cursor->pending) >= GRILO_MS2_CURSOR_MAX_PENDING) {
+      cursor->cancelled = TRUE;
+      grl_operation_cancel (cursor->operation_id);
+    }
+    return;
+  }
+
+  cursor->running = FALSE;
+  if (cursor->cancelled) {
+    cursor->cancelled = FALSE;
+  } else {
+    cursor->finished = TRUE;
+  }
+  unref_cursor (cursor);
+}
+
+/* Starts a Grilo operation getting the medias after the ones already
+   received */
+static void
+start_cursor_operation (GriloMs2Cursor *cursor)
+{
+  GrlMedia *media;
+  GrlOperationOptions *options;
+  guint skip;
+
+  skip = cursor->position + g_queue_get_length (cursor->pending);
+  if (skip >= limit) {
+    cursor->finished = TRUE;
+    return;
+  }
+
+  options = grl_operation_options_new (NULL);
+  grl_operation_options_set_resolution_flags (options,
+                                              GRL_RESOLVE_FULL |
+                                              GRL_RESOLVE_IDLE_RELAY);
+  grl_operation_options_set_skip (options, skip);
+  grl_operation_options_set_count (options, limit - skip);
+
+  cursor->running = TRUE;
+  cursor->request = ms2_server_get_request_serial (cursor->server);
+  ref_cursor (cursor);
+  if (cursor->query) {
+    cursor->operation_id = grl_source_search (cursor->source,
+                                              cursor->query,
+                                              cursor->keys,
+                                              options,
+                                              cursor_browse_cb,
+                                              cursor);
+    GRILO_MS2_TRACE5 (operation__start, cursor->request, cursor->operation_id,
+                      grl_source_get_id (cursor->source), "search",
+                      limit - skip);
+  } else {
+    media = unserialize_media (cursor->source, cursor->id);
+    cursor->operation_id = grl_source_browse (cursor->source,
+                                              media,
+                                              cursor->keys,
+                                              options,
+                                              cursor_browse_cb,
+                                              cursor);
+    GRILO_MS2_TRACE5 (operation__start, cursor->request, cursor->operation_id,
+                      grl_source_get_id (cursor->source), "browse",
+                      limit - skip);
+    g_object_unref (media);
+  }
+
+  g_object_unref (options);
+}
+
+/* Gives again the medias in the last page, as client is asking for them */
+static void
+rewind_cursor (GriloMs2Cursor *cursor)
+{
+  while (!g_queue_is_empty (cursor->given)) {
+    g_queue_push_head (cursor->pending, g_queue_pop_tail (cursor->given));
+  }
+  cursor->position = cursor->given_position;
+}
+
+/* Returns the cursor pointed by token, or a new one starting at the position
+   stored in token if it does not exist anymore. Token can also point to the
+   last page given, when client could not take all of it */
+static GriloMs2Cursor *
+get_cursor (MS2Server *server,
+            GrlSource *source,
+            const gchar *id,
+            const gchar *query,
+            const gchar *token,
+            const gchar **properties)
+{
+  GriloMs2Cursor *cursor;
+  GList *other_keys = NULL;
+  gchar *filter;
+  guint position = 0;
+  guint serial = 0;
+
+  if (token && *token) {
+    sscanf (token, "%u/%u", &serial, &position);
+  }
+
+  filter = g_strjoinv (",", (gchar **) properties);
+
+  cursor = g_hash_table_lookup (cursors, GUINT_TO_POINTER (serial));
+  if (cursor) {
+    if (cursor->server == server &&
+        (cursor->position == position ||
+         (cursor->given_position == position &&
+          !g_queue_is_empty (cursor->given))) &&
+        g_strcmp0 (cursor->id, id) == 0 &&
+        g_strcmp0 (cursor->query, query) == 0 &&
+        g_strcmp0 (cursor->filter, filter) == 0) {
+      g_free (filter);
+      if (cursor->expire_id) {
+        g_source_remove (cursor->expire_id);
+        cursor->expire_id = 0;
+      }
+      if (cursor->position != position) {
+        rewind_cursor (cursor);
+      }
+      return cursor;
+    }
+    release_cursor (cursor);
+  }
+
+  cursor = g_slice_new0 (GriloMs2Cursor);
+  cursor->ref_count = 1;
+  cursor->serial = ++last_cursor;
+  cursor->server = g_object_ref (server);
+  cursor->source = g_object_ref (source);
+  cursor->id = g_strdup (id);
+  cursor->query = g_strdup (query);
+  cursor->filter = filter;
+  cursor->keys = get_grilo_keys (properties, &other_keys);
+  cursor->position = position;
+  cursor->pending = g_queue_new ();
+  cursor->given = g_queue_new ();
+  g_list_free (other_keys);
+
+  g_hash_table_insert (cursors, GUINT_TO_POINTER (cursor->serial), cursor);
+
+  return cursor;
+}
+
+/* Gets next page from cursor, browsing id or searching query */
+static GList *
+get_children_from_cursor (MS2Server *server,
+                          const gchar *id,
+                          const gchar *query,
+                          const gchar *token,
+                          guint max_count,
+                          const gchar **properties,
+                          gchar **next_cursor,
+                          gpointer data,
+                          GError **error)
+{
+  GHashTable *prop_table;
+  GList *children = NULL;
+  GList *keys;
+  GList *other_keys = NULL;
+  GrlMedia *media;
+  GrlSource *source;
+  GriloMs2Cursor *cursor;
+  guint i;
+
+  touch_activity ();
+
+  source = get_source (server, data);
+  if (!source) {
+    if (error) {
+      *error = g_error_new (0, 0, "source is not available");
+    }
+    return NULL;
+  }
+
+  if (max_count == 0) {
+    max_count = G_MAXUINT;
+  }
+
+  /* Main loop is iterated below, where cursor can be released */
+  cursor = ref_cursor (get_cursor (server, source, id, query, token,
+                                   properties));
+
+  /* Wait until there are enough medias; the operation is kept running, so
+     next page is likely ready when requested */
+  if (!cursor->running && !cursor->finished &&
+      g_queue_get_length (cursor->pending) < max_count) {
+    start_cursor_operation (cursor);
+  }
+
+  while (cursor->running &&
+         g_queue_get_length (cursor->pending) < max_count) {
+    g_main_context_iteration (NULL, TRUE);
+  }
+
+  if (cursor->released) {
+    if (error) {
+      *error = g_error_new (0, 0, "cursor is not available anymore");
+    }
+    unref_cursor (cursor);
+    return NULL;
+  }
+
+  if (cursor->error) {
+    if (error) {
+      *error = cursor->error;
+    } else {
+      g_error_free (cursor->error);
+    }
+    cursor->error = NULL;
+    release_cursor (cursor);
+    unref_cursor (cursor);
+    return NULL;
+  }
+
+  /* Keep the page, in case client can not take all of it */
+  g_queue_free_full (cursor->given, g_object_unref);
+  cursor->given = g_queue_new ();
+  cursor->given_position = cursor->position;
+
+  keys = get_grilo_keys (properties, &other_keys);
+  for (i = 0; i < max_count && !g_queue_is_empty (cursor->pending); i++) {
+    media = g_queue_pop_head (cursor->pending);
+    grl_media_set_grilo_ms2_parent (media, id);
+    remember_location (server, media, id);
+    prop_table = ms2_server_new_reply_properties_hashtable ();
+    fill_properties_table (server, prop_table, keys, media);
+    fill_other_properties_table (server,
+                                 source,
+                                 prop_table,
+                                 other_keys,
+                                 media);
+    children = g_list_prepend (children, prop_table);
+    g_queue_push_tail (cursor->given, media);
+    cursor->position++;
+  }
+  g_list_free (keys);
+  g_list_free (other_keys);
+
+  /* Even when there is nothing else, last page could be asked again */
+  if (!cursor->finished || !g_queue_is_empty (cursor->pending)) {
+    *next_cursor = g_strdup_printf ("%u/%u", cursor->serial, cursor->position);
+  }
+  /* A nested request for the same cursor may have set its own timeout while
+     this one was waiting for the source */
+  if (cursor->expire_id) {
+    g_source_remove (cursor->expire_id);
+  }
+  cursor->expire_id = g_timeout_add_seconds (cursor_timeout,
+                                             cursor_expired_cb,
+                                             cursor);
+  unref_cursor (cursor);
+
+  return g_list_reverse (children);
+}
+
+static GList *
+list_children_from_cb (MS2Server *server,
+                       const gchar *id,
+                       const gchar *cursor,
+                       guint max_count,
+                       const gchar **properties,
+                       gchar **next_cursor,
+                       gpointer data,
+                       GError **error)
+{
+  return get_children_from_cursor (server,
+                                   id,
+                                   NULL,
+                                   cursor,
+                                   max_count,
+                                   properties,
+                                   next_cursor,
+                                   data,
+                                   error);
+}
+
+static GList *
+search_objects_from_cb (MS2Server *server,
+                        const gchar *id,
+                        const gchar *query,
+                        const gchar *cursor,
+                        guint max_count,
+                        const gchar **properties,
+                        gchar **next_cursor,
+                        gpointer data,
+                        GError **error)
+{
+  touch_activity ();
+
+  /* Search is only allowed in root container */
+  if (g_strcmp0 (id, MS2_ROOT) != 0) {
+    if (error) {
+      *error = g_error_new (0, 0, "search is only allowed in root container");
+    }
+    return NULL;
+  }
+
+  return get_children_from_cursor (server,
+                                   id,
+                                   query,
+                                   cursor,
+                                   max_count,
+                                   properties,
+                                   next_cursor,
+                                   data,
+                                   error);
+}
+
+/* Returns the path of the file caching the sources being served */
+static gchar *
+get_manifest_file ()
+{
+  return g_build_filename (g_get_user_cache_dir (),
+                           "grilo-mediaserver2",
+                           GRILO_MS2_MANIFEST_FILE,
+                           NULL);
+}
+
+/* Returns the path of the file storing the object identifiers of a server */
+static gchar *
+get_ids_file (const gchar *name)
+{
+  return g_build_filename (g_get_user_cache_dir (),
+                           "grilo-mediaserver2",
+                           "ids",
+                           name,
+                           NULL);
+}
+
+/* Restores identifiers stored by a previous run, so object paths handed to
+   clients remain valid */
+static void
+load_ids (MS2Server *server)
+{
+  GError *error = NULL;
+  gchar *ids_file;
+
+  ids_file = get_ids_file (ms2_server_get_name (server));
+  if (!ms2_server_load_ids (server, ids_file, &error)) {
+    if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+      g_warning ("Unable to load identifiers from %s: %s",
+                 ids_file,
+                 error->message);
+    }
+    g_error_free (error);
+  }
+  g_free (ids_file);
+}
+
+/* Stores the sources currently served, so next run can register them without
+   activating their plugins */
+static gboolean
+save_manifest (gpointer user_data)
+{
+  GError *error = NULL;
+  GKeyFile *manifest;
+  GList *source;
+  GList *sources;
+  GrlPlugin *plugin;
+  gchar *data;
+  gchar *manifest_dir;
+  gchar *manifest_file;
+  gchar *sanitized_source_id;
+  gsize length;
+
+  save_manifest_id = 0;
+
+  manifest = g_key_file_new ();
+  sources = grl_registry_get_sources (registry, FALSE);
+  for (source = sources; source; source = g_list_next (source)) {
+    sanitized_source_id = g_strdup (grl_source_get_id (source->data));
+    sanitize (sanitized_source_id);
+    plugin = grl_source_get_plugin (source->data);
+    if (plugin && g_hash_table_lookup (servers, sanitized_source_id)) {
+      g_key_file_set_string (manifest,
+                             sanitized_source_id,
+                             "SourceId",
+                             grl_source_get_id (source->data));
+      g_key_file_set_string (manifest,
+                             sanitized_source_id,
+                             "SourceName",
+                             grl_source_get_name (source->data));
+      g_key_file_set_string (manifest,
+                             sanitized_source_id,
+                             "PluginId",
+                             grl_plugin_get_id (plugin));
+      g_key_file_set_boolean (manifest,
+                              sanitized_source_id,
+                              "Search",
+                              (grl_source_supported_operations (source->data) & GRL_OP_SEARCH) != 0);
+    }
+    g_free (sanitized_source_id);
+  }
+  g_list_free (sources);
+
+  manifest_file = get_manifest_file ();
+  manifest_dir = g_path_get_dirname (manifest_file);
+  data = g_key_file_to_data (manifest, &length, NULL);
+
+  if (g_mkdir_with_parents (manifest_dir, 0755) != 0 ||
+      !g_file_set_contents (manifest_file, data, length, &error)) {
+    g_warning ("Unable to save sources manifest %s: %s",
+               manifest_file,
+               error? error->message: g_strerror (errno));
+    g_clear_error (&error);
+  }
+
+  g_free (data);
+  g_free (manifest_dir);
+  g_free (manifest_file);
+  g_key_file_free (manifest);
+
+  return FALSE;
+}
+
+/* Sources come up in bursts while plugins are loaded, so the manifest is
+   written once things settle down */
+static void
+schedule_save_manifest ()
+{
+  if (lazy || save_manifest_id) {
+    return;
+  }
+
+  save_manifest_id = g_idle_add_full (G_PRIORITY_LOW,
+                                      save_manifest,
+                                      NULL,
+                                      NULL);
+}
+
+/* Invoked when the dbus name of a server has been requested */
+/* user_data is the name of the source, as stored in providers_names, or NULL
+   if it is not there */
+static void
+server_registered_cb (MS2Server *server,
+                      gboolean success,
+                      gpointer user_data)
+{
+  GList *entry;
+  gchar *name;
+
+  if (success) {
+    g_debug ("Registered %s in %" G_GINT64_FORMAT " us",
+             ms2_server_get_name (server),
+             ms2_server_get_registration_time (server));
+    return;
+  }
+
+  g_warning ("Cannot register %s", ms2_server_get_name (server));
+
+  /* Let another source with the same name take its place; do it before
+     dropping the server, as that frees user_data */
+  if (user_data) {
+    entry = g_list_find_custom (providers_names,
+                                user_data,
+                                (GCompareFunc) g_strcmp0);
+    if (entry) {
+      g_free (entry->data);
+      providers_names = g_list_delete_link (providers_names, entry);
+    }
+  }
+
+  name = g_strdup (ms2_server_get_name (server));
+  if (lazy_sources) {
+    g_hash_table_remove (lazy_sources, name);
+  }
+  g_hash_table_remove (servers, name);
+  g_free (name);
+}
+
+/* Registers a server for each source in the manifest, deferring the plugin
+   activation until the source is actually used. Returns FALSE if there is no
+   manifest to load */
+static gboolean
+register_lazy_sources ()
+{
+  GError *error = NULL;
+  GKeyFile *manifest;
+  GriloMs2LazySource *lazy_source;
+  MS2Server *server;
+  gchar **group;
+  gchar **groups;
+  gchar *manifest_file;
+  gchar *plugin_id;
+  gchar *source_id;
+  gchar *source_name;
+
+  manifest = g_key_file_new ();
+  manifest_file = get_manifest_file ();
+  if (!g_key_file_load_from_file (manifest, manifest_file, G_KEY_FILE_NONE, &error)) {
+    g_debug ("Unable to load sources manifest %s: %s",
+             manifest_file,
+             error->message);
+    g_error_free (error);
+    g_free (manifest_file);
+    g_key_file_free (manifest);
+    return FALSE;
+  }
+  g_free (manifest_file);
+
+  lazy_sources = g_hash_table_new_full (g_str_hash,
+                                        g_str_equal,
+                                        g_free,
+                                        (GDestroyNotify) free_lazy_source);
+
+  groups = g_key_file_get_groups (manifest, NULL);
+  for (group = groups; *group; group++) {
+    source_id = g_key_file_get_string (manifest, *group, "SourceId", NULL);
+    source_name = g_key_file_get_string (manifest, *group, "SourceName", NULL);
+    plugin_id = g_key_file_get_string (manifest, *group, "PluginId", NULL);
+
+    if (!source_id || !plugin_id) {
+      g_warning ("Skipping malformed %s entry in sources manifest", *group);
+      g_free (source_id);
+      g_free (source_name);
+      g_free (plugin_id);
+      continue;
+    }
+
+    g_debug ("Registering %s [%s] source lazily", *group, source_name);
+
+    server = ms2_server_new_async (*group, NULL);
+    if (!server) {
+      g_warning ("Cannot register %s", *group);
+      g_free (source_id);
+      g_free (source_name);
+      g_free (plugin_id);
+      continue;
+    }
+
+    load_ids (server);
+
+    g_signal_connect_data (server, "registered",
+                           G_CALLBACK (server_registered_cb),
+                           !dups? g_strdup (source_name): NULL,
+                           (GClosureNotify) g_free, 0);
+    ms2_server_set_get_properties_func (server, get_properties_cb);
+    ms2_server_set_get_properties_batch_func (server, get_properties_batch_cb);
+    ms2_server_set_list_children_func (server, list_children_cb);
+    ms2_server_set_list_children_from_func (server, list_children_from_cb);
+    ms2_server_set_updated_window (server,
+                                   GRILO_MS2_UPDATE_INTERVAL,
+                                   GRILO_MS2_MAX_UPDATES);
+    if (g_key_file_get_boolean (manifest, *group, "Search", NULL)) {
+      ms2_server_set_search_objects_func (server, search_objects_cb);
+      ms2_server_set_search_objects_from_func (server, search_objects_from_cb);
+    }
+
+    if (!dups && source_name) {
+      providers_names = g_list_prepend (providers_names, source_name);
+    } else {
+      g_free (source_name);
+    }
+
+    lazy_source = g_slice_new0 (GriloMs2LazySource);
+    lazy_source->source_id = source_id;
+    lazy_source->plugin_id = plugin_id;
+    g_hash_table_insert (lazy_sources, g_strdup (*group), lazy_source);
+    g_hash_table_insert (servers, g_strdup (*group), server);
+  }
+
+  g_strfreev (groups);
+  g_key_file_free (manifest);
+
+  return TRUE;
+}
+
 /* Callback invoked whenever a new source comes up */
 static void
 source_added_cb (GrlRegistry *registry,
@@ -749,8 +1906,9 @@ source_added_cb (GrlRegistry *registry,
                  gpointer user_data)
 {
   GrlSupportedOps supported_ops;
+  GriloMs2LazySource *lazy_source;
   MS2Server *server;
-  const gchar *source_name;
+  const gchar *source_name = NULL;
   gchar *sanitized_source_id;
   gchar *source_id;
 
@@ -763,6 +1921,20 @@ source_added_cb (GrlRegistry *registry,
     source_id =
       (gchar *) grl_source_get_id (source);
 
+    /* Sources registered from the manifest just need to be bound */
+    if (lazy_sources) {
+      sanitized_source_id = g_strdup (source_id);
+      sanitize (sanitized_source_id);
+      lazy_source = g_hash_table_lookup (lazy_sources, sanitized_source_id);
+      g_free (sanitized_source_id);
+      if (lazy_source) {
+        g_debug ("Binding %s source", source_id);
+        lazy_source->source = source;
+        watch_source_changes (source);
+        return;
+      }
+    }
+
     /* Check if there is already another provider with the same name */
     if (!dups) {
       source_name =
@@ -782,17 +1954,32 @@ source_added_cb (GrlRegistry *registry,
 
     sanitize (sanitized_source_id);
 
-    server = ms2_server_new (sanitized_source_id, source);
+    /* Name is requested asynchronously, so sources showing up together are
+       registered in parallel */
+    server = ms2_server_new_async (sanitized_source_id, source);
 
     if (!server) {
       g_warning ("Cannot register %s", sanitized_source_id);
       g_free (sanitized_source_id);
     } else {
+      g_signal_connect_data (server, "registered",
+                             G_CALLBACK (server_registered_cb),
+                             !dups? g_strdup (source_name): NULL,
+                             (GClosureNotify) g_free, 0);
+      load_ids (server);
       ms2_server_set_get_properties_func (server, get_properties_cb);
+      ms2_server_set_get_properties_batch_func (server,
+                                                get_properties_batch_cb);
       ms2_server_set_list_children_func (server, list_children_cb);
+      ms2_server_set_list_children_from_func (server, list_children_from_cb);
+      ms2_server_set_updated_window (server,
+                                     GRILO_MS2_UPDATE_INTERVAL,
+                                     GRILO_MS2_MAX_UPDATES);
       /* Add search  */
       if (supported_ops & GRL_OP_SEARCH) {
         ms2_server_set_search_objects_func (server, search_objects_cb);
+        ms2_server_set_search_objects_from_func (server,
+                                                 search_objects_from_cb);
       }
       /* Save reference */
       if (!dups) {
@@ -800,6 +1987,8 @@ source_added_cb (GrlRegistry *registry,
                                           g_strdup(source_name));
       }
       g_hash_table_insert (servers, sanitized_source_id, server);
+      watch_source_changes (source);
+      schedule_save_manifest ();
     }
   } else {
     g_debug ("%s source does not support either browse or resolve",
@@ -814,9 +2003,13 @@ source_removed_cb (GrlRegistry *registry,
                    gpointer user_data)
 {
   GList *entry;
+  GrlSupportedOps supported_ops;
+  MS2Server *server;
   const gchar *source_name;
   gchar *source_id;
 
+  supported_ops =
+    grl_source_supported_operations (source);
   source_name =
     grl_source_get_name (source);
   source_id =
@@ -832,11 +2025,215 @@ source_removed_cb (GrlRegistry *registry,
     }
   }
 
+  if (supported_ops & GRL_OP_NOTIFY_CHANGE) {
+    grl_source_notify_change_stop (source, NULL);
+    g_signal_handlers_disconnect_by_func (source, content_changed_cb, NULL);
+  }
+
   sanitize (source_id);
-  g_hash_table_remove (servers, source_id);
+  server = g_hash_table_lookup (servers, source_id);
+  if (server) {
+    release_server_cursors (server);
+  }
+  if (lazy_sources) {
+    g_hash_table_remove (lazy_sources, source_id);
+  }
+  g_hash_table_remove (locations, source_id);
+  if (g_hash_table_remove (servers, source_id)) {
+    schedule_save_manifest ();
+  }
   g_free (source_id);
 }
 
+/* Removes service files written by a previous run for sources that are no
+   longer served; files not launching this daemon are left alone */
+static void
+remove_stale_service_files (const gchar *services_dir)
+{
+  GDir *dir;
+  const gchar *filename;
+  gchar *contents;
+  gchar *name;
+  gchar *owned;
+  gchar *quoted;
+  gchar *service_file;
+
+  dir = g_dir_open (services_dir, 0, NULL);
+  if (!dir) {
+    return;
+  }
+
+  /* Options may differ among runs */
+  quoted = g_shell_quote (exec_path);
+  owned = g_strdup_printf ("\nExec=%s --lazy ", quoted);
+  g_free (quoted);
+  while ((filename = g_dir_read_name (dir)) != NULL) {
+    if (!g_str_has_prefix (filename, "org.gnome.UPnP.MediaServer2.") ||
+        !g_str_has_suffix (filename, ".service")) {
+      continue;
+    }
+
+    name = g_strndup (filename + strlen ("org.gnome.UPnP.MediaServer2."),
+                      strlen (filename) -
+                      strlen ("org.gnome.UPnP.MediaServer2.") -
+                      strlen (".service"));
+    if (!g_hash_table_lookup_extended (servers, name, NULL, NULL)) {
+      service_file = g_build_filename (services_dir, filename, NULL);
+      if (g_file_get_contents (service_file, &contents, NULL, NULL)) {
+        if (strstr (contents, owned) && g_unlink (service_file) != 0) {
+          g_warning ("Unable to remove %s: %s",
+                     service_file,
+                     g_strerror (errno));
+        }
+        g_free (contents);
+      }
+      g_free (service_file);
+    }
+    g_free (name);
+  }
+
+  g_free (owned);
+  g_dir_close (dir);
+}
+
+/* Writes the files needed to get the daemon activated by DBus when any of the
+   current sources is requested again */
+static void
+write_service_files ()
+{
+  GError *error = NULL;
+  GHashTableIter iter;
+  GString *exec;
+  gchar *contents;
+  gchar *name;
+  gchar *quoted;
+  gchar *service_file;
+  gchar *services_dir;
+
+  if (!exec_path) {
+    return;
+  }
+
+  services_dir = g_build_filename (g_get_user_data_dir (),
+                                   "dbus-1",
+                                   "services",
+                                   NULL);
+  if (g_mkdir_with_parents (services_dir, 0755) != 0) {
+    g_warning ("Unable to create %s: %s", services_dir, g_strerror (errno));
+    g_free (services_dir);
+    return;
+  }
+
+  /* Restart in the same configuration, but with lazy activation */
+  quoted = g_shell_quote (exec_path);
+  exec = g_string_new (quoted);
+  g_free (quoted);
+  g_string_append_printf (exec,
+                          " --lazy --idle-timeout=%d --cursor-timeout=%d",
+                          idle_timeout,
+                          cursor_timeout);
+  if (dups) {
+    g_string_append (exec, " --allow-duplicates");
+  }
+  if (limit != G_MAXINT) {
+    g_string_append_printf (exec, " --limit=%d", limit);
+  }
+  if (conffile) {
+    quoted = g_shell_quote (conffile);
+    g_string_append_printf (exec, " --config-file=%s", quoted);
+    g_free (quoted);
+  }
+
+  g_hash_table_iter_init (&iter, servers);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &name, NULL)) {
+    contents = g_strdup_printf ("[D-BUS Service]\n"
+                                "Name=org.gnome.UPnP.MediaServer2.%s\n"
+                                "Exec=%s\n",
+                                name,
+                                exec->str);
+    service_file = g_strdup_printf ("%s/org.gnome.UPnP.MediaServer2.%s.service",
+                                    services_dir,
+                                    name);
+    if (!g_file_set_contents (service_file, contents, -1, &error)) {
+      g_warning ("Unable to write %s: %s", service_file, error->message);
+      g_clear_error (&error);
+    }
+    g_free (service_file);
+    g_free (contents);
+  }
+
+  remove_stale_service_files (services_dir);
+
+  g_string_free (exec, TRUE);
+  g_free (services_dir);
+}
+
+/* Stores what is needed to quickly restart serving the same sources */
+static void
+save_state ()
+{
+  GError *error = NULL;
+  GHashTableIter iter;
+  MS2Server *server;
+  gchar *ids_dir;
+  gchar *ids_file;
+  gchar *name;
+
+  if (save_manifest_id) {
+    g_source_remove (save_manifest_id);
+    save_manifest (NULL);
+  }
+
+  ids_dir = g_build_filename (g_get_user_cache_dir (),
+                              "grilo-mediaserver2",
+                              "ids",
+                              NULL);
+  if (g_mkdir_with_parents (ids_dir, 0755) != 0) {
+    g_warning ("Unable to create %s: %s", ids_dir, g_strerror (errno));
+  } else {
+    g_hash_table_iter_init (&iter, servers);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &name, (gpointer *) &server)) {
+      ids_file = get_ids_file (name);
+      if (!ms2_server_save_ids (server, ids_file, &error)) {
+        g_warning ("Unable to save identifiers to %s: %s",
+                   ids_file,
+                   error->message);
+        g_clear_error (&error);
+      }
+      g_free (ids_file);
+    }
+  }
+  g_free (ids_dir);
+
+  if (idle_timeout > 0) {
+    write_service_files ();
+  }
+}
+
+/* Checks periodically if daemon has been idle long enough to exit */
+static gboolean
+check_idle (gpointer user_data)
+{
+  if (g_get_monotonic_time () - last_activity <
+      (gint64) idle_timeout * 60 * G_USEC_PER_SEC) {
+    return TRUE;
+  }
+
+  g_debug ("Exiting after %d minutes without requests", idle_timeout);
+  g_main_loop_quit (main_loop);
+
+  return FALSE;
+}
+
+/* Invoked when daemon is asked to terminate */
+static gboolean
+quit_cb (gpointer user_data)
+{
+  g_main_loop_quit (main_loop);
+
+  return FALSE;
+}
+
 /* Load plugins configuration */
 static void
 load_config ()
@@ -894,6 +2291,9 @@ main (gint argc, gchar **argv)
   if (limit == 0) {
     limit = G_MAXINT;
   }
+  if (cursor_timeout <= 0) {
+    cursor_timeout = GRILO_MS2_CURSOR_TIMEOUT;
+  }
 
   /* Initialize grilo */
   grl_init (&argc, &argv);
@@ -928,19 +2328,68 @@ main (gint argc, gchar **argv)
                                    g_free,
                                    g_object_unref);
 
+  /* Initialize state to propagate changes */
+  locations = g_hash_table_new_full (g_str_hash,
+                                     g_str_equal,
+                                     g_free,
+                                     (GDestroyNotify) g_hash_table_unref);
+
+  /* Initialize <serial, cursor> pairs */
+  cursors = g_hash_table_new (g_direct_hash, g_direct_equal);
+
   g_signal_connect (registry, "source-added",
                     G_CALLBACK (source_added_cb), NULL);
 
   g_signal_connect (registry, "source-removed",
                     G_CALLBACK (source_removed_cb), NULL);
 
+  /* In lazy mode sources are registered from the manifest written by a
+     previous run, and plugins are only activated when first used */
+  if (lazy && args && args[0]) {
+    g_warning ("Ignoring lazy mode, as plugins are explicitly given");
+    lazy = FALSE;
+  }
+
+  if (lazy && !register_lazy_sources ()) {
+    g_debug ("No sources manifest available; loading plugins eagerly");
+    lazy = FALSE;
+  }
+
   if (!args || !args[0]) {
-    grl_registry_load_all_plugins (registry, TRUE, NULL);
+    grl_registry_load_all_plugins (registry, !lazy, NULL);
   } else {
     for (i = 0; args[i]; i++) {
       grl_registry_load_plugin (registry, args[i], NULL);
     }
   }
 
-  g_main_loop_run (g_main_loop_new (NULL, FALSE));
+  /* Keep the command to restart the daemon through DBus activation */
+  exec_path = g_file_read_link ("/proc/self/exe", NULL);
+  if (!exec_path) {
+    exec_path = g_find_program_in_path (argv[0]);
+  }
+
+  main_loop = g_main_loop_new (NULL, FALSE);
+
+  if (idle_timeout > 0) {
+    touch_activity ();
+    g_timeout_add_seconds (60, check_idle, NULL);
+  }
+
+  g_unix_signal_add (SIGTERM, quit_cb, NULL);
+  g_unix_signal_add (SIGINT, quit_cb, NULL);
+
+  g_main_loop_run (main_loop);
+
+  /* Leave everything ready for next start */
+  save_state ();
+
+  g_hash_table_destroy (servers);
+  if (lazy_sources) {
+    g_hash_table_destroy (lazy_sources);
+  }
+  g_main_loop_unref (main_loop);
+  g_free (exec_path);
+
+  return 0;
 }
@@ -1,8 +1,30 @@
 #include <media-server2-client.h>
 #include <media-server2-observer.h>
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib-lowlevel.h>
 #include <glib.h>
 #include <string.h>
 
+/* Provider implementing only the standard MediaServer2 interfaces, served by
+   this same process on its own connection. Root has LEGACY_CONTAINERS
+   containers, with LEGACY_ITEMS items each; listings of LEGACY_SLOW are never
+   replied */
+#define LEGACY_NAME       "test_legacy"
+#define LEGACY_SERVICE    "org.gnome.UPnP.MediaServer2." LEGACY_NAME
+#define LEGACY_ROOT       "/org/gnome/UPnP/MediaServer2/" LEGACY_NAME
+#define LEGACY_SLOW       LEGACY_ROOT "/slow"
+#define LEGACY_CONTAINERS 3
+#define LEGACY_ITEMS      100
+
+/* Provider exported by grilo-ms2 from the synthetic source of bench/, which
+   must be started with --cursor-timeout=SYNTHETIC_CURSOR_TIMEOUT */
+#define SYNTHETIC_NAME           "grl_synthetic"
+#define SYNTHETIC_CURSOR_TIMEOUT 1
+#define SYNTHETIC_PAGE           5
+
+/* Milliseconds to wait for replies that never arrive */
+#define TEST_TIMEOUT 200
+
 static gchar *properties[] = { MS2_PROP_PATH,
                                MS2_PROP_DISPLAY_NAME,
                                MS2_PROP_PARENT,
@@ -420,6 +442,724 @@ test_dynamic_providers ()
   g_strfreev (providers);
 }
 
+static DBusConnection *legacy_connection = NULL;
+static GList *legacy_held = NULL;
+static guint legacy_version = 0;
+static guint legacy_requests = 0;
+static guint failures = 0;
+
+/* Reports the result of a check */
+static void
+check (gboolean success,
+       const gchar *what)
+{
+  g_print ("%s: %s\n", success? "PASS": "FAIL", what);
+  if (!success) {
+    failures++;
+  }
+}
+
+/* Dispatches events until done is set */
+static void
+run_until (gboolean *done)
+{
+  while (!*done) {
+    g_main_context_iteration (NULL, TRUE);
+  }
+}
+
+/* Appends a property to a dictionary */
+static void
+legacy_append_property (DBusMessageIter *dict,
+                        const gchar *key,
+                        gint type,
+                        gconstpointer value)
+{
+  DBusMessageIter entry;
+  DBusMessageIter variant;
+  gchar signature[2] = { type, '\0' };
+
+  dbus_message_iter_open_container (dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+  dbus_message_iter_append_basic (&entry, DBUS_TYPE_STRING, &key);
+  dbus_message_iter_open_container (&entry,
+                                    DBUS_TYPE_VARIANT,
+                                    signature,
+                                    &variant);
+  dbus_message_iter_append_basic (&variant, type, value);
+  dbus_message_iter_close_container (&entry, &variant);
+  dbus_message_iter_close_container (dict, &entry);
+}
+
+/* Appends the properties of object_path as a dictionary */
+static void
+legacy_append_object (DBusMessageIter *iter,
+                      const gchar *object_path)
+{
+  DBusMessageIter dict;
+  const gchar *type;
+  gchar *basename;
+  gchar *name;
+  gchar *parent;
+
+  basename = g_path_get_basename (object_path);
+  name = g_strdup_printf ("%s version %u", basename, legacy_version);
+  parent = g_path_get_dirname (object_path);
+  type = g_str_has_prefix (basename, "i")? "item": "container";
+
+  dbus_message_iter_open_container (iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+  legacy_append_property (&dict, MS2_PROP_PATH, DBUS_TYPE_OBJECT_PATH,
+                          &object_path);
+  legacy_append_property (&dict, MS2_PROP_PARENT, DBUS_TYPE_OBJECT_PATH,
+                          &parent);
+  legacy_append_property (&dict, MS2_PROP_DISPLAY_NAME, DBUS_TYPE_STRING,
+                          &name);
+  legacy_append_property (&dict, MS2_PROP_TYPE, DBUS_TYPE_STRING, &type);
+  dbus_message_iter_close_container (iter, &dict);
+
+  g_free (basename);
+  g_free (name);
+  g_free (parent);
+}
+
+/* Replies a ListChildren, ListContainers or ListItems request */
+static void
+legacy_reply_list (DBusConnection *c,
+                   DBusMessage *m)
+{
+  DBusMessage *r;
+  DBusMessageIter array;
+  DBusMessageIter iter;
+  const gchar *member;
+  const gchar *path;
+  gboolean containers;
+  gboolean items;
+  gchar **filter = NULL;
+  gchar *child;
+  gint n_filter;
+  guint i;
+  guint max_count = 0;
+  guint n;
+  guint offset = 0;
+
+  dbus_message_get_args (m, NULL,
+                         DBUS_TYPE_UINT32, &offset,
+                         DBUS_TYPE_UINT32, &max_count,
+                         DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &filter, &n_filter,
+                         DBUS_TYPE_INVALID);
+
+  path = dbus_message_get_path (m);
+  member = dbus_message_get_member (m);
+  containers = g_strcmp0 (path, LEGACY_ROOT) == 0;
+  items = !containers;
+  if (g_strcmp0 (member, "ListContainers") == 0) {
+    items = FALSE;
+  } else if (g_strcmp0 (member, "ListItems") == 0) {
+    containers = FALSE;
+  }
+
+  n = containers? LEGACY_CONTAINERS: (items? LEGACY_ITEMS: 0);
+  if (max_count == 0 || max_count > n) {
+    max_count = n;
+  }
+
+  r = dbus_message_new_method_return (m);
+  dbus_message_iter_init_append (r, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "a{sv}", &array);
+  for (i = offset; i < n && i - offset < max_count; i++) {
+    child = g_strdup_printf ("%s/%c%u", path, containers? 'c': 'i', i);
+    legacy_append_object (&array, child);
+    g_free (child);
+  }
+  dbus_message_iter_close_container (&iter, &array);
+
+  dbus_connection_send (c, r, NULL);
+  dbus_message_unref (r);
+  dbus_free_string_array (filter);
+}
+
+/* Replies a GetAll request; all properties are given, whatever the
+   interface */
+static void
+legacy_reply_properties (DBusConnection *c,
+                         DBusMessage *m)
+{
+  DBusMessage *r;
+  DBusMessageIter iter;
+
+  legacy_requests++;
+  r = dbus_message_new_method_return (m);
+  dbus_message_iter_init_append (r, &iter);
+  legacy_append_object (&iter, dbus_message_get_path (m));
+  dbus_connection_send (c, r, NULL);
+  dbus_message_unref (r);
+}
+
+/* Handles requests to the legacy provider; anything not handled gets an
+   UnknownMethod error, like the paged interface */
+static DBusHandlerResult
+legacy_handler (DBusConnection *c,
+                DBusMessage *m,
+                void *user_data)
+{
+  const gchar *member;
+
+  if (dbus_message_is_method_call (m,
+                                   "org.freedesktop.DBus.Properties",
+                                   "GetAll")) {
+    legacy_reply_properties (c, m);
+    return DBUS_HANDLER_RESULT_HANDLED;
+  }
+
+  if (!dbus_message_has_interface (m, "org.gnome.UPnP.MediaContainer2")) {
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+
+  member = dbus_message_get_member (m);
+  if (g_strcmp0 (member, "ListChildren") != 0 &&
+      g_strcmp0 (member, "ListContainers") != 0 &&
+      g_strcmp0 (member, "ListItems") != 0) {
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+
+  if (dbus_message_has_path (m, LEGACY_SLOW)) {
+    legacy_held = g_list_prepend (legacy_held, dbus_message_ref (m));
+  } else {
+    legacy_reply_list (c, m);
+  }
+
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+/* Starts serving the legacy provider, if it is not already served */
+static gboolean
+legacy_start ()
+{
+  DBusError error;
+  static const DBusObjectPathVTable vtable = {
+    .message_function = legacy_handler
+  };
+
+  if (legacy_connection) {
+    return TRUE;
+  }
+
+  dbus_error_init (&error);
+  legacy_connection = dbus_bus_get_private (DBUS_BUS_SESSION, &error);
+  if (!legacy_connection) {
+    g_printerr ("Unable to connect the legacy provider, %s\n", error.message);
+    dbus_error_free (&error);
+    return FALSE;
+  }
+
+  dbus_connection_set_exit_on_disconnect (legacy_connection, FALSE);
+  dbus_connection_setup_with_g_main (legacy_connection, NULL);
+  if (dbus_bus_request_name (legacy_connection,
+                             LEGACY_SERVICE,
+                             DBUS_NAME_FLAG_DO_NOT_QUEUE,
+                             &error) != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+    g_printerr ("Unable to own %s\n", LEGACY_SERVICE);
+    dbus_error_free (&error);
+    return FALSE;
+  }
+  dbus_connection_register_fallback (legacy_connection,
+                                     LEGACY_ROOT,
+                                     &vtable,
+                                     NULL);
+
+  return TRUE;
+}
+
+typedef struct {
+  MS2ChildIterator *iter;
+  GError *error;
+  guint count;
+  gboolean done;
+} IteratorTest;
+
+static void
+iterator_test_reply (GObject *source,
+                     GAsyncResult *res,
+                     gpointer user_data)
+{
+  GHashTable *child;
+  IteratorTest *test = (IteratorTest *) user_data;
+
+  child = ms2_child_iterator_next_finish (test->iter, res, &test->error);
+  if (!child) {
+    test->done = TRUE;
+    return;
+  }
+
+  test->count++;
+  g_hash_table_unref (child);
+  ms2_child_iterator_next_async (test->iter, iterator_test_reply, test);
+}
+
+/* Iterates over the children of a provider implementing only the standard
+   interface, which must be used after the paged one is found unsupported */
+static void
+test_iterator_fallback ()
+{
+  IteratorTest test = { 0 };
+  MS2Client *client;
+
+  if (!legacy_start ()) {
+    return;
+  }
+
+  client = ms2_client_new (LEGACY_NAME);
+  test.iter = ms2_child_iterator_new (client,
+                                      LEGACY_ROOT "/c0",
+                                      (gchar **) properties,
+                                      3);
+  ms2_child_iterator_next_async (test.iter, iterator_test_reply, &test);
+  run_until (&test.done);
+
+  check (!test.error, "iterator falls back without error");
+  check (test.count == LEGACY_ITEMS, "iterator falls back to all children");
+
+  g_clear_error (&test.error);
+  ms2_child_iterator_free (test.iter);
+  g_object_unref (client);
+}
+
+typedef struct {
+  GError *error;
+  guint count;
+  gboolean done;
+} WalkTest;
+
+static gboolean
+walk_test_object (MS2Client *client,
+                  GHashTable *properties,
+                  guint depth,
+                  gpointer user_data)
+{
+  WalkTest *test = (WalkTest *) user_data;
+
+  test->count++;
+
+  return TRUE;
+}
+
+static void
+walk_test_reply (GObject *source,
+                 GAsyncResult *res,
+                 gpointer user_data)
+{
+  WalkTest *test = (WalkTest *) user_data;
+
+  ms2_client_walk_finish (MS2_CLIENT (source), res, &test->error);
+  test->done = TRUE;
+}
+
+/* Walks the whole tree of a provider implementing only the standard
+   interface, with several requests in flight when it is found unsupported */
+static void
+test_walk_fallback ()
+{
+  WalkTest test = { 0 };
+  MS2Client *client;
+
+  if (!legacy_start ()) {
+    return;
+  }
+
+  client = ms2_client_new (LEGACY_NAME);
+  ms2_client_walk_async (client,
+                         LEGACY_ROOT,
+                         (gchar **) properties,
+                         0,
+                         4,
+                         walk_test_object,
+                         walk_test_reply,
+                         &test);
+  run_until (&test.done);
+
+  check (!test.error, "walk falls back without error");
+  check (test.count == LEGACY_CONTAINERS * (LEGACY_ITEMS + 1),
+         "walk falls back to all objects");
+
+  g_clear_error (&test.error);
+  g_object_unref (client);
+}
+
+typedef struct {
+  GHashTable *result;
+  GError *error;
+  gboolean done;
+} PropertiesTest;
+
+static void
+properties_test_reply (GObject *source,
+                       GAsyncResult *res,
+                       gpointer user_data)
+{
+  PropertiesTest *test = (PropertiesTest *) user_data;
+
+  test->result = ms2_client_get_properties_finish (MS2_CLIENT (source),
+                                                   res,
+                                                   &test->error);
+  test->done = TRUE;
+}
+
+/* Gets the display name of object_path; returns NULL on error */
+static gchar *
+properties_test_get_name (MS2Client *client,
+                          const gchar *object_path)
+{
+  PropertiesTest test = { 0 };
+  gchar *name = NULL;
+  static gchar *names[] = { MS2_PROP_DISPLAY_NAME, MS2_PROP_PARENT, NULL };
+
+  ms2_client_get_properties_async (client,
+                                   object_path,
+                                   names,
+                                   properties_test_reply,
+                                   &test);
+  run_until (&test.done);
+
+  if (test.result) {
+    name = g_strdup (ms2_client_get_display_name (test.result));
+    g_hash_table_unref (test.result);
+  }
+  g_clear_error (&test.error);
+
+  return name;
+}
+
+static void
+cache_test_updated (MS2Client *client,
+                    const gchar *object_path,
+                    gpointer user_data)
+{
+  *(gboolean *) user_data = TRUE;
+}
+
+/* Checks cached properties of children are dropped when provider notifies
+   their container has been updated */
+static void
+test_cache_invalidation ()
+{
+  DBusMessage *signal;
+  MS2Client *client;
+  gboolean updated = FALSE;
+  gchar *name;
+  gchar *expected;
+  guint requests;
+
+  if (!legacy_start ()) {
+    return;
+  }
+
+  client = ms2_client_new (LEGACY_NAME);
+  ms2_client_set_cache_enabled (client, TRUE);
+  g_signal_connect (client,
+                    "updated",
+                    G_CALLBACK (cache_test_updated),
+                    &updated);
+
+  name = properties_test_get_name (client, LEGACY_ROOT "/c0/i0");
+  g_free (name);
+
+  requests = legacy_requests;
+  name = properties_test_get_name (client, LEGACY_ROOT "/c0/i0");
+  check (name != NULL, "cached properties are returned");
+  check (legacy_requests == requests, "cached properties are not requested");
+  g_free (name);
+
+  legacy_version++;
+  signal = dbus_message_new_signal (LEGACY_ROOT "/c0",
+                                    "org.gnome.UPnP.MediaContainer2",
+                                    "Updated");
+  dbus_connection_send (legacy_connection, signal, NULL);
+  dbus_message_unref (signal);
+  run_until (&updated);
+
+  expected = g_strdup_printf ("i0 version %u", legacy_version);
+  name = properties_test_get_name (client, LEGACY_ROOT "/c0/i0");
+  check (legacy_requests > requests,
+         "properties of children are requested after update");
+  check (g_strcmp0 (name, expected) == 0,
+         "properties of children are fresh after update");
+  g_free (name);
+  g_free (expected);
+
+  g_object_unref (client);
+}
+
+/* Returns whether both listings have the same objects, in the same order */
+static gboolean
+same_children (GList *a,
+               GList *b)
+{
+  for (; a && b; a = g_list_next (a), b = g_list_next (b)) {
+    if (g_strcmp0 (ms2_client_get_path (a->data),
+                   ms2_client_get_path (b->data)) != 0) {
+      return FALSE;
+    }
+  }
+
+  return !a && !b;
+}
+
+static void
+free_children (GList *children)
+{
+  g_list_free_full (children, (GDestroyNotify) g_hash_table_unref);
+}
+
+typedef struct {
+  GList *expected;
+  guint pending;
+  guint matching;
+} CursorTest;
+
+static void
+cursor_test_reply (GObject *source,
+                   GAsyncResult *res,
+                   gpointer user_data)
+{
+  CursorTest *test = (CursorTest *) user_data;
+  GList *children;
+  gchar *next_cursor = NULL;
+
+  children = ms2_client_list_children_cursor_finish (MS2_CLIENT (source),
+                                                     res,
+                                                     &next_cursor,
+                                                     NULL);
+  if (same_children (children, test->expected)) {
+    test->matching++;
+  }
+  test->pending--;
+
+  free_children (children);
+  g_free (next_cursor);
+}
+
+/* Continues a listing after its cursor has expired in provider, which must
+   give the same page as an offset listing; then asks the next page several
+   times at once with the same cursor */
+static void
+test_cursor_expiry ()
+{
+  CursorTest test = { 0 };
+  GError *error = NULL;
+  GHashTable *result;
+  GList *children;
+  GList *expected;
+  MS2Client *client;
+  const gchar *root;
+  gchar *cursor = NULL;
+  gchar *next_cursor = NULL;
+  guint i;
+
+  client = ms2_client_new (SYNTHETIC_NAME);
+  if (!client) {
+    g_printerr ("Unable to create a client\n");
+    return;
+  }
+  root = ms2_client_get_root_path (client);
+
+  children = ms2_client_list_children_cursor (client, root, NULL,
+                                              SYNTHETIC_PAGE,
+                                              (gchar **) properties,
+                                              &cursor, &error);
+  check (children && cursor, "first page gives a cursor");
+  free_children (children);
+  if (!cursor) {
+    g_clear_error (&error);
+    g_object_unref (client);
+    return;
+  }
+
+  g_usleep ((SYNTHETIC_CURSOR_TIMEOUT + 1) * G_USEC_PER_SEC);
+  while (g_main_context_iteration (NULL, FALSE));
+
+  children = ms2_client_list_children_cursor (client, root, cursor,
+                                              SYNTHETIC_PAGE,
+                                              (gchar **) properties,
+                                              &next_cursor, &error);
+  expected = ms2_client_list_children (client, root,
+                                       SYNTHETIC_PAGE, SYNTHETIC_PAGE,
+                                       (gchar **) properties, NULL);
+  check (!error, "expired cursor is accepted");
+  check (expected && same_children (children, expected),
+         "expired cursor continues at its position");
+  g_clear_error (&error);
+  free_children (children);
+  free_children (expected);
+
+  test.expected = ms2_client_list_children (client, root,
+                                            2 * SYNTHETIC_PAGE,
+                                            SYNTHETIC_PAGE,
+                                            (gchar **) properties, NULL);
+  for (i = 0; i < 4; i++) {
+    test.pending++;
+    ms2_client_list_children_cursor_async (client, root, next_cursor,
+                                           SYNTHETIC_PAGE,
+                                           (gchar **) properties,
+                                           cursor_test_reply, &test);
+  }
+  while (test.pending > 0) {
+    g_main_context_iteration (NULL, TRUE);
+  }
+  check (test.matching == 4, "concurrent requests get the same page");
+  free_children (test.expected);
+
+  result = ms2_client_get_properties (client, root, (gchar **) properties,
+                                      &error);
+  check (result != NULL, "provider is still alive");
+  if (result) {
+    g_hash_table_unref (result);
+  }
+  g_clear_error (&error);
+
+  g_free (cursor);
+  g_free (next_cursor);
+  g_object_unref (client);
+}
+
+typedef struct {
+  MS2ChildIterator *iter;
+  GError *error;
+  gboolean done;
+} StopTest;
+
+static void
+stop_test_list_reply (GObject *source,
+                      GAsyncResult *res,
+                      gpointer user_data)
+{
+  StopTest *test = (StopTest *) user_data;
+
+  free_children (ms2_client_list_children_finish (MS2_CLIENT (source),
+                                                  res,
+                                                  &test->error));
+  test->done = TRUE;
+}
+
+static void
+stop_test_iterator_reply (GObject *source,
+                          GAsyncResult *res,
+                          gpointer user_data)
+{
+  GHashTable *child;
+  StopTest *test = (StopTest *) user_data;
+
+  child = ms2_child_iterator_next_finish (test->iter, res, &test->error);
+  if (child) {
+    g_hash_table_unref (child);
+  }
+  test->done = TRUE;
+}
+
+static void
+stop_test_walk_reply (GObject *source,
+                      GAsyncResult *res,
+                      gpointer user_data)
+{
+  StopTest *test = (StopTest *) user_data;
+
+  ms2_client_walk_finish (MS2_CLIENT (source), res, &test->error);
+  test->done = TRUE;
+}
+
+static gboolean
+stop_test_cancel (gpointer user_data)
+{
+  g_cancellable_cancel (G_CANCELLABLE (user_data));
+
+  return FALSE;
+}
+
+/* Lists a container whose listings are never replied, either cancelling the
+   listing while it waits or waiting at most TEST_TIMEOUT, and checks the
+   error given; what is 0 to list children, 1 to iterate and 2 to walk */
+static void
+stop_test_run (MS2Client *client,
+               guint what,
+               gboolean cancel)
+{
+  GCancellable *cancellable = NULL;
+  StopTest test = { 0 };
+  gchar *description;
+  gint timeout = -1;
+  static const gchar *names[] = { "listing", "iterator", "walk" };
+
+  if (cancel) {
+    cancellable = g_cancellable_new ();
+    g_timeout_add (TEST_TIMEOUT, stop_test_cancel, cancellable);
+  } else {
+    timeout = TEST_TIMEOUT;
+  }
+
+  switch (what) {
+  case 0:
+    ms2_client_list_children_async_full (client, LEGACY_SLOW,
+                                         0, 0,
+                                         (gchar **) properties,
+                                         timeout, cancellable,
+                                         stop_test_list_reply, &test);
+    break;
+  case 1:
+    test.iter = ms2_child_iterator_new_full (client, LEGACY_SLOW,
+                                             (gchar **) properties,
+                                             1,
+                                             timeout, cancellable);
+    ms2_child_iterator_next_async (test.iter, stop_test_iterator_reply, &test);
+    break;
+  default:
+    ms2_client_walk_async_full (client, LEGACY_SLOW,
+                                (gchar **) properties,
+                                0, 1,
+                                walk_test_object,
+                                timeout, cancellable,
+                                stop_test_walk_reply, &test);
+    break;
+  }
+  run_until (&test.done);
+
+  description = g_strdup_printf ("%s %s", names[what],
+                                 cancel? "is cancelled": "times out");
+  check (g_error_matches (test.error,
+                          G_IO_ERROR,
+                          cancel? G_IO_ERROR_CANCELLED: G_IO_ERROR_TIMED_OUT),
+         description);
+  g_free (description);
+
+  g_clear_error (&test.error);
+  if (test.iter) {
+    ms2_child_iterator_free (test.iter);
+  }
+  if (cancellable) {
+    g_object_unref (cancellable);
+  }
+}
+
+/* Checks listings, iterators and walks report being cancelled and timing
+   out with the expected errors */
+static void
+test_cancel_and_timeout ()
+{
+  MS2Client *client;
+  guint what;
+
+  if (!legacy_start ()) {
+    return;
+  }
+
+  client = ms2_client_new (LEGACY_NAME);
+  for (what = 0; what < 3; what++) {
+    stop_test_run (client, what, TRUE);
+    stop_test_run (client, what, FALSE);
+  }
+
+  g_list_free_full (legacy_held, (GDestroyNotify) dbus_message_unref);
+  legacy_held = NULL;
+  g_object_unref (client);
+}
+
 int main (int argc, char **argv)
 {
   GMainLoop *mainloop;
@@ -436,6 +1176,11 @@ int main (int argc, char **argv)
   if (0) test_provider_free ();
   if (0) test_updated ();
   if (0) test_dynamic_providers ();
+  if (0) test_iterator_fallback ();
+  if (0) test_walk_fallback ();
+  if (0) test_cache_invalidation ();
+  if (0) test_cursor_expiry ();
+  if (0) test_cancel_and_timeout ();
 
   mainloop = g_main_loop_new (NULL, FALSE);
   g_main_loop_run (mainloop);